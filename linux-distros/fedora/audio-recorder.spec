@@ -12,7 +12,7 @@ Source0: %{name}-%{version}-%{releasenum}.tar.gz
 #Patch1: audio-recorder-port-to-gtk3.patch
 #Patch2: audio-recorder-include.patch
 
-BuildRequires: gtk+-devel gtk3-devel glib-devel gstreamer1-devel gstreamer1-plugins-base-devel intltool pulseaudio-libs-devel dbus-devel cairo-gobject libappindicator-gtk3-devel
+BuildRequires: gtk+-devel gtk3-devel glib-devel gstreamer1-devel gstreamer1-plugins-base-devel intltool pulseaudio-libs-devel dbus-devel openssl-devel cairo-gobject libappindicator-gtk3-devel
 
 %description
 This amazing program allows you to record your favourite music or audio to a file.
@@ -242,31 +242,28 @@ GList *audio_sources_wash_device_list(GList *dev_list) {
     // Wash the given device list.
     // User may have unplugged webcams and microphones, etc.
 
-    // This function gets a fresh device list from GStreamer and removes invalid/unplugged items from the list.
+    // This function removes invalid/unplugged items from the list.
     // Invalid devices may crash the GStreamer pipeline.
 
+    // The device registry in gst-devices.c is kept up to date by GStreamer's device monitor,
+    // so we do not need to enumerate the devices here.
+
     // Create a new list for valid devs
     GList *new_list = NULL;
 
-    // Get fresh device list from pulseaudio (or gstreamer)
-    GList *fresh_dev_list = get_audio_devices();
-
     GList *n = g_list_first(dev_list);
     while (n) {
         gchar *dev_id = (gchar*)n->data;
-        // dev_id is in fresh_dev_list?
-        if (audio_sources_find_in_list(fresh_dev_list, dev_id)) {
+        // dev_id is a connected device (or the default device)?
+        if (!g_strcmp0(dev_id, "default-device") || gstdev_device_exists(dev_id)) {
             // Yes
             new_list = g_list_append(new_list, g_strdup(dev_id));
         }
         n = g_list_next(n);
     }
 
-    // Free fresh_dev_list
-    audio_sources_free_list(fresh_dev_list);
-
     // Return new_list.
-    // Caller should free this with free_str_list(new_list).
+    // Caller should free this with str_list_free(new_list).
     return new_list;
 }
 
@@ -786,22 +783,8 @@ gboolean audio_sources_combo_get_values(GtkWidget *combo, gchar **device_name,
 
 static GList *get_audio_devices() {
     // Get list of audio input devices (ids and names).
-    GList *pa_list = gstdev_get_source_list();
-
-    GList *lst = NULL;
-
-    GList *n = g_list_first(pa_list);
-    while (n) {
-        DeviceItem *item = (DeviceItem*)n->data;
-
-        // Take a copy
-        DeviceItem *copy = device_item_copy(item);
-
-        // Add to our private list
-        lst = g_list_append(lst, copy);
-
-        n = g_list_next(n);
-    }
+    // This is a copy of the device registry. See gst-devices.c.
+    GList *lst = gstdev_get_source_list();
 
     // Add "Default" device
 
@@ -28,21 +28,77 @@
 // Glib/DBus connection
 static GDBusConnection *g_dbus_conn = NULL;
 
+#define DBUS_MPRIS2_NAMESPACE "org.mpris.MediaPlayer2."
+
+// Service names (within org.mpris.MediaPlayer2.*) that currently have an owner on the bus.
+// Seeded once by "ListNames", then kept up to date by "NameOwnerChanged" signals.
+static GHashTable *g_name_owners = NULL;
+static gboolean g_name_owners_seeded = FALSE;
+static guint g_owner_signal_id = 0;
+
+// Cached "DesktopEntry" values. Key is service name.
+// An entry is removed when its service name gets a new owner.
+static GHashTable *g_desktop_entries = NULL;
+
+// Cancels module-wide asynchronous calls
+static GCancellable *g_cancellable = NULL;
+
 static GDBusConnection *mpris2_connect_to_dbus();
 static void mpris2_disconnect_from_dbus();
 
+static void mpris2_watch_name_owners(GDBusConnection *dbus_conn);
+static void mpris2_seed_name_owners(GVariant *result);
+
 static gboolean mpris2_check_proxy(MediaPlayerRec *player);
 static GVariant *mpris2_get_property(MediaPlayerRec *player, gchar *prop_name);
 
+static void mpris2_parse_metadata(TrackInfo *tr, GVariant *dict);
+static gint mpris2_parse_status(GVariant *value);
+
+typedef void (*PlayerFunction)(MediaPlayerRec *player);
+static void mpris2_update_position(MediaPlayerRec *player, PlayerFunction done_func);
+
 void mpris2_module_init() {
     LOG_DEBUG("Init dbus_mpris2.c.\n");
 
     g_dbus_conn = NULL;
+
+    g_name_owners = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_name_owners_seeded = FALSE;
+    g_owner_signal_id = 0;
+
+    g_desktop_entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    g_cancellable = g_cancellable_new();
 }
 
 void mpris2_module_exit() {
     LOG_DEBUG("Clean up dbus_mpris2.c.\n");
 
+    // Cancel pending calls
+    if (G_IS_CANCELLABLE(g_cancellable)) {
+        g_cancellable_cancel(g_cancellable);
+        g_object_unref(g_cancellable);
+    }
+    g_cancellable = NULL;
+
+    // Stop watching NameOwnerChanged
+    if (g_owner_signal_id > 0 && G_IS_DBUS_CONNECTION(g_dbus_conn)) {
+        g_dbus_connection_signal_unsubscribe(g_dbus_conn, g_owner_signal_id);
+    }
+    g_owner_signal_id = 0;
+
+    if (g_name_owners) {
+        g_hash_table_destroy(g_name_owners);
+    }
+    g_name_owners = NULL;
+    g_name_owners_seeded = FALSE;
+
+    if (g_desktop_entries) {
+        g_hash_table_destroy(g_desktop_entries);
+    }
+    g_desktop_entries = NULL;
+
     mpris2_disconnect_from_dbus();
 }
 
@@ -62,6 +118,9 @@ GDBusConnection *mpris2_connect_to_dbus() {
 
             return NULL;
         }
+
+        // Start tracking owners of org.mpris.MediaPlayer2.* names
+        mpris2_watch_name_owners(g_dbus_conn);
     }
     return g_dbus_conn;
 }
@@ -74,19 +133,126 @@ void mpris2_disconnect_from_dbus() {
     g_dbus_conn = NULL;
 }
 
-static void mpris2_player_track_changed_TOTEM(gpointer player_rec) {
+static void mpris2_name_owner_changed(GDBusConnection *connection, const gchar *sender_name, const gchar *object_path,
+                                      const gchar *interface_name, const gchar *signal_name, GVariant *parameters, gpointer user_data) {
+    // Handle "NameOwnerChanged" signal. The data has format "(sss)"; name, old owner, new owner.
+    const gchar *name = NULL;
+    const gchar *old_owner = NULL;
+    const gchar *new_owner = NULL;
+
+    if (!g_name_owners) return;
+
+    if (g_strcmp0(g_variant_get_type_string(parameters), "(sss)")) {
+        return;
+    }
+
+    g_variant_get(parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+
+    // The player has started or quit. Its details may have changed.
+    if (g_desktop_entries) {
+        g_hash_table_remove(g_desktop_entries, name);
+    }
+
+    // Rebuild the player list when it's needed next time
+    dbus_player_list_changed();
+
+    if (str_length0(new_owner) > 0) {
+        LOG_PLAYER("Service %s appeared on DBus (owner %s).\n", name, new_owner);
+        g_hash_table_add(g_name_owners, g_strdup(name));
+    } else {
+        LOG_PLAYER("Service %s vanished from DBus.\n", name);
+        g_hash_table_remove(g_name_owners, name);
+    }
+}
+
+static void mpris2_list_names_done(GObject *source, GAsyncResult *res, gpointer user_data) {
+    // Reply to the asynchronous "ListNames" call
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+
+    if (error) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_printerr("Cannot read service names from org.freedesktop.DBus. %s\n", error->message);
+        }
+        g_error_free(error);
+        return;
+    }
+
+    mpris2_seed_name_owners(result);
+
+    g_variant_unref(result);
+}
+
+static void mpris2_watch_name_owners(GDBusConnection *dbus_conn) {
+    // Subscribe to NameOwnerChanged for the org.mpris.MediaPlayer2.* namespace, then seed the
+    // g_name_owners table with one asynchronous "ListNames" call.
+    // mpris2_service_is_running_by_name() becomes a simple table lookup.
+    if (g_owner_signal_id > 0) return;
+
+    // Ref: https://developer.gnome.org/gio/stable/GDBusConnection.html#g-dbus-connection-signal-subscribe
+    g_owner_signal_id = g_dbus_connection_signal_subscribe(dbus_conn,
+                        "org.freedesktop.DBus", /* sender */
+                        "org.freedesktop.DBus", /* interface */
+                        "NameOwnerChanged",
+                        "/org/freedesktop/DBus", /* path */
+                        "org.mpris.MediaPlayer2", /* arg0 namespace */
+                        G_DBUS_SIGNAL_FLAGS_MATCH_ARG0_NAMESPACE,
+                        mpris2_name_owner_changed,
+                        NULL,
+                        NULL);
+
+    g_dbus_connection_call(dbus_conn,
+                           "org.freedesktop.DBus", /* name */
+                           "/org/freedesktop/DBus", /* path */
+                           "org.freedesktop.DBus", /* interface */
+                           "ListNames",
+                           NULL,
+                           G_VARIANT_TYPE("(as)"),
+                           G_DBUS_CALL_FLAGS_NONE,
+                           -1,
+                           g_cancellable,
+                           mpris2_list_names_done,
+                           NULL);
+}
+
+static void mpris2_seed_name_owners(GVariant *result) {
+    // Take a fresh snapshot of org.mpris.MediaPlayer2.* names from a "ListNames" reply, "(as)".
+    if (!(g_name_owners && result)) return;
+
+    g_hash_table_remove_all(g_name_owners);
+
+    GVariantIter *iter = NULL;
+    const gchar *service_name = NULL;
+
+    g_variant_get(result, "(as)", &iter);
+    while (g_variant_iter_next(iter, "&s", &service_name)) {
+        if (g_str_has_prefix(service_name, DBUS_MPRIS2_NAMESPACE)) {
+            g_hash_table_add(g_name_owners, g_strdup(service_name));
+        }
+    }
+    g_variant_iter_free(iter);
+
+    g_name_owners_seeded = TRUE;
+}
+
+static void mpris2_send_data(MediaPlayerRec *player) {
+    //Debug:
+    //dbus_player_debug_print(player);
+
+    // Send data to the queue (rec-manager.c)
+    dbus_player_process_data(player);
+}
+
+static void mpris2_player_track_changed_TOTEM(MediaPlayerRec *player) {
     // Spesific treatment of Totem movie player
     // Sound/audio track changed.
+    // Called when player->track holds the new track data and the current stream position.
 
     static gchar *g_totem_track = NULL;
     static gboolean g_totem_stopped = TRUE;
 
-    MediaPlayerRec *player = (MediaPlayerRec*)player_rec;
     if (!player) return;
 
-    // Re-read all track-data
-    mpris2_get_metadata(player_rec);
-
     TrackInfo *tr = &player->track;
 
     if (tr->status != PLAYER_STATUS_PLAYING) {
@@ -114,29 +280,25 @@ static void mpris2_player_track_changed_TOTEM(gpointer player_rec) {
     g_free(g_totem_track);
     g_totem_track = tmp;
 
-    //Debug:
-    //dbus_player_debug_print(player);
-
     // Send data to the queue (rec-manager.c)
-    dbus_player_process_data(player);
+    mpris2_send_data(player);
 }
 
-static void mpris2_player_track_changed(gpointer player_rec) {
+static void mpris2_player_track_changed(MediaPlayerRec *player, TrackInfo *new_tr) {
     // Sound/audio track changed.
-    MediaPlayerRec *player = (MediaPlayerRec*)player_rec;
+    // The new_tr contains track data taken from the "PropertiesChanged" signal.
     if (!player) return;
 
+    TrackInfo *tr = &player->track;
+
     // Totem's DBus-plugin sends PLAYER_STATUS_PLAYING multiple times (eg. 20 times in a row).
-    // This may occur because we re-read all 'Metadata' from the player for each
-    // state and track-change signals.
     // ATM, we have to give Totem movie player a spesific treatment.
     if (g_str_has_suffix(player->service_name, ".totem")) {
-        mpris2_player_track_changed_TOTEM(player_rec);
+        *tr = *new_tr;
+        mpris2_update_position(player, mpris2_player_track_changed_TOTEM);
         return;
     }
 
-    TrackInfo *tr = &player->track;
-
     // Check if track_pos == 0 (at the beginning of track)?
     if (tr->track_pos == 0L) {
         // Stop current recording first. Send PLAYER_STATUS_STOPPED to the rec-manager.c.
@@ -148,29 +310,103 @@ static void mpris2_player_track_changed(gpointer player_rec) {
         dbus_player_process_data(player);
     }
 
-    // Re-read all track-data. Status should now be PLAYER_STATUS_PLAYING.
-    mpris2_get_metadata(player_rec);
-
-    //Debug:
-    //dbus_player_debug_print(player);
+    // Take the new track data. Status should now be PLAYER_STATUS_PLAYING.
+    *tr = *new_tr;
 
-    // Send data to the queue (rec-manager.c)
-    dbus_player_process_data(player);
+    // Read stream position, then send data to the queue (rec-manager.c)
+    mpris2_update_position(player, mpris2_send_data);
 }
 
-static void mpris2_player_state_changed(gpointer player_rec) {
+static void mpris2_player_state_changed(MediaPlayerRec *player, TrackInfo *new_tr) {
     // Player's state changed; Playing | Paused | Stopped.
-    MediaPlayerRec *player = (MediaPlayerRec*)player_rec;
     if (!player) return;
 
-    // Re-read data.
-    mpris2_get_metadata(player_rec);
+    // Take the new state. Track data is kept from earlier signals.
+    player->track = *new_tr;
 
-    //Debug:
-    //dbus_player_debug_print(player);
+    // Read stream position, then send data to the queue (rec-manager.c)
+    mpris2_update_position(player, mpris2_send_data);
+}
 
-    // Send data to the queue (rec-manager.c)
-    dbus_player_process_data(player);
+typedef struct {
+    MediaPlayerRec *player;
+    PlayerFunction done_func;
+} PositionCall;
+
+static void mpris2_position_done(GObject *source, GAsyncResult *res, gpointer user_data) {
+    // Reply to the asynchronous "Position" query
+    PositionCall *call = (PositionCall*)user_data;
+
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+
+    if (error) {
+        gboolean cancelled = g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+        g_error_free(error);
+
+        if (cancelled) {
+            // The player record may be gone. Do not touch it.
+            g_free(call);
+            return;
+        }
+    }
+
+    MediaPlayerRec *player = call->player;
+
+    if (result) {
+        // (<int64 0>,)
+        GVariant *peek = NULL;
+        g_variant_get(result, "(v)", &peek);
+
+        if (g_variant_is_of_type(peek, G_VARIANT_TYPE_INT64)) {
+            player->track.track_pos = g_variant_get_int64(peek);
+        }
+
+        g_variant_unref(peek);
+        g_variant_unref(result);
+    }
+
+    call->done_func(player);
+
+    g_free(call);
+}
+
+static void mpris2_update_position(MediaPlayerRec *player, PlayerFunction done_func) {
+    // Read current stream position asynchronously, then call done_func(player).
+    // Position is not announced by "PropertiesChanged", so we must ask for it.
+    // Ref: https://specifications.freedesktop.org/mpris-spec/latest/Player_Interface.html#Property:Position
+
+    TrackInfo *tr = &player->track;
+    tr->track_pos = -1L;
+
+    GDBusConnection *dbus_conn = mpris2_connect_to_dbus();
+
+    // The position is needed only while playing
+    if (!dbus_conn || tr->status != PLAYER_STATUS_PLAYING) {
+        done_func(player);
+        return;
+    }
+
+    if (!G_IS_CANCELLABLE(player->cancellable)) {
+        player->cancellable = g_cancellable_new();
+    }
+
+    PositionCall *call = g_malloc0(sizeof(PositionCall));
+    call->player = player;
+    call->done_func = done_func;
+
+    g_dbus_connection_call(dbus_conn,
+                           player->service_name, /* name */
+                           "/org/mpris/MediaPlayer2", /* path */
+                           "org.freedesktop.DBus.Properties", /* interface */
+                           "Get",
+                           g_variant_new("(ss)", "org.mpris.MediaPlayer2.Player", "Position"),
+                           G_VARIANT_TYPE("(v)"),
+                           G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                           DBUS_MPRIS_TIMEOUT,
+                           player->cancellable,
+                           mpris2_position_done,
+                           (gpointer)call);
 }
 
 void debug_hash_table(MediaPlayerRec *player, GHashTable *table) {
@@ -200,8 +436,9 @@ static gboolean mpris2_check_proxy(MediaPlayerRec *player) {
 
     // Proxy that points to "org.mpris.MediaPlayer2.Player" object.
     GError *error = NULL;
+    // We only call methods on it, so do not load (or watch) its properties.
     player->proxy = g_dbus_proxy_new_sync(dbus_conn,
-                                          G_DBUS_PROXY_FLAGS_NONE,
+                                          G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES | G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
                                           NULL,
                                           player->service_name,  /* name */
                                           "/org/mpris/MediaPlayer2",  /* object path */
@@ -247,28 +484,30 @@ gchar *mpris2_get_property_str(MediaPlayerRec *player, gchar *prop_name) {
     return s;
 }
 
+static gchar *mpris2_get_desktop_entry(MediaPlayerRec *player) {
+    // Return player's "DesktopEntry" property. Read it from the player only once.
+    // Caller should g_free() this value.
+    gchar *desktop_file = NULL;
+
+    if (g_desktop_entries && g_hash_table_lookup_extended(g_desktop_entries, player->service_name, NULL, (gpointer*)&desktop_file)) {
+        return g_strdup(desktop_file);
+    }
+
+    desktop_file = mpris2_get_property_str(player, "DesktopEntry");
+
+    if (g_desktop_entries) {
+        g_hash_table_insert(g_desktop_entries, g_strdup(player->service_name), g_strdup(desktop_file));
+    }
+
+    return desktop_file;
+}
+
 static GVariant *mpris2_get_property(MediaPlayerRec *player, gchar *prop_name) {
     // Read a property from the player's "org.mpris.MediaPlayer2" interface.
     if (!player) return FALSE;
 
     GDBusConnection *dbus_conn = mpris2_connect_to_dbus();
-
-    // Proxy that points to "org.mpris.MediaPlayer2" object.
-    GError *error = NULL;
-    GDBusProxy *proxy = g_dbus_proxy_new_sync(dbus_conn,
-                        G_DBUS_PROXY_FLAGS_NONE,
-                        NULL,
-                        player->service_name, /* service name */
-                        "/org/mpris/MediaPlayer2", /* object path */
-                        "org.mpris.MediaPlayer2", /* base interface */
-                        NULL,
-                        &error);
-
-    if (error) {
-        g_printerr("Cannot create proxy for %s. %s.\n", player->service_name, error->message);
-        g_error_free(error);
-        return NULL;
-    }
+    if (!dbus_conn) return NULL;
 
     // List of valid properties:
     // https://specifications.freedesktop.org/mpris-spec/latest/
@@ -279,14 +518,19 @@ static GVariant *mpris2_get_property(MediaPlayerRec *player, gchar *prop_name) {
     // values for many media-players.
     // GVariant *result = g_dbus_proxy_get_cached_property(proxy, prop_name);
 
-    // This should work right.
-    error = NULL;
-    GVariant *result = g_dbus_proxy_call_sync(proxy,
-                       "org.freedesktop.DBus.Properties.Get",
+    // Call org.freedesktop.DBus.Properties.Get directly. Creating a proxy here would cost
+    // extra round-trips (GetNameOwner and GetAll) for each property.
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_sync(dbus_conn,
+                       player->service_name, /* service name */
+                       "/org/mpris/MediaPlayer2", /* object path */
+                       "org.freedesktop.DBus.Properties", /* interface */
+                       "Get",
                        g_variant_new("(ss)", "org.mpris.MediaPlayer2", prop_name),
-                       G_DBUS_CALL_FLAGS_NONE,
-                       -1,
-                       NULL,
+                       G_VARIANT_TYPE("(v)"),
+                       G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                       DBUS_MPRIS_TIMEOUT,
+                       g_cancellable,
                        &error);
 
     if (error) {
@@ -294,9 +538,6 @@ static GVariant *mpris2_get_property(MediaPlayerRec *player, gchar *prop_name) {
         result = NULL;
     }
 
-    // Unref proxy
-    g_object_unref(proxy);
-
     // Caller should unref this value.
     return result;
 }
@@ -335,10 +576,13 @@ static void mpris2_prop_signal(GDBusProxy *proxy, gchar *sender_name, gchar *sig
     // LOG_PLAYER("The interface is %s.\n", iface);
 
     // Check if Metadata(sound track) or PlaybackStatus has changed.
-    // We are NOT interested in the data itself, just which properties changed.
+    // The signal carries the new values, so we take them from here instead of re-reading the player.
     gboolean track_changed = FALSE;
     gboolean player_state_changed = FALSE;
 
+    // Start from the last known state
+    TrackInfo new_tr = player->track;
+
     gchar *key = NULL;
     GVariant *value = NULL;
     while (g_variant_iter_next(iter, "{sv}", &key, &value)) {
@@ -346,25 +590,31 @@ static void mpris2_prop_signal(GDBusProxy *proxy, gchar *sender_name, gchar *sig
         // Sound/audio track changed?
         if (!g_ascii_strcasecmp(key, "Metadata")) {
             track_changed = TRUE;
+            mpris2_parse_metadata(&new_tr, value);
 
             // Player's state changed; Playing/Stopped/Paused?
         } else if (!g_ascii_strcasecmp(key, "PlaybackStatus")) {
             player_state_changed = TRUE;
+            new_tr.status = mpris2_parse_status(value);
         }
 
         g_free(key);
         g_variant_unref(value);
     }
 
+    g_free(iface);
+    g_variant_iter_free(iter);
+    g_variant_iter_free(invalidated_iter);
+
     if (track_changed) {
         // Track changed.
-        // Stop current recording. Then re-read data and re-start recording from a new track.
-        mpris2_player_track_changed(player);
+        // Stop current recording. Then re-start recording from a new track.
+        mpris2_player_track_changed(player, &new_tr);
 
     } else if (player_state_changed) {
         // Player's state changed.
         // Send status change to the recorder.
-        mpris2_player_state_changed(player);
+        mpris2_player_state_changed(player, &new_tr);
     }
 
     /* ***
@@ -396,6 +646,90 @@ static void mpris2_prop_changed(GDBusProxy *proxy, GVariant *changed_properties,
 
 }
 
+static void mpris2_get_all_done(GObject *source, GAsyncResult *res, gpointer user_data) {
+    // Reply to the asynchronous "GetAll" call. Store the player's current state and track data.
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+
+    if (error) {
+        // Notice: If cancelled, the player record may be gone.
+        g_error_free(error);
+        return;
+    }
+
+    MediaPlayerRec *player = (MediaPlayerRec*)user_data;
+    TrackInfo *tr = &player->track;
+
+    GVariantIter *iter = NULL;
+    gchar *key = NULL;
+    GVariant *value = NULL;
+
+    g_variant_get(result, "(a{sv})", &iter);
+    while (g_variant_iter_next(iter, "{sv}", &key, &value)) {
+
+        if (!g_ascii_strcasecmp(key, "Metadata")) {
+            mpris2_parse_metadata(tr, value);
+
+        } else if (!g_ascii_strcasecmp(key, "PlaybackStatus")) {
+            tr->status = mpris2_parse_status(value);
+
+        } else if (!g_ascii_strcasecmp(key, "Position") && g_variant_is_of_type(value, G_VARIANT_TYPE_INT64)) {
+            tr->track_pos = g_variant_get_int64(value);
+        }
+
+        g_free(key);
+        g_variant_unref(value);
+    }
+
+    g_variant_iter_free(iter);
+    g_variant_unref(result);
+
+    //Debug:
+    //dbus_player_debug_print(player);
+}
+
+static void mpris2_prop_proxy_ready(GObject *source, GAsyncResult *res, gpointer user_data) {
+    // Proxy for org.freedesktop.DBus.Properties has been created
+    GError *error = NULL;
+    GDBusProxy *proxy = g_dbus_proxy_new_finish(res, &error);
+
+    if (error) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_printerr("Cannot create proxy for org.freedesktop.DBus.Properties. %s.\n", error->message);
+        }
+        // Notice: If cancelled, the player record may be gone.
+        g_error_free(error);
+        return;
+    }
+
+    MediaPlayerRec *player = (MediaPlayerRec*)user_data;
+    player->prop_proxy = proxy;
+
+    // Ref: https://developer.gnome.org/gio/2.28/GDBusProxy.html
+    g_signal_connect(player->prop_proxy, "g-properties-changed",
+                     G_CALLBACK(mpris2_prop_changed), (gpointer)player/*user data*/);
+
+    g_signal_connect(player->prop_proxy, "g-signal",
+                     G_CALLBACK(mpris2_prop_signal), (gpointer)player/*user data*/);
+
+    // Read the player's current state once. After this the "PropertiesChanged" signals keep it up to date.
+    GDBusConnection *dbus_conn = mpris2_connect_to_dbus();
+    if (!dbus_conn) return;
+
+    g_dbus_connection_call(dbus_conn,
+                           player->service_name, /* name */
+                           "/org/mpris/MediaPlayer2", /* path */
+                           "org.freedesktop.DBus.Properties", /* interface */
+                           "GetAll",
+                           g_variant_new("(s)", "org.mpris.MediaPlayer2.Player"),
+                           G_VARIANT_TYPE("(a{sv})"),
+                           G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                           DBUS_MPRIS_TIMEOUT,
+                           player->cancellable,
+                           mpris2_get_all_done,
+                           (gpointer)player);
+}
+
 void mpris2_set_signals(gpointer player_rec, gboolean do_connect) {
     // Connect/disconnct signals for this player.
 
@@ -405,35 +739,34 @@ void mpris2_set_signals(gpointer player_rec, gboolean do_connect) {
     if (do_connect) {
 
         GDBusConnection *dbus_conn = mpris2_connect_to_dbus();
+        if (!dbus_conn) return;
 
-        GError *error = NULL;
-        // Proxy for org.freedesktop.DBus.Properties
-        player->prop_proxy = g_dbus_proxy_new_sync(dbus_conn,
-                             G_DBUS_PROXY_FLAGS_NONE,
-                             NULL,
-                             player->service_name,  /* name */
-                             "/org/mpris/MediaPlayer2",  /* object path */
-                             "org.freedesktop.DBus.Properties",  /* interface */
-                             NULL,
-                             &error);
-
-        if (error) {
-            g_printerr("Cannot create proxy for org.freedesktop.DBus.Properties. %s.\n", error->message);
-            g_error_free(error);
-            player->prop_proxy = NULL;
-            return;
+        if (!G_IS_CANCELLABLE(player->cancellable)) {
+            player->cancellable = g_cancellable_new();
         }
 
-        // Ref: https://developer.gnome.org/gio/2.28/GDBusProxy.html
-        g_signal_connect(player->prop_proxy, "g-properties-changed",
-                         G_CALLBACK(mpris2_prop_changed), (gpointer)player/*user data*/);
-
-        g_signal_connect(player->prop_proxy, "g-signal",
-                         G_CALLBACK(mpris2_prop_signal), (gpointer)player/*user data*/);
+        // Proxy for org.freedesktop.DBus.Properties.
+        // Create it asynchronously; the player may still be starting up.
+        g_dbus_proxy_new(dbus_conn,
+                         G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                         NULL,
+                         player->service_name,  /* name */
+                         "/org/mpris/MediaPlayer2",  /* object path */
+                         "org.freedesktop.DBus.Properties",  /* interface */
+                         player->cancellable,
+                         mpris2_prop_proxy_ready,
+                         (gpointer)player);
 
         // Disconnect signals
     } else {
 
+        // Cancel pending calls for this player
+        if (G_IS_CANCELLABLE(player->cancellable)) {
+            g_cancellable_cancel(player->cancellable);
+            g_object_unref(player->cancellable);
+        }
+        player->cancellable = NULL;
+
         // Delete player->prop_proxy. This should unset the above signals.
         if (G_IS_DBUS_PROXY(player->prop_proxy)) {
             g_object_unref(player->prop_proxy);
@@ -465,36 +798,29 @@ gboolean mpris2_service_is_running_by_name(const char *service_name) {
     GDBusConnection *dbus_conn = mpris2_connect_to_dbus();
     if (!dbus_conn) return FALSE;
 
-    // Proxy for DBUS_SERVICE_DBUS
-    GError *error = NULL;
-    GDBusProxy *proxy = g_dbus_proxy_new_sync(dbus_conn,
-                        G_DBUS_PROXY_FLAGS_NONE,
-                        NULL,
-                        DBUS_SERVICE_DBUS,
-                        DBUS_PATH_DBUS,
-                        DBUS_INTERFACE_DBUS,
-                        NULL,
-                        &error);
-
-    if (error) {
-        g_printerr("Cannot create proxy for %s. %s.\n", DBUS_INTERFACE_DBUS, error->message);
-        g_error_free(error);
-        return FALSE;
+    // Names in the org.mpris.MediaPlayer2.* namespace are tracked by NameOwnerChanged.
+    // No round-trip is needed once the table has been seeded.
+    if (g_name_owners_seeded && g_str_has_prefix(service_name, DBUS_MPRIS2_NAMESPACE)) {
+        return g_hash_table_contains(g_name_owners, service_name);
     }
 
     // Call "NameHasOwner" method
-    error = NULL;
-    GVariant *result = g_dbus_proxy_call_sync(proxy, "NameHasOwner",
+    GError *error = NULL;
+    GVariant *result = g_dbus_connection_call_sync(dbus_conn,
+                       DBUS_SERVICE_DBUS,
+                       DBUS_PATH_DBUS,
+                       DBUS_INTERFACE_DBUS,
+                       "NameHasOwner",
                        g_variant_new("(s)", service_name),
+                       G_VARIANT_TYPE("(b)"),
                        G_DBUS_CALL_FLAGS_NONE,
-                       -1,
-                       NULL,
+                       DBUS_MPRIS_TIMEOUT,
+                       g_cancellable,
                        &error);
 
     if (error) {
         g_printerr("Cannot get NameHasOwner for %s. %s\n", service_name, error->message);
         g_error_free(error);
-        g_object_unref(proxy);
         return FALSE;
     }
 
@@ -510,7 +836,6 @@ gboolean mpris2_service_is_running_by_name(const char *service_name) {
     g_variant_get_child(result, 0, "b", &running);
 
     g_variant_unref(result);
-    g_object_unref(proxy);
 
     // Return TRUE/FALSE
     return running;
@@ -557,8 +882,8 @@ GVariant *mpris2_get_player_value(gpointer player_rec, gchar *variable) {
                                            "org.freedesktop.DBus.Properties.Get",
                                            g_variant_new("(ss)", "org.mpris.MediaPlayer2.Player", variable),
                                            G_DBUS_CALL_FLAGS_NONE,
-                                           -1,
-                                           NULL,
+                                           DBUS_MPRIS_TIMEOUT,
+                                           g_cancellable,
                                            &error);
 
     if (error) {
@@ -583,104 +908,37 @@ void debug_variant(const gchar *tag, GVariant *v) {
 }
 #endif
 
-void mpris2_get_metadata(gpointer player_rec) {
-    // Get track information (=metadata) and state for the given media player.
-    // Ref: https://specifications.freedesktop.org/mpris-spec/2.1/Player_Interface.html#Property:Metadata
-
-    MediaPlayerRec *player = (MediaPlayerRec*)player_rec;
-    if (!player) return;
-
-    // Reset track info
-    TrackInfo *tr = &player->track;
-    tr->status = PLAYER_STATUS_STOPPED;
-    tr->flags = 0;
-    tr->track[0] = tr->artist[0] = tr->album[0] = '\0';
-    tr->track_len = -1L;
-    tr->track_pos = -1L;
-
-    // Proxy that points to "org.mpris.MediaPlayer2.Player"
-    // Ref: https://specifications.freedesktop.org/mpris-spec/2.1/
-    if (!mpris2_check_proxy(player)) {
-        return;
-    }
-
-    // Read "PlaybackStatus" from player's "org.mpris.MediaPlayer2.Player" interface
-    //
-    // Test:
-    // $ dbus-send --print-reply --session --dest=org.mpris.MediaPlayer2.rhythmbox /org/mpris/MediaPlayer2
-    //   org.freedesktop.DBus.Properties.Get string:'org.mpris.MediaPlayer2.Player' string:'PlaybackStatus'
-    //
-    GVariant *result = mpris2_get_player_value(player, "PlaybackStatus");
-
-    // DEBUG: debug_variant("PlaybackStatus", result);
-
-    if (!result) {
-        // Cannot contact player (it has quit)?
-        tr->status = PLAYER_STATUS_CLOSED;
-        return;
-    }
-
-    // So result != NULL.
-
-    // Notice: The MPRIS2-standard defines result as "v" (variant that contains one string).
-    // I think some players return a container type "(v)".
-
-    GVariant *peek = result;
-    // Is "(v)"?
-    if (g_variant_is_container(result)) {
-        // Peek to "v"
-        g_variant_get(result, "(v)", &peek);
+static gint mpris2_parse_status(GVariant *value) {
+    // Convert "PlaybackStatus" value ("s") to one of the PLAYER_STATUS_* values.
+    // Ref: https://specifications.freedesktop.org/mpris-spec/latest/Player_Interface.html#Property:PlaybackStatus
+    if (!(value && g_variant_is_of_type(value, G_VARIANT_TYPE_STRING))) {
+        return PLAYER_STATUS_STOPPED;
     }
 
-    gchar *s = NULL;
-    g_variant_get(peek, "s", &s);
+    const gchar *s = g_variant_get_string(value, NULL);
 
-    // Set tr->status
     if (!g_ascii_strcasecmp(s, "Playing"))
-        tr->status = PLAYER_STATUS_PLAYING;
+        return PLAYER_STATUS_PLAYING;
 
     else if (!g_ascii_strcasecmp(s, "Paused"))
-        tr->status = PLAYER_STATUS_PAUSED;
-
-    else if (!g_ascii_strcasecmp(s, "Stopped"))
-        tr->status = PLAYER_STATUS_STOPPED;
-
-    g_variant_unref(result);
-    result = NULL;
-
-    g_variant_unref(peek);
-    peek = NULL;
+        return PLAYER_STATUS_PAUSED;
 
-    g_free(s);
-
-    // Should we continue?
-    if (tr->status != PLAYER_STATUS_PLAYING) {
-        return;
-    }
+    return PLAYER_STATUS_STOPPED;
+}
 
-    // Here tr->status is PLAYER_STATUS_PLAYING.
-    // Get track info (Metadata) from player's "org.mpris.MediaPlayer2.Player" interface.
-    // The dict has type "a{sv}".
+static void mpris2_parse_metadata(TrackInfo *tr, GVariant *dict) {
+    // Take track data from the "Metadata" dictionary, "a{sv}".
     // Ref: https://specifications.freedesktop.org/mpris-spec/latest/Player_Interface.html#Property:Metadata
-    //
-    // Test:
-    // $ dbus-send --print-reply --session --dest=org.mpris.MediaPlayer2.rhythmbox /org/mpris/MediaPlayer2
-    //    org.freedesktop.DBus.Properties.Get string:'org.mpris.MediaPlayer2.Player' string:'Metadata'
-    //
-    GVariant *dict = mpris2_get_player_value(player, "Metadata");
-
-    // DEBUG: debug_variant("Metadata", dict);
 
-    if (!dict) {
-        // Cannot get Metadata (should we consider this as on error?)
-        // 03.april.2015, commented out by MOma:  Ambient Noise Player does not support "Metadata" yet.  
-
-        // tr->status = PLAYER_STATUS_CLOSED;
+    // Reset track data
+    tr->track[0] = tr->artist[0] = tr->album[0] = '\0';
+    tr->track_len = -1L;
 
+    if (!(dict && g_variant_is_of_type(dict, G_VARIANT_TYPE_VARDICT))) {
         return;
     }
 
-    /* Some essential key names for the returned "a{sv}" dictionary:
+    /* Some essential key names for the "a{sv}" dictionary:
       'mpris:trackid' has type 's'
       'xesam:url' has type 's'
       'xesam:title' has type 's'
@@ -727,19 +985,12 @@ void mpris2_get_metadata(gpointer player_rec) {
          'vlc:length': <int64 197172>, 'vlc:publisher': <9>}>}, @as [])
     */
 
-    peek = dict;
-    // Is it "(v)" ?
-    if (g_variant_is_container(dict)) {
-        // Peek to "v"
-        g_variant_get(dict, "(v)", &peek);
-    }
-
     GVariantIter iter;
     GVariant *value = NULL;
     gchar *key = NULL;
 
     // Ref: https://developer.gnome.org/glib/2.30/glib-GVariant.html#g-variant-get-va
-    g_variant_iter_init(&iter, peek);
+    g_variant_iter_init(&iter, dict);
     while (g_variant_iter_next(&iter, "{sv}", &key, &value)) {
 
         // Debug
@@ -751,7 +1002,6 @@ void mpris2_get_metadata(gpointer player_rec) {
 #endif
 
         gchar *str = NULL;
-        GVariantIter *iter2 = NULL;
 
         // xesam:title?
         if (g_str_has_suffix(key, ":title")) {
@@ -814,19 +1064,114 @@ void mpris2_get_metadata(gpointer player_rec) {
 
         }
         // mpris:length? (total length of content/stream in microseconds)
-        else if (g_str_has_suffix(key, ":length")) {
+        else if (g_str_has_suffix(key, ":length") && g_variant_is_of_type(value, G_VARIANT_TYPE_INT64)) {
             tr->track_len = g_variant_get_int64(value);
         }
 
-        if (iter2)
-            g_variant_iter_free(iter2);
-
         g_free(str);
 
         g_variant_unref(value);
         g_free(key);
 
     }
+}
+
+void mpris2_get_metadata(gpointer player_rec) {
+    // Get track information (=metadata) and state for the given media player.
+    // Ref: https://specifications.freedesktop.org/mpris-spec/2.1/Player_Interface.html#Property:Metadata
+
+    MediaPlayerRec *player = (MediaPlayerRec*)player_rec;
+    if (!player) return;
+
+    // Reset track info
+    TrackInfo *tr = &player->track;
+    tr->status = PLAYER_STATUS_STOPPED;
+    tr->flags = 0;
+    tr->track[0] = tr->artist[0] = tr->album[0] = '\0';
+    tr->track_len = -1L;
+    tr->track_pos = -1L;
+
+    // Proxy that points to "org.mpris.MediaPlayer2.Player"
+    // Ref: https://specifications.freedesktop.org/mpris-spec/2.1/
+    if (!mpris2_check_proxy(player)) {
+        return;
+    }
+
+    // Read "PlaybackStatus" from player's "org.mpris.MediaPlayer2.Player" interface
+    //
+    // Test:
+    // $ dbus-send --print-reply --session --dest=org.mpris.MediaPlayer2.rhythmbox /org/mpris/MediaPlayer2
+    //   org.freedesktop.DBus.Properties.Get string:'org.mpris.MediaPlayer2.Player' string:'PlaybackStatus'
+    //
+    GVariant *result = mpris2_get_player_value(player, "PlaybackStatus");
+
+    // DEBUG: debug_variant("PlaybackStatus", result);
+
+    if (!result) {
+        // Cannot contact player (it has quit)?
+        tr->status = PLAYER_STATUS_CLOSED;
+        return;
+    }
+
+    // So result != NULL.
+
+    // Notice: The MPRIS2-standard defines result as "v" (variant that contains one string).
+    // I think some players return a container type "(v)".
+
+    GVariant *peek = result;
+    // Is "(v)"?
+    if (g_variant_is_container(result)) {
+        // Peek to "v"
+        g_variant_get(result, "(v)", &peek);
+    }
+
+    // Set tr->status
+    tr->status = mpris2_parse_status(peek);
+
+    g_variant_unref(result);
+    result = NULL;
+
+    g_variant_unref(peek);
+    peek = NULL;
+
+    // Should we continue?
+    if (tr->status != PLAYER_STATUS_PLAYING) {
+        return;
+    }
+
+    // Here tr->status is PLAYER_STATUS_PLAYING.
+    // Get track info (Metadata) from player's "org.mpris.MediaPlayer2.Player" interface.
+    // The dict has type "a{sv}".
+    // Ref: https://specifications.freedesktop.org/mpris-spec/latest/Player_Interface.html#Property:Metadata
+    //
+    // Test:
+    // $ dbus-send --print-reply --session --dest=org.mpris.MediaPlayer2.rhythmbox /org/mpris/MediaPlayer2
+    //    org.freedesktop.DBus.Properties.Get string:'org.mpris.MediaPlayer2.Player' string:'Metadata'
+    //
+    GVariant *dict = mpris2_get_player_value(player, "Metadata");
+
+    // DEBUG: debug_variant("Metadata", dict);
+
+    if (!dict) {
+        // Cannot get Metadata (should we consider this as on error?)
+        // 03.april.2015, commented out by MOma:  Ambient Noise Player does not support "Metadata" yet.  
+
+        // tr->status = PLAYER_STATUS_CLOSED;
+
+        return;
+    }
+
+    // The Metadata dictionary is parsed in mpris2_parse_metadata().
+    peek = dict;
+    // Is it "(v)" ?
+    if (g_variant_is_container(dict) && !g_variant_is_of_type(dict, G_VARIANT_TYPE_VARDICT)) {
+        // Peek to "v"
+        g_variant_get(dict, "(v)", &peek);
+    } else {
+        g_variant_ref(peek);
+    }
+
+    mpris2_parse_metadata(tr, peek);
 
     g_variant_unref(dict);
     g_variant_unref(peek);
@@ -951,10 +1296,8 @@ void mpris2_detect_players() {
     GDBusConnection *dbus_conn = mpris2_connect_to_dbus();
     if (!dbus_conn) return;
 
-    // Get player list
-    GHashTable *player_list = dbus_player_get_list_ref();
-
-#define DBUS_MPRIS2_NAMESPACE "org.mpris.MediaPlayer2."
+    // Make sure the player list exists
+    dbus_player_get_list_ref();
 
     GError *error = NULL;
 
@@ -1011,6 +1354,9 @@ void mpris2_detect_players() {
 
     // The result is an array of strings, "(as)".
 
+    // Refresh the name-owner table with this snapshot
+    mpris2_seed_name_owners(result);
+
     GVariantIter *iter = NULL;
     gchar *service_name = NULL;
 
@@ -1046,7 +1392,8 @@ void mpris2_detect_players() {
 
             // Get player's desktop file.
             // Ref: https://specifications.freedesktop.org/mpris-spec/latest/Media_Player.html
-            player->desktop_file = mpris2_get_property_str(player, "DesktopEntry");
+            // This is cached until the service gets a new owner.
+            player->desktop_file = mpris2_get_desktop_entry(player);
 
             if (str_length0(player->desktop_file) < 1) {
                 g_printerr("Error: DBus-interface for %s should implement \"DesktopEntry\" property.\n", service_name);
@@ -1073,16 +1420,12 @@ void mpris2_detect_players() {
         if (player && player->app_name) {
 
             // Add player to the g_player_list.
+            // Duplicates (by app_name, like: "Amarok 2.3.2") are freed.
+            dbus_player_add_item(player);
 
-            // Lookup the record by its app_name (like: "Amarok 2.3.2")
-            if (!dbus_player_lookup_app_name(player->app_name)) {
-                // Add it to the list
-                g_hash_table_insert(player_list, g_strdup(player->service_name), player);
-            } else {
-                // Duplicate or bad record. Free it.
-                dbus_player_delete_item(player);
-            }
-
+        } else if (player) {
+            // Bad record. Free it.
+            dbus_player_delete_item(player);
         }
 
         g_free(service_name);
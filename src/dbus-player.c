@@ -20,6 +20,7 @@
 #include <gdk/gdk.h>
 #include <gio/gio.h>
 #include <gio/gdesktopappinfo.h>
+#include <glib/gstdio.h>
 #include <unistd.h>
 
 #include "dconf.h"
@@ -42,9 +43,30 @@
 // List of players
 static GHashTable *g_player_list = NULL;
 
+// Secondary index for g_player_list. Key is app_name, value is a MediaPlayerRec (owned by g_player_list).
+static GHashTable *g_app_name_index = NULL;
+
+// Is g_player_list up to date?
+// Reset by GAppInfoMonitor (applications installed/removed) and NameOwnerChanged (players started/quit).
+static gboolean g_player_list_valid = FALSE;
+
+// Discovery cache. Details read from .desktop files, also saved to disk.
+static GKeyFile *g_discovery_cache = NULL;
+static gboolean g_discovery_cache_changed = FALSE;
+
+static GAppInfoMonitor *g_app_monitor = NULL;
+
 static void dbus_player_disconnect_signals();
 static void dbus_player_clear_list();
 
+static void dbus_player_cache_load();
+static void dbus_player_cache_save();
+static void dbus_player_cache_clear();
+static void dbus_player_apps_changed(GAppInfoMonitor *monitor, gpointer user_data);
+static gboolean dbus_player_cache_lookup(const gchar *desktop_id, MediaPlayerRec *pl, gboolean *found);
+static void dbus_player_cache_store(const gchar *desktop_id, const gchar *path, const gchar *app_name, const gchar *exec_cmd);
+static gchar *dbus_player_find_command(const gchar *exec_cmd);
+
 static void dbus_player_get_saved();
 static void dbus_player_save(MediaPlayerRec *pl);
 static void dbus_player_delete_saved(const gchar *service_name);
@@ -56,6 +78,15 @@ void dbus_player_init() {
     LOG_DEBUG("Init dbus-player.c.\n");
 
     g_player_list = NULL;
+    g_app_name_index = NULL;
+    g_player_list_valid = FALSE;
+
+    // Load discovery cache from disk
+    dbus_player_cache_load();
+
+    // Get notified when applications are installed or removed
+    g_app_monitor = g_app_info_monitor_get();
+    g_signal_connect(g_app_monitor, "changed", G_CALLBACK(dbus_player_apps_changed), NULL);
 
     skype_module_init();
 
@@ -74,6 +105,20 @@ void dbus_player_exit() {
     mpris2_module_exit();
 
     skype_module_exit();
+
+    if (G_IS_OBJECT(g_app_monitor)) {
+        g_signal_handlers_disconnect_by_func(g_app_monitor, dbus_player_apps_changed, NULL);
+        g_object_unref(g_app_monitor);
+    }
+    g_app_monitor = NULL;
+
+    // Save and free the discovery cache
+    dbus_player_cache_save();
+
+    if (g_discovery_cache) {
+        g_key_file_free(g_discovery_cache);
+    }
+    g_discovery_cache = NULL;
 }
 
 static RecorderCommand *convert_data(MediaPlayerRec *pl) {
@@ -164,15 +209,63 @@ GHashTable *dbus_player_get_list_ref() {
     if (!g_player_list)
         g_player_list = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, dbus_player_delete_item);
 
+    if (!g_app_name_index)
+        g_app_name_index = g_hash_table_new(g_str_hash, g_str_equal);
+
     return g_player_list;
 }
 
+gboolean dbus_player_add_item(MediaPlayerRec *player) {
+    // Add player to g_player_list and index it by app_name.
+    // Return FALSE if a player with the same app_name or service_name exists. The player is then freed.
+    GHashTable *player_list = dbus_player_get_list_ref();
+
+    if (dbus_player_lookup_app_name(player->app_name) ||
+        g_hash_table_contains(player_list, player->service_name)) {
+
+        // Duplicate or bad record. Free it.
+        dbus_player_delete_item(player);
+        return FALSE;
+    }
+
+    g_hash_table_insert(player_list, g_strdup(player->service_name), player);
+
+    if (player->app_name) {
+        g_hash_table_insert(g_app_name_index, player->app_name, player);
+    }
+    return TRUE;
+}
+
+static void dbus_player_remove_item(const gchar *service_name) {
+    // Remove player from g_player_list and its index
+    MediaPlayerRec *player = dbus_player_lookup_service_name(service_name);
+    if (!player) return;
+
+    if (player->app_name && g_hash_table_lookup(g_app_name_index, player->app_name) == player) {
+        g_hash_table_remove(g_app_name_index, player->app_name);
+    }
+
+    g_hash_table_remove(g_player_list, service_name);
+}
+
+void dbus_player_list_changed() {
+    // Players have been started, stopped, installed or removed.
+    // Rebuild g_player_list on the next dbus_player_get_player_list() call.
+    g_player_list_valid = FALSE;
+}
+
 static gboolean dbus_palyer_remove_node(gpointer key, gpointer value, gpointer user_data) {
     // Return TRUE so this (key, value) pair gets removed and deleted.
     return TRUE;
 }
 
 static void dbus_player_clear_list() {
+    // Delete the index first. It does not own its values.
+    if (g_app_name_index) {
+        g_hash_table_destroy(g_app_name_index);
+    }
+    g_app_name_index = NULL;
+
     // Delete the entire g_player_list
     if (g_player_list) {
         g_hash_table_foreach_remove(g_player_list, dbus_palyer_remove_node, NULL);
@@ -202,6 +295,12 @@ void dbus_player_delete_item(gpointer data) {
     }
     player->prop_proxy = NULL;
 
+    if (G_IS_CANCELLABLE(player->cancellable)) {
+        g_cancellable_cancel(player->cancellable);
+        g_object_unref(player->cancellable);
+    }
+    player->cancellable = NULL;
+
     g_free(player->service_name);
     g_free(player->desktop_file);
     g_free(player->exec_cmd);
@@ -213,37 +312,21 @@ void dbus_player_delete_item(gpointer data) {
 MediaPlayerRec *dbus_player_lookup_app_name(const gchar *app_name) {
     // Lookup player by its application name (p->app_name).
     // Typical app_names are "Amarok 2.3.2", "RhythmBox 2.3" and "Skype 4.1".
-    GHashTableIter iter;
-    gpointer key, value;
-
     if (str_length(app_name, 1024) < 1) return NULL;
 
-    g_hash_table_iter_init(&iter, g_player_list);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        MediaPlayerRec *p = (MediaPlayerRec*)value;
-        if (!g_strcmp0(p->app_name, app_name)) {
-            return p;
-        }
-    }
-    return NULL;
+    if (!g_app_name_index) return NULL;
+
+    return (MediaPlayerRec*)g_hash_table_lookup(g_app_name_index, app_name);
 }
 
 MediaPlayerRec *dbus_player_lookup_service_name(const gchar *service_name) {
     // Lookup player by its service name (p->service_name).
     // "org.mpris.MediaPlayer2.Player.banshee" is a typical service_name.
-    GHashTableIter iter;
-    gpointer key, value;
-
     if (str_length(service_name, 1024) < 1) return NULL;
 
-    g_hash_table_iter_init(&iter, g_player_list);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        MediaPlayerRec *p = (MediaPlayerRec*)value;
-        if (!g_strcmp0(p->service_name, service_name)) {
-            return p;
-        }
-    }
-    return NULL;
+    if (!g_player_list) return NULL;
+
+    return (MediaPlayerRec*)g_hash_table_lookup(g_player_list, service_name);
 }
 
 void dbus_player_debug_print(MediaPlayerRec *p) {
@@ -300,6 +383,11 @@ void dbus_player_debug_print(MediaPlayerRec *p) {
 }
 
 GHashTable *dbus_player_get_player_list() {
+    // Nothing has changed since the last call?
+    if (g_player_list_valid && g_player_list) {
+        return g_player_list;
+    }
+
     // Clear the old list
     dbus_player_clear_list();
 
@@ -324,6 +412,11 @@ GHashTable *dbus_player_get_player_list() {
     // Add Skype manually (check if installed)
     add_skype();
 
+    g_player_list_valid = TRUE;
+
+    // Write new discoveries to disk
+    dbus_player_cache_save();
+
     return g_player_list;
 }
 
@@ -343,7 +436,7 @@ gboolean add_player_to_list(gchar *desktop_file, gchar *service_name) {
     get_details_from_desktop_file(player, desktop_file);
 
     // Find executable /usr/bin/exec_cmd
-    gchar *path = find_command_path(player->exec_cmd);
+    gchar *path = dbus_player_find_command(player->exec_cmd);
 
     if (!path) {
         // Not installed.
@@ -370,14 +463,8 @@ gboolean add_player_to_list(gchar *desktop_file, gchar *service_name) {
     // Function to check if this player is running
     player->func_check_is_running = mpris2_service_is_running;
 
-    if (!dbus_player_lookup_app_name(player->app_name)) {
-        // Add to list
-        GHashTable *player_list = dbus_player_get_list_ref();
-        g_hash_table_insert(player_list, g_strdup(player->service_name), player);
-    } else {
-        // Duplicate or bad record. Free it.
-        dbus_player_delete_item(player);
-    }
+    // Add to list (duplicates are freed)
+    dbus_player_add_item(player);
 
     return TRUE;
 }
@@ -387,11 +474,11 @@ void add_skype() {
     const gchar *service_name = "com.Skype.API";
 
     // Remove Skype from the list
-    GHashTable *player_list = dbus_player_get_list_ref();
-    g_hash_table_remove(player_list, service_name);
+    dbus_player_get_list_ref();
+    dbus_player_remove_item(service_name);
 
     // Find /usr/bin/skype
-    gchar *path = find_command_path("skype");
+    gchar *path = dbus_player_find_command("skype");
     if (!path) {
         // Not installed.
         return;
@@ -422,14 +509,8 @@ void add_skype() {
     // Function to start/run Skype
     player->func_start_app = skype_start_app;
 
-    if (!dbus_player_lookup_app_name(player->app_name)) {
-        // Add to list
-        GHashTable *player_list = dbus_player_get_list_ref();
-        g_hash_table_insert(player_list, g_strdup(player->service_name), player);
-    } else {
-        // Duplicate or bad record. Free it.
-        dbus_player_delete_item(player);
-    }
+    // Add to list (duplicates are freed)
+    dbus_player_add_item(player);
 }
 
 void dbus_player_send_notification(gchar *msg) {
@@ -629,6 +710,193 @@ LBL_1: {
 
 }
 
+// --------------------------------------------------------------------
+// Discovery cache.
+// Saves details from .desktop files so we do not need to scan the application directories
+// each time the player list is rebuilt. Cleared when GAppInfoMonitor reports changes.
+// --------------------------------------------------------------------
+
+static gchar *dbus_player_cache_filename() {
+    // Eg. ~/.cache/audio-recorder/players.cache
+    // Caller should g_free() this value
+    return g_build_filename(g_get_user_cache_dir(), "audio-recorder", "players.cache", NULL);
+}
+
+static void dbus_player_cache_load() {
+    // Load the discovery cache from disk. Drop entries whose .desktop file has changed.
+    if (g_discovery_cache) {
+        g_key_file_free(g_discovery_cache);
+    }
+    g_discovery_cache = g_key_file_new();
+    g_discovery_cache_changed = FALSE;
+
+    gchar *filename = dbus_player_cache_filename();
+
+    if (!g_key_file_load_from_file(g_discovery_cache, filename, G_KEY_FILE_NONE, NULL)) {
+        g_free(filename);
+        return;
+    }
+    g_free(filename);
+
+    gchar **groups = g_key_file_get_groups(g_discovery_cache, NULL);
+
+    guint i = 0;
+    for (i=0; groups && groups[i]; i++) {
+        gchar *path = g_key_file_get_string(g_discovery_cache, groups[i], "Filename", NULL);
+        gint64 mtime = g_key_file_get_int64(g_discovery_cache, groups[i], "Modified", NULL);
+
+        GStatBuf fstat;
+        if (!path || g_stat(path, &fstat) || (gint64)fstat.st_mtime != mtime) {
+            LOG_PLAYER("Discovery cache: %s has changed.\n", groups[i]);
+            g_key_file_remove_group(g_discovery_cache, groups[i], NULL);
+            g_discovery_cache_changed = TRUE;
+        }
+
+        g_free(path);
+    }
+
+    g_strfreev(groups);
+}
+
+static void dbus_player_cache_save() {
+    // Save the discovery cache to disk (if changed)
+    if (!(g_discovery_cache && g_discovery_cache_changed)) return;
+
+    gchar *filename = dbus_player_cache_filename();
+    gchar *path = g_path_get_dirname(filename);
+    g_mkdir_with_parents(path, 0700);
+
+    // Do not save .desktop files that were not found.
+    // User may install them while we are not running.
+    GKeyFile *key_file = g_key_file_new();
+
+    gchar **groups = g_key_file_get_groups(g_discovery_cache, NULL);
+
+    guint i = 0;
+    for (i=0; groups && groups[i]; i++) {
+        gchar *app_file = g_key_file_get_string(g_discovery_cache, groups[i], "Filename", NULL);
+
+        if (app_file) {
+            gchar *name = g_key_file_get_string(g_discovery_cache, groups[i], "Name", NULL);
+            gchar *exec = g_key_file_get_string(g_discovery_cache, groups[i], "Exec", NULL);
+
+            g_key_file_set_string(key_file, groups[i], "Filename", app_file);
+            g_key_file_set_int64(key_file, groups[i], "Modified", g_key_file_get_int64(g_discovery_cache, groups[i], "Modified", NULL));
+            g_key_file_set_string(key_file, groups[i], "Name", check_null(name));
+            g_key_file_set_string(key_file, groups[i], "Exec", check_null(exec));
+
+            g_free(name);
+            g_free(exec);
+        }
+
+        g_free(app_file);
+    }
+
+    g_strfreev(groups);
+
+    gsize len = 0;
+    gchar *data = g_key_file_to_data(key_file, &len, NULL);
+
+    GError *error = NULL;
+    if (!g_file_set_contents(filename, data, len, &error)) {
+        LOG_ERROR("Cannot write %s. %s\n", filename, error ? error->message : "");
+        if (error)
+            g_error_free(error);
+    }
+
+    g_discovery_cache_changed = FALSE;
+
+    g_free(data);
+    g_key_file_free(key_file);
+    g_free(path);
+    g_free(filename);
+}
+
+static void dbus_player_cache_clear() {
+    // Forget everything. Also the file on disk.
+    if (g_discovery_cache) {
+        g_key_file_free(g_discovery_cache);
+    }
+    g_discovery_cache = g_key_file_new();
+    g_discovery_cache_changed = FALSE;
+
+    gchar *filename = dbus_player_cache_filename();
+    g_remove(filename);
+    g_free(filename);
+}
+
+static gboolean dbus_player_cache_lookup(const gchar *desktop_id, MediaPlayerRec *pl, gboolean *found) {
+    // Lookup desktop_id (eg. "vlc.desktop") from the cache.
+    // Return TRUE if the cache has an answer. The *found tells whether the .desktop file exists.
+    *found = FALSE;
+
+    if (!(g_discovery_cache && g_key_file_has_group(g_discovery_cache, desktop_id))) {
+        return FALSE;
+    }
+
+    gchar *path = g_key_file_get_string(g_discovery_cache, desktop_id, "Filename", NULL);
+    if (path) {
+        pl->app_name = g_key_file_get_string(g_discovery_cache, desktop_id, "Name", NULL);
+        pl->exec_cmd = g_key_file_get_string(g_discovery_cache, desktop_id, "Exec", NULL);
+        *found = TRUE;
+    }
+    g_free(path);
+
+    return TRUE;
+}
+
+static void dbus_player_cache_store(const gchar *desktop_id, const gchar *path, const gchar *app_name, const gchar *exec_cmd) {
+    // Save details of desktop_id in the cache. Path is NULL if the .desktop file was not found.
+    if (!g_discovery_cache) return;
+
+    g_key_file_remove_group(g_discovery_cache, desktop_id, NULL);
+
+    if (!path) {
+        g_key_file_set_boolean(g_discovery_cache, desktop_id, "Missing", TRUE);
+        return;
+    }
+
+    GStatBuf fstat;
+    gint64 mtime = 0;
+    if (!g_stat(path, &fstat)) {
+        mtime = (gint64)fstat.st_mtime;
+    }
+
+    g_key_file_set_string(g_discovery_cache, desktop_id, "Filename", path);
+    g_key_file_set_int64(g_discovery_cache, desktop_id, "Modified", mtime);
+    g_key_file_set_string(g_discovery_cache, desktop_id, "Name", check_null((gchar*)app_name));
+    g_key_file_set_string(g_discovery_cache, desktop_id, "Exec", check_null((gchar*)exec_cmd));
+
+    g_discovery_cache_changed = TRUE;
+}
+
+static void dbus_player_apps_changed(GAppInfoMonitor *monitor, gpointer user_data) {
+    // Applications have been installed, removed or updated.
+    LOG_PLAYER("Installed applications changed. Clear the discovery cache.\n");
+
+    dbus_player_cache_clear();
+    dbus_player_list_changed();
+}
+
+static gchar *dbus_player_find_command(const gchar *exec_cmd) {
+    // Return absolute path of the program in exec_cmd (eg. "rhythmbox %U").
+    // Searches $PATH directly, without running "which".
+    // Caller should g_free() this value.
+    gint argc = 0;
+    gchar **argv = NULL;
+    gchar *path = NULL;
+
+    if (str_length0(exec_cmd) < 1) return NULL;
+
+    if (g_shell_parse_argv(exec_cmd, &argc, &argv, NULL) && argc > 0) {
+        path = g_find_program_in_path(argv[0]);
+    }
+
+    g_strfreev(argv);
+
+    return path;
+}
+
 void get_details_from_desktop_file(MediaPlayerRec *pl, const gchar *desktop_file) {
 
     if (!desktop_file) {
@@ -645,11 +913,24 @@ void get_details_from_desktop_file(MediaPlayerRec *pl, const gchar *desktop_file
         s = g_strdup_printf("%s.desktop", desktop_file);
     }
 
+    // Already in the discovery cache?
+    gboolean found = FALSE;
+    if (dbus_player_cache_lookup(s, pl, &found)) {
+        g_free(s);
+
+        if (found) {
+            pl->icon_name = g_strdup(desktop_file);
+        }
+        goto LBL_1;
+    }
+
     // Get GDesktopAppInfo from propgram.desktop file
     GDesktopAppInfo *app_info = g_desktop_app_info_new(s);
-    g_free(s);
 
     if (!app_info) {
+        // Remember this too (in memory only)
+        dbus_player_cache_store(s, NULL, NULL, NULL);
+        g_free(s);
         goto LBL_1;
     }
 
@@ -672,6 +953,10 @@ void get_details_from_desktop_file(MediaPlayerRec *pl, const gchar *desktop_file
     // FIX ME.
     pl->icon_name = g_strdup(desktop_file);
 
+    // Save in the discovery cache
+    dbus_player_cache_store(s, g_desktop_app_info_get_filename(app_info), pl->app_name, pl->exec_cmd);
+    g_free(s);
+
     g_object_unref(app_info);
 
 
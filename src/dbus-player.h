@@ -49,6 +49,8 @@ typedef struct {
 
     GDBusProxy *prop_proxy; // Proxy for the "org.freedesktop.DBus.Properties" interface
 
+    GCancellable *cancellable; // Cancels pending (asynchronous) DBus calls for this player
+
     gchar *service_name; // Eg. "org.mpris.MediaPlayer2.banshee" or "com.Skype.API"
 
     gchar *desktop_file; // Name of .desktop file (normally without .desktop extension)
@@ -71,6 +73,12 @@ GHashTable *dbus_player_get_list_ref();
 
 GHashTable *dbus_player_get_player_list();
 
+// Add player to the list. Return FALSE (and free the player) if it's a duplicate.
+gboolean dbus_player_add_item(MediaPlayerRec *player);
+
+// Mark the player list out of date
+void dbus_player_list_changed();
+
 MediaPlayerRec *dbus_player_lookup_app_name(const gchar *app_name);
 MediaPlayerRec *dbus_player_lookup_service_name(const gchar *service_name);
 
@@ -15,10 +15,14 @@
  * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
  * or <http://www.gnu.org/licenses/>.
 */
+#include <string.h>
 #include "log.h"
 #include "support.h"
 #include "about.h"
 #include "rec-manager.h"
+#include "dbus-server.h"
+#include "gst-stall.h"
+#include "gst-diskspace.h"
 #include <gst/gst.h>
 
 // This module creates a DBus-server for this program.
@@ -33,6 +37,16 @@
 //  set_state(state), set new state. The state can be one of: "start"|"stop"|"pause"|"hide"|"show"|"quit".
 //                    returns "OK" if success. NULL if error.
 //
+//  set_source_gain(device, gain), set_source_mute(device, mute), change an input of the running recording.
+//                    device "" means all inputs. gain is 0 - 4.0 (1.0 is unchanged).
+//
+//  add_source(device), remove_source(device), add/remove an input device while recording (2+ devices).
+//
+//  These return "OK", or a DBus error with the reason.
+//
+//  Signal event(name, detail) is sent to all connected clients when the recorder changes its behaviour
+//  by itself (eg. adaptive encoding under CPU pressure, see gst-pressure.c).
+//
 // Ref: https://developer.gnome.org/gio/stable/GDBusServer.html
 //
 // Notice: This module has nothing to do with dbus-player.[ch], dbus-mpris2.[ch] modules.
@@ -43,9 +57,18 @@
 #define R_DBUS_OBJECT_PATH "/org/gnome/API/AudioRecorder"
 #define R_DBUS_INTERFACE_NAME "org.gnome.API.AudioRecorderInterface"
 
+// Timeout (in milliseconds) for client requests. A healthy server answers in well under 1 ms.
+#define R_DBUS_CLIENT_TIMEOUT 2000
+
 static GDBusServer *g_dbus_server = NULL;
 static GDBusNodeInfo *g_introspection_data = NULL;
 
+// Server side connections. Events are sent to these.
+static GList *g_server_connections = NULL;
+
+// Client side connection. Re-used by all requests of this process (eg. "start+show").
+static GDBusConnection *g_client_connection = NULL;
+
 // Signatures for the methods we are exporting.
 // DBus clients can get information or control the recorder by calling these functions.
 static const gchar g_introspection_xml[] =
@@ -58,11 +81,38 @@ static const gchar g_introspection_xml[] =
     "      <arg type='s' name='state' direction='in'/>"      // Set new state. Input argument:"start"|"stop"|"pause"|"hide"|"show"|"quit".
     "      <arg type='s' name='response' direction='out'/>"  // Returns "OK" or NULL if error.
     "    </method>"
+    "    <method name='set_source_gain'>"
+    "      <arg type='s' name='device' direction='in'/>"     // Device id. "" for all inputs.
+    "      <arg type='d' name='gain' direction='in'/>"       // 0 - 4.0
+    "      <arg type='s' name='response' direction='out'/>"  // Returns "OK" or error.
+    "    </method>"
+    "    <method name='set_source_mute'>"
+    "      <arg type='s' name='device' direction='in'/>"     // Device id. "" for all inputs.
+    "      <arg type='b' name='mute' direction='in'/>"
+    "      <arg type='s' name='response' direction='out'/>"  // Returns "OK" or error.
+    "    </method>"
+    "    <method name='add_source'>"
+    "      <arg type='s' name='device' direction='in'/>"
+    "      <arg type='s' name='response' direction='out'/>"  // Returns "OK" or error.
+    "    </method>"
+    "    <method name='remove_source'>"
+    "      <arg type='s' name='device' direction='in'/>"
+    "      <arg type='s' name='response' direction='out'/>"  // Returns "OK" or error.
+    "    </method>"
+    "    <method name='get_sink_metrics'>"
+    "      <arg type='a{sv}' name='metrics' direction='out'/>" // Disk-stall metrics of the running or last recording (see gst-stall.c)
+    "    </method>"
+    "    <method name='get_disk_space'>"
+    "      <arg type='a{sv}' name='info' direction='out'/>"    // Free space and predicted recording time (see gst-diskspace.c)
+    "    </method>"
+    "    <signal name='event'>"
+    "      <arg type='s' name='name'/>"                       // Eg. "pressure-spill"
+    "      <arg type='s' name='detail'/>"                     // Human readable description
+    "    </signal>"
     "  </interface>"
     "</node>";
 
 static gboolean dbus_service_start();
-static void dbus_service_set_state(gchar *new_state);
 
 // -----------------------------------------------------------------------------------
 
@@ -88,6 +138,8 @@ void dbus_service_module_exit() {
         g_object_unref(g_dbus_server);
     }
     g_dbus_server = NULL;
+
+    dbus_service_client_disconnect();
 }
 
 static void handle_method_call(GDBusConnection *connection,
@@ -104,49 +156,138 @@ static void handle_method_call(GDBusConnection *connection,
     if (g_strcmp0(method_name, "get_state") == 0) {
 
         // Get recording state
-        gint state = -1;
-        gint pending = -1;
-        rec_manager_get_state(&state, &pending);
+        const gchar *state_str = dbus_service_get_state();
 
-        const gchar *state_str = NULL;
+        g_dbus_method_invocation_return_value(invocation, g_variant_new ("(s)", state_str));
+        LOG_DEBUG("Audio recorder (DBus-server) executed method get_state().\n");
+    }
 
-        switch (state) {
-        case GST_STATE_PAUSED:
-            state_str = "paused";
-            break;
+    // DBus method call: get_sink_metrics.
+    // Returns a dictionary: stalls, max_stall_ms, ring_bytes, ring_peak_bytes, spool_bytes, spool_peak_bytes, spooled_bytes, drained_bytes.
+    else if (g_strcmp0(method_name, "get_sink_metrics") == 0) {
+        StallMetrics m;
+        memset(&m, 0, sizeof(m));
+        stall_get_metrics(&m);
+
+        GVariantBuilder builder;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+        g_variant_builder_add(&builder, "{sv}", "stalled", g_variant_new_boolean(m.stalled));
+        g_variant_builder_add(&builder, "{sv}", "stalls", g_variant_new_uint32(m.stalls));
+        g_variant_builder_add(&builder, "{sv}", "max_stall_ms", g_variant_new_double(m.max_stall_ms));
+        g_variant_builder_add(&builder, "{sv}", "ring_bytes", g_variant_new_uint64(m.ring_bytes));
+        g_variant_builder_add(&builder, "{sv}", "ring_peak_bytes", g_variant_new_uint64(m.ring_peak_bytes));
+        g_variant_builder_add(&builder, "{sv}", "spool_bytes", g_variant_new_uint64(m.spool.pending_bytes));
+        g_variant_builder_add(&builder, "{sv}", "spool_peak_bytes", g_variant_new_uint64(m.spool.peak_bytes));
+        g_variant_builder_add(&builder, "{sv}", "spooled_bytes", g_variant_new_uint64(m.spool.spooled_bytes));
+        g_variant_builder_add(&builder, "{sv}", "drained_bytes", g_variant_new_uint64(m.spool.drained_bytes));
+
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(a{sv})", &builder));
+        LOG_DEBUG("Audio recorder (DBus-server) executed method get_sink_metrics().\n");
+    }
 
-        case GST_STATE_PLAYING:
-            state_str = "on";
-            break;
+    // DBus method call: get_disk_space.
+    // Returns a dictionary: recording, state, free_bytes, reserve_bytes, bitrate, remaining_seconds (-1 = unknown).
+    else if (g_strcmp0(method_name, "get_disk_space") == 0) {
+        DiskSpaceInfo ds;
+        memset(&ds, 0, sizeof(ds));
+        ds.remaining_sec = -1;
 
-        default:
-            state_str = "off";
-        }
+        gboolean recording = diskspace_get_info(&ds);
 
-        g_dbus_method_invocation_return_value(invocation, g_variant_new ("(s)", state_str));
-        LOG_DEBUG("Audio recorder (DBus-server) executed method get_state().\n");
+        const gchar *states[] = {"unknown", "ok", "low", "action", "stop"};
+
+        GVariantBuilder builder;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+        g_variant_builder_add(&builder, "{sv}", "recording", g_variant_new_boolean(recording));
+        g_variant_builder_add(&builder, "{sv}", "state", g_variant_new_string(states[ds.state]));
+        g_variant_builder_add(&builder, "{sv}", "free_bytes", g_variant_new_uint64(ds.free_bytes));
+        g_variant_builder_add(&builder, "{sv}", "reserve_bytes", g_variant_new_uint64(ds.reserve_bytes));
+        g_variant_builder_add(&builder, "{sv}", "bitrate", g_variant_new_double(ds.bitrate));
+        g_variant_builder_add(&builder, "{sv}", "remaining_seconds", g_variant_new_int64(ds.remaining_sec));
+
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(a{sv})", &builder));
+        LOG_DEBUG("Audio recorder (DBus-server) executed method get_disk_space().\n");
     }
 
     // DBus method call: set_state(new_state).
     // new_state can be: "start" | "stop" | "pause" | "show"  | "hide" | "quit".
     // Returns "OK" | NULL
     else if (g_strcmp0 (method_name, "set_state") == 0) {
-        gchar *response = g_strdup("OK");
-
         gchar *new_state = NULL;
         g_variant_get(parameters, "(&s)", &new_state);
 
-        g_dbus_method_invocation_return_value(invocation, g_variant_new ("(s)", response));
-        g_free(response);
+        // Set recorder to new_state.
+        // Reply only after the command has been accepted. The client waits for this acknowledgement.
+        if (!dbus_service_set_state(new_state)) {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                                  "Unknown state \"%s\".", new_state);
+            return;
+        }
+
+        g_dbus_method_invocation_return_value(invocation, g_variant_new ("(s)", "OK"));
         LOG_DEBUG("Audio recorder (Dbus-server) executed method set_state(%s).\n", new_state);
+    }
+
+    // DBus method calls: set_source_gain(device, gain), set_source_mute(device, mute),
+    // add_source(device), remove_source(device).
+    // Returns "OK" | error
+    else {
+        gchar *device = NULL;
+        gchar *err_msg = NULL;
+        gboolean ok = FALSE;
+
+        if (g_strcmp0(method_name, "set_source_gain") == 0) {
+            gdouble gain = 1.0;
+            g_variant_get(parameters, "(&sd)", &device, &gain);
+            ok = rec_manager_set_source_gain((*device ? device : NULL), gain, &err_msg);
+
+        } else if (g_strcmp0(method_name, "set_source_mute") == 0) {
+            gboolean mute = FALSE;
+            g_variant_get(parameters, "(&sb)", &device, &mute);
+            ok = rec_manager_set_source_mute((*device ? device : NULL), mute, &err_msg);
+
+        } else if (g_strcmp0(method_name, "add_source") == 0) {
+            g_variant_get(parameters, "(&s)", &device);
+            ok = rec_manager_add_source(device, &err_msg);
+
+        } else if (g_strcmp0(method_name, "remove_source") == 0) {
+            g_variant_get(parameters, "(&s)", &device);
+            ok = rec_manager_remove_source(device, &err_msg);
+        }
 
-        // Set recorder to new_state
-        dbus_service_set_state(new_state);
+        if (!ok) {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                                                  "%s", (err_msg ? err_msg : "Failed."));
+            g_free(err_msg);
+            return;
+        }
+
+        g_dbus_method_invocation_return_value(invocation, g_variant_new ("(s)", "OK"));
+        LOG_DEBUG("Audio recorder (Dbus-server) executed method %s(%s).\n", method_name, device);
     }
 }
 
-static void dbus_service_set_state(gchar *new_state) {
-    // Set recorder to new_state
+const gchar *dbus_service_get_state() {
+    // Return current recording state: "on" | "off" | "paused"
+    gint state = -1;
+    gint pending = -1;
+    rec_manager_get_state(&state, &pending);
+
+    switch (state) {
+    case GST_STATE_PAUSED:
+        return "paused";
+
+    case GST_STATE_PLAYING:
+        return "on";
+
+    default:
+        return "off";
+    }
+}
+
+gboolean dbus_service_set_state(const gchar *new_state) {
+    // Set recorder to new_state.
+    // Return FALSE if new_state is not a valid command.
 
     // $ audio-recorder --command start
     if (!g_strcmp0(new_state, "start")) {
@@ -177,6 +318,12 @@ static void dbus_service_set_state(gchar *new_state) {
     else if (!g_strcmp0(new_state, "quit")) {
         rec_manager_quit_application();
     }
+
+    else {
+        return FALSE;
+    }
+
+    return TRUE;
 }
 
 static const GDBusInterfaceVTable interface_vtable = {
@@ -187,6 +334,30 @@ static const GDBusInterfaceVTable interface_vtable = {
 
 // ---------------------------------------------------------------------------------
 
+static void on_connection_closed(GDBusConnection *connection, gboolean remote_peer_vanished, GError *error, gpointer user_data) {
+    // Client disconnected
+    g_server_connections = g_list_remove(g_server_connections, connection);
+    g_object_unref(connection);
+}
+
+void dbus_service_emit_event(const gchar *name, const gchar *detail) {
+    // Send signal event(name, detail) to all connected clients
+    GList *n = g_list_first(g_server_connections);
+    while (n) {
+        GDBusConnection *connection = (GDBusConnection*)n->data;
+
+        GError *error = NULL;
+        g_dbus_connection_emit_signal(connection, NULL, R_DBUS_OBJECT_PATH, R_DBUS_INTERFACE_NAME, "event",
+                                      g_variant_new("(ss)", name, (detail ? detail : "")), &error);
+        if (error) {
+            LOG_ERROR("Cannot send DBus event %s. %s\n", name, error->message);
+            g_error_free(error);
+        }
+
+        n = g_list_next(n);
+    }
+}
+
 static gboolean on_new_connection(GDBusServer *server, GDBusConnection *connection, gpointer user_data) {
     /*
     GCredentials *credentials = NULL;
@@ -208,6 +379,10 @@ static gboolean on_new_connection(GDBusServer *server, GDBusConnection *connecti
 
     g_object_ref(connection);
 
+    // Send events to this client until it disconnects
+    g_server_connections = g_list_append(g_server_connections, connection);
+    g_signal_connect(connection, "closed", G_CALLBACK(on_connection_closed), NULL);
+
     gint registration_id = g_dbus_connection_register_object(connection,
                            R_DBUS_OBJECT_PATH,
                            g_introspection_data->interfaces[0],
@@ -259,6 +434,40 @@ static gboolean dbus_service_start() {
     return (g_dbus_server != NULL);
 }
 
+static GDBusConnection *dbus_service_client_connect() {
+    // Connect to the server. Re-use existing connection.
+    if (g_client_connection && !g_dbus_connection_is_closed(g_client_connection)) {
+        return g_client_connection;
+    }
+
+    dbus_service_client_disconnect();
+
+    GError *error = NULL;
+
+    // Notice: Connecting to an abstract socket that nobody listens on fails immediately (ECONNREFUSED).
+    g_client_connection = g_dbus_connection_new_for_address_sync(R_DBUS_SERVER_ADDRESS,
+                          G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                          NULL, // GDBusAuthObserver
+                          NULL, // GCancellable
+                          &error);
+
+    if (!g_client_connection) {
+        LOG_DEBUG("Cannot connect to DBus address %s. %s\n", R_DBUS_SERVER_ADDRESS, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    return g_client_connection;
+}
+
+void dbus_service_client_disconnect() {
+    // Close client connection
+    if (g_client_connection) {
+        g_object_unref(g_client_connection);
+    }
+    g_client_connection = NULL;
+}
+
 gchar *dbus_service_client_request(gchar *method_name, gchar *arg) {
     // Execute method call on the server.
     // Audio-recorder itself can call methods on the server.
@@ -266,15 +475,8 @@ gchar *dbus_service_client_request(gchar *method_name, gchar *arg) {
 
     GError *error = NULL;
 
-    GDBusConnection *connection = g_dbus_connection_new_for_address_sync(R_DBUS_SERVER_ADDRESS,
-                                  G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
-                                  NULL, // GDBusAuthObserver
-                                  NULL, // GCancellable
-                                  &error);
-
+    GDBusConnection *connection = dbus_service_client_connect();
     if (!connection) {
-        LOG_DEBUG("Cannot connect to DBus address %s. %s\n", R_DBUS_SERVER_ADDRESS, error->message);
-        g_error_free(error);
         return NULL;
     }
 
@@ -293,14 +495,13 @@ gchar *dbus_service_client_request(gchar *method_name, gchar *arg) {
                                         argument, // input parm
                                         G_VARIANT_TYPE ("(s)"), // return value (one string)
                                         G_DBUS_CALL_FLAGS_NONE,
-                                        -1,
+                                        R_DBUS_CLIENT_TIMEOUT,
                                         NULL,
                                         &error);
 
     if (!value) {
         LOG_ERROR("Error invoking %s(%s). %s\n", method_name, arg, error->message);
         g_error_free(error);
-        g_object_unref(connection);
         return NULL;
     }
 
@@ -319,10 +520,94 @@ gchar *dbus_service_client_request(gchar *method_name, gchar *arg) {
     //  g_variant_unref(argument);
     //}
 
-    g_object_unref(connection);
-
     // Return ret
     return ret;
 }
 
+GPid dbus_service_client_get_server_pid() {
+    // Return PID of the running server (peer of our client connection), or -1.
+    GDBusConnection *connection = dbus_service_client_connect();
+    if (!connection) {
+        return -1;
+    }
+
+    GIOStream *stream = g_dbus_connection_get_stream(connection);
+    if (!G_IS_SOCKET_CONNECTION(stream)) {
+        return -1;
+    }
+
+    // Read SO_PEERCRED of the socket
+    GSocket *socket = g_socket_connection_get_socket(G_SOCKET_CONNECTION(stream));
+    GCredentials *credentials = g_socket_get_credentials(socket, NULL);
+    if (!credentials) {
+        return -1;
+    }
+
+    GPid pid = (GPid)g_credentials_get_unix_pid(credentials, NULL);
+    g_object_unref(credentials);
+
+    return pid;
+}
+
+static void dbus_service_print_timing(const gchar *label, gint64 *times, gint count) {
+    // Print min/avg/max of the measured round-trip times (in microseconds)
+    if (count < 1) return;
+
+    gint64 min = G_MAXINT64;
+    gint64 max = 0;
+    gint64 sum = 0;
+
+    gint i = 0;
+    for (i = 0; i < count; i++) {
+        min = MIN(min, times[i]);
+        max = MAX(max, times[i]);
+        sum += times[i];
+    }
+
+    g_print("%-28s n=%-5d min=%.3f ms  avg=%.3f ms  max=%.3f ms\n", label, count,
+            min / 1000.0, (sum / (gdouble)count) / 1000.0, max / 1000.0);
+}
+
+gboolean dbus_service_client_benchmark(gint rounds) {
+    // Measure round-trip time of get_state() requests to the running instance.
+    // $ audio-recorder --command benchmark
+    if (rounds < 1) return FALSE;
+
+    gint64 *times = g_new0(gint64, rounds);
+    gboolean ok = TRUE;
+
+    // 1) Connect + get_state(), like separate "audio-recorder --command status" processes do
+    gint i = 0;
+    for (i = 0; i < rounds && ok; i++) {
+        dbus_service_client_disconnect();
 
+        gint64 t0 = g_get_monotonic_time();
+        gchar *ret = dbus_service_client_request("get_state", NULL);
+        times[i] = g_get_monotonic_time() - t0;
+
+        ok = (ret != NULL);
+        g_free(ret);
+    }
+
+    if (ok) {
+        dbus_service_print_timing("connect + get_state():", times, rounds);
+    }
+
+    // 2) get_state() on an open connection
+    for (i = 0; i < rounds && ok; i++) {
+        gint64 t0 = g_get_monotonic_time();
+        gchar *ret = dbus_service_client_request("get_state", NULL);
+        times[i] = g_get_monotonic_time() - t0;
+
+        ok = (ret != NULL);
+        g_free(ret);
+    }
+
+    if (ok) {
+        dbus_service_print_timing("get_state():", times, rounds);
+    }
+
+    g_free(times);
+
+    return ok;
+}
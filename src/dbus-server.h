@@ -11,8 +11,29 @@ void dbus_service_module_exit();
 // Start DBus-server for this audio recorder
 gboolean dbus_service_start();
 
+// Current recording state: "on" | "off" | "paused"
+const gchar *dbus_service_get_state();
+
+// Set recorder to new_state: "start" | "stop" | "pause" | "show" | "hide" | "quit".
+// Return FALSE if new_state is unknown. Also used by socket-server.c.
+gboolean dbus_service_set_state(const gchar *new_state);
+
+// Send signal event(name, detail) to all connected DBus clients
+void dbus_service_emit_event(const gchar *name, const gchar *detail);
+
 // Execute client request (method call) on DBus-server
+// The client keeps its connection open between requests. Replies are acknowledgements; set_state() returns
+// "OK" after the server has accepted the command.
 gchar *dbus_service_client_request(gchar *method_name, gchar *arg);
 
+// Close client connection
+void dbus_service_client_disconnect();
+
+// PID of the running server (from the socket's peer credentials), or -1
+GPid dbus_service_client_get_server_pid();
+
+// Print round-trip times of client requests. Return FALSE if the server did not answer.
+gboolean dbus_service_client_benchmark(gint rounds);
+
 #endif
 
@@ -27,6 +27,7 @@
 #include "rec-manager-struct.h"
 
 #include "utility.h"
+#include "proc-info.h"
 #include "dconf.h"
 #include "log.h"
 #include "support.h"
@@ -54,6 +55,9 @@ static GDBusConnection *g_dbus_conn = NULL;
 static GDBusProxy *g_proxy_send = NULL;
 static guint g_registration_id = 0;
 
+// Exit watch of the skype process (see proc_watch_exit() in proc-info.c)
+static guint g_exit_watch_id = 0;
+
 static const gchar *g_introspection_xml = ""
         "<node>"
         "<interface name=\"com.Skype.API.Client\">"
@@ -115,6 +119,7 @@ void skype_module_init() {
     g_dbus_conn = NULL;
     g_proxy_send = NULL;
     g_registration_id = 0;
+    g_exit_watch_id = 0;
 
     // Init mutex
     g_mutex_init(&g_skype_mutex);
@@ -249,12 +254,35 @@ LBL_1:
     return is_running;
 }
 
+static void skype_exited(GPid pid, gpointer user_data) {
+    // The skype process has exited. Called from the main loop.
+    g_exit_watch_id = 0;
+
+    LOG_SKYPE("Skype (PID %d) has exited.\n", pid);
+
+    // Stop the call recording now. skype_monitor_thread() would notice it only after several failed status requests.
+    if (g_skype.call_no > 0) {
+        skype_stop_recording();
+    }
+}
+
+static void skype_watch_exit(GPid pid) {
+    // Watch the skype process for exit
+    if (g_exit_watch_id) {
+        g_source_remove(g_exit_watch_id);
+    }
+    g_exit_watch_id = 0;
+
+    if (pid > 0) {
+        g_exit_watch_id = proc_watch_exit(pid, skype_exited, NULL);
+    }
+}
+
 void skype_connect() {
     // Increment connection counter.
     // This will terminate all previous attempts and threads.
     g_connect_count += 1;
 
-    // Note: We do not use pid here. It's just for debugging.
     GPid pid = -1;
 
     // Skype is already running?
@@ -275,10 +303,9 @@ void skype_connect() {
     // Re-test
     is_running = skype_is_running(SKYPE_DBUS_API);
 
-    if (pid < 1) {
-        pid = get_PID("skype");
-        // Pid not used here.
-    }
+    // The started program may be a wrapper script (skype-wrapper). Watch the skype process itself.
+    pid = get_PID("skype");
+    skype_watch_exit(pid);
 
     // Check status
     gchar *str_val = skype_send_message_with_timeout("GET USERSTATUS", 400);
@@ -302,6 +329,9 @@ void skype_disconnect() {
     g_connect_count = -1;
     g_skype.call_no = 0;
 
+    // Remove the exit watch
+    skype_watch_exit(-1);
+
     // Unregister notify methods
     skype_setup_notify_methods(FALSE/*unregister*/);
 
@@ -0,0 +1,1551 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <glib/gstdio.h>
+
+#include "gst-append.h"
+#include "gst-recovery.h"
+#include "gst-rf64.h"
+#include "gst-seek.h"
+#include "gst-checksum.h"
+#include "gst-transcode.h"
+#include "gst-retention.h"
+#include "rec-manager.h"
+#include "log.h"
+#include "utility.h"
+#include "support.h"
+
+// Container-aware append ("append-to-file" setting).
+//
+// Concatenating a second encoded stream onto a file breaks the WAV header, the FLAC STREAMINFO and the MP4 index.
+// Instead, the new recording goes to a part file next to the old one. When it stops, a worker thread merges the
+// part into the old file. Only the new data is read and written; nothing is re-encoded:
+//  - Ogg (Vorbis, Opus, Speex): the part is added as a new link of a chained Ogg stream. Its serial number is
+//    changed if it equals the serial of the last link.
+//  - WAV: the samples of the part are added to the data chunk. RIFF and data sizes are rewritten (as RF64 beyond 4 GB).
+//  - FLAC: the frames of the part are renumbered (new header CRC-8 and frame CRC-16) and added after the old frames.
+//    STREAMINFO gets the new sample count; its MD5 is cleared. In a fixed-blocksize stream the last frame of the
+//    old part may be short, so times after it can be off by less than one block.
+//  - Fragmented MP4: the moof/mdat pairs of the part are added after the old fragments, with new sequence numbers
+//    and decode times. A trailing mfra index is removed.
+// Other formats (eg. MP3) are appended byte by byte as before. If the old file has another format than the
+// recording, the recording goes to a new file.
+
+// Copy buffer
+#define APPEND_COPY_SIZE (1024 * 1024)
+
+// WAV chunks after "data" (eg. LIST) are moved; max. size
+#define APPEND_WAV_TRAILER_MAX (1024 * 1024)
+
+// Ogg: the last page of the old file is found in this many bytes at the end (a page is max. 65307 bytes)
+#define APPEND_OGG_TAIL (256 * 1024)
+
+// FLAC: the last frame of the old file is found in this many bytes at the end
+#define APPEND_FLAC_TAIL (1024 * 1024)
+
+// MP4: moov and moof boxes are read into memory; max. size. Trailing boxes (mfra) are saved for a failed merge.
+#define APPEND_MP4_BOX_MAX (16 * 1024 * 1024)
+#define APPEND_MP4_MAX_TRACKS 8
+
+// MP4 fragment length (ms) of the part, if the muxer is not set already
+#define APPEND_FRAGMENT_MS 2000
+
+typedef enum {FORMAT_UNKNOWN, FORMAT_WAV, FORMAT_OGG, FORMAT_FLAC, FORMAT_MP4} AppendFormat;
+
+typedef struct {
+    gchar *target;
+    gchar *part;
+    gchar *transcode_profile;
+    gboolean keep;
+
+    // Merged? Else part is left as a separate recording.
+    gboolean merged;
+    gchar *err_msg;
+} AppendJob;
+
+// Sequential writer
+typedef struct {
+    gint fd;
+    guint64 pos;
+    GByteArray *buf;
+    gboolean failed;
+} AppendOut;
+
+static GThreadPool *g_pool = NULL;
+
+// Queued and running merges (AppendJob). Main thread only.
+static GList *g_jobs = NULL;
+
+static guint16 g_crc16_table[256];
+
+static gboolean append_merge_job(AppendJob *job);
+
+void append_module_init() {
+    LOG_DEBUG("Init gst-append.c.\n");
+
+    // FLAC frame CRC-16, polynomial x^16 + x^15 + x^2 + 1
+    guint i = 0;
+    for (i = 0; i < 256; i++) {
+        guint16 r = (guint16)(i << 8);
+
+        guint b = 0;
+        for (b = 0; b < 8; b++) {
+            r = (r & 0x8000) ? (guint16)((r << 1) ^ 0x8005) : (guint16)(r << 1);
+        }
+        g_crc16_table[i] = r;
+    }
+}
+
+void append_module_exit() {
+    LOG_DEBUG("Clean up gst-append.c.\n");
+
+    // Let the merges finish. They are short (the size of the new part).
+    if (g_pool) {
+        g_thread_pool_free(g_pool, FALSE, TRUE);
+    }
+    g_pool = NULL;
+
+    g_list_free(g_jobs);
+    g_jobs = NULL;
+}
+
+// ---------------------------------------------------------------------
+// File helpers
+// ---------------------------------------------------------------------
+
+static gboolean append_read(gint fd, guint8 *buf, gsize len, guint64 offset) {
+    gsize done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return FALSE;
+        done += n;
+    }
+    return TRUE;
+}
+
+static gboolean append_write(gint fd, const guint8 *buf, gsize len, guint64 offset) {
+    gsize done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return FALSE;
+        done += n;
+    }
+    return TRUE;
+}
+
+static void append_out_init(AppendOut *out, gint fd, guint64 pos) {
+    out->fd = fd;
+    out->pos = pos;
+    out->buf = g_byte_array_sized_new(APPEND_COPY_SIZE);
+    out->failed = FALSE;
+}
+
+static gboolean append_out_flush(AppendOut *out) {
+    if (out->failed) return FALSE;
+
+    if (out->buf->len) {
+        if (!append_write(out->fd, out->buf->data, out->buf->len, out->pos)) {
+            out->failed = TRUE;
+            return FALSE;
+        }
+
+        out->pos += out->buf->len;
+        g_byte_array_set_size(out->buf, 0);
+    }
+
+    return TRUE;
+}
+
+static void append_out_add(AppendOut *out, const guint8 *data, gsize len) {
+    if (out->failed) return;
+
+    g_byte_array_append(out->buf, data, len);
+
+    if (out->buf->len >= APPEND_COPY_SIZE) {
+        append_out_flush(out);
+    }
+}
+
+static guint64 append_out_end(AppendOut *out) {
+    // Write the rest. Return the end offset (0 if a write failed).
+    gboolean ok = append_out_flush(out);
+    g_byte_array_free(out->buf, TRUE);
+    out->buf = NULL;
+
+    return (ok ? out->pos : 0);
+}
+
+static AppendFormat append_detect(gint fd) {
+    // Container of an open file
+    guint8 h[12];
+    if (!append_read(fd, h, sizeof(h), 0)) return FORMAT_UNKNOWN;
+
+    if ((!memcmp(h, "RIFF", 4) || !memcmp(h, "RF64", 4)) && !memcmp(h + 8, "WAVE", 4)) return FORMAT_WAV;
+    if (!memcmp(h, "OggS", 4)) return FORMAT_OGG;
+    if (!memcmp(h, "fLaC", 4)) return FORMAT_FLAC;
+    if (!memcmp(h + 4, "ftyp", 4)) return FORMAT_MP4;
+
+    return FORMAT_UNKNOWN;
+}
+
+static AppendFormat append_format_of_ext(const gchar *file_ext) {
+    // Container written by profiles with this file extension
+    if (!file_ext) return FORMAT_UNKNOWN;
+
+    if (!g_ascii_strcasecmp(file_ext, "wav")) return FORMAT_WAV;
+
+    if (!g_ascii_strcasecmp(file_ext, "ogg") || !g_ascii_strcasecmp(file_ext, "oga") ||
+            !g_ascii_strcasecmp(file_ext, "opus") || !g_ascii_strcasecmp(file_ext, "spx")) return FORMAT_OGG;
+
+    if (!g_ascii_strcasecmp(file_ext, "flac")) return FORMAT_FLAC;
+
+    if (!g_ascii_strcasecmp(file_ext, "m4a") || !g_ascii_strcasecmp(file_ext, "mp4")) return FORMAT_MP4;
+
+    return FORMAT_UNKNOWN;
+}
+
+// ---------------------------------------------------------------------
+// MP4 boxes
+// ---------------------------------------------------------------------
+
+static gboolean append_mp4_box(gint fd, guint64 pos, guint64 size, guint64 *box, gchar *type) {
+    // Size and type of the top-level box at pos. FALSE if it is torn.
+    guint8 h[16];
+    if (pos + 8 > size || !append_read(fd, h, 8, pos)) return FALSE;
+
+    *box = GST_READ_UINT32_BE(h);
+    if (*box == 1) {
+        if (pos + 16 > size || !append_read(fd, h + 8, 8, pos + 8)) return FALSE;
+        *box = GST_READ_UINT64_BE(h + 8);
+    } else if (*box == 0) {
+        *box = size - pos;
+    }
+
+    memcpy(type, h + 4, 4);
+    type[4] = '\0';
+
+    return (*box >= 8 && pos + *box <= size);
+}
+
+static guint8 *append_mp4_child(guint8 *data, gsize len, const gchar *type, guint8 *after, gsize *box_len) {
+    // Find child box type in data[8, len) (data is a box). Start after the child "after" (or from the first).
+    gsize pos = (after ? (gsize)(after - data) + GST_READ_UINT32_BE(after) : 8);
+
+    while (pos + 8 <= len) {
+        gsize box = GST_READ_UINT32_BE(data + pos);
+        if (box < 8 || pos + box > len) return NULL;
+
+        if (!memcmp(data + pos + 4, type, 4)) {
+            *box_len = box;
+            return data + pos;
+        }
+
+        pos += box;
+    }
+
+    return NULL;
+}
+
+static guint8 *append_mp4_path(guint8 *data, gsize len, const gchar *path, gsize *box_len) {
+    // Find a box by path, eg. "mdia/minf/stbl/stsd"
+    gchar **names = g_strsplit(path, "/", -1);
+
+    guint8 *box = data;
+    gsize n = len;
+
+    gint i = 0;
+    for (i = 0; box && names[i]; i++) {
+        box = append_mp4_child(box, n, names[i], NULL, &n);
+    }
+
+    g_strfreev(names);
+
+    *box_len = n;
+    return box;
+}
+
+static guint8 *append_mp4_read_box(gint fd, guint64 pos, guint64 box) {
+    if (box > APPEND_MP4_BOX_MAX) return NULL;
+
+    guint8 *data = g_malloc(box);
+    if (!append_read(fd, data, box, pos)) {
+        g_free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+static gboolean append_mp4_is_fragmented(gint fd) {
+    // Has the moov box an mvex (movie extends) box?
+    off_t size = lseek(fd, 0, SEEK_END);
+
+    guint64 pos = 0;
+    guint64 box = 0;
+    gchar type[5];
+
+    while (append_mp4_box(fd, pos, size, &box, type)) {
+        if (!strcmp(type, "moov")) {
+            guint8 *moov = append_mp4_read_box(fd, pos, box);
+            gsize n = 0;
+            gboolean found = (moov && append_mp4_child(moov, box, "mvex", NULL, &n));
+            g_free(moov);
+            return found;
+        }
+        pos += box;
+    }
+
+    return FALSE;
+}
+
+// ---------------------------------------------------------------------
+// WAV
+// ---------------------------------------------------------------------
+
+static gboolean append_copy(gint src, guint64 src_off, guint64 len, gint dst, guint64 dst_off) {
+    // Copy len bytes between files
+    guint8 *buf = g_malloc(APPEND_COPY_SIZE);
+    gboolean ok = TRUE;
+
+    guint64 done = 0;
+    while (ok && done < len) {
+        gsize n = (gsize)MIN((guint64)APPEND_COPY_SIZE, len - done);
+
+        ok = append_read(src, buf, n, src_off + done) && append_write(dst, buf, n, dst_off + done);
+        done += n;
+    }
+
+    g_free(buf);
+    return ok;
+}
+
+static gboolean append_merge_wav(gint fd, gint part_fd, gchar **err_msg) {
+    guint64 size = lseek(fd, 0, SEEK_END);
+    guint64 part_size = lseek(part_fd, 0, SEEK_END);
+
+    WavHeader t;
+    WavHeader p;
+
+    if (!(rf64_read_header(fd, size, &t) && rf64_read_header(part_fd, part_size, &p))) {
+        *err_msg = g_strdup(_("Cannot read the WAV header."));
+        return FALSE;
+    }
+
+    if (t.fmt_len != p.fmt_len || memcmp(t.fmt, p.fmt, MIN(t.fmt_len, sizeof(t.fmt)))) {
+        *err_msg = g_strdup(_("The audio formats are different."));
+        return FALSE;
+    }
+
+    // Chunks after the data (eg. LIST) are moved after the new samples
+    guint64 old_end = t.data_off + t.data_len;
+    guint64 trailer_off = MIN(old_end + (t.data_len & 1), size);
+    gsize trailer_len = (gsize)(size - trailer_off);
+
+    if (trailer_len > APPEND_WAV_TRAILER_MAX) {
+        *err_msg = g_strdup(_("Cannot read the WAV header."));
+        return FALSE;
+    }
+
+    guint64 data_len = t.data_len + p.data_len;
+    guint64 end = old_end + p.data_len + (data_len & 1) + trailer_len;
+
+    // Beyond 4 GB the header becomes RF64. It needs the JUNK chunk of arwavenc (see gst-rf64.c).
+    if (end - 8 > RF64_RIFF_MAX && !t.rf64 && !t.ds64_off) {
+        *err_msg = g_strdup(_("The WAV file would be larger than 4 GB."));
+        return FALSE;
+    }
+
+    guint8 *trailer = g_malloc(trailer_len + 1);
+    gboolean ok = (!trailer_len || append_read(fd, trailer, trailer_len, trailer_off));
+
+    // Samples, pad byte, trailing chunks. Then the sizes.
+    ok = ok && append_copy(part_fd, p.data_off, p.data_len, fd, old_end);
+
+    guint64 pos = old_end + p.data_len;
+    if (ok && (data_len & 1)) {
+        guint8 pad = 0;
+        ok = append_write(fd, &pad, 1, pos);
+        pos++;
+    }
+
+    ok = ok && (!trailer_len || append_write(fd, trailer, trailer_len, pos));
+    ok = ok && ftruncate(fd, end) == 0;
+    ok = ok && rf64_write_sizes(fd, &t, data_len, end);
+
+    if (!ok) {
+        *err_msg = g_strdup_printf(_("Cannot write to file. %s."), g_strerror(errno));
+
+        // Put the old file back
+        if (trailer_len) append_write(fd, trailer, trailer_len, trailer_off);
+        if (ftruncate(fd, size) != 0) LOG_ERROR("Cannot truncate WAV file. %s\n", g_strerror(errno));
+        rf64_write_sizes(fd, &t, t.data_len, size);
+    }
+
+    g_free(trailer);
+
+    return ok;
+}
+
+// ---------------------------------------------------------------------
+// Ogg
+// ---------------------------------------------------------------------
+
+static gsize append_ogg_page_len(const guint8 *p, gsize avail) {
+    // Length of the Ogg page at p. 0 if it is not a whole page.
+    if (avail < 27 || memcmp(p, "OggS", 4)) return 0;
+
+    guint nseg = p[26];
+    if (avail < 27 + nseg) return 0;
+
+    gsize len = 27 + nseg;
+    guint s = 0;
+    for (s = 0; s < nseg; s++) {
+        len += p[27 + s];
+    }
+
+    return (len <= avail ? len : 0);
+}
+
+static gboolean append_ogg_last_serial(gint fd, guint32 *serial) {
+    // Serial number of the last page (the last link of the chain)
+    guint64 size = lseek(fd, 0, SEEK_END);
+    gsize tail = (gsize)MIN(size, (guint64)APPEND_OGG_TAIL);
+
+    guint8 *buf = g_malloc(tail);
+    gboolean found = FALSE;
+
+    if (append_read(fd, buf, tail, size - tail)) {
+        gsize i = 0;
+        while (i < tail) {
+            gsize len = append_ogg_page_len(buf + i, tail - i);
+
+            if (len && recovery_ogg_crc(buf + i, len) == GST_READ_UINT32_LE(buf + i + 22)) {
+                *serial = GST_READ_UINT32_LE(buf + i + 14);
+                found = TRUE;
+                i += len;
+            } else {
+                i++;
+            }
+        }
+    }
+
+    g_free(buf);
+    return found;
+}
+
+static gboolean append_merge_ogg(gint fd, GMappedFile *part, gchar **err_msg) {
+    // Add the part as a new link of the chain. The old stream gets its end-of-stream flag.
+    if (!recovery_finish_ogg(fd)) {
+        *err_msg = g_strdup(_("Cannot read the Ogg stream."));
+        return FALSE;
+    }
+
+    guint32 last_serial = 0;
+    if (!append_ogg_last_serial(fd, &last_serial)) {
+        *err_msg = g_strdup(_("Cannot read the Ogg stream."));
+        return FALSE;
+    }
+
+    guint64 size = lseek(fd, 0, SEEK_END);
+
+    const guint8 *d = (const guint8*)g_mapped_file_get_contents(part);
+    gsize n = g_mapped_file_get_length(part);
+
+    // A link must not continue the serial number of the previous link
+    guint32 new_serial = last_serial ^ 0x5a5a5a5a;
+
+    AppendOut out;
+    append_out_init(&out, fd, size);
+
+    guint pages = 0;
+    guint renumbered = 0;
+
+    gsize pos = 0;
+    while (pos < n) {
+        gsize len = append_ogg_page_len(d + pos, n - pos);
+        if (!len) break;
+
+        guint32 serial = GST_READ_UINT32_LE(d + pos + 14);
+
+        if (serial == last_serial) {
+            guint8 *page = g_memdup(d + pos, len);
+            GST_WRITE_UINT32_LE(page + 14, new_serial);
+            GST_WRITE_UINT32_LE(page + 22, recovery_ogg_crc(page, len));
+
+            append_out_add(&out, page, len);
+            g_free(page);
+            renumbered++;
+        } else {
+            append_out_add(&out, d + pos, len);
+        }
+
+        pages++;
+        pos += len;
+    }
+
+    guint64 end = append_out_end(&out);
+
+    if (!pages || !end) {
+        if (ftruncate(fd, size) != 0) LOG_ERROR("Cannot truncate Ogg file. %s\n", g_strerror(errno));
+
+        *err_msg = (pages ? g_strdup_printf(_("Cannot write to file. %s."), g_strerror(errno)) : g_strdup(_("Cannot read the Ogg stream.")));
+        return FALSE;
+    }
+
+    LOG_APPEND("Ogg: added %u pages (%u with a new serial number), %" G_GSIZE_FORMAT " bytes.\n", pages, renumbered, pos);
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------
+// FLAC
+// ---------------------------------------------------------------------
+
+typedef struct {
+    guint64 si_off;      // Offset of the STREAMINFO data (34 bytes)
+    guint8 si[34];
+    guint64 frames_off;  // First frame
+
+    guint min_bs;
+    guint max_bs;
+    guint rate;
+    guint channels;
+    guint bps;
+    guint64 total;       // Samples (0 = unknown)
+} FlacInfo;
+
+typedef struct {
+    gsize header_len;
+    gboolean variable;   // Blocking strategy. Number is the sample number (variable) or the frame number (fixed).
+    guint64 number;
+    guint blocksize;
+    gsize num_off;       // Offset and length of the coded number
+    gsize num_len;
+} FlacFrameHeader;
+
+static guint8 append_flac_crc8(const guint8 *d, gsize n) {
+    // Frame header CRC-8, polynomial x^8 + x^2 + x + 1
+    guint8 crc = 0;
+
+    gsize i = 0;
+    for (i = 0; i < n; i++) {
+        crc ^= d[i];
+
+        guint b = 0;
+        for (b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (guint8)((crc << 1) ^ 0x07) : (guint8)(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+static guint16 append_flac_crc16(guint16 crc, const guint8 *d, gsize n) {
+    gsize i = 0;
+    for (i = 0; i < n; i++) {
+        crc = (guint16)((crc << 8) ^ g_crc16_table[((crc >> 8) ^ d[i]) & 0xff]);
+    }
+    return crc;
+}
+
+static gboolean append_flac_info(gint fd, FlacInfo *fi) {
+    // Walk the metadata blocks. STREAMINFO is the first one.
+    guint64 size = lseek(fd, 0, SEEK_END);
+
+    memset(fi, 0, sizeof(FlacInfo));
+
+    guint64 pos = 4;
+    gboolean last = FALSE;
+
+    while (!last) {
+        guint8 h[4];
+        if (pos + 4 > size || !append_read(fd, h, 4, pos)) return FALSE;
+
+        last = (h[0] & 0x80);
+        guint type = (h[0] & 0x7f);
+        guint32 len = (h[1] << 16) | (h[2] << 8) | h[3];
+
+        if (type == 0) {
+            if (len < 34 || !append_read(fd, fi->si, 34, pos + 4)) return FALSE;
+            fi->si_off = pos + 4;
+        }
+
+        pos += 4 + len;
+    }
+
+    if (!fi->si_off || pos > size) return FALSE;
+
+    fi->frames_off = pos;
+
+    const guint8 *s = fi->si;
+    fi->min_bs = GST_READ_UINT16_BE(s);
+    fi->max_bs = GST_READ_UINT16_BE(s + 2);
+    fi->rate = (s[10] << 12) | (s[11] << 4) | (s[12] >> 4);
+    fi->channels = ((s[12] >> 1) & 0x07) + 1;
+    fi->bps = (((s[12] & 0x01) << 4) | (s[13] >> 4)) + 1;
+    fi->total = ((guint64)(s[13] & 0x0f) << 32) | GST_READ_UINT32_BE(s + 14);
+
+    return TRUE;
+}
+
+static gboolean append_flac_header(const guint8 *p, gsize avail, FlacFrameHeader *h) {
+    // Parse and check a frame header
+    if (avail < 6 || p[0] != 0xff || (p[1] & 0xfe) != 0xf8) return FALSE;
+
+    guint bs_code = p[2] >> 4;
+    guint sr_code = p[2] & 0x0f;
+    if (bs_code == 0 || sr_code == 15) return FALSE;
+
+    // Channel assignment, sample size and the reserved bit
+    if ((p[3] >> 4) > 10 || ((p[3] >> 1) & 0x07) == 3 || (p[3] & 0x01)) return FALSE;
+
+    // UTF-8 coded number
+    guint8 b = p[4];
+    gsize len = 0;
+    guint64 v = 0;
+
+    if (!(b & 0x80)) {
+        len = 1;
+        v = b;
+    } else if ((b & 0xe0) == 0xc0) {
+        len = 2;
+        v = b & 0x1f;
+    } else if ((b & 0xf0) == 0xe0) {
+        len = 3;
+        v = b & 0x0f;
+    } else if ((b & 0xf8) == 0xf0) {
+        len = 4;
+        v = b & 0x07;
+    } else if ((b & 0xfc) == 0xf8) {
+        len = 5;
+        v = b & 0x03;
+    } else if ((b & 0xfe) == 0xfc) {
+        len = 6;
+        v = b & 0x01;
+    } else if (b == 0xfe) {
+        len = 7;
+        v = 0;
+    } else {
+        return FALSE;
+    }
+
+    if (4 + len > avail) return FALSE;
+
+    gsize i = 0;
+    for (i = 1; i < len; i++) {
+        if ((p[4 + i] & 0xc0) != 0x80) return FALSE;
+        v = (v << 6) | (p[4 + i] & 0x3f);
+    }
+
+    gsize pos = 4 + len;
+
+    // Block size
+    guint blocksize = 0;
+    if (bs_code == 6) {
+        if (pos + 1 > avail) return FALSE;
+        blocksize = p[pos] + 1;
+        pos += 1;
+    } else if (bs_code == 7) {
+        if (pos + 2 > avail) return FALSE;
+        blocksize = GST_READ_UINT16_BE(p + pos) + 1;
+        pos += 2;
+    } else if (bs_code == 1) {
+        blocksize = 192;
+    } else if (bs_code <= 5) {
+        blocksize = 576 << (bs_code - 2);
+    } else {
+        blocksize = 256 << (bs_code - 8);
+    }
+
+    // Sample rate
+    if (sr_code == 12) {
+        pos += 1;
+    } else if (sr_code == 13 || sr_code == 14) {
+        pos += 2;
+    }
+
+    if (pos + 1 > avail || append_flac_crc8(p, pos) != p[pos]) return FALSE;
+
+    h->header_len = pos + 1;
+    h->variable = (p[1] & 0x01);
+    h->number = v;
+    h->blocksize = blocksize;
+    h->num_off = 4;
+    h->num_len = len;
+
+    return TRUE;
+}
+
+static gsize append_flac_utf8(guint64 v, guint8 *out) {
+    // UTF-8 style coding of a frame/sample number (max. 36 bits)
+    if (v < 0x80) {
+        out[0] = (guint8)v;
+        return 1;
+    }
+
+    gsize len = 2;
+    while (len < 7 && v >= ((guint64)1 << (5 * len + 1))) {
+        len++;
+    }
+
+    gsize i = 0;
+    for (i = len - 1; i > 0; i--) {
+        out[i] = 0x80 | (v & 0x3f);
+        v >>= 6;
+    }
+
+    out[0] = (len == 7 ? 0xfe : (guint8)((0xff << (8 - len)) & 0xff) | (guint8)v);
+
+    return len;
+}
+
+static gsize append_flac_frame_end(const guint8 *d, gsize n, gsize start, gsize header_len) {
+    // End of the frame at start: the next frame header (or the end of data) where the CRC-16 of the frame is 0.
+    // Return 0 if not found.
+    guint16 crc = append_flac_crc16(0, d + start, header_len);
+
+    FlacFrameHeader h;
+
+    gsize p = 0;
+    for (p = start + header_len; p < n; p++) {
+        crc = append_flac_crc16(crc, d + p, 1);
+
+        gsize q = p + 1;
+        if (crc == 0 && (q == n || append_flac_header(d + q, n - q, &h))) {
+            return q;
+        }
+    }
+
+    return 0;
+}
+
+static gboolean append_flac_last_frame(gint fd, const FlacInfo *fi, FlacFrameHeader *last) {
+    // Header of the last frame of the file
+    guint64 size = lseek(fd, 0, SEEK_END);
+    if (size <= fi->frames_off) return FALSE;
+
+    gsize tail = (gsize)MIN(size - fi->frames_off, (guint64)APPEND_FLAC_TAIL);
+
+    guint8 *buf = g_malloc(tail);
+    gboolean found = FALSE;
+
+    if (append_read(fd, buf, tail, size - tail)) {
+        // Last frame is the last header whose CRC-16 to the end of file is 0
+        gsize i = tail;
+        while (!found && i-- > 0) {
+            if (buf[i] != 0xff || !append_flac_header(buf + i, tail - i, last)) continue;
+
+            found = (append_flac_crc16(0, buf + i, tail - i) == 0);
+        }
+    }
+
+    g_free(buf);
+    return found;
+}
+
+static gboolean append_merge_flac(gint fd, gint part_fd, GMappedFile *part, gchar **err_msg) {
+    FlacInfo t;
+    FlacInfo p;
+
+    if (!(append_flac_info(fd, &t) && append_flac_info(part_fd, &p))) {
+        *err_msg = g_strdup(_("Cannot read the FLAC header."));
+        return FALSE;
+    }
+
+    if (t.rate != p.rate || t.channels != p.channels || t.bps != p.bps) {
+        *err_msg = g_strdup(_("The audio formats are different."));
+        return FALSE;
+    }
+
+    FlacFrameHeader last;
+    if (!append_flac_last_frame(fd, &t, &last)) {
+        *err_msg = g_strdup(_("Cannot read the FLAC frames."));
+        return FALSE;
+    }
+
+    // Numbering continues after the last frame
+    guint64 next = (last.variable ? last.number + last.blocksize : last.number + 1);
+
+    guint64 size = lseek(fd, 0, SEEK_END);
+
+    const guint8 *d = (const guint8*)g_mapped_file_get_contents(part);
+    gsize n = g_mapped_file_get_length(part);
+
+    AppendOut out;
+    append_out_init(&out, fd, size);
+
+    guint frames = 0;
+    guint min_bs = G_MAXUINT;
+    guint max_bs = 0;
+    gboolean ok = TRUE;
+
+    gsize pos = (gsize)p.frames_off;
+    while (ok && pos < n) {
+        FlacFrameHeader h;
+        if (!append_flac_header(d + pos, n - pos, &h) || h.variable != last.variable) {
+            ok = FALSE;
+            break;
+        }
+
+        gsize end = append_flac_frame_end(d, n, pos, h.header_len);
+        if (!end) {
+            // Torn frame at the end of the part
+            break;
+        }
+
+        // New header: coded number changes, then CRC-8
+        guint8 header[32];
+        memcpy(header, d + pos, 4);
+
+        gsize len = 4 + append_flac_utf8(next + h.number, header + 4);
+
+        gsize rest = h.header_len - 1 - (h.num_off + h.num_len);
+        memcpy(header + len, d + pos + h.num_off + h.num_len, rest);
+        len += rest;
+
+        header[len] = append_flac_crc8(header, len);
+        len++;
+
+        // Subframes unchanged. New CRC-16.
+        const guint8 *body = d + pos + h.header_len;
+        gsize body_len = end - pos - h.header_len - 2;
+
+        guint16 crc = append_flac_crc16(append_flac_crc16(0, header, len), body, body_len);
+
+        guint8 footer[2];
+        GST_WRITE_UINT16_BE(footer, crc);
+
+        append_out_add(&out, header, len);
+        append_out_add(&out, body, body_len);
+        append_out_add(&out, footer, 2);
+
+        min_bs = MIN(min_bs, h.blocksize);
+        max_bs = MAX(max_bs, h.blocksize);
+
+        frames++;
+        pos = end;
+    }
+
+    guint64 end = append_out_end(&out);
+
+    if (!ok || !frames || !end) {
+        if (ftruncate(fd, size) != 0) LOG_ERROR("Cannot truncate FLAC file. %s\n", g_strerror(errno));
+
+        *err_msg = (end ? g_strdup(_("Cannot read the FLAC frames.")) : g_strdup_printf(_("Cannot write to file. %s."), g_strerror(errno)));
+        return FALSE;
+    }
+
+    // STREAMINFO: block sizes, sample count. Frame sizes and MD5 are unknown now.
+    guint8 *s = t.si;
+    GST_WRITE_UINT16_BE(s, MIN(t.min_bs, min_bs));
+    GST_WRITE_UINT16_BE(s + 2, MAX(t.max_bs, max_bs));
+    memset(s + 4, 0, 6);
+
+    guint64 total = ((t.total && p.total) ? t.total + p.total : 0);
+    if (total >> 36) total = 0;
+
+    s[13] = (s[13] & 0xf0) | (guint8)((total >> 32) & 0x0f);
+    GST_WRITE_UINT32_BE(s + 14, (guint32)(total & 0xffffffff));
+    memset(s + 18, 0, 16);
+
+    if (!append_write(fd, s, 34, t.si_off)) {
+        if (ftruncate(fd, size) != 0) LOG_ERROR("Cannot truncate FLAC file. %s\n", g_strerror(errno));
+
+        *err_msg = g_strdup_printf(_("Cannot write to file. %s."), g_strerror(errno));
+        return FALSE;
+    }
+
+    LOG_APPEND("FLAC: added %u frames from number %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT " samples in total.\n", frames, next, total);
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------
+// Fragmented MP4
+// ---------------------------------------------------------------------
+
+typedef struct {
+    guint32 track_id;
+    guint32 trex_duration;   // Default sample duration from moov/mvex/trex
+    guint64 end;             // Decode time after the last fragment
+    guint32 timescale;
+    guint8 entry[32];        // Sample entry of stsd: type, channels, sample size, sample rate
+} Mp4Track;
+
+typedef struct {
+    Mp4Track tracks[APPEND_MP4_MAX_TRACKS];
+    guint n_tracks;
+
+    guint64 moov_off;
+    guint8 *moov;
+    gsize moov_len;
+
+    guint32 last_seq;
+    guint64 frag_end;        // End of the last moof/mdat pair
+    guint64 first_frag;      // First moof
+} Mp4Info;
+
+static Mp4Track *append_mp4_track(Mp4Info *mi, guint32 track_id) {
+    guint i = 0;
+    for (i = 0; i < mi->n_tracks; i++) {
+        if (mi->tracks[i].track_id == track_id) return &mi->tracks[i];
+    }
+    return NULL;
+}
+
+static gboolean append_mp4_read_moov(Mp4Info *mi) {
+    // Tracks (id, timescale, sample entry) and their trex defaults
+    guint8 *trak = NULL;
+    gsize len = 0;
+
+    while ((trak = append_mp4_child(mi->moov, mi->moov_len, "trak", trak, &len)) && mi->n_tracks < APPEND_MP4_MAX_TRACKS) {
+        Mp4Track *t = &mi->tracks[mi->n_tracks];
+        memset(t, 0, sizeof(Mp4Track));
+
+        gsize n = 0;
+        guint8 *tkhd = append_mp4_child(trak, len, "tkhd", NULL, &n);
+        if (!tkhd || n < 32) return FALSE;
+        t->track_id = GST_READ_UINT32_BE(tkhd + (tkhd[8] == 1 ? 28 : 20));
+
+        guint8 *mdhd = append_mp4_path(trak, len, "mdia/mdhd", &n);
+        if (!mdhd || n < 32) return FALSE;
+        t->timescale = GST_READ_UINT32_BE(mdhd + (mdhd[8] == 1 ? 28 : 20));
+
+        // stsd: version/flags, entry count, then the first sample entry
+        guint8 *stsd = append_mp4_path(trak, len, "mdia/minf/stbl/stsd", &n);
+        if (!stsd || n < 20 + sizeof(t->entry)) return FALSE;
+        memcpy(t->entry, stsd + 16 + 4, sizeof(t->entry));
+
+        mi->n_tracks++;
+    }
+
+    guint8 *mvex = append_mp4_child(mi->moov, mi->moov_len, "mvex", NULL, &len);
+    if (!mvex) return FALSE;
+
+    gsize n = 0;
+    guint8 *trex = NULL;
+    while ((trex = append_mp4_child(mvex, len, "trex", trex, &n))) {
+        if (n < 32) continue;
+
+        Mp4Track *t = append_mp4_track(mi, GST_READ_UINT32_BE(trex + 12));
+        if (t) t->trex_duration = GST_READ_UINT32_BE(trex + 20);
+    }
+
+    return (mi->n_tracks > 0);
+}
+
+static guint8 *append_mp4_tfhd(guint8 *traf, gsize len, guint32 *track_id, guint32 *flags, guint32 *default_duration) {
+    // Track fragment header
+    gsize n = 0;
+    guint8 *tfhd = append_mp4_child(traf, len, "tfhd", NULL, &n);
+    if (!tfhd || n < 16) return NULL;
+
+    *flags = GST_READ_UINT32_BE(tfhd + 8) & 0xffffff;
+    *track_id = GST_READ_UINT32_BE(tfhd + 12);
+
+    gsize off = 16;
+    if (*flags & 0x01) off += 8;
+    if (*flags & 0x02) off += 4;
+
+    *default_duration = 0;
+    if ((*flags & 0x08) && off + 4 <= n) {
+        *default_duration = GST_READ_UINT32_BE(tfhd + off);
+    }
+
+    return tfhd;
+}
+
+static guint64 append_mp4_traf_duration(guint8 *traf, gsize len, guint32 default_duration) {
+    // Sum of the sample durations of all trun boxes
+    guint64 dur = 0;
+
+    gsize n = 0;
+    guint8 *trun = NULL;
+    while ((trun = append_mp4_child(traf, len, "trun", trun, &n))) {
+        if (n < 16) continue;
+
+        guint32 flags = GST_READ_UINT32_BE(trun + 8) & 0xffffff;
+        guint32 count = GST_READ_UINT32_BE(trun + 12);
+
+        gsize off = 16;
+        if (flags & 0x01) off += 4;
+        if (flags & 0x04) off += 4;
+
+        if (!(flags & 0x100)) {
+            dur += (guint64)count * default_duration;
+            continue;
+        }
+
+        gsize stride = 4 * (((flags & 0x100) != 0) + ((flags & 0x200) != 0) + ((flags & 0x400) != 0) + ((flags & 0x800) != 0));
+
+        guint32 i = 0;
+        for (i = 0; i < count && off + 4 <= n; i++, off += stride) {
+            dur += GST_READ_UINT32_BE(trun + off);
+        }
+    }
+
+    return dur;
+}
+
+static guint8 *append_mp4_tfdt(guint8 *traf, gsize len, guint64 *base) {
+    // Base media decode time
+    gsize n = 0;
+    guint8 *tfdt = append_mp4_child(traf, len, "tfdt", NULL, &n);
+    if (!tfdt || n < 16) return NULL;
+
+    *base = (tfdt[8] == 1 && n >= 20 ? GST_READ_UINT64_BE(tfdt + 12) : GST_READ_UINT32_BE(tfdt + 12));
+    return tfdt;
+}
+
+static void append_mp4_scan_moof(Mp4Info *mi, guint8 *moof, gsize len) {
+    // Sequence number and decode end times of a fragment
+    gsize n = 0;
+    guint8 *mfhd = append_mp4_child(moof, len, "mfhd", NULL, &n);
+    if (mfhd && n >= 16) {
+        mi->last_seq = MAX(mi->last_seq, GST_READ_UINT32_BE(mfhd + 12));
+    }
+
+    guint8 *traf = NULL;
+    while ((traf = append_mp4_child(moof, len, "traf", traf, &n))) {
+        guint32 track_id = 0;
+        guint32 flags = 0;
+        guint32 default_duration = 0;
+
+        if (!append_mp4_tfhd(traf, n, &track_id, &flags, &default_duration)) continue;
+
+        Mp4Track *t = append_mp4_track(mi, track_id);
+        if (!t) continue;
+
+        if (!default_duration) default_duration = t->trex_duration;
+
+        guint64 base = t->end;
+        append_mp4_tfdt(traf, n, &base);
+
+        t->end = MAX(t->end, base + append_mp4_traf_duration(traf, n, default_duration));
+    }
+}
+
+static gboolean append_mp4_info(gint fd, Mp4Info *mi) {
+    // Read moov and walk the fragments. Moof boxes are small; mdat boxes are skipped.
+    guint64 size = lseek(fd, 0, SEEK_END);
+
+    memset(mi, 0, sizeof(Mp4Info));
+
+    guint64 pos = 0;
+    guint64 box = 0;
+    gchar type[5];
+
+    while (pos < size) {
+        if (!append_mp4_box(fd, pos, size, &box, type)) return FALSE;
+
+        if (!strcmp(type, "moov")) {
+            mi->moov_off = pos;
+            mi->moov_len = box;
+            mi->moov = append_mp4_read_box(fd, pos, box);
+
+            if (!(mi->moov && append_mp4_read_moov(mi))) return FALSE;
+
+        } else if (!strcmp(type, "moof")) {
+            guint8 *moof = append_mp4_read_box(fd, pos, box);
+            if (!(moof && mi->moov)) {
+                g_free(moof);
+                return FALSE;
+            }
+
+            if (!mi->first_frag) mi->first_frag = pos;
+
+            append_mp4_scan_moof(mi, moof, box);
+            g_free(moof);
+
+        } else if (!strcmp(type, "mdat")) {
+            mi->frag_end = pos + box;
+
+        } else if (!strcmp(type, "mfra")) {
+            // Index of the fragments. Not valid after the merge.
+            break;
+        }
+
+        pos += box;
+    }
+
+    if (!mi->frag_end) mi->frag_end = pos;
+
+    return (mi->moov != NULL);
+}
+
+static gboolean append_mp4_patch_moof(Mp4Info *t, guint8 *moof, gsize len, gint64 delta) {
+    // Fragment of the part: new sequence number, decode times after the old fragments, moved data offsets
+    gsize n = 0;
+    guint8 *mfhd = append_mp4_child(moof, len, "mfhd", NULL, &n);
+    if (!mfhd || n < 16) return FALSE;
+
+    GST_WRITE_UINT32_BE(mfhd + 12, ++t->last_seq);
+
+    guint8 *traf = NULL;
+    while ((traf = append_mp4_child(moof, len, "traf", traf, &n))) {
+        guint32 track_id = 0;
+        guint32 flags = 0;
+        guint32 default_duration = 0;
+
+        guint8 *tfhd = append_mp4_tfhd(traf, n, &track_id, &flags, &default_duration);
+        Mp4Track *tt = append_mp4_track(t, track_id);
+        if (!(tfhd && tt)) return FALSE;
+
+        // Explicit base data offset is an absolute file position
+        if (flags & 0x01) {
+            GST_WRITE_UINT64_BE(tfhd + 16, GST_READ_UINT64_BE(tfhd + 16) + delta);
+        }
+
+        guint64 base = 0;
+        guint8 *tfdt = append_mp4_tfdt(traf, n, &base);
+        if (!tfdt) {
+            // Decode times cannot be moved
+            return FALSE;
+        }
+
+        base += tt->end;
+
+        if (tfdt[8] == 1) {
+            GST_WRITE_UINT64_BE(tfdt + 12, base);
+        } else if (base <= G_MAXUINT32) {
+            GST_WRITE_UINT32_BE(tfdt + 12, (guint32)base);
+        } else {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void append_mp4_add_duration(guint8 *box, gsize len, guint off32, guint off64, guint64 add) {
+    // Add to a duration field of a full box (mvhd, mehd). Zero (unknown) stays.
+    if (!box) return;
+
+    if (box[8] == 1) {
+        if (off64 + 8 > len) return;
+        guint64 v = GST_READ_UINT64_BE(box + off64);
+        if (v) GST_WRITE_UINT64_BE(box + off64, v + add);
+    } else {
+        if (off32 + 4 > len) return;
+        guint32 v = GST_READ_UINT32_BE(box + off32);
+        if (v && v != G_MAXUINT32) GST_WRITE_UINT32_BE(box + off32, (guint32)MIN((guint64)v + add, (guint64)G_MAXUINT32 - 1));
+    }
+}
+
+static guint64 append_mp4_duration(guint8 *box, gsize len, guint off32, guint off64) {
+    if (!box) return 0;
+    if (box[8] == 1) return (off64 + 8 <= len ? GST_READ_UINT64_BE(box + off64) : 0);
+    return (off32 + 4 <= len ? GST_READ_UINT32_BE(box + off32) : 0);
+}
+
+static gboolean append_merge_mp4(gint fd, gint part_fd, GMappedFile *part, gchar **err_msg) {
+    Mp4Info t;
+    Mp4Info p;
+    gboolean ok = FALSE;
+
+    guint8 *trailer = NULL;
+    gsize trailer_len = 0;
+
+    guint64 size = lseek(fd, 0, SEEK_END);
+
+    memset(&t, 0, sizeof(Mp4Info));
+    memset(&p, 0, sizeof(Mp4Info));
+
+    if (!(append_mp4_info(fd, &t) && append_mp4_info(part_fd, &p) && p.first_frag)) {
+        *err_msg = g_strdup(_("The MP4 files are not fragmented."));
+        goto LBL_1;
+    }
+
+    // Same tracks and sample formats
+    guint i = 0;
+    for (i = 0; i < p.n_tracks; i++) {
+        Mp4Track *tt = append_mp4_track(&t, p.tracks[i].track_id);
+
+        if (!tt || tt->timescale != p.tracks[i].timescale || memcmp(tt->entry, p.tracks[i].entry, sizeof(tt->entry))) {
+            *err_msg = g_strdup(_("The audio formats are different."));
+            goto LBL_1;
+        }
+    }
+
+    // The fragments go over the mfra box. Keep it until the merge has succeeded.
+    trailer_len = (gsize)(size - t.frag_end);
+    if (trailer_len > APPEND_MP4_BOX_MAX) {
+        *err_msg = g_strdup(_("Cannot read the MP4 file."));
+        goto LBL_1;
+    }
+
+    trailer = g_malloc(trailer_len + 1);
+    if (trailer_len && !append_read(fd, trailer, trailer_len, t.frag_end)) {
+        *err_msg = g_strdup(_("Cannot read the MP4 file."));
+        goto LBL_1;
+    }
+
+    guint8 *d = (guint8*)g_mapped_file_get_contents(part);
+    gsize n = g_mapped_file_get_length(part);
+
+    AppendOut out;
+    append_out_init(&out, fd, t.frag_end);
+
+    guint fragments = 0;
+    ok = TRUE;
+
+    gsize pos = (gsize)p.first_frag;
+    while (ok && pos + 8 <= n) {
+        guint64 box = GST_READ_UINT32_BE(d + pos);
+        if (box == 1 && pos + 16 <= n) {
+            box = GST_READ_UINT64_BE(d + pos + 8);
+        } else if (box == 0) {
+            box = n - pos;
+        }
+
+        if (box < 8 || pos + box > n) break;
+
+        if (!memcmp(d + pos + 4, "moof", 4)) {
+            if (box > APPEND_MP4_BOX_MAX) {
+                ok = FALSE;
+                break;
+            }
+
+            guint8 *moof = g_memdup(d + pos, box);
+
+            // Where the moof lands in the target, minus where it was in the part
+            gint64 delta = (gint64)(out.pos + out.buf->len) - (gint64)pos;
+
+            ok = append_mp4_patch_moof(&t, moof, box, delta);
+            if (ok) append_out_add(&out, moof, box);
+
+            g_free(moof);
+            fragments++;
+
+        } else if (!memcmp(d + pos + 4, "mdat", 4)) {
+            append_out_add(&out, d + pos, box);
+
+        } else if (!memcmp(d + pos + 4, "mfra", 4)) {
+            // New index is not written
+            break;
+        }
+
+        pos += box;
+    }
+
+    guint64 end = append_out_end(&out);
+
+    if (!ok || !fragments || !end || ftruncate(fd, end) != 0) {
+        *err_msg = (ok && fragments ? g_strdup_printf(_("Cannot write to file. %s."), g_strerror(errno)) :
+                    g_strdup(_("The MP4 files are not fragmented.")));
+        ok = FALSE;
+        goto LBL_1;
+    }
+
+    // Movie duration (mvhd) and fragment duration (mehd) in the movie timescale
+    gsize tn = 0;
+    gsize pn = 0;
+    guint8 *t_mvhd = append_mp4_child(t.moov, t.moov_len, "mvhd", NULL, &tn);
+    guint8 *p_mvhd = append_mp4_child(p.moov, p.moov_len, "mvhd", NULL, &pn);
+
+    if (t_mvhd && p_mvhd && tn >= 32 && pn >= 32) {
+        guint32 t_scale = GST_READ_UINT32_BE(t_mvhd + (t_mvhd[8] == 1 ? 28 : 20));
+        guint32 p_scale = GST_READ_UINT32_BE(p_mvhd + (p_mvhd[8] == 1 ? 28 : 20));
+
+        guint64 add = append_mp4_duration(p_mvhd, pn, 24, 32);
+
+        gsize en = 0;
+        guint8 *p_mehd = append_mp4_path(p.moov, p.moov_len, "mvex/mehd", &en);
+        if (p_mehd) add = MAX(add, append_mp4_duration(p_mehd, en, 12, 12));
+
+        if (p_scale) add = gst_util_uint64_scale(add, t_scale, p_scale);
+
+        append_mp4_add_duration(t_mvhd, tn, 24, 32, add);
+
+        guint8 *t_mehd = append_mp4_path(t.moov, t.moov_len, "mvex/mehd", &en);
+        append_mp4_add_duration(t_mehd, en, 12, 12, add);
+
+        if (!append_write(fd, t.moov, t.moov_len, t.moov_off)) {
+            LOG_ERROR("Cannot update the MP4 duration. %s\n", g_strerror(errno));
+        }
+    }
+
+    LOG_APPEND("MP4: added %u fragments, sequence numbers up to %u.\n", fragments, t.last_seq);
+
+LBL_1:
+    if (!ok && trailer) {
+        // Put the old file back
+        if (trailer_len) append_write(fd, trailer, trailer_len, t.frag_end);
+        if (ftruncate(fd, size) != 0) LOG_ERROR("Cannot truncate MP4 file. %s\n", g_strerror(errno));
+    }
+
+    g_free(trailer);
+    g_free(t.moov);
+    g_free(p.moov);
+
+    return ok;
+}
+
+// ---------------------------------------------------------------------
+// Merge
+// ---------------------------------------------------------------------
+
+gboolean append_merge(const gchar *target, const gchar *part, gchar **err_msg) {
+    // Merge part into target. Target is not changed if this fails.
+    gboolean ok = FALSE;
+
+    GError *error = NULL;
+    GMappedFile *map = NULL;
+
+    gint fd = g_open(target, O_RDWR, 0);
+    gint part_fd = g_open(part, O_RDONLY, 0);
+
+    if (fd < 0 || part_fd < 0) {
+        *err_msg = g_strdup_printf(_("Cannot open file. %s."), g_strerror(errno));
+        goto LBL_1;
+    }
+
+    map = g_mapped_file_new(part, FALSE, &error);
+    if (!map || !g_mapped_file_get_length(map)) {
+        *err_msg = g_strdup_printf(_("Cannot open file. %s."), (error ? error->message : "Empty file"));
+        goto LBL_1;
+    }
+
+    AppendFormat format = append_detect(fd);
+    if (format == FORMAT_UNKNOWN || format != append_detect(part_fd)) {
+        *err_msg = g_strdup(_("The audio formats are different."));
+        goto LBL_1;
+    }
+
+    switch (format) {
+    case FORMAT_WAV:
+        ok = append_merge_wav(fd, part_fd, err_msg);
+        break;
+
+    case FORMAT_OGG:
+        ok = append_merge_ogg(fd, map, err_msg);
+        break;
+
+    case FORMAT_FLAC:
+        ok = append_merge_flac(fd, part_fd, map, err_msg);
+        break;
+
+    case FORMAT_MP4:
+        ok = append_merge_mp4(fd, part_fd, map, err_msg);
+        break;
+
+    default:
+        break;
+    }
+
+    if (ok) {
+        fdatasync(fd);
+    }
+
+LBL_1:
+    if (error) g_error_free(error);
+    if (map) g_mapped_file_unref(map);
+
+    if (fd >= 0) close(fd);
+    if (part_fd >= 0) close(part_fd);
+
+    return ok;
+}
+
+static void append_job_free(AppendJob *job) {
+    g_free(job->target);
+    g_free(job->part);
+    g_free(job->transcode_profile);
+    g_free(job->err_msg);
+    g_free(job);
+}
+
+static gboolean append_done_cb(gpointer user_data) {
+    // Merge has finished. Runs in the main loop.
+    AppendJob *job = (AppendJob*)user_data;
+
+    if (job->merged) {
+        retention_file_changed(job->target);
+    } else {
+        gchar *msg = g_strdup_printf(_("Cannot append to file \"%s\". %s The new recording is in \"%s\".\n"),
+                                     job->target, job->err_msg, job->part);
+        rec_manager_set_error_text(msg);
+        g_free(msg);
+    }
+
+    // Convert the result (or the separate part) to the saved profile
+    if (job->transcode_profile) {
+        transcode_queue((job->merged ? job->target : job->part), job->transcode_profile, job->keep);
+    }
+
+    g_jobs = g_list_remove(g_jobs, job);
+
+    append_job_free(job);
+    return FALSE;
+}
+
+static void append_job_run(gpointer data, gpointer user_data) {
+    AppendJob *job = (AppendJob*)data;
+
+    gint64 t0 = g_get_monotonic_time();
+
+    job->merged = append_merge(job->target, job->part, &job->err_msg);
+
+    if (job->merged) {
+        g_remove(job->part);
+
+        // Sidecar indexes and checksums do not match the merged file
+        seek_index_remove(job->part);
+        seek_index_remove(job->target);
+        checksum_remove(job->part);
+        checksum_remove(job->target);
+
+        LOG_MSG("Appended %s to %s in %.1f ms.\n", job->part, job->target, (g_get_monotonic_time() - t0) / 1000.0);
+    } else {
+        LOG_ERROR("Cannot append %s to %s. %s\n", job->part, job->target, job->err_msg);
+    }
+
+    g_idle_add(append_done_cb, job);
+}
+
+static gboolean append_merge_job(AppendJob *job) {
+    // One worker. Merges into the same file run in order.
+    if (!g_pool) {
+        g_pool = g_thread_pool_new(append_job_run, NULL, 1, TRUE, NULL);
+    }
+
+    return (g_pool && g_thread_pool_push(g_pool, job, NULL));
+}
+
+void append_queue(const gchar *target, const gchar *part, const gchar *transcode_profile, gboolean keep) {
+    if (!(target && part)) return;
+
+    AppendJob *job = g_malloc0(sizeof(AppendJob));
+    job->target = g_strdup(target);
+    job->part = g_strdup(part);
+    job->transcode_profile = g_strdup(transcode_profile);
+    job->keep = keep;
+
+    if (!append_merge_job(job)) {
+        LOG_ERROR("Cannot start the merge of %s.\n", part);
+        append_job_free(job);
+        return;
+    }
+
+    g_jobs = g_list_append(g_jobs, job);
+}
+
+GList *append_pending_files() {
+    // Targets and parts of the queued and running merges
+    GList *files = NULL;
+
+    GList *n = g_list_first(g_jobs);
+    while (n) {
+        AppendJob *job = (AppendJob*)n->data;
+
+        files = g_list_append(files, g_strdup(job->target));
+        files = g_list_append(files, g_strdup(job->part));
+
+        n = g_list_next(n);
+    }
+
+    // Caller should free the list with str_list_free()
+    return files;
+}
+
+// ---------------------------------------------------------------------
+// Recording side
+// ---------------------------------------------------------------------
+
+AppendMode append_get_mode(const gchar *filename, const gchar *file_ext) {
+    AppendFormat format = append_format_of_ext(file_ext);
+
+    gint fd = g_open(filename, O_RDONLY, 0);
+    if (fd < 0) return APPEND_RAW;
+
+    AppendFormat old_format = append_detect(fd);
+
+    AppendMode mode = APPEND_MERGE;
+
+    if (format == FORMAT_UNKNOWN) {
+        // Eg. MP3. Frames can be appended as they are.
+        mode = APPEND_RAW;
+
+    } else if (old_format != format) {
+        mode = APPEND_NEW_FILE;
+
+    } else if (format == FORMAT_MP4 && !append_mp4_is_fragmented(fd)) {
+        // The index (moov) is at the end. Cannot add to it without rewriting the file.
+        mode = APPEND_NEW_FILE;
+    }
+
+    close(fd);
+
+    LOG_APPEND("Append to %s: mode %d.\n", filename, mode);
+    return mode;
+}
+
+gchar *append_part_filename(const gchar *filename) {
+    // Eg. "2017-01-20-10:00:00.append.ogg", "2017-01-20-10:00:00.append-2.ogg"
+    gchar *path = NULL;
+    gchar *base = NULL;
+    gchar *ext = NULL;
+    split_filename3((gchar*)filename, &path, &base, &ext);
+
+    gchar *part = NULL;
+
+    guint i = 1;
+    for (i = 1; !part || g_file_test(part, G_FILE_TEST_EXISTS); i++) {
+        g_free(part);
+
+        gchar *name = (i == 1 ? g_strdup_printf("%s.append.%s", base, ext) : g_strdup_printf("%s.append-%u.%s", base, i, ext));
+        part = g_build_filename(path, name, NULL);
+        g_free(name);
+    }
+
+    g_free(path);
+    g_free(base);
+    g_free(ext);
+
+    return part;
+}
+
+void append_setup_pipeline(GstElement *pipeline) {
+    // Only fragmented MP4 can be merged. Other muxers need nothing.
+    if (!GST_IS_BIN(pipeline)) return;
+
+    GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    GValue value = G_VALUE_INIT;
+
+    while (gst_iterator_next(it, &value) == GST_ITERATOR_OK) {
+        GstElement *elem = GST_ELEMENT(g_value_get_object(&value));
+
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(elem), "fragment-duration")) {
+            guint ms = 0;
+            g_object_get(G_OBJECT(elem), "fragment-duration", &ms, NULL);
+
+            if (!ms) {
+                g_object_set(G_OBJECT(elem), "fragment-duration", (guint)APPEND_FRAGMENT_MS, NULL);
+            }
+        }
+
+        g_value_reset(&value);
+    }
+
+    g_value_unset(&value);
+    gst_iterator_free(it);
+}
@@ -0,0 +1,46 @@
+#ifndef _GST_APPEND_H
+#define _GST_APPEND_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-append.c.
+//#define DEBUG_APPEND
+
+#if defined(DEBUG_APPEND) || defined(DEBUG_ALL)
+#define LOG_APPEND LOG_MSG
+#else
+#define LOG_APPEND(x, ...)
+#endif
+
+typedef enum {
+    APPEND_RAW,       // Append the bytes (eg. MP3 frames)
+    APPEND_MERGE,     // Record to a part file and merge it into the old file (Ogg, WAV, FLAC, fragmented MP4)
+    APPEND_NEW_FILE,  // Cannot append to this file (another format). Record to a new file.
+} AppendMode;
+
+void append_module_init();
+
+// Wait for the running merges and stop the worker
+void append_module_exit();
+
+// How to append a recording with file extension file_ext to filename
+AppendMode append_get_mode(const gchar *filename, const gchar *file_ext);
+
+// Free name for the part file of filename (in the same folder). Caller should g_free() this value.
+gchar *append_part_filename(const gchar *filename);
+
+// Set the muxers of pipeline so that the part can be merged (MP4 fragments)
+void append_setup_pipeline(GstElement *pipeline);
+
+// Merge part into target in the background. Part is deleted after a successful merge.
+// If transcode_profile is not NULL, the result is then converted to it (see gst-transcode.c).
+void append_queue(const gchar *target, const gchar *part, const gchar *transcode_profile, gboolean keep);
+
+// Targets and parts of the queued and running merges. Main thread only. Free the list with str_list_free().
+GList *append_pending_files();
+
+// Merge part into target now (without re-encoding). Return FALSE and set err_msg if the files cannot be merged.
+gboolean append_merge(const gchar *target, const gchar *part, gchar **err_msg);
+
+#endif
@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <glib/gstdio.h>
+
+#include "gst-bench.h"
+#include "gst-pipeline.h"
+#include "media-profiles.h"
+#include "log.h"
+#include "support.h"
+
+// Encoder benchmark for media profiles.
+//
+// Each profile is built with the real pipeline_create() code. An appsrc feeds deterministic test audio
+// (speech-like noise, a sine sweep and silence) as fast as the pipeline takes it, and the encoded file is
+// written to the temp directory. The results are tab-separated lines, one per profile, signal and source format.
+//
+// $ audio-recorder --benchmark=encoders
+
+typedef enum {
+    BENCH_SPEECH,
+    BENCH_SWEEP,
+    BENCH_SILENCE,
+    BENCH_N_SIGNALS
+} BenchSignal;
+
+static const gchar *g_signal_names[BENCH_N_SIGNALS] = {"speech", "sweep", "silence"};
+
+// Typical source formats: CD, most sound cards and webcams, and a voice headset
+static const gint g_formats[][2] = {{44100, 2}, {48000, 2}, {16000, 1}};
+
+#define BENCH_N_FORMATS (sizeof(g_formats) / sizeof(g_formats[0]))
+
+// Frames per buffer
+#define BENCH_FRAMES 1024
+
+typedef struct {
+    BenchSignal signal;
+    gint rate;
+    gint channels;
+
+    guint64 n_frames;
+    guint64 offset;
+
+    // Generator state
+    guint32 seed;
+    gdouble noise;
+    gdouble phase;
+
+    // Monotonic times
+    gint64 eos_time;
+    gint64 first_buffer_time;
+} BenchSource;
+
+typedef struct {
+    gdouble realtime_factor;
+
+    // CPU seconds per hour of audio
+    gdouble cpu_per_hour;
+
+    // kB
+    glong peak_rss;
+
+    gdouble bytes_per_sec;
+
+    gdouble start_ms;
+    gdouble stop_ms;
+} BenchResult;
+
+static gdouble bench_cpu_time() {
+    // Process CPU time (user + system) in milliseconds. Includes the GStreamer threads.
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+static void bench_reset_peak_rss() {
+    // Reset the peak RSS (VmHWM) of this process. Linux 4.0 and newer.
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (!f) return;
+
+    fputs("5", f);
+    fclose(f);
+}
+
+static glong bench_peak_rss() {
+    // Peak RSS in kB since bench_reset_peak_rss()
+    glong rss = -1;
+
+    gchar *text = NULL;
+    if (g_file_get_contents("/proc/self/status", &text, NULL, NULL)) {
+        gchar *p = strstr(text, "VmHWM:");
+        if (p) {
+            rss = atol(p + strlen("VmHWM:"));
+        }
+        g_free(text);
+    }
+
+    if (rss < 0) {
+        // Peak of the whole process
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        rss = usage.ru_maxrss;
+    }
+
+    return rss;
+}
+
+static gdouble bench_random(BenchSource *src) {
+    // Xorshift. Same sequence on every run. Return value in [-1.0, 1.0].
+    guint32 x = src->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    src->seed = x;
+
+    return (x / (gdouble)G_MAXUINT32) * 2.0 - 1.0;
+}
+
+static gdouble bench_sample(BenchSource *src, guint64 frame) {
+    // Next sample of the test signal
+    gdouble t = frame / (gdouble)src->rate;
+    gdouble v = 0.0;
+
+    switch (src->signal) {
+    case BENCH_SPEECH: {
+        // Low-passed noise in syllables (about 4 per second) with pauses between phrases
+        src->noise = 0.9 * src->noise + 0.1 * bench_random(src);
+
+        gdouble syllable = sin(2.0 * G_PI * 4.0 * t);
+        gdouble phrase = sin(2.0 * G_PI * 0.25 * t);
+
+        v = 4.0 * src->noise * (syllable > 0.0 ? syllable : 0.0) * (phrase > -0.5 ? 1.0 : 0.0);
+        break;
+    }
+
+    case BENCH_SWEEP: {
+        // Logarithmic sweep from 20 Hz to 90% of Nyquist over the run
+        gdouble f0 = 20.0;
+        gdouble f1 = src->rate * 0.45;
+        gdouble f = f0 * pow(f1 / f0, (gdouble)frame / src->n_frames);
+
+        src->phase += 2.0 * G_PI * f / src->rate;
+        if (src->phase > 2.0 * G_PI) src->phase -= 2.0 * G_PI;
+
+        v = 0.5 * sin(src->phase);
+        break;
+    }
+
+    default:
+        // Silence
+        v = 0.0;
+    }
+
+    return CLAMP(v, -1.0, 1.0);
+}
+
+static void bench_need_data(GstElement *appsrc, guint length, gpointer user_data) {
+    // Push the next buffer. Runs in the streaming thread of appsrc.
+    BenchSource *src = (BenchSource*)user_data;
+
+    if (src->offset >= src->n_frames) {
+        if (!src->eos_time) {
+            src->eos_time = g_get_monotonic_time();
+
+            GstFlowReturn ret;
+            g_signal_emit_by_name(appsrc, "end-of-stream", &ret);
+        }
+        return;
+    }
+
+    guint n = (guint)MIN(BENCH_FRAMES, src->n_frames - src->offset);
+
+    GstBuffer *buf = gst_buffer_new_allocate(NULL, n * src->channels * 2, NULL);
+
+    GstMapInfo map;
+    gst_buffer_map(buf, &map, GST_MAP_WRITE);
+
+    gint16 *s = (gint16*)map.data;
+
+    guint i = 0;
+    for (i = 0; i < n; i++) {
+        gint16 v = (gint16)(bench_sample(src, src->offset + i) * 32767.0);
+
+        gint c = 0;
+        for (c = 0; c < src->channels; c++) {
+            s[i * src->channels + c] = v;
+        }
+    }
+
+    gst_buffer_unmap(buf, &map);
+
+    GST_BUFFER_PTS(buf) = gst_util_uint64_scale(src->offset, GST_SECOND, src->rate);
+    GST_BUFFER_DURATION(buf) = gst_util_uint64_scale(n, GST_SECOND, src->rate);
+
+    src->offset += n;
+
+    GstFlowReturn ret;
+    g_signal_emit_by_name(appsrc, "push-buffer", buf, &ret);
+    gst_buffer_unref(buf);
+}
+
+static GstPadProbeReturn bench_first_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    // First encoded buffer reached the filesink
+    BenchSource *src = (BenchSource*)user_data;
+    src->first_buffer_time = g_get_monotonic_time();
+
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static GstElement *bench_find_appsrc(GstElement *pipeline) {
+    // The capture front-end does not name the source. Find it by factory.
+    GstElement *appsrc = NULL;
+
+    GstIterator *it = gst_bin_iterate_sources(GST_BIN(pipeline));
+    GValue item = G_VALUE_INIT;
+
+    while (!appsrc && gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+        GstElement *e = GST_ELEMENT(g_value_get_object(&item));
+        GstElementFactory *factory = gst_element_get_factory(e);
+
+        if (factory && !g_strcmp0(gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)), "appsrc")) {
+            appsrc = gst_object_ref(e);
+        }
+        g_value_reset(&item);
+    }
+
+    g_value_unset(&item);
+    gst_iterator_free(it);
+
+    return appsrc;
+}
+
+static gboolean bench_run(const gchar *profile_str, BenchSignal signal, gint rate, gint channels, gdouble seconds,
+                          BenchResult *res, gchar **err_msg) {
+    // Encode seconds of the test signal with profile_str. Fill res.
+    gboolean ok = FALSE;
+
+    memset(res, 0, sizeof(BenchResult));
+
+    BenchSource src;
+    memset(&src, 0, sizeof(BenchSource));
+    src.signal = signal;
+    src.rate = rate;
+    src.channels = channels;
+    src.n_frames = (guint64)(seconds * rate);
+    src.seed = 2463534242U;
+
+    gchar *filename = g_strdup_printf("%s/audio-recorder-bench-%d", g_get_tmp_dir(), (gint)getpid());
+
+    // The real recording pipeline. No device: the capture front-end creates a plain appsrc.
+    PipelineParms *parms = g_malloc0(sizeof(PipelineParms));
+    parms->source = g_strdup("appsrc");
+    parms->profile_str = g_strdup(profile_str);
+    parms->filename = g_strdup(filename);
+
+    GstElement *pipeline = pipeline_create(parms, err_msg);
+    GstElement *appsrc = NULL;
+    GstElement *filesink = NULL;
+    GstBus *bus = NULL;
+
+    pipeline_free_parms(parms);
+
+    if (!pipeline) goto LBL_1;
+
+    appsrc = bench_find_appsrc(pipeline);
+    filesink = gst_bin_get_by_name(GST_BIN(pipeline), "filesink");
+
+    if (!(appsrc && filesink)) {
+        *err_msg = g_strdup(_("Cannot create audio pipeline. Cannot link.\n"));
+        goto LBL_1;
+    }
+
+    GstCaps *caps = gst_caps_new_simple("audio/x-raw", "format", G_TYPE_STRING, "S16LE", "layout", G_TYPE_STRING, "interleaved",
+                                        "rate", G_TYPE_INT, rate, "channels", G_TYPE_INT, channels, NULL);
+
+    g_object_set(G_OBJECT(appsrc), "caps", caps, "format", GST_FORMAT_TIME, NULL);
+    gst_caps_unref(caps);
+
+    g_signal_connect(appsrc, "need-data", G_CALLBACK(bench_need_data), &src);
+
+    g_object_set(G_OBJECT(filesink), "location", filename, NULL);
+
+    GstPad *pad = gst_element_get_static_pad(filesink, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, bench_first_buffer, &src, NULL);
+    gst_object_unref(pad);
+
+    bench_reset_peak_rss();
+
+    gdouble cpu = bench_cpu_time();
+    gint64 t0 = g_get_monotonic_time();
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+    if (!(msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS)) {
+        *err_msg = g_strdup(_("Cannot start reading from the stream/pipeline.\n"));
+        if (msg) gst_message_unref(msg);
+        goto LBL_1;
+    }
+
+    gst_message_unref(msg);
+
+    // Stop. The file is complete after the NULL state.
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+
+    gint64 t1 = g_get_monotonic_time();
+
+    cpu = bench_cpu_time() - cpu;
+
+    GStatBuf st;
+    goffset size = (g_stat(filename, &st) == 0 ? st.st_size : 0);
+
+    res->realtime_factor = seconds / ((t1 - t0) / (gdouble)G_USEC_PER_SEC);
+    res->cpu_per_hour = (cpu / 1000.0) * (3600.0 / seconds);
+    res->peak_rss = bench_peak_rss();
+    res->bytes_per_sec = size / seconds;
+    res->start_ms = (src.first_buffer_time ? (src.first_buffer_time - t0) / 1000.0 : -1.0);
+    res->stop_ms = (t1 - src.eos_time) / 1000.0;
+
+    ok = TRUE;
+
+LBL_1:
+    if (pipeline) {
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+    }
+
+    if (bus) gst_object_unref(bus);
+    if (appsrc) gst_object_unref(appsrc);
+    if (filesink) gst_object_unref(filesink);
+
+    g_remove(filename);
+    g_free(filename);
+
+    return ok;
+}
+
+const gchar *bench_header() {
+    return "profile\tsignal\trate\tchannels\trealtime_factor\tcpu_s_per_audio_hour\tpeak_rss_kb\tbytes_per_s\tstart_ms\tstop_ms";
+}
+
+gchar *bench_profile(const gchar *id, const gchar *profile_str, gdouble seconds) {
+    // Run all test signals and source formats. Failed runs get "-" values.
+    GString *str = g_string_new(NULL);
+
+    guint f = 0;
+    for (f = 0; f < BENCH_N_FORMATS; f++) {
+
+        gint s = 0;
+        for (s = 0; s < BENCH_N_SIGNALS; s++) {
+            BenchResult res;
+            gchar *err_msg = NULL;
+
+            g_string_append_printf(str, "%s\t%s\t%d\t%d\t", id, g_signal_names[s], g_formats[f][0], g_formats[f][1]);
+
+            if (bench_run(profile_str, s, g_formats[f][0], g_formats[f][1], seconds, &res, &err_msg)) {
+                g_string_append_printf(str, "%.1f\t%.1f\t%ld\t%.0f\t%.1f\t%.1f\n", res.realtime_factor, res.cpu_per_hour,
+                                       res.peak_rss, res.bytes_per_sec, res.start_ms, res.stop_ms);
+            } else {
+                g_string_append(str, "-\t-\t-\t-\t-\t-\n");
+                LOG_BENCH("Benchmark of %s failed: %s", id, (err_msg ? err_msg : "\n"));
+            }
+
+            g_free(err_msg);
+        }
+    }
+
+    return g_string_free(str, FALSE);
+}
+
+static void bench_print_profile(GHashTable *done, const ProfileRec *rec, gdouble seconds) {
+    // Each profile id once
+    if (g_hash_table_contains(done, rec->id)) return;
+    g_hash_table_add(done, rec->id);
+
+    gchar *lines = bench_profile(rec->id, rec->pipe, seconds);
+    g_print("%s", lines);
+    g_free(lines);
+}
+
+void bench_profiles(gdouble seconds) {
+    // Built-in profiles first, then the user's saved profiles
+    // $ audio-recorder --benchmark=encoders
+    g_print("%s\n", bench_header());
+
+    GHashTable *done = g_hash_table_new(g_str_hash, g_str_equal);
+
+    guint i = 0;
+    const ProfileRec *rec = NULL;
+    while ((rec = profiles_get_default(i++))) {
+        bench_print_profile(done, rec, seconds);
+    }
+
+    GList *item = g_list_first(profiles_get_list());
+    while (item) {
+        bench_print_profile(done, (ProfileRec*)item->data, seconds);
+        item = g_list_next(item);
+    }
+
+    g_hash_table_destroy(done);
+}
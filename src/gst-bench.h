@@ -0,0 +1,30 @@
+#ifndef _GST_BENCH_H
+#define _GST_BENCH_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-bench.c.
+//#define DEBUG_BENCH
+
+#if defined(DEBUG_BENCH) || defined(DEBUG_ALL)
+#define LOG_BENCH LOG_MSG
+#else
+#define LOG_BENCH(x, ...)
+#endif
+
+// Seconds of test audio per run
+#define BENCH_SECONDS 30.0
+#define BENCH_DRAFT_SECONDS 10.0
+
+// Benchmark one profile with every test signal and source format.
+// Return tab-separated lines (see bench_header()). Caller should g_free() this value.
+gchar *bench_profile(const gchar *id, const gchar *profile_str, gdouble seconds);
+
+// Column names of the bench_profile() lines
+const gchar *bench_header();
+
+// Benchmark all built-in and user-saved profiles. Print the results.
+void bench_profiles(gdouble seconds);
+
+#endif
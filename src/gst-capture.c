@@ -0,0 +1,789 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+
+#include "gst-capture.h"
+#include "gst-devices.h"
+#include "rec-manager.h"
+#include "dconf.h"
+#include "log.h"
+#include "support.h"
+
+// Capture front-end with live device failover.
+//
+// Each recorded device gets an input-selector. The recording continues through the selector when devices come and go:
+//
+//  pulsesrc device=X ! queue ! selector.      <- device (or backup device)
+//  audiotestsrc wave=silence is-live=true ! capsfilter ! selector.  <- fills gaps
+//  input-selector name=selector ! (level, mixer, encoder, filesink...)
+//
+// The silence source runs only during a failover (its state is locked to NULL otherwise).
+// When the device is lost (unplugged, EOS or error from the source), the selector switches to silence,
+// the dead branch is removed and a branch for the backup device ("backup-device-id" setting, or the system's default source)
+// is added. The selector switches to it when its first buffer arrives.
+// When the device comes back, it is re-bound the same way and the backup branch is removed.
+// The encoder and filesink are never restarted.
+//
+// Failover time (device lost -> first buffer from backup) and gap duration (last buffer from lost device -> first buffer from backup)
+// are written to the log and shown in the GUI.
+
+typedef struct _CaptureSlot CaptureSlot;
+
+typedef struct {
+    CaptureSlot *slot;
+
+    // Device id. NULL: the system's default source.
+    gchar *device;
+
+    GstElement *source;
+    GstElement *queue;
+
+    // Request pad of the input-selector
+    GstPad *sel_pad;
+    gulong probe_id;
+
+    gboolean removed;
+    gboolean failed;
+
+    // Monotonic time of the last buffer
+    gint64 last_buffer;
+
+    // > 0 while we wait for the first buffer. Then the selector switches to this branch.
+    gint64 switch_start;
+} CaptureBranch;
+
+struct _CaptureSlot {
+    // Owner (not referenced)
+    GstElement *pipeline;
+
+    gchar *source_name;
+
+    // Device selected by the user
+    gchar *device;
+
+    GstElement *selector;
+
+    // Silence source
+    GstElement *silence;
+    GstElement *silence_filter;
+    GstPad *silence_pad;
+
+    // All branches (also removed ones, freed with the slot)
+    GList *branches;
+
+    // Branch we record from (or are switching to). NULL: silence.
+    CaptureBranch *active;
+
+    gboolean stopping;
+
+    // Removed from the recording (see capture_remove_source())
+    gboolean removed;
+
+    // Failover metrics
+    gint64 lost_time;
+    gint64 gap_start;
+    guint failovers;
+};
+
+typedef struct {
+    GstElement *pipeline;
+    CaptureBranch *branch;
+    gint64 time;
+} CaptureIdle;
+
+// Protects fields used by streaming threads (last_buffer, switch_start, stopping, removed, sel_pad, selector)
+G_LOCK_DEFINE_STATIC(g_capture);
+
+// The running recording pipeline
+static GstElement *g_capture_pipeline = NULL;
+
+#define CAPTURE_SLOTS_KEY "capture-slots"
+
+static CaptureBranch *capture_branch_add(CaptureSlot *slot, const gchar *device, gboolean running);
+static void capture_branch_remove(CaptureBranch *b);
+static void capture_branch_lost(CaptureBranch *b);
+static void capture_silence_stop(CaptureSlot *slot);
+
+void capture_module_init() {
+    LOG_DEBUG("Init gst-capture.c.\n");
+    g_capture_pipeline = NULL;
+}
+
+void capture_module_exit() {
+    LOG_DEBUG("Clean up gst-capture.c.\n");
+    capture_set_pipeline(NULL);
+}
+
+static void capture_branch_free(CaptureBranch *b) {
+    g_free(b->device);
+    if (b->sel_pad) {
+        gst_object_unref(b->sel_pad);
+    }
+    g_free(b);
+}
+
+static void capture_slot_free(CaptureSlot *slot) {
+    // Called when the pipeline is finalized
+    g_list_free_full(slot->branches, (GDestroyNotify)capture_branch_free);
+
+    if (slot->silence_pad) {
+        gst_object_unref(slot->silence_pad);
+    }
+
+    g_free(slot->source_name);
+    g_free(slot->device);
+    g_free(slot);
+}
+
+static GPtrArray *capture_get_slots(GstElement *pipeline, gboolean create) {
+    // Slots of the pipeline. They live as long as the pipeline.
+    if (!GST_IS_ELEMENT(pipeline)) return NULL;
+
+    GPtrArray *slots = g_object_get_data(G_OBJECT(pipeline), CAPTURE_SLOTS_KEY);
+    if (!slots && create) {
+        slots = g_ptr_array_new_with_free_func((GDestroyNotify)capture_slot_free);
+        g_object_set_data_full(G_OBJECT(pipeline), CAPTURE_SLOTS_KEY, slots, (GDestroyNotify)g_ptr_array_unref);
+    }
+    return slots;
+}
+
+void capture_set_pipeline(GstElement *pipeline) {
+    // Set the running recording pipeline
+    if (g_capture_pipeline) {
+        gst_object_unref(g_capture_pipeline);
+    }
+
+    g_capture_pipeline = (pipeline ? gst_object_ref(pipeline) : NULL);
+}
+
+void capture_prepare_stop(GstElement *pipeline) {
+    // Recording is being stopped. Let EOS pass to the encoder.
+    GPtrArray *slots = capture_get_slots(pipeline, FALSE);
+    if (!slots) return;
+
+    G_LOCK(g_capture);
+
+    guint i = 0;
+    for (i = 0; i < slots->len; i++) {
+        CaptureSlot *slot = g_ptr_array_index(slots, i);
+        slot->stopping = TRUE;
+    }
+
+    G_UNLOCK(g_capture);
+}
+
+gboolean capture_reset(GstElement *pipeline) {
+    // Prepare a stopped pipeline for a new recording.
+    // Return FALSE if a source has failed over to another device (the pipeline should be rebuilt).
+    GPtrArray *slots = capture_get_slots(pipeline, FALSE);
+    if (!slots) return TRUE;
+
+    guint i = 0;
+    for (i = 0; i < slots->len; i++) {
+        CaptureSlot *slot = g_ptr_array_index(slots, i);
+        if (slot->removed) continue;
+
+        if (!slot->active || g_strcmp0(slot->active->device, slot->device)) {
+            return FALSE;
+        }
+    }
+
+    G_LOCK(g_capture);
+
+    for (i = 0; i < slots->len; i++) {
+        CaptureSlot *slot = g_ptr_array_index(slots, i);
+        if (slot->removed) continue;
+
+        slot->stopping = FALSE;
+        slot->lost_time = 0;
+        slot->gap_start = 0;
+        slot->failovers = 0;
+
+        slot->active->last_buffer = 0;
+        slot->active->switch_start = 0;
+    }
+
+    G_UNLOCK(g_capture);
+
+    for (i = 0; i < slots->len; i++) {
+        CaptureSlot *slot = g_ptr_array_index(slots, i);
+        if (!slot->removed) {
+            capture_silence_stop(slot);
+        }
+    }
+
+    return TRUE;
+}
+
+void capture_set_caps(GstElement *pipeline, GstCaps *caps) {
+    // Source caps changed (new encoder). Set the caps of the silence sources.
+    if (!caps) return;
+
+    GPtrArray *slots = capture_get_slots(pipeline, FALSE);
+    if (!slots) return;
+
+    guint i = 0;
+    for (i = 0; i < slots->len; i++) {
+        CaptureSlot *slot = g_ptr_array_index(slots, i);
+        if (!slot->removed && slot->silence_filter) {
+            g_object_set(G_OBJECT(slot->silence_filter), "caps", caps, NULL);
+        }
+    }
+}
+
+static void capture_silence_start(CaptureSlot *slot) {
+    // Fill a gap with silence. Main thread.
+    if (!(slot->silence && gst_element_is_locked_state(slot->silence))) return;
+
+    gst_element_set_locked_state(slot->silence, FALSE);
+    gst_element_sync_state_with_parent(slot->silence);
+}
+
+static void capture_silence_stop(CaptureSlot *slot) {
+    // A device delivers data again. The silence source must not burn CPU. Main thread.
+    if (!slot->silence) return;
+
+    gst_element_set_locked_state(slot->silence, TRUE);
+    gst_element_set_state(slot->silence, GST_STATE_NULL);
+}
+
+static CaptureIdle *capture_idle_new(CaptureBranch *b, gint64 time) {
+    CaptureIdle *idle = g_malloc0(sizeof(CaptureIdle));
+    idle->pipeline = gst_object_ref(b->slot->pipeline);
+    idle->branch = b;
+    idle->time = time;
+    return idle;
+}
+
+static void capture_idle_free(CaptureIdle *idle) {
+    gst_object_unref(idle->pipeline);
+    g_free(idle);
+}
+
+static gboolean capture_lost_idle_cb(gpointer user_data) {
+    // A branch sent EOS (device stopped). Fail over.
+    CaptureIdle *idle = (CaptureIdle*)user_data;
+
+    // Recording still running?
+    if (idle->pipeline == g_capture_pipeline) {
+        capture_branch_lost(idle->branch);
+    }
+
+    // FALSE: Remove this source
+    return FALSE;
+}
+
+static gboolean capture_switched_idle_cb(gpointer user_data) {
+    // Selector switched to a new branch (backup device or re-bound device). Report and clean up.
+    CaptureIdle *idle = (CaptureIdle*)user_data;
+    CaptureBranch *b = idle->branch;
+    CaptureSlot *slot = b->slot;
+
+    if (idle->pipeline != g_capture_pipeline || b->removed || slot->active != b) {
+        // FALSE: Remove this source
+        return FALSE;
+    }
+
+    const gchar *name = (b->device ? b->device : _("System's default device"));
+
+    if (slot->lost_time) {
+        // Failover
+        gdouble failover_ms = (idle->time - slot->lost_time) / 1000.0;
+        gdouble gap_ms = (idle->time - slot->gap_start) / 1000.0;
+
+        LOG_MSG("Audio device %s was lost. Recording from %s. Failover took %.1f ms, gap (silence) was %.1f ms.\n",
+                slot->device, name, failover_ms, gap_ms);
+
+        gchar *msg = g_strdup_printf(_("Audio device was lost. Recording continues from %s (gap %.1f s)."), name, gap_ms / 1000.0);
+        rec_manager_send_gui_msg(msg);
+        g_free(msg);
+
+        slot->lost_time = 0;
+
+    } else {
+        LOG_MSG("Audio device %s is back. Re-bound in %.1f ms.\n", name, (idle->time - b->switch_start) / 1000.0);
+        rec_manager_send_gui_msg(NULL);
+    }
+
+    // Remove the other (backup) branches
+    GList *item = g_list_first(slot->branches);
+    while (item) {
+        CaptureBranch *other = (CaptureBranch*)item->data;
+        if (other != b) {
+            capture_branch_remove(other);
+        }
+        item = g_list_next(item);
+    }
+
+    capture_silence_stop(slot);
+
+    // FALSE: Remove this source
+    return FALSE;
+}
+
+static GstPadProbeReturn capture_branch_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    // Watch buffers and events from a device branch. Runs in the streaming thread.
+    CaptureBranch *b = (CaptureBranch*)user_data;
+    CaptureSlot *slot = b->slot;
+
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+        gint64 now = g_get_monotonic_time();
+
+        G_LOCK(g_capture);
+
+        b->last_buffer = now;
+
+        gboolean do_switch = (b->switch_start > 0 && !b->removed && b->sel_pad && slot->selector);
+        b->switch_start = 0;
+
+        // The main thread may remove the branch (and release the pad) now. Keep them alive.
+        GstElement *selector = (do_switch ? gst_object_ref(slot->selector) : NULL);
+        GstPad *sel_pad = (do_switch ? gst_object_ref(b->sel_pad) : NULL);
+
+        G_UNLOCK(g_capture);
+
+        if (do_switch) {
+            // First buffer from the new input. Record from it.
+            g_object_set(G_OBJECT(selector), "active-pad", sel_pad, NULL);
+
+            gst_object_unref(sel_pad);
+            gst_object_unref(selector);
+
+            g_idle_add_full(G_PRIORITY_DEFAULT, capture_switched_idle_cb, capture_idle_new(b, now), (GDestroyNotify)capture_idle_free);
+        }
+
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_EOS) {
+
+        G_LOCK(g_capture);
+        gboolean stopping = slot->stopping;
+        G_UNLOCK(g_capture);
+
+        if (!stopping) {
+            // The device stopped. Do not let this EOS finish the recording.
+            LOG_CAPTURE("Got EOS from device %s. Failing over.\n", b->device);
+
+            g_idle_add_full(G_PRIORITY_DEFAULT, capture_lost_idle_cb, capture_idle_new(b, g_get_monotonic_time()), (GDestroyNotify)capture_idle_free);
+            return GST_PAD_PROBE_DROP;
+        }
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+static CaptureBranch *capture_branch_add(CaptureSlot *slot, const gchar *device, gboolean running) {
+    // Add source ! queue for the device and link it to the selector.
+    // If running is TRUE, start the branch and switch to it on its first buffer.
+    GstElement *source = gst_element_factory_make(slot->source_name, NULL);
+    GstElement *queue = gst_element_factory_make("queue", NULL);
+
+    if (!(GST_IS_ELEMENT(source) && GST_IS_ELEMENT(queue))) {
+        LOG_ERROR("Cannot create element \"%s\" or \"queue\".\n", slot->source_name);
+        if (source) gst_object_unref(source);
+        if (queue) gst_object_unref(queue);
+        return NULL;
+    }
+
+    if (device) {
+        g_object_set(G_OBJECT(source), "device", device, NULL);
+    }
+
+    CaptureBranch *b = g_malloc0(sizeof(CaptureBranch));
+    b->slot = slot;
+    b->device = g_strdup(device);
+    b->source = source;
+    b->queue = queue;
+
+    gst_bin_add_many(GST_BIN(slot->pipeline), source, queue, NULL);
+    gst_element_link(source, queue);
+
+    b->sel_pad = gst_element_get_request_pad(slot->selector, "sink_%u");
+
+    GstPad *src_pad = gst_element_get_static_pad(queue, "src");
+    gst_pad_link(src_pad, b->sel_pad);
+
+    b->probe_id = gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                                    capture_branch_probe, b, NULL);
+    gst_object_unref(src_pad);
+
+    slot->branches = g_list_append(slot->branches, b);
+
+    if (running) {
+        G_LOCK(g_capture);
+        b->switch_start = g_get_monotonic_time();
+        G_UNLOCK(g_capture);
+
+        gst_element_sync_state_with_parent(queue);
+        gst_element_sync_state_with_parent(source);
+    }
+
+    LOG_CAPTURE("Added capture branch for %s.\n", (device ? device : "default device"));
+
+    return b;
+}
+
+static void capture_branch_remove(CaptureBranch *b) {
+    // Stop the branch and remove it from the pipeline
+    if (b->removed) return;
+
+    // The probe checks this before it touches the pad
+    G_LOCK(g_capture);
+    b->removed = TRUE;
+    GstPad *sel_pad = b->sel_pad;
+    b->sel_pad = NULL;
+    G_UNLOCK(g_capture);
+
+    LOG_CAPTURE("Remove capture branch for %s.\n", (b->device ? b->device : "default device"));
+
+    CaptureSlot *slot = b->slot;
+
+    GstPad *src_pad = gst_element_get_static_pad(b->queue, "src");
+    gst_pad_remove_probe(src_pad, b->probe_id);
+
+    // The selector does not wait for inactive pads (sync-streams=FALSE), so the streaming threads stop promptly
+    gst_element_set_state(b->source, GST_STATE_NULL);
+    gst_element_set_state(b->queue, GST_STATE_NULL);
+
+    gst_pad_unlink(src_pad, sel_pad);
+    gst_object_unref(src_pad);
+
+    gst_element_release_request_pad(slot->selector, sel_pad);
+    gst_object_unref(sel_pad);
+
+    gst_bin_remove_many(GST_BIN(slot->pipeline), b->source, b->queue, NULL);
+    b->source = NULL;
+    b->queue = NULL;
+
+    if (slot->active == b) {
+        slot->active = NULL;
+    }
+}
+
+static gchar *capture_get_backup_device(const gchar *lost_device) {
+    // Return backup device id, or NULL for the system's default source.
+    // Caller should g_free() this value.
+    gchar *dev_id = NULL;
+    conf_get_string_value("backup-device-id", &dev_id);
+
+    if (!(dev_id && *dev_id) || !g_strcmp0(dev_id, lost_device) || !gstdev_device_exists(dev_id)) {
+        g_free(dev_id);
+        return NULL;
+    }
+
+    return dev_id;
+}
+
+static void capture_branch_lost(CaptureBranch *b) {
+    // Device of the branch is gone. Record silence and fail over to a backup device.
+    if (b->removed || b->failed) return;
+    b->failed = TRUE;
+
+    CaptureSlot *slot = b->slot;
+    gboolean was_active = (slot->active == b);
+
+    G_LOCK(g_capture);
+    gint64 last_buffer = b->last_buffer;
+    G_UNLOCK(g_capture);
+
+    if (was_active) {
+        // Fill the gap with silence
+        capture_silence_start(slot);
+        g_object_set(G_OBJECT(slot->selector), "active-pad", slot->silence_pad, NULL);
+
+        if (!slot->lost_time) {
+            slot->lost_time = g_get_monotonic_time();
+            slot->gap_start = (last_buffer ? last_buffer : slot->lost_time);
+        }
+        slot->failovers++;
+
+        LOG_MSG("Audio device %s was lost. Recording silence.\n", (b->device ? b->device : "default device"));
+    }
+
+    capture_branch_remove(b);
+
+    if (!was_active) return;
+
+    if (!b->device) {
+        // The default source failed too. Continue with silence until a device comes back.
+        return;
+    }
+
+    // Fail over to the backup device (or default source)
+    gchar *backup = capture_get_backup_device(b->device);
+    slot->active = capture_branch_add(slot, backup, TRUE);
+    g_free(backup);
+}
+
+GstElement *capture_create_source(GstElement *pipeline, const gchar *source_name, const gchar *device, GstCaps *caps) {
+    // Create audio source for the device.
+    // Return the element that should be linked downstream.
+    // caps: caps that the pipeline negotiates with the source (or NULL).
+
+    gboolean failover = TRUE;
+    conf_get_boolean_value("device-failover", &failover);
+
+    GstElement *selector = NULL;
+    if (device && failover) {
+        selector = gst_element_factory_make("input-selector", NULL);
+    }
+
+    if (!GST_IS_ELEMENT(selector)) {
+        // Plain source (no failover for the default device)
+        GstElement *source = gst_element_factory_make(source_name, NULL);
+        if (!GST_IS_ELEMENT(source)) {
+            LOG_ERROR("Cannot create element \"%s\".\n", source_name);
+            return NULL;
+        }
+
+        if (device) {
+            g_object_set(G_OBJECT(source), "device", device, NULL);
+        }
+
+        gst_bin_add(GST_BIN(pipeline), source);
+        return source;
+    }
+
+    // Inactive pads drop their data. Do not wait for them.
+    g_object_set(G_OBJECT(selector), "sync-streams", FALSE, NULL);
+
+    gst_bin_add(GST_BIN(pipeline), selector);
+
+    CaptureSlot *slot = g_malloc0(sizeof(CaptureSlot));
+    slot->pipeline = pipeline;
+    slot->source_name = g_strdup(source_name);
+    slot->device = g_strdup(device);
+    slot->selector = selector;
+
+    g_ptr_array_add(capture_get_slots(pipeline, TRUE), slot);
+
+    // Silence source. Use the source caps (or the device's own rate and channels) so switching needs no renegotiation downstream.
+    GstDevCaps dev_caps;
+    gint rate = 44100;
+    gint channels = 2;
+    if (gstdev_get_capabilities(device, &dev_caps)) {
+        if (dev_caps.rate_max > 0) rate = CLAMP(48000, dev_caps.rate_min, dev_caps.rate_max);
+        if (dev_caps.channels_max > 0) channels = CLAMP(2, dev_caps.channels_min, dev_caps.channels_max);
+    }
+
+    GstElement *silence = gst_element_factory_make("audiotestsrc", NULL);
+    GstElement *filter = gst_element_factory_make("capsfilter", NULL);
+
+    if (GST_IS_ELEMENT(silence) && GST_IS_ELEMENT(filter)) {
+        // wave=4: silence. It is started mid-recording, so it takes the timestamps from the clock.
+        g_object_set(G_OBJECT(silence), "is-live", TRUE, "do-timestamp", TRUE, "wave", 4, NULL);
+
+        // Runs during a failover only (see capture_silence_start())
+        gst_element_set_locked_state(silence, TRUE);
+
+        GstCaps *silence_caps = NULL;
+        if (caps) {
+            silence_caps = gst_caps_ref(caps);
+        } else {
+            silence_caps = gst_caps_new_simple("audio/x-raw", "rate", G_TYPE_INT, rate, "channels", G_TYPE_INT, channels, NULL);
+        }
+
+        g_object_set(G_OBJECT(filter), "caps", silence_caps, NULL);
+        gst_caps_unref(silence_caps);
+
+        gst_bin_add_many(GST_BIN(pipeline), silence, filter, NULL);
+        gst_element_link(silence, filter);
+
+        slot->silence = silence;
+        slot->silence_filter = filter;
+
+        slot->silence_pad = gst_element_get_request_pad(selector, "sink_%u");
+
+        GstPad *src_pad = gst_element_get_static_pad(filter, "src");
+        gst_pad_link(src_pad, slot->silence_pad);
+        gst_object_unref(src_pad);
+    }
+
+    // The device itself
+    slot->active = capture_branch_add(slot, device, FALSE);
+
+    if (slot->active) {
+        g_object_set(G_OBJECT(selector), "active-pad", slot->active->sel_pad, NULL);
+    }
+
+    return selector;
+}
+
+static CaptureBranch *capture_find_branch(GstObject *obj) {
+    // Find branch that owns the element obj
+    GPtrArray *slots = capture_get_slots(g_capture_pipeline, FALSE);
+    if (!(slots && obj)) return NULL;
+
+    guint i = 0;
+    for (i = 0; i < slots->len; i++) {
+        CaptureSlot *slot = g_ptr_array_index(slots, i);
+
+        GList *item = g_list_first(slot->branches);
+        while (item) {
+            CaptureBranch *b = (CaptureBranch*)item->data;
+            if (!b->removed && (obj == GST_OBJECT(b->source) || obj == GST_OBJECT(b->queue))) {
+                return b;
+            }
+            item = g_list_next(item);
+        }
+    }
+
+    return NULL;
+}
+
+gboolean capture_handle_error(GstMessage *msg) {
+    // Error from a capture source? Fail over.
+    CaptureBranch *b = capture_find_branch(GST_MESSAGE_SRC(msg));
+    if (!b) return FALSE;
+
+    capture_branch_lost(b);
+    return TRUE;
+}
+
+void capture_device_changed(const gchar *dev_id, gboolean added) {
+    // Device was added or removed. Fail over or re-bind.
+    GPtrArray *slots = capture_get_slots(g_capture_pipeline, FALSE);
+    if (!(slots && dev_id)) return;
+
+    guint i = 0;
+    for (i = 0; i < slots->len; i++) {
+        CaptureSlot *slot = g_ptr_array_index(slots, i);
+
+        if (slot->stopping) continue;
+
+        if (!added) {
+            // Lost device
+            GList *item = g_list_first(slot->branches);
+            while (item) {
+                CaptureBranch *b = (CaptureBranch*)item->data;
+                if (!b->removed && !g_strcmp0(b->device, dev_id)) {
+                    capture_branch_lost(b);
+                }
+                item = g_list_next(item);
+            }
+
+        } else if (!g_strcmp0(slot->device, dev_id) && !(slot->active && !g_strcmp0(slot->active->device, dev_id))) {
+            // The user's device is back. Re-bind it. The backup is removed when the device delivers data.
+            LOG_MSG("Audio device %s is back. Re-binding.\n", dev_id);
+            slot->active = capture_branch_add(slot, dev_id, TRUE);
+        }
+    }
+}
+
+gboolean capture_handles_device(const gchar *dev_id) {
+    // Does the running recording have a failover slot for dev_id?
+    GPtrArray *slots = capture_get_slots(g_capture_pipeline, FALSE);
+    if (!(slots && dev_id)) return FALSE;
+
+    guint i = 0;
+    for (i = 0; i < slots->len; i++) {
+        CaptureSlot *slot = g_ptr_array_index(slots, i);
+        if (!slot->removed && !g_strcmp0(slot->device, dev_id)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static CaptureSlot *capture_find_slot(GstElement *pipeline, GstElement *head) {
+    // Find slot by its input-selector
+    GPtrArray *slots = capture_get_slots(pipeline, FALSE);
+    if (!slots) return NULL;
+
+    guint i = 0;
+    for (i = 0; i < slots->len; i++) {
+        CaptureSlot *slot = g_ptr_array_index(slots, i);
+        if (!slot->removed && slot->selector == head) {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+void capture_start_source(GstElement *pipeline, GstElement *head) {
+    // Start a source that was added to a running pipeline. Downstream elements first.
+    CaptureSlot *slot = capture_find_slot(pipeline, head);
+    if (!slot) {
+        gst_element_sync_state_with_parent(head);
+        return;
+    }
+
+    gst_element_sync_state_with_parent(slot->selector);
+
+    if (slot->silence) {
+        gst_element_sync_state_with_parent(slot->silence_filter);
+
+        // Silence source is started by a failover only
+        if (!gst_element_is_locked_state(slot->silence)) {
+            gst_element_sync_state_with_parent(slot->silence);
+        }
+    }
+
+    GList *item = g_list_first(slot->branches);
+    while (item) {
+        CaptureBranch *b = (CaptureBranch*)item->data;
+        if (!b->removed) {
+            gst_element_sync_state_with_parent(b->queue);
+            gst_element_sync_state_with_parent(b->source);
+        }
+        item = g_list_next(item);
+    }
+}
+
+void capture_remove_source(GstElement *pipeline, GstElement *head) {
+    // Stop the source (head and everything behind it) and remove it from the pipeline.
+    // Caller unlinks head from downstream.
+    CaptureSlot *slot = capture_find_slot(pipeline, head);
+    if (!slot) {
+        gst_element_set_state(head, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(pipeline), head);
+        return;
+    }
+
+    // No failover for this device any more
+    G_LOCK(g_capture);
+    slot->stopping = TRUE;
+    slot->removed = TRUE;
+    G_UNLOCK(g_capture);
+
+    GList *item = g_list_first(slot->branches);
+    while (item) {
+        capture_branch_remove((CaptureBranch*)item->data);
+        item = g_list_next(item);
+    }
+
+    if (slot->silence) {
+        gst_element_set_state(slot->silence, GST_STATE_NULL);
+        gst_element_set_state(slot->silence_filter, GST_STATE_NULL);
+        gst_bin_remove_many(GST_BIN(pipeline), slot->silence, slot->silence_filter, NULL);
+        slot->silence = NULL;
+        slot->silence_filter = NULL;
+    }
+
+    G_LOCK(g_capture);
+    GstElement *selector = slot->selector;
+    slot->selector = NULL;
+    G_UNLOCK(g_capture);
+
+    gst_element_set_state(selector, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(pipeline), selector);
+}
@@ -0,0 +1,51 @@
+#ifndef _GST_CAPTURE_H
+#define _GST_CAPTURE_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-capture.c.
+//#define DEBUG_CAPTURE
+
+#if defined(DEBUG_CAPTURE) || defined(DEBUG_ALL)
+#define LOG_CAPTURE LOG_MSG
+#else
+#define LOG_CAPTURE(x, ...)
+#endif
+
+void capture_module_init();
+void capture_module_exit();
+
+// Create audio source for the device and add it to the pipeline.
+// Return the element that should be linked downstream (an input-selector, or the plain source element).
+// caps: fixed caps that the pipeline negotiates with the source, or NULL.
+GstElement *capture_create_source(GstElement *pipeline, const gchar *source_name, const gchar *device, GstCaps *caps);
+
+// Start a source that was added to a running pipeline
+void capture_start_source(GstElement *pipeline, GstElement *head);
+
+// Stop the source (returned by capture_create_source) and remove it from the pipeline
+void capture_remove_source(GstElement *pipeline, GstElement *head);
+
+// Prepare a stopped pipeline for a new recording. FALSE: a source has failed over, rebuild the pipeline.
+gboolean capture_reset(GstElement *pipeline);
+
+// Set caps of the silence sources (after the encoder has changed)
+void capture_set_caps(GstElement *pipeline, GstCaps *caps);
+
+// Set the running recording pipeline (or NULL). Device failover applies to this pipeline.
+void capture_set_pipeline(GstElement *pipeline);
+
+// Let EOS from the sources pass (the recording is being stopped)
+void capture_prepare_stop(GstElement *pipeline);
+
+// Handle error message from a capture source. Return TRUE if the error was handled (failover started).
+gboolean capture_handle_error(GstMessage *msg);
+
+// Device was added or removed (called by gst-devices.c)
+void capture_device_changed(const gchar *dev_id, gboolean added);
+
+// Does the running recording fail over if dev_id is removed?
+gboolean capture_handles_device(const gchar *dev_id);
+
+#endif
@@ -0,0 +1,882 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+
+#include <glib/gstdio.h>
+
+#include "gst-checksum.h"
+#include "log.h"
+#include "dconf.h"
+#include "utility.h"
+#include "support.h"
+
+// Streaming checksums of the recordings ("checksum" setting: off, xxh64 or sha256).
+//
+// Hashing a finished file reads it again from the disk. Instead, the data is hashed on its way to the file sink
+// (a probe on the sink pad). Muxers seek back at the end to rewrite their headers (WAV, FLAC, Xing), so a plain
+// digest of the file could only be computed by reading it all again. The file is therefore hashed in
+// CHECKSUM_BLOCK_SIZE blocks:
+//      digest = H(H(block 0) || H(block 1) || ... || H(block n-1))
+// H is SHA-256 or XXH64 (canonical big-endian bytes); the last block can be shorter. A block is hashed when
+// its data has gone to the sink. A block that is written again later (usually block 0, the header) is read back
+// from the file when the recording stops. Only those blocks are read.
+// When the sink appends to an existing file (raw append, eg. MP3), the old blocks are read back at the end, and the
+// hashing continues from the old size (the tail of the old data is read once at the start).
+//
+// The sidecar "<recording>.checksum" has the digest and the block digests, so a damaged block can be found:
+//      # audio-recorder checksum
+//      file 2017-01-20-10:00:00.flac
+//      algorithm sha256
+//      block-size 4194304
+//      size 10485760
+//      digest 3b2c...
+//      block 0 8f1e...
+// Segments of a session (see rec_start_cheaper_segment()) are listed in "<first file>.manifest":
+// "digest<TAB>size<TAB>file name" per line.
+// $ audio-recorder --verify=<file> computes the digest again and compares it with the sidecar.
+
+typedef enum {CHECKSUM_OFF, CHECKSUM_XXH64, CHECKSUM_SHA256} ChecksumAlgo;
+
+// Max. digest length (SHA-256)
+#define CHECKSUM_DIGEST_MAX 32
+
+typedef struct {
+    guint64 total;
+    guint64 v[4];
+    guint8 mem[32];
+    guint mem_len;
+} Xxh64;
+
+typedef struct {
+    ChecksumAlgo algo;
+    GChecksum *sha;
+    Xxh64 xxh;
+} Hasher;
+
+typedef struct {
+    ChecksumAlgo algo;
+    gchar *filename;
+
+    GstPad *pad;
+    gulong probe_id;
+
+    // File offset of the next buffer. Bytes [0, hashed) have been hashed in order.
+    guint64 position;
+    guint64 hashed;
+
+    // A gap in the file; blocks from the gap on are read back
+    gboolean in_order;
+
+    // The sink appends (O_APPEND). Every write goes to the end, whatever the byte segments say.
+    gboolean append;
+
+    // Current block, and the digests of the complete blocks. Dirty blocks were written again after hashing.
+    Hasher block;
+    gboolean block_dirty;
+    GByteArray *digests;
+    GByteArray *dirty;
+} ChecksumState;
+
+// State of a recording, on its pipeline. The old segment of a switch is hashed until its EOS (see rec_switch_segment()).
+#define CHECKSUM_STATE_KEY "checksum-state"
+
+// Session manifest and its lines
+static gchar *g_manifest = NULL;
+static GPtrArray *g_session = NULL;
+
+// ---------------------------------------------------------------------
+// XXH64
+// ---------------------------------------------------------------------
+
+#define XXH_PRIME64_1 G_GUINT64_CONSTANT(0x9E3779B185EBCA87)
+#define XXH_PRIME64_2 G_GUINT64_CONSTANT(0xC2B2AE3D27D4EB4F)
+#define XXH_PRIME64_3 G_GUINT64_CONSTANT(0x165667B19E3779F9)
+#define XXH_PRIME64_4 G_GUINT64_CONSTANT(0x85EBCA77C2B2AE63)
+#define XXH_PRIME64_5 G_GUINT64_CONSTANT(0x27D4EB2F165667C5)
+
+static inline guint64 xxh64_rotl(guint64 x, gint r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline guint64 xxh64_round(guint64 acc, guint64 input) {
+    acc += input * XXH_PRIME64_2;
+    acc = xxh64_rotl(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline guint64 xxh64_merge(guint64 acc, guint64 val) {
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static void xxh64_init(Xxh64 *x) {
+    // Seed 0
+    memset(x, 0, sizeof(Xxh64));
+    x->v[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+    x->v[1] = XXH_PRIME64_2;
+    x->v[2] = 0;
+    x->v[3] = -XXH_PRIME64_1;
+}
+
+static inline void xxh64_stripe(Xxh64 *x, const guint8 *p) {
+    x->v[0] = xxh64_round(x->v[0], GST_READ_UINT64_LE(p));
+    x->v[1] = xxh64_round(x->v[1], GST_READ_UINT64_LE(p + 8));
+    x->v[2] = xxh64_round(x->v[2], GST_READ_UINT64_LE(p + 16));
+    x->v[3] = xxh64_round(x->v[3], GST_READ_UINT64_LE(p + 24));
+}
+
+static void xxh64_update(Xxh64 *x, const guint8 *p, gsize len) {
+    x->total += len;
+
+    if (x->mem_len + len < 32) {
+        memcpy(x->mem + x->mem_len, p, len);
+        x->mem_len += len;
+        return;
+    }
+
+    if (x->mem_len) {
+        gsize n = 32 - x->mem_len;
+        memcpy(x->mem + x->mem_len, p, n);
+        xxh64_stripe(x, x->mem);
+
+        p += n;
+        len -= n;
+        x->mem_len = 0;
+    }
+
+    while (len >= 32) {
+        xxh64_stripe(x, p);
+        p += 32;
+        len -= 32;
+    }
+
+    memcpy(x->mem, p, len);
+    x->mem_len = len;
+}
+
+static guint64 xxh64_digest(const Xxh64 *x) {
+    guint64 h = 0;
+
+    if (x->total >= 32) {
+        h = xxh64_rotl(x->v[0], 1) + xxh64_rotl(x->v[1], 7) + xxh64_rotl(x->v[2], 12) + xxh64_rotl(x->v[3], 18);
+        h = xxh64_merge(h, x->v[0]);
+        h = xxh64_merge(h, x->v[1]);
+        h = xxh64_merge(h, x->v[2]);
+        h = xxh64_merge(h, x->v[3]);
+    } else {
+        h = x->v[2] + XXH_PRIME64_5;
+    }
+
+    h += x->total;
+
+    const guint8 *p = x->mem;
+    gsize len = x->mem_len;
+
+    while (len >= 8) {
+        h ^= xxh64_round(0, GST_READ_UINT64_LE(p));
+        h = xxh64_rotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+        len -= 8;
+    }
+
+    if (len >= 4) {
+        h ^= (guint64)GST_READ_UINT32_LE(p) * XXH_PRIME64_1;
+        h = xxh64_rotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+        len -= 4;
+    }
+
+    while (len > 0) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h = xxh64_rotl(h, 11) * XXH_PRIME64_1;
+        p++;
+        len--;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+// ---------------------------------------------------------------------
+// Hasher
+// ---------------------------------------------------------------------
+
+static const gchar *checksum_algo_name(ChecksumAlgo algo) {
+    return (algo == CHECKSUM_SHA256 ? "sha256" : "xxh64");
+}
+
+static ChecksumAlgo checksum_algo_from_name(const gchar *name) {
+    if (!g_strcmp0(name, "sha256")) return CHECKSUM_SHA256;
+    if (!g_strcmp0(name, "xxh64")) return CHECKSUM_XXH64;
+    return CHECKSUM_OFF;
+}
+
+static gsize hasher_len(ChecksumAlgo algo) {
+    return (algo == CHECKSUM_SHA256 ? 32 : 8);
+}
+
+static void hasher_init(Hasher *h, ChecksumAlgo algo) {
+    h->algo = algo;
+    h->sha = NULL;
+
+    if (algo == CHECKSUM_SHA256) {
+        h->sha = g_checksum_new(G_CHECKSUM_SHA256);
+    } else {
+        xxh64_init(&h->xxh);
+    }
+}
+
+static void hasher_update(Hasher *h, const guint8 *data, gsize len) {
+    if (h->sha) {
+        g_checksum_update(h->sha, data, len);
+    } else {
+        xxh64_update(&h->xxh, data, len);
+    }
+}
+
+static gsize hasher_finish(Hasher *h, guint8 *out) {
+    // Write the digest to out and free the hasher. Return the digest length.
+    gsize len = hasher_len(h->algo);
+
+    if (h->sha) {
+        g_checksum_get_digest(h->sha, out, &len);
+        g_checksum_free(h->sha);
+        h->sha = NULL;
+    } else {
+        GST_WRITE_UINT64_BE(out, xxh64_digest(&h->xxh));
+    }
+
+    return len;
+}
+
+static gchar *checksum_hex(const guint8 *digest, gsize len) {
+    // Caller should g_free() this value
+    gchar *hex = g_malloc(len * 2 + 1);
+
+    gsize i = 0;
+    for (i = 0; i < len; i++) {
+        g_snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+
+    return hex;
+}
+
+static gboolean checksum_read(gint fd, guint8 *buf, gsize len, guint64 offset) {
+    gsize done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return FALSE;
+        done += n;
+    }
+    return TRUE;
+}
+
+static gboolean checksum_hash_block(gint fd, ChecksumAlgo algo, guint64 block, guint64 size, guint8 *buf, guint8 *out) {
+    // Read a block from the file and hash it
+    guint64 offset = block * CHECKSUM_BLOCK_SIZE;
+    gsize len = (gsize)MIN((guint64)CHECKSUM_BLOCK_SIZE, size - offset);
+
+    if (!checksum_read(fd, buf, len, offset)) return FALSE;
+
+    Hasher h;
+    hasher_init(&h, algo);
+    hasher_update(&h, buf, len);
+    hasher_finish(&h, out);
+
+    return TRUE;
+}
+
+static gchar *checksum_sidecar_name(const gchar *filename) {
+    // Caller should g_free() this value
+    return g_strdup_printf("%s.%s", filename, CHECKSUM_EXT);
+}
+
+// ---------------------------------------------------------------------
+// Streaming
+// ---------------------------------------------------------------------
+
+static void checksum_feed(ChecksumState *st, const guint8 *data, gsize len) {
+    // Bytes at the end of the hashed data
+    while (len > 0) {
+        gsize n = (gsize)MIN((guint64)len, CHECKSUM_BLOCK_SIZE - st->hashed % CHECKSUM_BLOCK_SIZE);
+
+        hasher_update(&st->block, data, n);
+        st->hashed += n;
+        data += n;
+        len -= n;
+
+        if (st->hashed % CHECKSUM_BLOCK_SIZE == 0) {
+            // Block is complete
+            guint8 digest[CHECKSUM_DIGEST_MAX];
+            gsize dlen = hasher_finish(&st->block, digest);
+
+            guint8 dirty = (guint8)st->block_dirty;
+            g_byte_array_append(st->digests, digest, dlen);
+            g_byte_array_append(st->dirty, &dirty, 1);
+
+            hasher_init(&st->block, st->algo);
+            st->block_dirty = FALSE;
+        }
+    }
+}
+
+static void checksum_mark_dirty(ChecksumState *st, guint64 from, guint64 to) {
+    // Bytes [from, to) were hashed and have been written again
+    if (from >= to) return;
+
+    guint64 b = 0;
+    for (b = from / CHECKSUM_BLOCK_SIZE; b <= (to - 1) / CHECKSUM_BLOCK_SIZE; b++) {
+        if (b < st->dirty->len) {
+            st->dirty->data[b] = 1;
+        } else {
+            st->block_dirty = TRUE;
+        }
+    }
+}
+
+static void checksum_write(ChecksumState *st, const guint8 *data, gsize len) {
+    // Data goes to the file at st->position
+    guint64 pos = st->position;
+    guint64 end = pos + len;
+
+    st->position = end;
+
+    if (!st->in_order) return;
+
+    if (pos > st->hashed) {
+        // Gap (a seek forward). The rest is read back.
+        st->in_order = FALSE;
+        return;
+    }
+
+    // Header rewrite, or a write that overlaps the hashed data
+    checksum_mark_dirty(st, pos, MIN(end, st->hashed));
+
+    if (end > st->hashed) {
+        gsize skip = (gsize)(st->hashed - pos);
+        checksum_feed(st, data + skip, len - skip);
+    }
+}
+
+static GstPadProbeReturn checksum_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    // Data on its way to the file. Runs in the streaming thread of the sink.
+    ChecksumState *st = (ChecksumState*)user_data;
+
+    if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+        // Muxers seek back to rewrite their headers
+        if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT && !st->append) {
+            const GstSegment *segment = NULL;
+            gst_event_parse_segment(event, &segment);
+
+            if (segment->format == GST_FORMAT_BYTES) {
+                st->position = segment->start;
+            }
+        }
+
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!buf) return GST_PAD_PROBE_OK;
+
+    GstMapInfo map;
+    if (gst_buffer_map(buf, &map, GST_MAP_READ)) {
+        checksum_write(st, map.data, map.size);
+        gst_buffer_unmap(buf, &map);
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void checksum_skip_old_data(ChecksumState *st) {
+    // The file has data from an earlier recording. Its complete blocks are read back at the end;
+    // the last, partial block is hashed now so the new data continues it.
+    gint fd = g_open(st->filename, O_RDONLY, 0);
+    if (fd < 0) return;
+
+    guint64 size = lseek(fd, 0, SEEK_END);
+    guint64 n_blocks = size / CHECKSUM_BLOCK_SIZE;
+    gsize dlen = hasher_len(st->algo);
+
+    guint8 digest[CHECKSUM_DIGEST_MAX];
+    memset(digest, 0, sizeof(digest));
+    guint8 dirty = 1;
+
+    guint64 b = 0;
+    for (b = 0; b < n_blocks; b++) {
+        g_byte_array_append(st->digests, digest, dlen);
+        g_byte_array_append(st->dirty, &dirty, 1);
+    }
+
+    st->hashed = n_blocks * CHECKSUM_BLOCK_SIZE;
+
+    gsize tail = (gsize)(size - st->hashed);
+    if (tail) {
+        guint8 *buf = g_malloc(tail);
+
+        if (checksum_read(fd, buf, tail, st->hashed)) {
+            checksum_feed(st, buf, tail);
+        } else {
+            // Read it all back at the end
+            st->in_order = FALSE;
+        }
+
+        g_free(buf);
+    }
+
+    st->position = size;
+    close(fd);
+}
+
+static ChecksumState *checksum_state_new(GstElement *pipeline, const gchar *filename, ChecksumAlgo algo, gboolean append) {
+    // Hash the data that goes to the "filesink" element of pipeline
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "filesink");
+    if (!sink) return NULL;
+
+    GstPad *pad = gst_element_get_static_pad(sink, "sink");
+    gst_object_unref(sink);
+
+    if (!pad) return NULL;
+
+    ChecksumState *st = g_malloc0(sizeof(ChecksumState));
+    st->algo = algo;
+    st->filename = g_strdup(filename);
+    st->pad = pad;
+    st->in_order = TRUE;
+    st->append = append;
+    st->digests = g_byte_array_new();
+    st->dirty = g_byte_array_new();
+
+    hasher_init(&st->block, algo);
+
+    if (append) {
+        checksum_skip_old_data(st);
+    }
+
+    st->probe_id = gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                                     checksum_probe, st, NULL);
+
+    return st;
+}
+
+static void checksum_state_free(ChecksumState *st) {
+    if (st->pad) {
+        gst_pad_remove_probe(st->pad, st->probe_id);
+        gst_object_unref(st->pad);
+    }
+
+    guint8 digest[CHECKSUM_DIGEST_MAX];
+    hasher_finish(&st->block, digest);
+
+    g_byte_array_free(st->digests, TRUE);
+    g_byte_array_free(st->dirty, TRUE);
+    g_free(st->filename);
+    g_free(st);
+}
+
+static GByteArray *checksum_finish(ChecksumState *st, guint64 *size, guint64 *reread) {
+    // Block digests of the closed file. Blocks that were not hashed in order are read back.
+    gint fd = g_open(st->filename, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+
+    *size = lseek(fd, 0, SEEK_END);
+    *reread = 0;
+
+    gsize dlen = hasher_len(st->algo);
+    guint64 n_blocks = (*size + CHECKSUM_BLOCK_SIZE - 1) / CHECKSUM_BLOCK_SIZE;
+
+    GByteArray *digests = g_byte_array_sized_new(n_blocks * dlen);
+    guint8 *buf = NULL;
+    gboolean ok = TRUE;
+
+    guint64 b = 0;
+    for (b = 0; ok && b < n_blocks; b++) {
+        guint64 block_end = MIN((b + 1) * CHECKSUM_BLOCK_SIZE, *size);
+        guint8 digest[CHECKSUM_DIGEST_MAX];
+
+        if (b < st->dirty->len && !st->dirty->data[b] && block_end == (b + 1) * CHECKSUM_BLOCK_SIZE) {
+            // Hashed while recording
+            memcpy(digest, st->digests->data + b * dlen, dlen);
+
+        } else if (b == st->dirty->len && !st->block_dirty && st->in_order && st->hashed == *size) {
+            // The last, short block
+            hasher_finish(&st->block, digest);
+            hasher_init(&st->block, st->algo);
+
+        } else {
+            if (!buf) buf = g_malloc(CHECKSUM_BLOCK_SIZE);
+
+            ok = checksum_hash_block(fd, st->algo, b, *size, buf, digest);
+            *reread += block_end - b * CHECKSUM_BLOCK_SIZE;
+        }
+
+        g_byte_array_append(digests, digest, dlen);
+    }
+
+    g_free(buf);
+    close(fd);
+
+    if (!ok) {
+        g_byte_array_free(digests, TRUE);
+        return NULL;
+    }
+
+    return digests;
+}
+
+static gchar *checksum_top_digest(ChecksumAlgo algo, GByteArray *digests) {
+    // Digest of the block digests. Caller should g_free() this value.
+    Hasher h;
+    hasher_init(&h, algo);
+    hasher_update(&h, digests->data, digests->len);
+
+    guint8 digest[CHECKSUM_DIGEST_MAX];
+    gsize len = hasher_finish(&h, digest);
+
+    return checksum_hex(digest, len);
+}
+
+static gboolean checksum_write_sidecar(const gchar *filename, ChecksumAlgo algo, guint64 size, GByteArray *digests, const gchar *top) {
+    GString *str = g_string_new("# audio-recorder checksum\n");
+
+    gchar *base = g_path_get_basename(filename);
+    g_string_append_printf(str, "file %s\nalgorithm %s\nblock-size %d\nsize %" G_GUINT64_FORMAT "\ndigest %s\n",
+                           base, checksum_algo_name(algo), CHECKSUM_BLOCK_SIZE, size, top);
+    g_free(base);
+
+    gsize dlen = hasher_len(algo);
+
+    guint i = 0;
+    for (i = 0; i < digests->len / dlen; i++) {
+        gchar *hex = checksum_hex(digests->data + i * dlen, dlen);
+        g_string_append_printf(str, "block %u %s\n", i, hex);
+        g_free(hex);
+    }
+
+    gchar *sidecar = checksum_sidecar_name(filename);
+
+    GError *error = NULL;
+    gboolean ok = g_file_set_contents(sidecar, str->str, str->len, &error);
+
+    if (error) {
+        LOG_ERROR("Cannot write checksum file %s. %s\n", sidecar, error->message);
+        g_error_free(error);
+    }
+
+    g_free(sidecar);
+    g_string_free(str, TRUE);
+
+    return ok;
+}
+
+static void checksum_add_to_session(const gchar *filename, guint64 size, const gchar *top) {
+    // Manifest lists the files of a session that has segments
+    gchar *base = g_path_get_basename(filename);
+    g_ptr_array_add(g_session, g_strdup_printf("%s\t%" G_GUINT64_FORMAT "\t%s\n", top, size, base));
+    g_free(base);
+
+    if (g_session->len < 2) return;
+
+    GString *str = g_string_new("# audio-recorder session manifest\n# digest\tsize\tfile\n");
+
+    guint i = 0;
+    for (i = 0; i < g_session->len; i++) {
+        g_string_append(str, (gchar*)g_ptr_array_index(g_session, i));
+    }
+
+    GError *error = NULL;
+    g_file_set_contents(g_manifest, str->str, str->len, &error);
+
+    if (error) {
+        LOG_ERROR("Cannot write manifest %s. %s\n", g_manifest, error->message);
+        g_error_free(error);
+    }
+
+    g_string_free(str, TRUE);
+}
+
+void checksum_begin(GstElement *pipeline, const gchar *filename, gboolean new_session, gboolean append) {
+    checksum_end(pipeline);
+
+    gchar *name = NULL;
+    conf_get_string_value("checksum", &name);
+    ChecksumAlgo algo = checksum_algo_from_name(name);
+
+    if (algo == CHECKSUM_OFF && !g_strcmp0(name, "xxh3")) {
+        // xxh3 is not implemented (no libxxhash dependency). The sidecar says "xxh64".
+        LOG_MSG("Checksum: xxh3 is not available. Using xxh64 instead.\n");
+        algo = CHECKSUM_XXH64;
+
+    } else if (algo == CHECKSUM_OFF && g_strcmp0(name, "off") && name && *name) {
+        LOG_ERROR("Checksum: unknown algorithm \"%s\" in the checksum setting. Valid values are; off, xxh64, sha256.\n", name);
+    }
+
+    g_free(name);
+
+    if (!(algo != CHECKSUM_OFF && GST_IS_BIN(pipeline) && filename)) return;
+
+    if (new_session || !g_session) {
+        if (g_session) g_ptr_array_free(g_session, TRUE);
+        g_session = g_ptr_array_new_with_free_func(g_free);
+
+        g_free(g_manifest);
+        g_manifest = g_strdup_printf("%s.%s", filename, CHECKSUM_MANIFEST_EXT);
+    }
+
+    ChecksumState *st = checksum_state_new(pipeline, filename, algo, append);
+    g_object_set_data(G_OBJECT(pipeline), CHECKSUM_STATE_KEY, st);
+
+    LOG_CHECKSUM("Computing %s checksum of %s.\n", checksum_algo_name(algo), filename);
+}
+
+void checksum_end(GstElement *pipeline) {
+    if (!G_IS_OBJECT(pipeline)) return;
+
+    ChecksumState *st = g_object_steal_data(G_OBJECT(pipeline), CHECKSUM_STATE_KEY);
+    if (!st) return;
+
+    // No more data
+    gst_pad_remove_probe(st->pad, st->probe_id);
+    gst_object_unref(st->pad);
+    st->pad = NULL;
+
+    guint64 size = 0;
+    guint64 reread = 0;
+    GByteArray *digests = checksum_finish(st, &size, &reread);
+
+    if (digests) {
+        gchar *top = checksum_top_digest(st->algo, digests);
+
+        if (checksum_write_sidecar(st->filename, st->algo, size, digests, top)) {
+            checksum_add_to_session(st->filename, size, top);
+        }
+
+        LOG_MSG("Checksum %s %s of %s. %.1f MB hashed while recording, %.1f kB read back.\n", checksum_algo_name(st->algo), top,
+                st->filename, (size - MIN(size, reread)) / (1024.0 * 1024.0), reread / 1024.0);
+
+        g_free(top);
+        g_byte_array_free(digests, TRUE);
+    } else {
+        LOG_ERROR("Cannot compute the checksum of %s.\n", st->filename);
+    }
+
+    checksum_state_free(st);
+}
+
+void checksum_remove(const gchar *filename) {
+    if (!filename) return;
+
+    gchar *sidecar = checksum_sidecar_name(filename);
+    g_remove(sidecar);
+    g_free(sidecar);
+}
+
+// ---------------------------------------------------------------------
+// Verify
+// ---------------------------------------------------------------------
+
+gboolean checksum_verify(const gchar *filename) {
+    // $ audio-recorder --verify=<file>
+    gchar *sidecar = checksum_sidecar_name(filename);
+    gchar *text = NULL;
+
+    gboolean ok = FALSE;
+    ChecksumAlgo algo = CHECKSUM_OFF;
+    gint block_size = 0;
+    guint64 size = 0;
+    gchar *top = NULL;
+    GPtrArray *blocks = g_ptr_array_new_with_free_func(g_free);
+
+    gint fd = -1;
+    guint8 *buf = NULL;
+    GByteArray *digests = NULL;
+
+    if (!g_file_get_contents(sidecar, &text, NULL, NULL)) {
+        g_print("%s: no checksum file %s.\n", filename, sidecar);
+        goto LBL_1;
+    }
+
+    gchar **lines = g_strsplit(text, "\n", -1);
+
+    gint i = 0;
+    for (i = 0; lines[i]; i++) {
+        gchar **f = g_strsplit(lines[i], " ", 3);
+
+        if (f[0] && f[1]) {
+            if (!g_strcmp0(f[0], "algorithm")) algo = checksum_algo_from_name(f[1]);
+            else if (!g_strcmp0(f[0], "block-size")) block_size = atoi(f[1]);
+            else if (!g_strcmp0(f[0], "size")) size = g_ascii_strtoull(f[1], NULL, 10);
+            else if (!g_strcmp0(f[0], "digest")) top = g_strdup(f[1]);
+            else if (!g_strcmp0(f[0], "block") && f[2]) g_ptr_array_add(blocks, g_strdup(f[2]));
+        }
+
+        g_strfreev(f);
+    }
+
+    g_strfreev(lines);
+
+    if (algo == CHECKSUM_OFF || block_size != CHECKSUM_BLOCK_SIZE || !top) {
+        g_print("%s: cannot read checksum file %s.\n", filename, sidecar);
+        goto LBL_1;
+    }
+
+    fd = g_open(filename, O_RDONLY, 0);
+    if (fd < 0) {
+        g_print("%s: %s.\n", filename, g_strerror(errno));
+        goto LBL_1;
+    }
+
+    guint64 file_size = lseek(fd, 0, SEEK_END);
+    if (file_size != size) {
+        g_print("%s: FAILED. Size is %" G_GUINT64_FORMAT " bytes, expected %" G_GUINT64_FORMAT ".\n", filename, file_size, size);
+        goto LBL_1;
+    }
+
+    gsize dlen = hasher_len(algo);
+    guint64 n_blocks = (size + CHECKSUM_BLOCK_SIZE - 1) / CHECKSUM_BLOCK_SIZE;
+
+    buf = g_malloc(CHECKSUM_BLOCK_SIZE);
+    digests = g_byte_array_sized_new(n_blocks * dlen);
+
+    guint bad = 0;
+    guint64 b = 0;
+    for (b = 0; b < n_blocks; b++) {
+        guint8 digest[CHECKSUM_DIGEST_MAX];
+
+        if (!checksum_hash_block(fd, algo, b, size, buf, digest)) {
+            g_print("%s: %s.\n", filename, g_strerror(errno));
+            goto LBL_1;
+        }
+
+        g_byte_array_append(digests, digest, dlen);
+
+        // Damaged block?
+        gchar *hex = checksum_hex(digest, dlen);
+        if (b < blocks->len && g_strcmp0(hex, g_ptr_array_index(blocks, b))) {
+            g_print("%s: block %" G_GUINT64_FORMAT " (bytes %" G_GUINT64_FORMAT "-) differs.\n", filename, b, b * CHECKSUM_BLOCK_SIZE);
+            bad++;
+        }
+        g_free(hex);
+    }
+
+    gchar *hex = checksum_top_digest(algo, digests);
+    ok = !g_strcmp0(hex, top);
+    g_free(hex);
+
+    g_print("%s: %s (%s).\n", filename, (ok ? "OK" : "FAILED"), checksum_algo_name(algo));
+
+    if (!ok && !bad) {
+        g_print("%s: the block digests of the checksum file are damaged.\n", filename);
+    }
+
+LBL_1:
+    if (fd >= 0) close(fd);
+    if (digests) g_byte_array_free(digests, TRUE);
+
+    g_free(buf);
+    g_free(top);
+    g_ptr_array_free(blocks, TRUE);
+    g_free(text);
+    g_free(sidecar);
+
+    return ok;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+// ---------------------------------------------------------------------
+
+static gdouble checksum_cpu_time() {
+    // User + system time of the process (s)
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+void checksum_benchmark(guint mbytes) {
+    // $ audio-recorder --benchmark=checksum
+    // The streaming path: 64 kB buffers (a typical sink buffer) through the block hasher, as in the probe.
+    const gsize buf_size = 64 * 1024;
+    guint8 *data = g_malloc(buf_size);
+
+    gsize i = 0;
+    for (i = 0; i < buf_size; i++) {
+        data[i] = (guint8)(i * 31 + 7);
+    }
+
+    // Lossless bitrates (bytes/s)
+    const gdouble rate_8ch = 8 * 48000 * 3;
+    const gdouble rate_32ch = 32 * 96000 * 4;
+
+    g_print("Checksum benchmark: %u MB in 64 kB buffers.\n", mbytes);
+    g_print("algorithm\tMB_per_s\tcpu_pct_8ch_48k_24bit\tcpu_pct_32ch_96k_32bit\n");
+
+    ChecksumAlgo algos[] = {CHECKSUM_XXH64, CHECKSUM_SHA256};
+
+    guint a = 0;
+    for (a = 0; a < G_N_ELEMENTS(algos); a++) {
+        ChecksumState st;
+        memset(&st, 0, sizeof(st));
+        st.algo = algos[a];
+        st.in_order = TRUE;
+        st.digests = g_byte_array_new();
+        st.dirty = g_byte_array_new();
+        hasher_init(&st.block, st.algo);
+
+        guint64 total = (guint64)mbytes * 1024 * 1024;
+
+        gdouble cpu0 = checksum_cpu_time();
+        gint64 t0 = g_get_monotonic_time();
+
+        guint64 done = 0;
+        while (done < total) {
+            checksum_write(&st, data, buf_size);
+            done += buf_size;
+        }
+
+        gdouble sec = (g_get_monotonic_time() - t0) / (gdouble)G_USEC_PER_SEC;
+        gdouble cpu = checksum_cpu_time() - cpu0;
+
+        // Bytes per CPU second
+        gdouble per_cpu_sec = total / MAX(cpu, 1e-6);
+
+        g_print("%s\t%.0f\t%.3f\t%.3f\n", checksum_algo_name(st.algo), total / (1024.0 * 1024.0) / MAX(sec, 1e-6),
+                100.0 * rate_8ch / per_cpu_sec, 100.0 * rate_32ch / per_cpu_sec);
+
+        guint8 digest[CHECKSUM_DIGEST_MAX];
+        hasher_finish(&st.block, digest);
+        g_byte_array_free(st.digests, TRUE);
+        g_byte_array_free(st.dirty, TRUE);
+    }
+
+    g_free(data);
+}
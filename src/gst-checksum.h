@@ -0,0 +1,40 @@
+#ifndef _GST_CHECKSUM_H
+#define _GST_CHECKSUM_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-checksum.c.
+//#define DEBUG_CHECKSUM
+
+#if defined(DEBUG_CHECKSUM) || defined(DEBUG_ALL)
+#define LOG_CHECKSUM LOG_MSG
+#else
+#define LOG_CHECKSUM(x, ...)
+#endif
+
+// File name extensions of the sidecar ("recording.flac.checksum") and of the session manifest
+#define CHECKSUM_EXT "checksum"
+#define CHECKSUM_MANIFEST_EXT "manifest"
+
+// The digest is computed over blocks of this size (see gst-checksum.c)
+#define CHECKSUM_BLOCK_SIZE (4 * 1024 * 1024)
+
+// Hash the data of pipeline on its way to filename ("checksum" setting: off, xxh64 or sha256).
+// A new session starts a new manifest; segments of a session are added to it.
+// append: the sink appends to the bytes already in filename.
+void checksum_begin(GstElement *pipeline, const gchar *filename, gboolean new_session, gboolean append);
+
+// File of pipeline is closed. Write its sidecar and update the session manifest.
+void checksum_end(GstElement *pipeline);
+
+// Delete the sidecar of filename (the recording was deleted or changed)
+void checksum_remove(const gchar *filename);
+
+// Compute the digest of filename again and compare it with its sidecar. Print the result.
+gboolean checksum_verify(const gchar *filename);
+
+// Throughput of the hash functions, and their CPU share at lossless multichannel bitrates. Print the results.
+void checksum_benchmark(guint mbytes);
+
+#endif
@@ -20,6 +20,7 @@
 #include "log.h"
 #include "utility.h"
 #include "rec-manager-struct.h"
+#include "gst-capture.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -39,25 +40,43 @@
 // $ pactl list | grep -A6  'Sink #' | egrep "Name: |Description: "
 
 
-// Audio sink devices
+// Device registry, maintained by the GstDeviceMonitor (GST_MESSAGE_DEVICE_ADDED/REMOVED).
+// The devices are enumerated only once, when the monitor starts. After that, the registry is updated incrementally.
+// Pipeline builders validate device ids against the registry in O(1) time. See audio_sources_wash_device_list().
+G_LOCK_DEFINE_STATIC(g_registry);
+
+// Device id -> GstDevInfo
+static GHashTable *g_registry = NULL;
+
+// GstDevice* -> device id. Removed devices are found by their GstDevice object.
+static GHashTable *g_device_ids = NULL;
+
+// Incremented on each change
+static guint g_generation = 0;
+
+// Audio sink devices (DeviceItems owned by g_registry)
 static GList *g_sink_list = NULL;
 
-// Audio source devices
-G_LOCK_DEFINE_STATIC(g_source_list);
+// Audio source devices (DeviceItems owned by g_registry)
 static GList *g_source_list = NULL;
 
 static GstDeviceMonitor *g_dev_monitor = NULL;
 
-static void gstdev_get_devices();
-static void gstdev_read_fields(GstDevice *dev, gchar **dev_id, gchar **dev_descr, gchar **dev_class, gchar **dev_caps_str);
-static void gstdev_add_to_list(GstDevice *dev);
-static void gstdev_remove_from_list(GstDevice *dev);
+static void gstdev_registry_start();
+static void gstdev_read_fields(GstDevice *dev, gchar **dev_id, gchar **dev_descr, gchar **dev_class);
+static void gstdev_add_device(GstDevice *dev);
+static void gstdev_remove_device(GstDevice *dev);
+static void gstdev_registry_insert(GstDevInfo *info);
+static gboolean gstdev_registry_remove_id(const gchar *dev_id);
 static void gstdev_clear_lists();
 
 void gstdev_module_init() {
     LOG_DEBUG("Init gst-devices.c.\n");
     g_source_list = NULL;
     g_sink_list = NULL;
+    g_registry = NULL;
+    g_device_ids = NULL;
+    g_generation = 0;
     g_dev_monitor = NULL;
 }
 
@@ -75,28 +94,156 @@ void gstdev_module_exit() {
     gstdev_clear_lists();
 }
 
+static void gstdev_info_free(GstDevInfo *info) {
+    if (!info) return;
+
+    device_item_free(info->item);
+
+    if (info->caps) {
+        gst_caps_unref(info->caps);
+    }
+
+    if (info->match_cache) {
+        g_hash_table_destroy(info->match_cache);
+    }
+
+    if (info->device) {
+        gst_object_unref(info->device);
+    }
+
+    g_free(info);
+}
+
 GList *gstdev_get_source_list() {
-    // Return g_source_list to the caller
+    // Return a copy of the audio source list.
+    // Caller should free this with audio_sources_free_list().
+
+    gstdev_registry_start();
+
+    G_LOCK(g_registry);
+
+    GList *lst = NULL;
+
+    GList *item = g_list_first(g_source_list);
+    while (item) {
+        lst = g_list_append(lst, device_item_copy((DeviceItem*)item->data));
+        item = g_list_next(item);
+    }
 
-    gstdev_get_devices();
+    G_UNLOCK(g_registry);
 
-    return g_source_list;
+    return lst;
+}
+
+gboolean gstdev_device_exists(const gchar *dev_id) {
+    // Is dev_id a connected device?
+    if (!dev_id) return FALSE;
+
+    gstdev_registry_start();
+
+    G_LOCK(g_registry);
+    gboolean ret = g_hash_table_contains(g_registry, dev_id);
+    G_UNLOCK(g_registry);
+
+    return ret;
+}
+
+guint gstdev_get_generation() {
+    // Return generation of the registry. It changes when devices are added or removed.
+    return g_generation;
+}
+
+gboolean gstdev_get_capabilities(const gchar *dev_id, GstDevCaps *dev_caps) {
+    // Return capability info of the device. Return FALSE if dev_id is not in the registry.
+    gstdev_registry_start();
+
+    G_LOCK(g_registry);
+
+    GstDevInfo *info = (dev_id ? g_hash_table_lookup(g_registry, dev_id) : NULL);
+    if (info && dev_caps) {
+        *dev_caps = info->dev_caps;
+    }
+
+    G_UNLOCK(g_registry);
+
+    return (info != NULL);
+}
+
+GstCaps *gstdev_get_caps(const gchar *dev_id) {
+    // Return native caps of the device, or NULL.
+    // Caller should gst_caps_unref() this value.
+    gstdev_registry_start();
+
+    G_LOCK(g_registry);
+
+    GstDevInfo *info = (dev_id ? g_hash_table_lookup(g_registry, dev_id) : NULL);
+    GstCaps *caps = (info && info->caps ? gst_caps_ref(info->caps) : NULL);
+
+    G_UNLOCK(g_registry);
+
+    return caps;
+}
+
+GstCaps *gstdev_match_caps(const gchar *dev_id, GstCaps *wanted) {
+    // Return the part of wanted caps that the device can deliver natively.
+    // Caller should gst_caps_unref() this value.
+    gstdev_registry_start();
+
+    G_LOCK(g_registry);
+
+    GstDevInfo *info = (dev_id ? g_hash_table_lookup(g_registry, dev_id) : NULL);
+    if (!(info && info->caps)) {
+        G_UNLOCK(g_registry);
+        return NULL;
+    }
+
+    if (!info->match_cache) {
+        info->match_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)gst_caps_unref);
+    }
+
+    // Negotiated before?
+    gchar *key = gst_caps_to_string(wanted);
+    GstCaps *caps = g_hash_table_lookup(info->match_cache, key);
+
+    if (caps) {
+        g_free(key);
+    } else {
+        caps = gst_caps_intersect(info->caps, wanted);
+        g_hash_table_insert(info->match_cache, key, caps);
+    }
+
+    caps = gst_caps_ref(caps);
+
+    G_UNLOCK(g_registry);
+
+    return caps;
 }
 
 static void gstdev_clear_lists() {
-    LOG_DEBUG("gstdev_clear_lists(). Clear g_sink_list and g_source_list.\n");
+    LOG_DEBUG("gstdev_clear_lists(). Clear g_sink_list, g_source_list and the device registry.\n");
 
-    G_LOCK(g_source_list);
+    G_LOCK(g_registry);
 
-    // Free g_sink_list
-    audio_sources_free_list(g_sink_list);
+    // The DeviceItems are owned by g_registry
+    g_list_free(g_sink_list);
     g_sink_list = NULL;
 
-    // Free g_source_list
-    audio_sources_free_list(g_source_list);
+    g_list_free(g_source_list);
     g_source_list = NULL;
 
-    G_UNLOCK(g_source_list);
+    if (g_device_ids) {
+        g_hash_table_destroy(g_device_ids);
+    }
+    g_device_ids = NULL;
+
+    if (g_registry) {
+        g_hash_table_destroy(g_registry);
+    }
+    g_registry = NULL;
+
+    g_generation++;
+
+    G_UNLOCK(g_registry);
 }
 
 void gstdev_update_GUI() {
@@ -125,7 +272,8 @@ static gboolean message_func(GstBus *bus, GstMessage *message, gpointer user_dat
         LOG_DEBUG("Audio device added: %s\n", name);
         g_free (name);
 
-        gstdev_add_to_list(device);
+        gstdev_add_device(device);
+        gst_object_unref(device);
 
         gstdev_update_GUI();
 
@@ -139,7 +287,8 @@ static gboolean message_func(GstBus *bus, GstMessage *message, gpointer user_dat
         LOG_DEBUG("Audio device removed: %s\n", name);
         g_free (name);
 
-        gstdev_remove_from_list(device);
+        gstdev_remove_device(device);
+        gst_object_unref(device);
 
         gstdev_update_GUI();
 
@@ -171,7 +320,7 @@ GstDeviceMonitor *setup_raw_audio_source_device_monitor() {
     return monitor;
 }
 
-static void gstdev_read_fields(GstDevice *dev, gchar **dev_id, gchar **dev_descr, gchar **dev_class, gchar **dev_caps_str) {
+static void gstdev_read_fields(GstDevice *dev, gchar **dev_id, gchar **dev_descr, gchar **dev_class) {
 
     gchar *disp_name = gst_device_get_display_name(dev);
 
@@ -183,10 +332,6 @@ static void gstdev_read_fields(GstDevice *dev, gchar **dev_id, gchar **dev_descr
 
     *dev_class = gst_device_get_device_class(dev);
 
-    GstCaps *caps = gst_device_get_caps(dev);
-    *dev_caps_str = gst_caps_to_string(caps);
-    gst_caps_unref(caps);
-
     // Read device id (this should work for pulsesrc and alsasrc)
     GstElement *e = gst_device_create_element(dev, "element");
 
@@ -200,87 +345,94 @@ static void gstdev_read_fields(GstDevice *dev, gchar **dev_id, gchar **dev_descr
     gst_object_unref(GST_OBJECT(e));
 }
 
-GList *remove_item(GList *list, gchar *dev_id) {
+static void gstdev_int_limits(const GValue *value, gint *min, gint *max) {
+    // Widen [min, max] to cover value. The value can be an int, int range or a list of these.
+    if (!value) return;
 
-    GList *item = g_list_first(list);
-    while (item) {
+    gint lo = 0;
+    gint hi = 0;
 
-        DeviceItem *rec = (DeviceItem*)item->data;
-        if (rec && g_strcmp0(rec->id, dev_id) == 0) {
+    if (G_VALUE_HOLDS_INT(value)) {
+        lo = hi = g_value_get_int(value);
 
-            list = g_list_delete_link(list, item);
-            device_item_free(rec);
+    } else if (GST_VALUE_HOLDS_INT_RANGE(value)) {
+        lo = gst_value_get_int_range_min(value);
+        hi = gst_value_get_int_range_max(value);
 
-            return list;
+    } else if (GST_VALUE_HOLDS_LIST(value)) {
+        guint i = 0;
+        for (i = 0; i < gst_value_list_get_size(value); i++) {
+            gstdev_int_limits(gst_value_list_get_value(value, i), min, max);
         }
+        return;
 
-        item = g_list_next(item);
+    } else {
+        return;
     }
 
-    // Return unmodified list
-    return list;
+    *min = (*min > 0 ? MIN(*min, lo) : lo);
+    *max = MAX(*max, hi);
 }
 
-static void gstdev_remove_from_list(GstDevice *dev) {
-    gchar *dev_id = NULL;
-    gchar *dev_descr = NULL;
-    gchar *dev_class = NULL;
-    gchar *dev_caps_str = NULL;
-
-    LOG_DEBUG("Remove (input or output) device from the list.\n");
+static void gstdev_parse_caps(GstCaps *caps, GstDevCaps *dev_caps) {
+    // Read rate and channel limits from device caps
+    memset(dev_caps, 0, sizeof(GstDevCaps));
 
-    G_LOCK(g_source_list);
+    if (!caps) return;
 
-    gstdev_read_fields(dev, &dev_id, &dev_descr, &dev_class, &dev_caps_str);
+    guint i = 0;
+    for (i = 0; i < gst_caps_get_size(caps); i++) {
+        GstStructure *st = gst_caps_get_structure(caps, i);
 
-    gchar *dev_class_l = g_ascii_strdown(dev_class, -1);
+        gstdev_int_limits(gst_structure_get_value(st, "rate"), &dev_caps->rate_min, &dev_caps->rate_max);
+        gstdev_int_limits(gst_structure_get_value(st, "channels"), &dev_caps->channels_min, &dev_caps->channels_max);
+    }
+}
 
-    // Audio/Source
-    if (g_str_has_prefix(dev_class_l, "audio/source")) {
+static void gstdev_fix_monitor_description(DeviceItem *rec) {
+    // Remove "Monitor of" from the description text, and add "(Audio ouput)" word to it. It means "loudspeakers".
+    // Registry must be locked.
 
-        LOG_DEBUG("Remove audio input device (from g_source_list):%s, decr:%s, class:%s\n", dev_id, dev_descr, dev_class);
+    // For example: "Monitor of Audio Stereo Card" becomes "Audio Stereo Card (Audio ouput)"
+    // This is easier to understand.
 
-        g_source_list = remove_item(g_source_list, dev_id);
+    // Note: Check listing of these commands:
+    //
+    // Input devices:
+    // pactl list | grep -A6  'Source #' | egrep "Name: |Description: "
+    // pactl list short sources | cut -f2
+    //
+    // And sink (output) devices:
+    // pactl list | grep -A6  'Sink #' | egrep "Name: |Description: "
+    // pactl list short sinks | cut -f2
 
-    }
-    // Audio/Sink
-    else if (g_str_has_prefix(dev_class_l, "audio/sink")) {
+    // Take device-id without ".monitor" suffix
+    if (!g_str_has_suffix(rec->id, ".monitor")) return;
 
-        LOG_DEBUG("Remove audio output device (from g_sink_list):%s, decr:%s, class:%s\n", dev_id, dev_descr, dev_class);
+    gchar *tmp = g_strndup(rec->id, strlen(rec->id) - strlen(".monitor"));
 
-        g_sink_list = remove_item(g_sink_list, dev_id);
+    // Find equivalent sink device (real audio card) and steal its description + add "(Audio output)" to it.
+    GstDevInfo *sink = g_hash_table_lookup(g_registry, tmp);
+    if (sink && sink->item->type == AUDIO_SINK) {
+        g_free(rec->description);
+        rec->description = g_strdup_printf("%s %s", sink->item->description, _("(Audio output)"));
     }
 
-    g_free(dev_id);
-    g_free(dev_descr);
-    g_free(dev_class);
-    g_free(dev_class_l);
-    g_free(dev_caps_str);
-
-    G_UNLOCK(g_source_list);
+    g_free(tmp);
 }
 
-static void gstdev_add_to_list(GstDevice *dev) {
-    gchar *dev_descr = NULL;
-    gchar *dev_id = NULL;
-    gchar *dev_class = NULL;
-    gchar *dev_caps_str = NULL;
-
-    LOG_DEBUG("Add new (input or output) device to the list.\n");
-
-    G_LOCK(g_source_list);
-
-    gstdev_read_fields(dev, &dev_id, &dev_descr, &dev_class, &dev_caps_str);
-
-    // Create new DeviceItem
-    DeviceItem *item = device_item_create(dev_id, dev_descr);
+static DeviceItem *gstdev_create_item(gchar *dev_id, gchar *dev_descr, gchar *dev_class) {
+    // Create DeviceItem for an audio source or sink. Return NULL for other devices.
+    DeviceItem *item = NULL;
 
     gchar *dev_class_l = g_ascii_strdown(dev_class, -1);
 
     // Audio/Source
     if (g_str_has_prefix(dev_class_l, "audio/source")) {
 
-        LOG_DEBUG("Add audio input device (to g_source_list):%s, decr:%s, class:%s\n", dev_id, dev_descr, dev_class);
+        LOG_DEBUG("Add audio input device:%s, decr:%s, class:%s\n", dev_id, dev_descr, dev_class);
+
+        item = device_item_create(dev_id, dev_descr);
 
         if (g_str_has_suffix(dev_id, ".monitor")) {
 
@@ -309,95 +461,160 @@ static void gstdev_add_to_list(GstDevice *dev) {
                 item->icon_name = g_strdup("microphone.png");
             }
         }
-
-        // Add to g_sources list
-        g_source_list = g_list_append(g_source_list, item);
     }
 
-
     // Audio/Sink
     else if (g_str_has_prefix(dev_class_l, "audio/sink")) {
 
-        LOG_DEBUG("Add audio output device (to g_sink_list):%s, decr:%s, class:%s\n", dev_id, dev_descr, dev_class);
+        LOG_DEBUG("Add audio output device:%s, decr:%s, class:%s\n", dev_id, dev_descr, dev_class);
+
+        item = device_item_create(dev_id, dev_descr);
 
         // This is a sound sink, normally real audio card with loudspeakers
         item->type = AUDIO_SINK;
 
-        // Add to g_sinks list
-        g_sink_list = g_list_append(g_sink_list, item);
-
         // Set icon (audio card)
         item->icon_name = g_strdup("audio-card.png");
     }
 
+    g_free(dev_class_l);
+
+    return item;
+}
+
+static void gstdev_add_device(GstDevice *dev) {
+    gchar *dev_descr = NULL;
+    gchar *dev_id = NULL;
+    gchar *dev_class = NULL;
+
+    LOG_DEBUG("Add new (input or output) device to the registry.\n");
+
+    gstdev_read_fields(dev, &dev_id, &dev_descr, &dev_class);
+
+    DeviceItem *item = gstdev_create_item(dev_id, dev_descr, dev_class);
+
+    if (item) {
+        GstDevInfo *info = g_malloc0(sizeof(GstDevInfo));
+        info->item = item;
+        info->device = gst_object_ref(dev);
+        info->caps = gst_device_get_caps(dev);
+        gstdev_parse_caps(info->caps, &info->dev_caps);
+
+        gstdev_registry_insert(info);
+
+        // Re-bind the device if a running recording lost it
+        capture_device_changed(dev_id, TRUE);
+    }
+
     g_free(dev_id);
     g_free(dev_descr);
     g_free(dev_class);
-    g_free(dev_class_l);
-    g_free(dev_caps_str);
+}
+
+static void gstdev_registry_insert(GstDevInfo *info) {
+    // Add device to the registry. Replaces existing device with the same id.
+    G_LOCK(g_registry);
+
+    DeviceItem *item = info->item;
+
+    gstdev_registry_remove_id(item->id);
+
+    info->generation = ++g_generation;
+
+    g_hash_table_insert(g_registry, g_strdup(item->id), info);
+
+    if (info->device) {
+        g_hash_table_insert(g_device_ids, info->device, g_strdup(item->id));
+    }
+
+    if (item->type == AUDIO_SINK) {
+        g_sink_list = g_list_append(g_sink_list, item);
+
+        // Fix description of its monitor device (if already registered)
+        gchar *monitor_id = g_strdup_printf("%s.monitor", item->id);
+        GstDevInfo *monitor = g_hash_table_lookup(g_registry, monitor_id);
+        if (monitor) {
+            gstdev_fix_monitor_description(monitor->item);
+        }
+        g_free(monitor_id);
+
+    } else {
+        g_source_list = g_list_append(g_source_list, item);
 
-    G_UNLOCK(g_source_list);
+        // Remove "Monitor of" from the description text.
+        gstdev_fix_monitor_description(item);
+    }
+
+    G_UNLOCK(g_registry);
 }
 
-void gstdev_fix_description() {
-    // Remove "Monitor of" from the description text, and add "(Audio ouput)" word to it. It means "loudspeakers".
+static gboolean gstdev_registry_remove_id(const gchar *dev_id) {
+    // Remove device from the registry. Registry must be locked.
+    GstDevInfo *info = g_hash_table_lookup(g_registry, dev_id);
+    if (!info) return FALSE;
 
-    // For example: "Monitor of Audio Stereo Card" becomes "Audio Stereo Card (Audio ouput)"
-    // This is easier to understand.
+    LOG_DEBUG("Remove audio device from the registry:%s\n", dev_id);
 
-    // Note: Check listing of these commands:
-    //
-    // Input devices:
-    // pactl list | grep -A6  'Source #' | egrep "Name: |Description: "
-    // pactl list short sources | cut -f2
-    //
-    // And sink (output) devices:
-    // pactl list | grep -A6  'Sink #' | egrep "Name: |Description: "
-    // pactl list short sinks | cut -f2
+    g_sink_list = g_list_remove(g_sink_list, info->item);
+    g_source_list = g_list_remove(g_source_list, info->item);
 
-    G_LOCK(g_source_list);
+    if (info->device) {
+        g_hash_table_remove(g_device_ids, info->device);
+    }
 
-    GList *item = g_list_first(g_source_list);
-    while (item) {
+    // This will free info
+    g_hash_table_remove(g_registry, dev_id);
 
-        DeviceItem *rec = (DeviceItem*)item->data;
+    g_generation++;
 
-        // Take device-id without ".monitor" suffix
-        if (g_str_has_suffix(rec->id, ".monitor")) {
+    return TRUE;
+}
 
-            gchar *tmp = g_strdup(rec->id);
-            gchar *p = g_strrstr(tmp, ".monitor");
-            if (p) {
-                // NULL terminate
-                *p = '\0';
+static void gstdev_remove_device(GstDevice *dev) {
+    LOG_DEBUG("Remove (input or output) device from the registry.\n");
 
-                // Find equivalent sink device (real audio card) and steal its description + add "(Audio output)" to it.
-                DeviceItem *sink_rec = audio_sources_find_in_list(g_sink_list, tmp);
-                if (sink_rec) {
-                    g_free(rec->description);
-                    rec->description = g_strdup_printf("%s %s", sink_rec->description, _("(Audio output)"));
-                }
-            }
+    G_LOCK(g_registry);
 
-            g_free(tmp);
-        }
+    gchar *dev_id = g_strdup(g_hash_table_lookup(g_device_ids, dev));
 
-        item = g_list_next(item);
+    G_UNLOCK(g_registry);
+
+    if (!dev_id) {
+        // Unknown GstDevice object. Read its id.
+        gchar *dev_descr = NULL;
+        gchar *dev_class = NULL;
+        gstdev_read_fields(dev, &dev_id, &dev_descr, &dev_class);
+        g_free(dev_descr);
+        g_free(dev_class);
     }
 
-    G_UNLOCK(g_source_list);
+    G_LOCK(g_registry);
+
+    gstdev_registry_remove_id(dev_id);
+
+    G_UNLOCK(g_registry);
+
+    // Fail over if a running recording uses this device
+    capture_device_changed(dev_id, FALSE);
+
+    g_free(dev_id);
 }
 
-static void gstdev_get_devices() {
+static void gstdev_registry_start() {
+    // Start device monitor and take the initial device list. This is done only once.
+    if (GST_IS_DEVICE_MONITOR(g_dev_monitor)) return;
 
     LOG_DEBUG("Get list of audio input/output devices from GStreamer.\n");
 
     gstdev_clear_lists();
 
-    // Set up device monitor
-    if (!GST_IS_DEVICE_MONITOR(g_dev_monitor)) {
-        g_dev_monitor = setup_raw_audio_source_device_monitor();
-    }
+    G_LOCK(g_registry);
+    g_registry = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)gstdev_info_free);
+    g_device_ids = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    G_UNLOCK(g_registry);
+
+    // Set up device monitor. It will keep the registry up to date.
+    g_dev_monitor = setup_raw_audio_source_device_monitor();
 
     GList *list = gst_device_monitor_get_devices(g_dev_monitor);
 
@@ -407,16 +624,87 @@ static void gstdev_get_devices() {
     while (item) {
         GstDevice *dev = (GstDevice*)item->data;
 
-        gstdev_add_to_list(dev);
+        gstdev_add_device(dev);
 
         item = g_list_next(item);
     }
 
     g_list_free_full(list, (GDestroyNotify)gst_object_unref);
-
-    // Remove "Monitor of" from the description text.
-    gstdev_fix_description();
 }
 
+void gstdev_benchmark(gint n_devices) {
+    // Register n_devices virtual audio sources and measure device validation on the recording start path.
+    // Compare registry lookups with the former method (copy of a fresh device list + linear search).
+    // $ audio-recorder --benchmark=devices
+    const gint rounds = 100;
+
+    gstdev_registry_start();
+
+    GList *ids = NULL;
+
+    gint i = 0;
+    for (i = 0; i < n_devices; i++) {
+        gchar *dev_id = g_strdup_printf("benchmark_input.%d", i);
 
+        GstDevInfo *info = g_malloc0(sizeof(GstDevInfo));
+        info->item = device_item_create(dev_id, "Virtual source");
+        info->item->type = AUDIO_INPUT;
+        gstdev_registry_insert(info);
 
+        ids = g_list_append(ids, dev_id);
+    }
+
+    // 1) audio_sources_wash_device_list(): O(1) registry lookup per device
+    gint64 t0 = g_get_monotonic_time();
+
+    gint r = 0;
+    for (r = 0; r < rounds; r++) {
+        GList *valid = audio_sources_wash_device_list(ids);
+        str_list_free(valid);
+    }
+
+    gint64 t_registry = g_get_monotonic_time() - t0;
+
+    // 2) Copy of the device list + linear search per device
+    t0 = g_get_monotonic_time();
+
+    for (r = 0; r < rounds; r++) {
+        GList *copy = gstdev_get_source_list();
+
+        GList *n = g_list_first(ids);
+        while (n) {
+            audio_sources_find_in_list(copy, (gchar*)n->data);
+            n = g_list_next(n);
+        }
+
+        audio_sources_free_list(copy);
+    }
+
+    gint64 t_linear = g_get_monotonic_time() - t0;
+
+    // 3) One full enumeration by GStreamer (this was done on each recording start)
+    t0 = g_get_monotonic_time();
+
+    GList *list = gst_device_monitor_get_devices(g_dev_monitor);
+    g_list_free_full(list, (GDestroyNotify)gst_object_unref);
+
+    gint64 t_enum = g_get_monotonic_time() - t0;
+
+    g_print("Device registry benchmark, %d virtual sources, %d rounds:\n", n_devices, rounds);
+    g_print("  registry lookup:            %.3f ms/round\n", t_registry / 1000.0 / rounds);
+    g_print("  list copy + linear search:  %.3f ms/round\n", t_linear / 1000.0 / rounds);
+    g_print("  GStreamer enumeration:      %.3f ms (once, real devices only)\n", t_enum / 1000.0);
+
+    // Remove the virtual devices
+    G_LOCK(g_registry);
+
+    GList *n = g_list_first(ids);
+    while (n) {
+        gstdev_registry_remove_id((gchar*)n->data);
+        n = g_list_next(n);
+    }
+
+    G_UNLOCK(g_registry);
+
+    str_list_free(ids);
+}
@@ -9,11 +9,55 @@
 
 #include "audio-sources.h"
 
+// Capability info parsed from the device caps. 0 if not known.
+typedef struct {
+    gint rate_min;
+    gint rate_max;
+    gint channels_min;
+    gint channels_max;
+} GstDevCaps;
+
+// Entry in the device registry
+typedef struct {
+    // Device id, type (AUDIO_INPUT, AUDIO_SINK_MONITOR or AUDIO_SINK), description and icon
+    DeviceItem *item;
+
+    // GstDevice from the device monitor. NULL for virtual devices.
+    GstDevice *device;
+
+    // Native caps of the device
+    GstCaps *caps;
+    GstDevCaps dev_caps;
+
+    // Registry generation when this device was added
+    guint generation;
+
+    // Negotiation results. Wanted caps (string) -> caps the device can deliver (or empty caps).
+    GHashTable *match_cache;
+} GstDevInfo;
+
 void gstdev_module_init();
 void gstdev_module_exit();
 
-// List of audio input (source) devices
+// Copy of the audio input (source) device list. Free it with audio_sources_free_list().
 GList *gstdev_get_source_list();
 
+// Is dev_id a connected device? O(1), no enumeration.
+gboolean gstdev_device_exists(const gchar *dev_id);
+
+// Registry generation. Changes when devices are added or removed.
+guint gstdev_get_generation();
+
+// Capability info and native caps of the device. Caller should gst_caps_unref() the caps.
+gboolean gstdev_get_capabilities(const gchar *dev_id, GstDevCaps *dev_caps);
+GstCaps *gstdev_get_caps(const gchar *dev_id);
+
+// Return the part of wanted caps that the device can deliver natively (empty caps if none), or NULL if the device's caps are not known.
+// The result is cached per device. Caller should gst_caps_unref() this value.
+GstCaps *gstdev_match_caps(const gchar *dev_id, GstCaps *wanted);
+
+// Time device validation with n_devices virtual sources
+void gstdev_benchmark(gint n_devices);
+
 #endif
 
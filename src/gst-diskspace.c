@@ -0,0 +1,556 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#include "gst-diskspace.h"
+#include "gst-pipeline.h"
+#include "gst-stall.h"
+#include "gst-recorder.h"
+#include "gst-retention.h"
+#include "rec-manager.h"
+#include "dbus-server.h"
+#include "log.h"
+#include "dconf.h"
+#include "utility.h"
+#include "support.h"
+
+// Disk-space guard.
+//
+// A long recording should not die with "No space left on device" and a truncated file. While recording:
+//  1. A probe on the sink queue (PIPELINE_SINK_QUEUE) counts the bytes the pipeline produces.
+//     The live bitrate is the average of the first seconds, then a moving average.
+//  2. The free space of the audio folder is read with statvfs() in a worker thread (a slow NFS mount must not
+//     block the main loop). It is read seldom when the disk is far from full, and more often near the end.
+//     Between the reads, the bytes produced since then (and those still buffered in the ring and spool) are
+//     subtracted, so the estimate stays exact.
+//  3. Remaining time = (free space - reserve) / bitrate. The reserve is what a clean stop still writes: the
+//     buffered data (STALL_DRAIN_TIMEOUT_MS of audio) and the index a muxer writes at EOS. It covers a rotation
+//     too; the old file gets audio until the new segment plays, then drains (see rec_switch_segment()).
+//
+// The remaining time is shown next to the file size and returned by diskspace_get_info() (DBus "get_disk_space").
+// Below "disk-space-warn-minutes" the user is warned. Below "disk-space-action-minutes", "disk-space-action" is
+// taken: "warn", "rotate" (continue in "disk-space-fallback-folder"), "cheaper" (continue with a cheaper profile)
+// or "stop". Whatever the action, the recording is stopped cleanly when only the reserve is left.
+// Events: "disk-space-low", "disk-space-rotate", "disk-space-cheaper", "disk-space-no-fallback", "disk-space-stop".
+//
+// Settings: "disk-space-guard" (on/off) and the above.
+
+// Check the prediction this often
+#define DISKSPACE_POLL_MS 1000
+
+// Read the free space at most/at least this often
+#define DISKSPACE_REFRESH_MIN_MS 1000
+#define DISKSPACE_REFRESH_MAX_MS 60000
+
+// Read the free space again after 1/20 of the remaining time
+#define DISKSPACE_REFRESH_DIV 20
+
+// No prediction before this (the encoders need a moment), plain average before the moving average
+#define DISKSPACE_WARMUP_SEC 3.0
+#define DISKSPACE_RATE_WINDOW_SEC 30.0
+
+// Reserve for a clean stop: seconds of audio in the buffers (as STALL_DRAIN_TIMEOUT_MS), share of the file
+// for the muxer's index, and a fixed minimum
+#define DISKSPACE_STOP_SEC 30.0
+#define DISKSPACE_INDEX_DIV 100
+#define DISKSPACE_MIN_RESERVE (4 * 1024 * 1024)
+
+// Default thresholds (minutes)
+#define DISKSPACE_WARN_MINUTES 10
+#define DISKSPACE_ACTION_MINUTES 2
+
+typedef struct {
+    gchar *folder;
+    guint64 produced;
+    guint64 pending;
+} DiskSpaceJob;
+
+G_LOCK_DEFINE_STATIC(g_lock);
+
+// Protected by g_lock (the probe and the worker thread)
+static guint64 g_produced = 0;
+static gchar *g_folder = NULL;
+static gboolean g_fs_valid = FALSE;
+static guint64 g_fs_free = 0;
+static guint64 g_fs_produced = 0;
+static guint64 g_fs_pending = 0;
+static gboolean g_refreshing = FALSE;
+
+static GThreadPool *g_pool = NULL;
+
+static GstPad *g_pad = NULL;
+static gulong g_probe_id = 0;
+static guint g_poll_id = 0;
+
+static DiskSpaceInfo g_info;
+static gboolean g_have_info = FALSE;
+
+static gint64 g_start_time = 0;
+static gint64 g_last_time = 0;
+static guint64 g_last_produced = 0;
+static gint64 g_refresh_time = 0;
+
+// Per segment
+static gboolean g_action_taken = FALSE;
+static gboolean g_stopping = FALSE;
+
+// Per session
+static gboolean g_warned = FALSE;
+static gboolean g_rotated = FALSE;
+
+static void diskspace_event(const gchar *name, gchar *detail) {
+    // Log, tell DBus clients and show in the GUI. Takes detail.
+    LOG_MSG("Disk space: %s\n", detail);
+
+    dbus_service_emit_event(name, detail);
+    rec_manager_set_error_text(detail);
+    g_free(detail);
+}
+
+static GstPadProbeReturn diskspace_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    // Count the bytes on their way to the file (streaming thread)
+    guint64 bytes = 0;
+
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+        bytes = gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+
+    } else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+
+        guint i = 0;
+        for (i = 0; i < gst_buffer_list_length(list); i++) {
+            bytes += gst_buffer_get_size(gst_buffer_list_get(list, i));
+        }
+    }
+
+    G_LOCK(g_lock);
+    g_produced += bytes;
+    G_UNLOCK(g_lock);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void diskspace_refresh_run(gpointer data, gpointer user_data) {
+    // Read the free space (worker thread). A statvfs() on a stalled NFS mount may take long.
+    DiskSpaceJob *job = (DiskSpaceJob*)data;
+
+    struct statvfs st;
+    gboolean ok = (statvfs(job->folder, &st) == 0);
+    int err = errno;
+
+    G_LOCK(g_lock);
+
+    // Still the same recording?
+    if (ok && !g_strcmp0(job->folder, g_folder)) {
+        g_fs_valid = TRUE;
+        g_fs_free = (guint64)st.f_bavail * (guint64)st.f_frsize;
+        g_fs_produced = job->produced;
+        g_fs_pending = job->pending;
+    }
+    g_refreshing = FALSE;
+
+    G_UNLOCK(g_lock);
+
+    if (!ok) {
+        LOG_ERROR("Disk space: Cannot read the free space of %s. %s\n", job->folder, g_strerror(err));
+    }
+
+    LOG_DISKSPACE("Free space of %s: %.1f MB.\n", job->folder, ok ? (gdouble)st.f_bavail * st.f_frsize / (1024.0 * 1024.0) : -1.0);
+
+    g_free(job->folder);
+    g_free(job);
+}
+
+static guint64 diskspace_pending() {
+    // Bytes produced but not written yet (ring and spool)
+    StallMetrics m;
+    memset(&m, 0, sizeof(m));
+
+    if (!stall_get_metrics(&m)) return 0;
+
+    return m.ring_bytes + m.spool.pending_bytes;
+}
+
+static guint64 diskspace_folder_free(const gchar *folder) {
+    struct statvfs st;
+    if (statvfs(folder, &st)) return 0;
+
+    return (guint64)st.f_bavail * (guint64)st.f_frsize;
+}
+
+static gboolean diskspace_same_device(const gchar *path1, const gchar *path2) {
+    struct stat st1;
+    struct stat st2;
+
+    if (stat(path1, &st1) || stat(path2, &st2)) return FALSE;
+
+    return st1.st_dev == st2.st_dev;
+}
+
+static gboolean diskspace_stop_cb(gpointer user_data) {
+    // Runs in the main loop. The normal stop writes the buffers and lets the muxer finish the file.
+    rec_manager_stop_recording();
+    return FALSE;
+}
+
+static gboolean diskspace_rotate(guint64 need_bytes) {
+    // Continue in the fallback folder. Return FALSE if it is not usable.
+    gchar *folder = NULL;
+    conf_get_string_value("disk-space-fallback-folder", &folder);
+    str_trim(folder);
+
+    gboolean ok = FALSE;
+    gchar *current = NULL;
+
+    if (g_rotated) {
+        diskspace_event("disk-space-no-fallback", g_strdup(_("Disk space is low. Already recording in the fallback folder.")));
+        goto LBL_1;
+    }
+
+    if (str_length0(folder) < 1 || !g_file_test(folder, G_FILE_TEST_IS_DIR) || !is_file_writable(folder)) {
+        diskspace_event("disk-space-no-fallback", g_strdup_printf(_("Disk space is low. Fallback folder \"%s\" is not usable."),
+                        folder ? folder : ""));
+        goto LBL_1;
+    }
+
+    G_LOCK(g_lock);
+    current = g_strdup(g_folder);
+    G_UNLOCK(g_lock);
+
+    // The same disk would not help
+    if (current && diskspace_same_device(folder, current)) {
+        diskspace_event("disk-space-no-fallback", g_strdup_printf(_("Disk space is low. Fallback folder \"%s\" is on the same disk."), folder));
+        goto LBL_1;
+    }
+
+    guint64 free_bytes = diskspace_folder_free(folder);
+    if (free_bytes < need_bytes) {
+        diskspace_event("disk-space-no-fallback", g_strdup_printf(_("Disk space is low. Fallback folder \"%s\" has only %.1f MB free."),
+                        folder, free_bytes / (1024.0 * 1024.0)));
+        goto LBL_1;
+    }
+
+    diskspace_event("disk-space-rotate", g_strdup_printf(_("Disk space is low. Continuing in %s."), folder));
+
+    // Rotated only if the new segment has started (not while the old segment of another switch drains)
+    ok = rec_start_segment_in_folder(folder);
+    g_rotated = ok;
+
+LBL_1:
+    g_free(current);
+    g_free(folder);
+    return ok;
+}
+
+static gchar *diskspace_get_action() {
+    // "disk-space-action". An unknown value is taken as "warn"; the recording is still stopped at the reserve.
+    static const gchar *actions[] = {"warn", "rotate", "cheaper", "stop", NULL};
+
+    gchar *action = NULL;
+    conf_get_string_value("disk-space-action", &action);
+    str_trim(action);
+
+    gint i = 0;
+    for (i = 0; actions[i]; i++) {
+        if (!g_strcmp0(action, actions[i])) return action;
+    }
+
+    LOG_ERROR("Invalid disk-space-action \"%s\". Using \"warn\".\n", (action ? action : ""));
+
+    g_free(action);
+    return g_strdup("warn");
+}
+
+static gboolean diskspace_action_cb(gpointer user_data) {
+    // Below the action threshold. Runs in the main loop. A new segment does not block it (see rec_switch_segment()).
+    gchar *action = diskspace_get_action();
+
+    gchar *left = diskspace_format_remaining(g_info.remaining_sec);
+
+    if (!g_strcmp0(action, "warn")) {
+        diskspace_event("disk-space-low", g_strdup_printf(_("Disk space is very low. About %s left."), left));
+
+    } else if (!g_strcmp0(action, "rotate")) {
+        // The new folder must hold at least the warning time
+        gint warn_min = 0;
+        conf_get_int_value("disk-space-warn-minutes", &warn_min);
+
+        guint64 need = g_info.reserve_bytes + (guint64)(g_info.bitrate * MAX(warn_min, 1) * 60);
+        diskspace_rotate(need);
+
+    } else if (!g_strcmp0(action, "cheaper")) {
+        gchar *id = rec_start_cheaper_segment();
+
+        if (id) {
+            diskspace_event("disk-space-cheaper", g_strdup_printf(_("Disk space is low. Continuing with the %s profile."), id));
+        } else {
+            diskspace_event("disk-space-low", g_strdup_printf(_("Disk space is low. No cheaper profile. About %s left."), left));
+        }
+        g_free(id);
+
+    } else if (!g_strcmp0(action, "stop") && !g_stopping) {
+        g_stopping = TRUE;
+        diskspace_event("disk-space-stop", g_strdup_printf(_("Disk space is low. Recording stopped with %s left."), left));
+        diskspace_stop_cb(NULL);
+    }
+
+    g_free(left);
+    g_free(action);
+    return FALSE;
+}
+
+static void diskspace_update_rate(gint64 now, guint64 produced) {
+    gdouble elapsed = (now - g_start_time) / (gdouble)G_TIME_SPAN_SECOND;
+    gdouble dt = (now - g_last_time) / (gdouble)G_TIME_SPAN_SECOND;
+
+    if (elapsed <= 0.0 || dt <= 0.0) return;
+
+    if (elapsed < DISKSPACE_RATE_WINDOW_SEC / 3) {
+        // Plain average while the first seconds come in
+        g_info.bitrate = produced / elapsed;
+    } else {
+        gdouble rate = (produced - g_last_produced) / dt;
+        g_info.bitrate += (rate - g_info.bitrate) * MIN(dt / DISKSPACE_RATE_WINDOW_SEC, 1.0);
+    }
+
+    g_last_time = now;
+    g_last_produced = produced;
+}
+
+static void diskspace_update() {
+    gint64 now = g_get_monotonic_time();
+
+    G_LOCK(g_lock);
+    guint64 produced = g_produced;
+    gboolean valid = g_fs_valid;
+    guint64 fs_free = g_fs_free;
+    guint64 fs_produced = g_fs_produced;
+    guint64 fs_pending = g_fs_pending;
+    gboolean refreshing = g_refreshing;
+    G_UNLOCK(g_lock);
+
+    diskspace_update_rate(now, produced);
+
+    // Read the free space again?
+    gint64 interval = DISKSPACE_REFRESH_MIN_MS;
+    if (g_info.remaining_sec > 0) {
+        interval = CLAMP(g_info.remaining_sec * 1000 / DISKSPACE_REFRESH_DIV, DISKSPACE_REFRESH_MIN_MS, DISKSPACE_REFRESH_MAX_MS);
+    }
+
+    if (!refreshing && (now - g_refresh_time) >= interval * G_TIME_SPAN_MILLISECOND) {
+        DiskSpaceJob *job = g_new0(DiskSpaceJob, 1);
+        job->produced = produced;
+        job->pending = diskspace_pending();
+
+        G_LOCK(g_lock);
+        job->folder = g_strdup(g_folder);
+        g_refreshing = TRUE;
+        G_UNLOCK(g_lock);
+
+        g_refresh_time = now;
+        g_thread_pool_push(g_pool, job, NULL);
+    }
+
+    gdouble elapsed = (now - g_start_time) / (gdouble)G_TIME_SPAN_SECOND;
+
+    if (!valid || elapsed < DISKSPACE_WARMUP_SEC || g_info.bitrate < 1.0) {
+        if (g_info.state != DISKSPACE_STOP) {
+            g_info.state = DISKSPACE_UNKNOWN;
+        }
+        g_info.remaining_sec = -1;
+        return;
+    }
+
+    // Free space now: the last reading, minus what was buffered then and what has been produced since
+    gint64 free_bytes = (gint64)fs_free - (gint64)fs_pending - (gint64)(produced - fs_produced);
+    free_bytes = MAX(free_bytes, 0);
+
+    guint64 reserve = (guint64)(g_info.bitrate * DISKSPACE_STOP_SEC) + produced / DISKSPACE_INDEX_DIV + DISKSPACE_MIN_RESERVE;
+
+    g_info.free_bytes = free_bytes;
+    g_info.reserve_bytes = reserve;
+    g_info.remaining_sec = ((guint64)free_bytes > reserve) ? (gint64)((free_bytes - reserve) / g_info.bitrate) : 0;
+
+    gint warn_min = DISKSPACE_WARN_MINUTES;
+    gint action_min = DISKSPACE_ACTION_MINUTES;
+    conf_get_int_value("disk-space-warn-minutes", &warn_min);
+    conf_get_int_value("disk-space-action-minutes", &action_min);
+
+    if ((guint64)free_bytes <= reserve) {
+        g_info.state = DISKSPACE_STOP;
+
+        if (!g_stopping) {
+            g_stopping = TRUE;
+            diskspace_event("disk-space-stop", g_strdup_printf(_("Disk is full. Recording stopped with %.1f MB free."),
+                            free_bytes / (1024.0 * 1024.0)));
+            g_idle_add(diskspace_stop_cb, NULL);
+        }
+
+    } else if (g_info.remaining_sec <= action_min * 60) {
+        g_info.state = DISKSPACE_ACTION;
+
+        if (!g_action_taken) {
+            g_action_taken = TRUE;
+            g_idle_add(diskspace_action_cb, NULL);
+        }
+
+    } else if (g_info.remaining_sec <= warn_min * 60) {
+        g_info.state = DISKSPACE_LOW;
+
+        if (!g_warned) {
+            g_warned = TRUE;
+
+            gchar *left = diskspace_format_remaining(g_info.remaining_sec);
+            diskspace_event("disk-space-low", g_strdup_printf(_("Disk space is low. About %s left."), left));
+            g_free(left);
+
+            // Old recordings may have to go ("retention-min-free")
+            retention_enforce();
+        }
+
+    } else {
+        g_info.state = DISKSPACE_OK;
+    }
+
+    LOG_DISKSPACE("Free %.1f MB, reserve %.1f MB, %.0f bytes/s, %" G_GINT64_FORMAT " s left.\n",
+                  free_bytes / (1024.0 * 1024.0), reserve / (1024.0 * 1024.0), g_info.bitrate, g_info.remaining_sec);
+}
+
+static gboolean diskspace_poll_cb(gpointer user_data) {
+    if (!g_pad) {
+        g_poll_id = 0;
+        return FALSE;
+    }
+
+    diskspace_update();
+
+    return TRUE;
+}
+
+void diskspace_module_init() {
+    LOG_DEBUG("Init gst-diskspace.c.\n");
+
+    memset(&g_info, 0, sizeof(g_info));
+
+    g_pool = g_thread_pool_new(diskspace_refresh_run, NULL, 1, TRUE, NULL);
+}
+
+void diskspace_module_exit() {
+    LOG_DEBUG("Clean up gst-diskspace.c.\n");
+
+    diskspace_set_pipeline(NULL, NULL, FALSE);
+
+    if (g_pool) {
+        g_thread_pool_free(g_pool, FALSE, TRUE);
+    }
+    g_pool = NULL;
+
+    G_LOCK(g_lock);
+    g_free(g_folder);
+    g_folder = NULL;
+    G_UNLOCK(g_lock);
+}
+
+void diskspace_set_pipeline(GstElement *pipeline, const gchar *filename, gboolean new_session) {
+    if (g_poll_id) {
+        g_source_remove(g_poll_id);
+    }
+    g_poll_id = 0;
+
+    if (g_pad) {
+        gst_pad_remove_probe(g_pad, g_probe_id);
+        gst_object_unref(g_pad);
+    }
+    g_pad = NULL;
+    g_probe_id = 0;
+    g_have_info = FALSE;
+
+    G_LOCK(g_lock);
+    g_free(g_folder);
+    g_folder = NULL;
+    g_fs_valid = FALSE;
+    g_produced = 0;
+    G_UNLOCK(g_lock);
+
+    if (!GST_IS_BIN(pipeline) || str_length0(filename) < 1) return;
+
+    gboolean guard = TRUE;
+    conf_get_boolean_value("disk-space-guard", &guard);
+    if (!guard) return;
+
+    GstElement *queue = gst_bin_get_by_name(GST_BIN(pipeline), PIPELINE_SINK_QUEUE);
+    if (!queue) return;
+
+    g_pad = gst_element_get_static_pad(queue, "sink");
+    gst_object_unref(queue);
+
+    if (!g_pad) return;
+
+    g_probe_id = gst_pad_add_probe(g_pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                                   diskspace_probe, NULL, NULL);
+
+    G_LOCK(g_lock);
+    g_folder = g_path_get_dirname(filename);
+    G_UNLOCK(g_lock);
+
+    memset(&g_info, 0, sizeof(g_info));
+    g_info.state = DISKSPACE_UNKNOWN;
+    g_info.remaining_sec = -1;
+    g_have_info = TRUE;
+
+    g_start_time = g_last_time = g_get_monotonic_time();
+    g_last_produced = 0;
+
+    // Read the free space on the first tick
+    g_refresh_time = g_start_time - DISKSPACE_REFRESH_MAX_MS * G_TIME_SPAN_MILLISECOND;
+
+    g_action_taken = FALSE;
+    g_stopping = FALSE;
+
+    if (new_session) {
+        g_warned = FALSE;
+        g_rotated = FALSE;
+    }
+
+    g_poll_id = g_timeout_add(DISKSPACE_POLL_MS, diskspace_poll_cb, NULL);
+}
+
+gboolean diskspace_get_info(DiskSpaceInfo *info) {
+    if (!g_have_info) return FALSE;
+
+    *info = g_info;
+    return TRUE;
+}
+
+gchar *diskspace_format_remaining(gint64 sec) {
+    if (sec < 0) return g_strdup("?");
+
+    if (sec >= 3600) {
+        return g_strdup_printf(_("%d h %02d min"), (gint)(sec / 3600), (gint)((sec % 3600) / 60));
+    }
+
+    if (sec >= 60) {
+        return g_strdup_printf(_("%d min"), (gint)(sec / 60));
+    }
+
+    return g_strdup_printf(_("%d s"), (gint)sec);
+}
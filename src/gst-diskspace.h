@@ -0,0 +1,46 @@
+#ifndef _GST_DISKSPACE_H
+#define _GST_DISKSPACE_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-diskspace.c.
+//#define DEBUG_DISKSPACE
+
+#if defined(DEBUG_DISKSPACE) || defined(DEBUG_ALL)
+#define LOG_DISKSPACE LOG_MSG
+#else
+#define LOG_DISKSPACE(x, ...)
+#endif
+
+typedef enum {
+    DISKSPACE_UNKNOWN,  // Not measured yet (no free space or no bitrate)
+    DISKSPACE_OK,
+    DISKSPACE_LOW,      // Below the warning threshold
+    DISKSPACE_ACTION,   // Below the action threshold ("disk-space-action" has been taken)
+    DISKSPACE_STOP,     // Only the space for a clean stop is left. Recording has been stopped.
+} DiskSpaceState;
+
+typedef struct {
+    DiskSpaceState state;
+
+    guint64 free_bytes;      // Free space of the audio folder (for the user), minus the data on its way to the file
+    guint64 reserve_bytes;   // Kept for a clean stop: the data still in the pipeline, and the index a muxer writes at EOS
+    gdouble bitrate;         // Bytes/s of the recording
+    gint64 remaining_sec;    // Predicted recording time (-1 = unknown)
+} DiskSpaceInfo;
+
+void diskspace_module_init();
+void diskspace_module_exit();
+
+// Watch the free space of the folder of filename while pipeline records (or stop watching if NULL).
+// A new session (not a segment of the running one) can take each action again.
+void diskspace_set_pipeline(GstElement *pipeline, const gchar *filename, gboolean new_session);
+
+// Free space and predicted recording time of the running recording. Return FALSE if there is none.
+gboolean diskspace_get_info(DiskSpaceInfo *info);
+
+// Predicted recording time for the GUI, eg. "2 h 05 min". Caller should g_free() this value.
+gchar *diskspace_format_remaining(gint64 sec);
+
+#endif
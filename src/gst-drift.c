@@ -0,0 +1,482 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+
+#include "gst-drift.h"
+#include "dconf.h"
+#include "log.h"
+#include "support.h"
+
+// Clock-drift compensation for recordings from 2 or more devices.
+//
+// Each device runs on its own hardware clock. The pipeline clock (one of the devices, or the system clock) is the master.
+// For every input branch (source ! queue ! mixer) we:
+//  - estimate the drift of the device against the master clock (samples delivered vs. clock time, in ppm),
+//  - resample the audio by a tiny ratio (linear interpolation) so the device follows the master clock,
+//  - re-timestamp the output so the mixer sees a continuous stream,
+//  - bound the queue to a latency budget ("input-latency-ms" setting). The queue drops old data if the budget is exceeded,
+//    so memory stays bounded also in 24-hour recordings.
+// Metrics (drift ppm, queue fill, samples inserted/dropped, queue overruns) are logged every minute and when the recording stops.
+
+// Default latency budget per input
+#define DRIFT_LATENCY_MS 200
+
+// Start compensation after this much audio (the drift estimate needs a baseline)
+#define DRIFT_SETTLE_TIME (10 * GST_SECOND)
+
+// Time constant for pulling the output timeline to the master clock
+#define DRIFT_SERVO_TAU 30.0
+
+// Max. correction in ppm (crystal drift is normally < 100 ppm)
+#define DRIFT_MAX_PPM 1000.0
+
+// Log metrics this often
+#define DRIFT_REPORT_INTERVAL (60 * GST_SECOND)
+
+#define DRIFT_STATES_KEY "drift-states"
+
+typedef struct {
+    gchar *name;
+
+    // Not referenced
+    GstElement *pipeline;
+    GstElement *queue;
+
+    guint latency_ms;
+
+    // Format from the caps event. Only interleaved F32LE and S16LE are resampled.
+    gint rate;
+    gint channels;
+    gboolean is_float;
+    gboolean supported;
+
+    // Timeline
+    gboolean started;
+    GstClockTime first_pts;
+    GstClockTime start_time;
+    guint64 samples_in;
+    guint64 samples_out;
+
+    // Estimated drift of the device (ppm, positive: device is fast)
+    gdouble drift_ppm;
+
+    // Smoothed offset of our output timeline against the master clock (seconds)
+    gdouble offset;
+
+    // Resampler. Output samples per input sample, position of the next output sample and the last input frame.
+    gdouble ratio;
+    gdouble phase;
+    gfloat *prev;
+
+    // Metrics
+    guint64 inserted;
+    guint64 dropped;
+    gint overruns;
+    GstClockTime last_report;
+
+} DriftState;
+
+static void drift_state_free(DriftState *st) {
+    g_free(st->name);
+    g_free(st->prev);
+    g_free(st);
+}
+
+static GPtrArray *drift_get_states(GstElement *pipeline, gboolean create) {
+    // States of the pipeline. They live as long as the pipeline.
+    if (!GST_IS_ELEMENT(pipeline)) return NULL;
+
+    GPtrArray *states = g_object_get_data(G_OBJECT(pipeline), DRIFT_STATES_KEY);
+    if (!states && create) {
+        states = g_ptr_array_new_with_free_func((GDestroyNotify)drift_state_free);
+        g_object_set_data_full(G_OBJECT(pipeline), DRIFT_STATES_KEY, states, (GDestroyNotify)g_ptr_array_unref);
+    }
+    return states;
+}
+
+static guint drift_get_latency_ms() {
+    // Latency budget per input
+    gint latency_ms = DRIFT_LATENCY_MS;
+    conf_get_int_value("input-latency-ms", &latency_ms);
+
+    if (latency_ms < 20) {
+        latency_ms = DRIFT_LATENCY_MS;
+    }
+    return (guint)latency_ms;
+}
+
+static gboolean drift_has_property(GstElement *elem, const gchar *prop) {
+    return (g_object_class_find_property(G_OBJECT_GET_CLASS(elem), prop) != NULL);
+}
+
+void drift_setup_mixer(GstElement *pipeline, GstElement *mixer) {
+    // Let the mixer (GstAggregator) wait for late inputs up to the latency budget
+    if (GST_IS_ELEMENT(mixer) && drift_has_property(mixer, "latency")) {
+        g_object_set(G_OBJECT(mixer), "latency", (guint64)drift_get_latency_ms() * GST_MSECOND, NULL);
+    }
+}
+
+void drift_setup_sources(GstElement *pipeline) {
+    // We re-timestamp and resample the audio ourselves.
+    // Turn off the sources' own slaving (skew mode drops or inserts whole chunks = glitches).
+    GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    GValue value = G_VALUE_INIT;
+
+    while (gst_iterator_next(it, &value) == GST_ITERATOR_OK) {
+        GstElement *elem = GST_ELEMENT(g_value_get_object(&value));
+
+        if (drift_has_property(elem, "slave-method")) {
+            // 3 = GST_AUDIO_BASE_SRC_SLAVE_NONE
+            g_object_set(G_OBJECT(elem), "slave-method", 3, NULL);
+        }
+
+        g_value_reset(&value);
+    }
+
+    g_value_unset(&value);
+    gst_iterator_free(it);
+}
+
+static void drift_overrun_cb(GstElement *queue, gpointer user_data) {
+    // The queue dropped data (input exceeded its latency budget)
+    DriftState *st = (DriftState*)user_data;
+    g_atomic_int_inc(&st->overruns);
+}
+
+static void drift_parse_caps(DriftState *st, GstCaps *caps) {
+    // Read rate, channels and sample format
+    GstStructure *s = gst_caps_get_structure(caps, 0);
+
+    st->rate = 0;
+    st->channels = 0;
+    gst_structure_get_int(s, "rate", &st->rate);
+    gst_structure_get_int(s, "channels", &st->channels);
+
+    const gchar *format = gst_structure_get_string(s, "format");
+    const gchar *layout = gst_structure_get_string(s, "layout");
+
+    st->is_float = !g_strcmp0(format, "F32LE");
+    st->supported = (st->rate > 0 && st->channels > 0) &&
+                    (st->is_float || !g_strcmp0(format, "S16LE")) &&
+                    (!layout || !g_strcmp0(layout, "interleaved"));
+
+    if (!st->supported) {
+        LOG_MSG("Drift compensation is not available for %s (format %s).\n", st->name, format);
+    }
+
+    // Restart the resampler
+    g_free(st->prev);
+    st->prev = NULL;
+    st->phase = 1.0;
+}
+
+static GstClockTime drift_clock_time(DriftState *st) {
+    // Running time of the master clock
+    GstClock *clock = gst_element_get_clock(st->pipeline);
+    if (!clock) return GST_CLOCK_TIME_NONE;
+
+    GstClockTime now = gst_clock_get_time(clock);
+    gst_object_unref(clock);
+
+    GstClockTime base = gst_element_get_base_time(st->pipeline);
+    return (now > base ? now - base : 0);
+}
+
+static void drift_update_ratio(DriftState *st, GstClockTime now) {
+    // Estimate drift and set the resampling ratio
+    GstClockTime elapsed = now - st->start_time;
+    if (elapsed < DRIFT_SETTLE_TIME) return;
+
+    gdouble clock_secs = (gdouble)elapsed / GST_SECOND;
+    gdouble device_secs = (gdouble)st->samples_in / st->rate;
+
+    // Long-term drift. Scheduling jitter averages out as the recording goes on.
+    st->drift_ppm = (device_secs - clock_secs) / clock_secs * 1e6;
+
+    // Offset of our output against the master clock (positive: output runs ahead)
+    gdouble out_secs = (gdouble)st->samples_out / st->rate;
+    st->offset += 0.01 * ((out_secs - clock_secs) - st->offset);
+
+    // Follow the master clock, and slowly remove the offset
+    gdouble ppm = -st->drift_ppm - st->offset / DRIFT_SERVO_TAU * 1e6;
+    ppm = CLAMP(ppm, -DRIFT_MAX_PPM, DRIFT_MAX_PPM);
+
+    st->ratio = 1.0 + ppm / 1e6;
+}
+
+static GstBuffer *drift_resample(DriftState *st, GstBuffer *buf) {
+    // Resample buf by st->ratio (linear interpolation). Return a new buffer.
+    GstMapInfo map;
+    if (!gst_buffer_map(buf, &map, GST_MAP_READ)) return NULL;
+
+    gint ch = st->channels;
+    gint bps = (st->is_float ? 4 : 2);
+    gint n_in = map.size / (bps * ch);
+
+    if (n_in < 1) {
+        gst_buffer_unmap(buf, &map);
+        return NULL;
+    }
+
+    if (!st->prev) {
+        // First frame
+        st->prev = g_new0(gfloat, ch);
+        st->phase = 1.0;
+    }
+
+    gdouble step = 1.0 / st->ratio;
+    gint n_max = (gint)((n_in - st->phase) / step) + 2;
+    if (n_max < 1) n_max = 1;
+
+    GstBuffer *out = gst_buffer_new_allocate(NULL, n_max * bps * ch, NULL);
+
+    GstMapInfo out_map;
+    gst_buffer_map(out, &out_map, GST_MAP_WRITE);
+
+    const gfloat *in_f = (const gfloat*)map.data;
+    const gint16 *in_s = (const gint16*)map.data;
+    gfloat *out_f = (gfloat*)out_map.data;
+    gint16 *out_s = (gint16*)out_map.data;
+
+    gdouble t = st->phase;
+    gint n_out = 0;
+
+    // t is the position in input frames. Frame 0 is the last frame of the previous buffer (st->prev).
+    while (t < n_in && n_out < n_max) {
+        gint i = (gint)t;
+        gfloat frac = (gfloat)(t - i);
+
+        gint c = 0;
+        for (c = 0; c < ch; c++) {
+            gfloat a = 0.0;
+            gfloat b = 0.0;
+
+            if (st->is_float) {
+                a = (i == 0 ? st->prev[c] : in_f[(i - 1) * ch + c]);
+                b = in_f[i * ch + c];
+            } else {
+                a = (i == 0 ? st->prev[c] : in_s[(i - 1) * ch + c] / 32768.0f);
+                b = in_s[i * ch + c] / 32768.0f;
+            }
+
+            gfloat v = a + (b - a) * frac;
+
+            if (st->is_float) {
+                out_f[n_out * ch + c] = v;
+            } else {
+                gfloat f = v * 32768.0f + (v >= 0.0f ? 0.5f : -0.5f);
+                out_s[n_out * ch + c] = (gint16)CLAMP(f, -32768.0f, 32767.0f);
+            }
+        }
+
+        n_out++;
+        t += step;
+    }
+
+    st->phase = t - n_in;
+
+    // Save the last input frame
+    gint c = 0;
+    for (c = 0; c < ch; c++) {
+        st->prev[c] = (st->is_float ? in_f[(n_in - 1) * ch + c] : in_s[(n_in - 1) * ch + c] / 32768.0f);
+    }
+
+    gst_buffer_unmap(out, &out_map);
+    gst_buffer_unmap(buf, &map);
+
+    gst_buffer_resize(out, 0, n_out * bps * ch);
+
+    // Metrics
+    if (n_out > n_in) {
+        st->inserted += n_out - n_in;
+    } else {
+        st->dropped += n_in - n_out;
+    }
+
+    return out;
+}
+
+static void drift_log_state(DriftState *st) {
+    guint64 level_time = 0;
+    if (GST_IS_ELEMENT(st->queue)) {
+        g_object_get(G_OBJECT(st->queue), "current-level-time", &level_time, NULL);
+    }
+
+    LOG_MSG("Input %s: drift %+.1f ppm, queue %" G_GUINT64_FORMAT " of %u ms, %" G_GUINT64_FORMAT " samples inserted, %"
+            G_GUINT64_FORMAT " dropped, %d queue overruns.\n", st->name, st->drift_ppm, level_time / GST_MSECOND, st->latency_ms,
+            st->inserted, st->dropped, g_atomic_int_get(&st->overruns));
+}
+
+static GstPadProbeReturn drift_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    // Runs in the streaming thread of the queue
+    DriftState *st = (DriftState*)user_data;
+
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+        if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+            GstCaps *caps = NULL;
+            gst_event_parse_caps(event, &caps);
+            drift_parse_caps(st, caps);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!(buf && st->supported)) return GST_PAD_PROBE_OK;
+
+    GstClockTime now = drift_clock_time(st);
+    if (!GST_CLOCK_TIME_IS_VALID(now)) return GST_PAD_PROBE_OK;
+
+    gsize frame_size = (st->is_float ? 4 : 2) * st->channels;
+    guint64 n_in = gst_buffer_get_size(buf) / frame_size;
+
+    if (!st->started) {
+        st->started = TRUE;
+        st->first_pts = (GST_BUFFER_PTS_IS_VALID(buf) ? GST_BUFFER_PTS(buf) : now);
+        st->start_time = now;
+        st->last_report = now;
+        st->ratio = 1.0;
+    }
+
+    drift_update_ratio(st, now);
+
+    st->samples_in += n_in;
+
+    GstBuffer *out = NULL;
+    if (st->ratio != 1.0 || st->prev) {
+        out = drift_resample(st, buf);
+    }
+
+    if (out) {
+        gst_buffer_copy_into(out, buf, GST_BUFFER_COPY_METADATA, 0, -1);
+        gst_buffer_unref(buf);
+        buf = out;
+        GST_PAD_PROBE_INFO_DATA(info) = buf;
+    } else {
+        buf = gst_buffer_make_writable(buf);
+        GST_PAD_PROBE_INFO_DATA(info) = buf;
+    }
+
+    // Continuous output timeline
+    guint64 n_out = gst_buffer_get_size(buf) / frame_size;
+
+    GST_BUFFER_PTS(buf) = st->first_pts + gst_util_uint64_scale(st->samples_out, GST_SECOND, st->rate);
+    GST_BUFFER_DURATION(buf) = gst_util_uint64_scale(n_out, GST_SECOND, st->rate);
+    GST_BUFFER_OFFSET(buf) = st->samples_out;
+    GST_BUFFER_OFFSET_END(buf) = st->samples_out + n_out;
+    GST_BUFFER_FLAG_UNSET(buf, GST_BUFFER_FLAG_DISCONT);
+
+    st->samples_out += n_out;
+
+    if (now - st->last_report >= DRIFT_REPORT_INTERVAL) {
+        st->last_report = now;
+        drift_log_state(st);
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+void drift_attach(GstElement *pipeline, GstElement *queue, const gchar *device) {
+    // Add drift compensation and latency budget to an input branch
+
+    DriftState *st = g_malloc0(sizeof(DriftState));
+    st->name = g_strdup(device ? device : "default");
+    st->pipeline = pipeline;
+    st->queue = queue;
+    st->latency_ms = drift_get_latency_ms();
+    st->ratio = 1.0;
+    st->phase = 1.0;
+
+    g_ptr_array_add(drift_get_states(pipeline, TRUE), st);
+
+    // Bounded queue. Drop old data (leaky=2, downstream) if the input exceeds its latency budget.
+    g_object_set(G_OBJECT(queue),
+                 "max-size-time", (guint64)st->latency_ms * GST_MSECOND,
+                 "max-size-buffers", 0,
+                 "max-size-bytes", 0,
+                 "leaky", 2,
+                 NULL);
+
+    g_signal_connect(queue, "overrun", G_CALLBACK(drift_overrun_cb), st);
+
+    GstPad *pad = gst_element_get_static_pad(queue, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, drift_probe, st, NULL);
+    gst_object_unref(pad);
+}
+
+void drift_detach(GstElement *pipeline, GstElement *queue) {
+    // The input branch was removed from the recording. Keep its metrics for the final report.
+    GPtrArray *states = drift_get_states(pipeline, FALSE);
+    if (!states) return;
+
+    guint i = 0;
+    for (i = 0; i < states->len; i++) {
+        DriftState *st = g_ptr_array_index(states, i);
+        if (st->queue == queue) {
+            g_signal_handlers_disconnect_by_func(queue, drift_overrun_cb, st);
+            st->queue = NULL;
+        }
+    }
+}
+
+void drift_reset(GstElement *pipeline) {
+    // Prepare a stopped pipeline for a new recording. Start new timelines and metrics.
+    GPtrArray *states = drift_get_states(pipeline, FALSE);
+    if (!states) return;
+
+    guint i = states->len;
+    while (i-- > 0) {
+        DriftState *st = g_ptr_array_index(states, i);
+
+        // Branch was removed
+        if (!st->queue) {
+            g_ptr_array_remove_index(states, i);
+            continue;
+        }
+
+        st->started = FALSE;
+        st->samples_in = 0;
+        st->samples_out = 0;
+        st->drift_ppm = 0.0;
+        st->offset = 0.0;
+        st->ratio = 1.0;
+        st->phase = 1.0;
+
+        g_free(st->prev);
+        st->prev = NULL;
+
+        st->inserted = 0;
+        st->dropped = 0;
+        g_atomic_int_set(&st->overruns, 0);
+    }
+}
+
+void drift_report(GstElement *pipeline) {
+    // Write drift metrics of all inputs to the log
+    GPtrArray *states = drift_get_states(pipeline, FALSE);
+    if (!states) return;
+
+    guint i = 0;
+    for (i = 0; i < states->len; i++) {
+        DriftState *st = g_ptr_array_index(states, i);
+        if (st->started) {
+            drift_log_state(st);
+        }
+    }
+}
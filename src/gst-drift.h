@@ -0,0 +1,34 @@
+#ifndef _GST_DRIFT_H
+#define _GST_DRIFT_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-drift.c.
+//#define DEBUG_DRIFT
+
+#if defined(DEBUG_DRIFT) || defined(DEBUG_ALL)
+#define LOG_DRIFT LOG_MSG
+#else
+#define LOG_DRIFT(x, ...)
+#endif
+
+// Prepare the mixer for drift compensation (latency budget)
+void drift_setup_mixer(GstElement *pipeline, GstElement *mixer);
+
+// Add drift compensation and latency budget to an input branch. queue is linked to the mixer.
+void drift_attach(GstElement *pipeline, GstElement *queue, const gchar *device);
+
+// Input branch with queue was removed from the pipeline
+void drift_detach(GstElement *pipeline, GstElement *queue);
+
+// Prepare a stopped pipeline for a new recording
+void drift_reset(GstElement *pipeline);
+
+// Let the drift compensation own the timing of all audio sources in the pipeline
+void drift_setup_sources(GstElement *pipeline);
+
+// Write drift metrics of all inputs to the log
+void drift_report(GstElement *pipeline);
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <glib/gstdio.h>
+
+#include "gst-encrypt.h"
+#include "log.h"
+#include "dconf.h"
+#include "support.h"
+
+// Encryption API of a build without OpenSSL (./configure --disable-encryption, or no libcrypto >= 3.0.0).
+// See gst-encrypt.c. The recordings are never written in cleartext when the "encryption" setting is on;
+// the recording fails to start instead.
+
+static gboolean encrypt_setting() {
+    gboolean enabled = FALSE;
+    conf_get_boolean_value("encryption", &enabled);
+    return enabled;
+}
+
+void encrypt_module_init() {
+    LOG_DEBUG("Init gst-encrypt-none.c.\n");
+
+    if (encrypt_setting()) {
+        LOG_ERROR("Encryption of the recordings is on, but this program was built without it.\n");
+    }
+}
+
+gboolean encrypt_enabled() {
+    // There is no "arencrypt" element in the pipeline
+    return FALSE;
+}
+
+gboolean encrypt_setup_pipeline(GstElement *pipeline, gchar **err_msg) {
+    (void)pipeline;
+
+    if (!encrypt_setting()) return TRUE;
+
+    *err_msg = g_strdup(_("Encryption of the recordings is on, but this program was built without it.\n"));
+    return FALSE;
+}
+
+gboolean encrypt_is_file(const gchar *filename) {
+    gboolean found = FALSE;
+
+    gint fd = g_open(filename, O_RDONLY, 0);
+    if (fd < 0) return FALSE;
+
+    gchar magic[8];
+    found = (read(fd, magic, sizeof(magic)) == sizeof(magic) && !memcmp(magic, ENCRYPT_MAGIC, sizeof(magic)));
+
+    close(fd);
+    return found;
+}
+
+gboolean encrypt_decrypt_file(const gchar *filename, const gchar *output, const gchar *key_source) {
+    (void)output;
+    (void)key_source;
+
+    g_print(_("Cannot decrypt %s. This program was built without encryption.\n"), filename);
+    return FALSE;
+}
+
+void encrypt_benchmark(guint mbytes) {
+    (void)mbytes;
+
+    g_print(_("This program was built without encryption.\n"));
+}
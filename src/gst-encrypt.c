@@ -0,0 +1,1012 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
+#include "gst-encrypt.h"
+#include "gst-pipeline.h"
+#include "log.h"
+#include "dconf.h"
+#include "utility.h"
+#include "support.h"
+
+// Encryption of the recordings at rest ("encryption" setting).
+//
+// The "arencrypt" element sits between the encoder and the sink queue, so the data is encrypted before the
+// queue, the spool file (gst-stall.c) and the file. Cleartext never reaches the disk; there is no second pass.
+//
+// The file is AES-256-GCM in chunks (OpenSSL uses AES-NI and PCLMULQDQ when the CPU has them):
+//      header (64 bytes): "AR-ENC01", chunk size (u32 BE), cipher 1 (u32 BE), key id (8), file id (16), zeros
+//      record i: nonce (12) | ciphertext of chunk i (ENCRYPT_CHUNK_SIZE bytes, the last one shorter) | tag (16)
+// Record i is at 64 + i * (ENCRYPT_CHUNK_SIZE + 28), so a chunk can be replaced in place.
+// Each file has its own key: HMAC-SHA256(key, "audio-recorder file key" || file id).
+// The nonce is the chunk index (u64 BE) and a counter of the file (u32 BE); it is never reused.
+// Authenticated data: header bytes 0-39, chunk index (u64 BE), final flag (1 byte). The last record has the final
+// flag, so a truncated file is detected. After a crash the records that were written still decrypt.
+//
+// Muxers seek back to rewrite their headers (WAV, FLAC, Xing, MP4 mdat size). The cleartext of the first
+// ENCRYPT_CACHE_CHUNKS chunks is kept in memory; a rewritten chunk is encrypted again with a new nonce.
+// encrypt_setup_pipeline() turns off the mp4mux modes that rewrite more (reserved moov) or use a temp file (faststart).
+//
+// Key ("encryption-key" setting): path of a key file (32 bytes, or 64 hex digits), or "keyring:<name>":
+//      $ head -c 32 /dev/urandom > ~/.config/audio-recorder/recording.key; chmod 600 ~/.config/audio-recorder/recording.key
+//      $ openssl rand -hex 32 | secret-tool store --label="Audio Recorder" application audio-recorder key <name>
+// Decrypt:
+//      $ audio-recorder --decrypt=<file> [--decrypt-output=<file>] [--decrypt-key=<key file or keyring:name>]
+
+#define ENCRYPT_CIPHER_AES256_GCM 1
+
+#define ENCRYPT_HEADER_LEN 64
+#define ENCRYPT_AAD_HEADER 40
+#define ENCRYPT_NONCE_LEN 12
+#define ENCRYPT_TAG_LEN 16
+
+#define ENCRYPT_RECORD_OVERHEAD (ENCRYPT_NONCE_LEN + ENCRYPT_TAG_LEN)
+#define ENCRYPT_RECORD_SIZE (ENCRYPT_CHUNK_SIZE + ENCRYPT_RECORD_OVERHEAD)
+
+// Cleartext of the first chunks (1 MB) for the header rewrites. Max. 32 (bits of the dirty mask).
+#define ENCRYPT_CACHE_CHUNKS 16
+
+typedef struct {
+    GstElement parent;
+
+    GstPad *sinkpad;
+    GstPad *srcpad;
+
+    // Key of the user. The file key and the header are new for each file.
+    guint8 key[ENCRYPT_KEY_LEN];
+    gboolean has_key;
+
+    EVP_CIPHER_CTX *ctx;
+    guint8 header[ENCRYPT_HEADER_LEN];
+    gboolean header_sent;
+    gboolean caps_sent;
+    guint32 counter;
+
+    // Cleartext offset of the next input buffer, and the cleartext in the records that have been written
+    guint64 position;
+    guint64 tail;
+
+    // Current chunk. It is written when it is full, or at EOS as the final record.
+    guint8 *chunk;
+    gsize chunk_len;
+
+    // Cleartext of the first chunks, and the chunks that have been rewritten
+    guint8 *cache;
+    guint32 dirty;
+
+    // Write position of the sink
+    guint64 out_pos;
+} ArEncrypt;
+
+typedef struct {
+    GstElementClass parent_class;
+} ArEncryptClass;
+
+GType ar_encrypt_get_type(void);
+
+#define AR_TYPE_ENCRYPT (ar_encrypt_get_type())
+#define AR_ENCRYPT(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), AR_TYPE_ENCRYPT, ArEncrypt))
+
+G_DEFINE_TYPE(ArEncrypt, ar_encrypt, GST_TYPE_ELEMENT);
+
+static GstStaticPadTemplate g_sink_template = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+        GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate g_src_template = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+        GST_STATIC_CAPS("application/x-audio-recorder-encrypted"));
+
+static GstFlowReturn ar_encrypt_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer);
+static gboolean ar_encrypt_sink_event(GstPad *pad, GstObject *parent, GstEvent *event);
+static GstStateChangeReturn ar_encrypt_change_state(GstElement *element, GstStateChange transition);
+static void ar_encrypt_finalize(GObject *object);
+
+// ---------------------------------------------------------------------
+// Records
+// ---------------------------------------------------------------------
+
+static void encrypt_key_id(const guint8 *key, guint8 *id) {
+    // First 8 bytes of SHA-256("audio-recorder key id" || key). Tells a wrong key from a damaged file.
+    GChecksum *sha = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(sha, (const guchar*)"audio-recorder key id", 21);
+    g_checksum_update(sha, key, ENCRYPT_KEY_LEN);
+
+    guint8 digest[32];
+    gsize len = sizeof(digest);
+    g_checksum_get_digest(sha, digest, &len);
+    g_checksum_free(sha);
+
+    memcpy(id, digest, 8);
+}
+
+static EVP_CIPHER_CTX *encrypt_ctx_new(const guint8 *key, const guint8 *header, gboolean encrypt) {
+    // AES-256-GCM with the key of the file
+    guint8 file_key[32];
+    gsize len = sizeof(file_key);
+
+    GHmac *hmac = g_hmac_new(G_CHECKSUM_SHA256, key, ENCRYPT_KEY_LEN);
+    g_hmac_update(hmac, (const guchar*)"audio-recorder file key", 23);
+    g_hmac_update(hmac, header + 24, 16);
+    g_hmac_get_digest(hmac, file_key, &len);
+    g_hmac_unref(hmac);
+
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+
+    gboolean ok = ctx &&
+                  EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL, encrypt) &&
+                  EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, ENCRYPT_NONCE_LEN, NULL) &&
+                  EVP_CipherInit_ex(ctx, NULL, NULL, file_key, NULL, encrypt);
+
+    OPENSSL_cleanse(file_key, sizeof(file_key));
+
+    if (!ok && ctx) {
+        EVP_CIPHER_CTX_free(ctx);
+        ctx = NULL;
+    }
+
+    return ctx;
+}
+
+static void encrypt_aad(const guint8 *header, guint64 index, gboolean final, guint8 *aad) {
+    memcpy(aad, header, ENCRYPT_AAD_HEADER);
+    GST_WRITE_UINT64_BE(aad + ENCRYPT_AAD_HEADER, index);
+    aad[ENCRYPT_AAD_HEADER + 8] = (final ? 1 : 0);
+}
+
+static gboolean encrypt_seal(EVP_CIPHER_CTX *ctx, const guint8 *header, guint64 index, guint32 counter, gboolean final,
+                             const guint8 *data, gsize len, guint8 *record) {
+    // Encrypt a chunk to a record (len + ENCRYPT_RECORD_OVERHEAD bytes)
+    guint8 aad[ENCRYPT_AAD_HEADER + 9];
+    encrypt_aad(header, index, final, aad);
+
+    guint8 *nonce = record;
+    GST_WRITE_UINT64_BE(nonce, index);
+    GST_WRITE_UINT32_BE(nonce + 8, counter);
+
+    gint n = 0;
+    if (!EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, nonce)) return FALSE;
+    if (!EVP_EncryptUpdate(ctx, NULL, &n, aad, sizeof(aad))) return FALSE;
+    if (len && !EVP_EncryptUpdate(ctx, record + ENCRYPT_NONCE_LEN, &n, data, (gint)len)) return FALSE;
+    if (!EVP_EncryptFinal_ex(ctx, record + ENCRYPT_NONCE_LEN + len, &n)) return FALSE;
+
+    return EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, ENCRYPT_TAG_LEN, record + ENCRYPT_NONCE_LEN + len);
+}
+
+static gboolean encrypt_open(EVP_CIPHER_CTX *ctx, const guint8 *header, guint64 index, gboolean final,
+                             const guint8 *record, gsize record_len, guint8 *data) {
+    // Decrypt and authenticate a record. Return FALSE if it was not written with this key, index and final flag.
+    if (record_len < ENCRYPT_RECORD_OVERHEAD) return FALSE;
+
+    gsize len = record_len - ENCRYPT_RECORD_OVERHEAD;
+
+    guint8 aad[ENCRYPT_AAD_HEADER + 9];
+    encrypt_aad(header, index, final, aad);
+
+    gint n = 0;
+    if (!EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, record)) return FALSE;
+    if (!EVP_DecryptUpdate(ctx, NULL, &n, aad, sizeof(aad))) return FALSE;
+    if (len && !EVP_DecryptUpdate(ctx, data, &n, record + ENCRYPT_NONCE_LEN, (gint)len)) return FALSE;
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, ENCRYPT_TAG_LEN, (void*)(record + ENCRYPT_NONCE_LEN + len))) return FALSE;
+
+    return EVP_DecryptFinal_ex(ctx, data + len, &n) > 0;
+}
+
+static gboolean encrypt_build_header(const guint8 *key, guint8 *header) {
+    memset(header, 0, ENCRYPT_HEADER_LEN);
+    memcpy(header, ENCRYPT_MAGIC, 8);
+    GST_WRITE_UINT32_BE(header + 8, ENCRYPT_CHUNK_SIZE);
+    GST_WRITE_UINT32_BE(header + 12, ENCRYPT_CIPHER_AES256_GCM);
+    encrypt_key_id(key, header + 16);
+
+    // File id. The file key is derived from it, and the nonce counter restarts in every file.
+    // A repeated file id would reuse nonces, so there is no fallback to a weaker generator.
+    return (RAND_bytes(header + 24, 16) == 1);
+}
+
+// ---------------------------------------------------------------------
+// Keys
+// ---------------------------------------------------------------------
+
+static gboolean encrypt_parse_hex(const gchar *str, guint8 *key) {
+    if (!(str && strlen(str) == ENCRYPT_KEY_LEN * 2)) return FALSE;
+
+    guint i = 0;
+    for (i = 0; i < ENCRYPT_KEY_LEN; i++) {
+        gint hi = g_ascii_xdigit_value(str[i * 2]);
+        gint lo = g_ascii_xdigit_value(str[i * 2 + 1]);
+        if (hi < 0 || lo < 0) return FALSE;
+
+        key[i] = (guint8)(hi << 4 | lo);
+    }
+
+    return TRUE;
+}
+
+static gboolean encrypt_load_key(const gchar *source, guint8 *key, gchar **err_msg) {
+    // Key from a key file or from the keyring (source NULL = "encryption-key" setting)
+    gchar *src = g_strdup(source);
+    if (!src) {
+        conf_get_string_value("encryption-key", &src);
+    }
+    str_trim(src);
+
+    gboolean ok = FALSE;
+
+    if (str_length(src, 4096) < 1) {
+        *err_msg = g_strdup(_("Encryption is on, but there is no encryption key.\n"));
+    }
+
+    else if (g_str_has_prefix(src, "keyring:")) {
+        // $ secret-tool lookup application audio-recorder key <name>
+        gchar *name = g_shell_quote(src + strlen("keyring:"));
+        gchar *cmd = g_strdup_printf("secret-tool lookup application audio-recorder key %s", name);
+
+        gint status = 0;
+        gchar *serr = NULL;
+        gchar *sout = NULL;
+        exec_command_sync(cmd, &status, &serr, &sout);
+
+        ok = (status == 0 && encrypt_parse_hex(sout, key));
+        if (!ok) {
+            *err_msg = g_strdup_printf(_("Cannot read the encryption key \"%s\" from the keyring. %s\n"), src + strlen("keyring:"), check_null(serr));
+        }
+
+        if (sout) OPENSSL_cleanse(sout, strlen(sout));
+
+        g_free(sout);
+        g_free(serr);
+        g_free(cmd);
+        g_free(name);
+    }
+
+    else {
+        // Key file: 32 bytes, or 64 hex digits
+        gchar *text = NULL;
+        gsize len = 0;
+        GError *error = NULL;
+
+        if (g_file_get_contents(src, &text, &len, &error)) {
+            if (len == ENCRYPT_KEY_LEN) {
+                memcpy(key, text, ENCRYPT_KEY_LEN);
+                ok = TRUE;
+            } else {
+                g_strstrip(text);
+                ok = encrypt_parse_hex(text, key);
+            }
+
+            if (!ok) {
+                *err_msg = g_strdup_printf(_("Encryption key file \"%s\" must have 32 bytes or 64 hex digits.\n"), src);
+            }
+
+            GStatBuf st;
+            if (ok && g_stat(src, &st) == 0 && (st.st_mode & (S_IRWXG | S_IRWXO))) {
+                LOG_MSG("Encryption key file %s can be read by other users. Set its mode to 600.\n", src);
+            }
+
+            OPENSSL_cleanse(text, len);
+            g_free(text);
+        } else {
+            *err_msg = g_strdup_printf(_("Cannot read encryption key file \"%s\". %s\n"), src, error->message);
+            g_error_free(error);
+        }
+    }
+
+    g_free(src);
+    return ok;
+}
+
+// ---------------------------------------------------------------------
+// arencrypt element
+// ---------------------------------------------------------------------
+
+static void ar_encrypt_class_init(ArEncryptClass *klass) {
+    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+
+    gst_element_class_set_static_metadata(element_class, "Audio-recorder encryption", "Filter/Encrypter",
+                                          "Encrypt the file in authenticated chunks (AES-256-GCM)", "Osmo Antero");
+
+    gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&g_sink_template));
+    gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&g_src_template));
+
+    object_class->finalize = ar_encrypt_finalize;
+    element_class->change_state = ar_encrypt_change_state;
+}
+
+static void ar_encrypt_reset(ArEncrypt *enc) {
+    // A new file: new file id, file key and counter
+    if (enc->ctx) {
+        EVP_CIPHER_CTX_free(enc->ctx);
+        enc->ctx = NULL;
+    }
+
+    if (enc->has_key && encrypt_build_header(enc->key, enc->header)) {
+        enc->ctx = encrypt_ctx_new(enc->key, enc->header, TRUE);
+    }
+
+    enc->header_sent = FALSE;
+    enc->caps_sent = FALSE;
+    enc->counter = 0;
+
+    enc->position = 0;
+    enc->tail = 0;
+    enc->chunk_len = 0;
+
+    enc->dirty = 0;
+
+    enc->out_pos = G_MAXUINT64;
+}
+
+static void ar_encrypt_init(ArEncrypt *enc) {
+    enc->sinkpad = gst_pad_new_from_static_template(&g_sink_template, "sink");
+    gst_pad_set_chain_function(enc->sinkpad, ar_encrypt_chain);
+    gst_pad_set_event_function(enc->sinkpad, ar_encrypt_sink_event);
+    gst_element_add_pad(GST_ELEMENT(enc), enc->sinkpad);
+
+    enc->srcpad = gst_pad_new_from_static_template(&g_src_template, "src");
+    gst_pad_use_fixed_caps(enc->srcpad);
+    gst_element_add_pad(GST_ELEMENT(enc), enc->srcpad);
+
+    enc->chunk = g_malloc(ENCRYPT_CHUNK_SIZE);
+    enc->cache = g_malloc(ENCRYPT_CACHE_CHUNKS * ENCRYPT_CHUNK_SIZE);
+
+    ar_encrypt_reset(enc);
+}
+
+static void ar_encrypt_finalize(GObject *object) {
+    ArEncrypt *enc = AR_ENCRYPT(object);
+
+    if (enc->ctx) {
+        EVP_CIPHER_CTX_free(enc->ctx);
+    }
+
+    // No cleartext or keys left in freed memory
+    OPENSSL_cleanse(enc->key, sizeof(enc->key));
+    OPENSSL_cleanse(enc->chunk, ENCRYPT_CHUNK_SIZE);
+    OPENSSL_cleanse(enc->cache, ENCRYPT_CACHE_CHUNKS * ENCRYPT_CHUNK_SIZE);
+
+    g_free(enc->chunk);
+    g_free(enc->cache);
+
+    G_OBJECT_CLASS(ar_encrypt_parent_class)->finalize(object);
+}
+
+static void ar_encrypt_set_key(ArEncrypt *enc, const guint8 *key) {
+    // Called before the pipeline starts
+    GST_OBJECT_LOCK(enc);
+    memcpy(enc->key, key, ENCRYPT_KEY_LEN);
+    enc->has_key = TRUE;
+    ar_encrypt_reset(enc);
+    GST_OBJECT_UNLOCK(enc);
+}
+
+static GstFlowReturn ar_encrypt_push(ArEncrypt *enc, GstBuffer *buf, guint64 offset) {
+    // Write buf at offset of the file
+    if (enc->out_pos != offset) {
+        GstSegment segment;
+        gst_segment_init(&segment, GST_FORMAT_BYTES);
+        segment.start = offset;
+        segment.position = offset;
+        gst_pad_push_event(enc->srcpad, gst_event_new_segment(&segment));
+    }
+
+    enc->out_pos = offset + gst_buffer_get_size(buf);
+
+    GST_BUFFER_OFFSET(buf) = offset;
+    GST_BUFFER_OFFSET_END(buf) = enc->out_pos;
+
+    return gst_pad_push(enc->srcpad, buf);
+}
+
+static GstFlowReturn ar_encrypt_push_record(ArEncrypt *enc, guint64 index, const guint8 *data, gsize len, gboolean final) {
+    if (enc->counter == G_MAXUINT32) {
+        // 4 billion records. A nonce must not repeat.
+        GST_ELEMENT_ERROR(enc, STREAM, ENCRYPT, (NULL), ("Too many encrypted records in one file."));
+        return GST_FLOW_ERROR;
+    }
+
+    GstBuffer *buf = gst_buffer_new_allocate(NULL, len + ENCRYPT_RECORD_OVERHEAD, NULL);
+
+    GstMapInfo map;
+    gst_buffer_map(buf, &map, GST_MAP_WRITE);
+    gboolean ok = encrypt_seal(enc->ctx, enc->header, index, enc->counter++, final, data, len, map.data);
+    gst_buffer_unmap(buf, &map);
+
+    if (!ok) {
+        gst_buffer_unref(buf);
+        GST_ELEMENT_ERROR(enc, STREAM, ENCRYPT, (NULL), ("Cannot encrypt a chunk."));
+        return GST_FLOW_ERROR;
+    }
+
+    return ar_encrypt_push(enc, buf, ENCRYPT_HEADER_LEN + index * ENCRYPT_RECORD_SIZE);
+}
+
+static GstFlowReturn ar_encrypt_flush_dirty(ArEncrypt *enc) {
+    // Encrypt the rewritten chunks again (new nonces)
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    guint64 i = 0;
+    for (i = 0; ret == GST_FLOW_OK && enc->dirty && i < ENCRYPT_CACHE_CHUNKS; i++) {
+        if (!(enc->dirty & (1u << i))) continue;
+
+        enc->dirty &= ~(1u << i);
+        ret = ar_encrypt_push_record(enc, i, enc->cache + i * ENCRYPT_CHUNK_SIZE, ENCRYPT_CHUNK_SIZE, FALSE);
+
+        LOG_ENCRYPT("arencrypt: chunk %" G_GUINT64_FORMAT " rewritten.\n", i);
+    }
+
+    return ret;
+}
+
+static GstFlowReturn ar_encrypt_emit(ArEncrypt *enc, gboolean final) {
+    // Write the current chunk. A full chunk that is not final moves the tail.
+    guint64 index = enc->tail / ENCRYPT_CHUNK_SIZE;
+
+    if (index < ENCRYPT_CACHE_CHUNKS) {
+        memcpy(enc->cache + index * ENCRYPT_CHUNK_SIZE, enc->chunk, enc->chunk_len);
+    }
+
+    GstFlowReturn ret = ar_encrypt_push_record(enc, index, enc->chunk, enc->chunk_len, final);
+
+    if (!final) {
+        enc->tail += ENCRYPT_CHUNK_SIZE;
+        enc->chunk_len = 0;
+    }
+
+    // The muxer is writing at the end again. Its header rewrites are complete.
+    if (ret == GST_FLOW_OK) {
+        ret = ar_encrypt_flush_dirty(enc);
+    }
+
+    return ret;
+}
+
+static GstFlowReturn ar_encrypt_rewrite(ArEncrypt *enc, guint64 pos, const guint8 *data, gsize len) {
+    // Bytes [pos, pos + len) have been written already (pos + len <= tail)
+    if (pos + len > (guint64)ENCRYPT_CACHE_CHUNKS * ENCRYPT_CHUNK_SIZE) {
+        // The cleartext of this chunk is gone. The file would not decrypt; fail the recording.
+        GST_ELEMENT_ERROR(enc, STREAM, ENCRYPT, (NULL),
+                          ("Cannot rewrite encrypted data at offset %" G_GUINT64_FORMAT ".", pos));
+        return GST_FLOW_ERROR;
+    }
+
+    memcpy(enc->cache + pos, data, len);
+
+    guint64 i = 0;
+    for (i = pos / ENCRYPT_CHUNK_SIZE; i <= (pos + len - 1) / ENCRYPT_CHUNK_SIZE; i++) {
+        enc->dirty |= (1u << i);
+    }
+
+    return GST_FLOW_OK;
+}
+
+static GstFlowReturn ar_encrypt_write(ArEncrypt *enc, const guint8 *data, gsize len) {
+    // Cleartext at enc->position
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    if (!enc->header_sent) {
+        GstBuffer *buf = gst_buffer_new_allocate(NULL, ENCRYPT_HEADER_LEN, NULL);
+        gst_buffer_fill(buf, 0, enc->header, ENCRYPT_HEADER_LEN);
+
+        ret = ar_encrypt_push(enc, buf, 0);
+        if (ret != GST_FLOW_OK) return ret;
+
+        enc->header_sent = TRUE;
+    }
+
+    guint64 pos = enc->position;
+    enc->position += len;
+
+    // Rewrite of the written chunks
+    if (len && pos < enc->tail) {
+        gsize n = (gsize)MIN((guint64)len, enc->tail - pos);
+        ret = ar_encrypt_rewrite(enc, pos, data, n);
+        if (ret != GST_FLOW_OK) return ret;
+
+        pos += n;
+        data += n;
+        len -= n;
+    }
+
+    // Seek beyond the end. Fill the gap with zeros, like a file.
+    while (ret == GST_FLOW_OK && len && pos > enc->tail + enc->chunk_len) {
+        gsize n = (gsize)MIN(pos - (enc->tail + enc->chunk_len), (guint64)(ENCRYPT_CHUNK_SIZE - enc->chunk_len));
+        memset(enc->chunk + enc->chunk_len, 0, n);
+        enc->chunk_len += n;
+
+        if (enc->chunk_len == ENCRYPT_CHUNK_SIZE) {
+            ret = ar_encrypt_emit(enc, FALSE);
+        }
+    }
+
+    while (ret == GST_FLOW_OK && len) {
+        gsize off = (gsize)(pos - enc->tail);
+        gsize n = MIN(len, ENCRYPT_CHUNK_SIZE - off);
+
+        memcpy(enc->chunk + off, data, n);
+        enc->chunk_len = MAX(enc->chunk_len, off + n);
+
+        pos += n;
+        data += n;
+        len -= n;
+
+        if (enc->chunk_len == ENCRYPT_CHUNK_SIZE) {
+            ret = ar_encrypt_emit(enc, FALSE);
+        }
+    }
+
+    return ret;
+}
+
+static GstFlowReturn ar_encrypt_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer) {
+    ArEncrypt *enc = AR_ENCRYPT(parent);
+
+    if (!enc->ctx) {
+        // Never write cleartext
+        gst_buffer_unref(buffer);
+        if (enc->has_key) {
+            GST_ELEMENT_ERROR(enc, STREAM, ENCRYPT, (NULL), ("Cannot create a random file id or the cipher context."));
+        } else {
+            GST_ELEMENT_ERROR(enc, STREAM, ENCRYPT, (NULL), ("No encryption key."));
+        }
+        return GST_FLOW_ERROR;
+    }
+
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        gst_buffer_unref(buffer);
+        return GST_FLOW_ERROR;
+    }
+
+    GstFlowReturn ret = ar_encrypt_write(enc, map.data, map.size);
+
+    gst_buffer_unmap(buffer, &map);
+    gst_buffer_unref(buffer);
+
+    return ret;
+}
+
+static gboolean ar_encrypt_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+    ArEncrypt *enc = AR_ENCRYPT(parent);
+
+    switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_CAPS: {
+        // The file has our format
+        gst_event_unref(event);
+
+        if (enc->caps_sent) return TRUE;
+        enc->caps_sent = TRUE;
+
+        GstCaps *caps = gst_caps_new_empty_simple("application/x-audio-recorder-encrypted");
+        gboolean ok = gst_pad_push_event(enc->srcpad, gst_event_new_caps(caps));
+        gst_caps_unref(caps);
+
+        return ok;
+    }
+
+    case GST_EVENT_SEGMENT: {
+        // Muxers seek back to rewrite their headers. The file gets our byte segments.
+        const GstSegment *segment = NULL;
+        gst_event_parse_segment(event, &segment);
+
+        if (segment->format == GST_FORMAT_BYTES) {
+            enc->position = segment->start;
+        }
+
+        gst_event_unref(event);
+        return TRUE;
+    }
+
+    case GST_EVENT_EOS:
+        // Final record, then the rewritten chunks
+        if (enc->ctx) {
+            GstFlowReturn ret = ar_encrypt_write(enc, NULL, 0);
+
+            if (ret == GST_FLOW_OK) {
+                ret = ar_encrypt_emit(enc, TRUE);
+            }
+
+            LOG_ENCRYPT("arencrypt: %" G_GUINT64_FORMAT " bytes encrypted, %u records.\n", enc->tail + enc->chunk_len, enc->counter);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return gst_pad_event_default(pad, parent, event);
+}
+
+static GstStateChangeReturn ar_encrypt_change_state(GstElement *element, GstStateChange transition) {
+    ArEncrypt *enc = AR_ENCRYPT(element);
+
+    if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+        GST_OBJECT_LOCK(enc);
+        ar_encrypt_reset(enc);
+        gboolean failed = (enc->has_key && !enc->ctx);
+        GST_OBJECT_UNLOCK(enc);
+
+        if (failed) {
+            // RAND_bytes() (or the cipher) failed. Fail the recording before any data is written.
+            GST_ELEMENT_ERROR(enc, STREAM, ENCRYPT, (NULL), ("Cannot create a random file id or the cipher context."));
+            return GST_STATE_CHANGE_FAILURE;
+        }
+    }
+
+    GstStateChangeReturn ret = GST_ELEMENT_CLASS(ar_encrypt_parent_class)->change_state(element, transition);
+
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+        // A reused pipeline writes the next file with a new file key
+        GST_OBJECT_LOCK(enc);
+        ar_encrypt_reset(enc);
+        OPENSSL_cleanse(enc->cache, ENCRYPT_CACHE_CHUNKS * ENCRYPT_CHUNK_SIZE);
+        GST_OBJECT_UNLOCK(enc);
+    }
+
+    return ret;
+}
+
+// ---------------------------------------------------------------------
+// Recorder
+// ---------------------------------------------------------------------
+
+void encrypt_module_init() {
+    LOG_DEBUG("Init gst-encrypt.c.\n");
+
+    gst_element_register(NULL, ENCRYPT_FACTORY, GST_RANK_NONE, AR_TYPE_ENCRYPT);
+}
+
+gboolean encrypt_enabled() {
+    gboolean enabled = FALSE;
+    conf_get_boolean_value("encryption", &enabled);
+    return enabled;
+}
+
+gboolean encrypt_setup_pipeline(GstElement *pipeline, gchar **err_msg) {
+    GstElement *elem = gst_bin_get_by_name(GST_BIN(pipeline), PIPELINE_ENCRYPT);
+
+    if (!encrypt_enabled()) {
+        if (elem) gst_object_unref(elem);
+        return TRUE;
+    }
+
+    if (!elem) {
+        *err_msg = g_strdup_printf(_("Cannot find audio element %s.\n"), PIPELINE_ENCRYPT);
+        return FALSE;
+    }
+
+    guint8 key[ENCRYPT_KEY_LEN];
+    gboolean ok = encrypt_load_key(NULL, key, err_msg);
+
+    if (ok) {
+        ar_encrypt_set_key(AR_ENCRYPT(elem), key);
+        OPENSSL_cleanse(key, sizeof(key));
+    }
+
+    gst_object_unref(elem);
+
+    // mp4mux: a reserved moov is rewritten all over the first MBs; faststart writes a cleartext temp file
+    GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    GValue value = G_VALUE_INIT;
+
+    while (gst_iterator_next(it, &value) == GST_ITERATOR_OK) {
+        GstElement *e = GST_ELEMENT(g_value_get_object(&value));
+        GObjectClass *klass = G_OBJECT_GET_CLASS(e);
+
+        if (g_object_class_find_property(klass, "reserved-max-duration")) {
+            g_object_set(G_OBJECT(e), "reserved-max-duration", (guint64)GST_CLOCK_TIME_NONE, NULL);
+        }
+
+        if (g_object_class_find_property(klass, "faststart")) {
+            g_object_set(G_OBJECT(e), "faststart", FALSE, NULL);
+        }
+
+        g_value_reset(&value);
+    }
+
+    g_value_unset(&value);
+    gst_iterator_free(it);
+
+    return ok;
+}
+
+gboolean encrypt_is_file(const gchar *filename) {
+    gboolean found = FALSE;
+
+    gint fd = g_open(filename, O_RDONLY, 0);
+    if (fd < 0) return FALSE;
+
+    gchar magic[8];
+    found = (read(fd, magic, sizeof(magic)) == sizeof(magic) && !memcmp(magic, ENCRYPT_MAGIC, sizeof(magic)));
+
+    close(fd);
+    return found;
+}
+
+// ---------------------------------------------------------------------
+// Decrypt
+// ---------------------------------------------------------------------
+
+static gsize encrypt_read(gint fd, guint8 *buf, gsize len) {
+    // Read len bytes, or up to the end of file
+    gsize done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, buf + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    return done;
+}
+
+static gboolean encrypt_write(gint fd, const guint8 *buf, gsize len) {
+    gsize done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return FALSE;
+        done += n;
+    }
+    return TRUE;
+}
+
+static gchar *encrypt_output_name(const gchar *filename) {
+    // "rec.ogg" -> "rec-decrypted.ogg". Caller should g_free() this value.
+    gchar *base = g_path_get_basename(filename);
+    gchar *dot = strrchr(base, '.');
+
+    gchar *name = NULL;
+    if (dot && dot != base) {
+        *dot = '\0';
+        name = g_strdup_printf("%s-decrypted.%s", base, dot + 1);
+    } else {
+        name = g_strdup_printf("%s-decrypted", base);
+    }
+
+    gchar *dir = g_path_get_dirname(filename);
+    gchar *path = g_build_filename(dir, name, NULL);
+
+    g_free(dir);
+    g_free(name);
+    g_free(base);
+
+    return path;
+}
+
+gboolean encrypt_decrypt_file(const gchar *filename, const gchar *output, const gchar *key_source) {
+    // $ audio-recorder --decrypt=<file>
+    gboolean ok = FALSE;
+    gboolean final = FALSE;
+
+    gchar *out_name = (output ? g_strdup(output) : encrypt_output_name(filename));
+    gchar *err_msg = NULL;
+
+    gint fd = -1;
+    gint out = -1;
+    EVP_CIPHER_CTX *ctx = NULL;
+
+    guint8 *record = g_malloc(ENCRYPT_RECORD_SIZE + 1);
+    guint8 *data = g_malloc(ENCRYPT_CHUNK_SIZE);
+
+    guint8 key[ENCRYPT_KEY_LEN];
+    guint8 header[ENCRYPT_HEADER_LEN];
+    guint64 index = 0;
+
+    if (!encrypt_load_key(key_source, key, &err_msg)) {
+        g_print("%s", err_msg);
+        goto LBL_1;
+    }
+
+    fd = g_open(filename, O_RDONLY, 0);
+    if (fd < 0) {
+        g_print("%s: %s.\n", filename, g_strerror(errno));
+        goto LBL_1;
+    }
+
+    if (encrypt_read(fd, header, ENCRYPT_HEADER_LEN) != ENCRYPT_HEADER_LEN || memcmp(header, ENCRYPT_MAGIC, 8)) {
+        g_print("%s: not an encrypted recording.\n", filename);
+        goto LBL_1;
+    }
+
+    if (GST_READ_UINT32_BE(header + 8) != ENCRYPT_CHUNK_SIZE || GST_READ_UINT32_BE(header + 12) != ENCRYPT_CIPHER_AES256_GCM) {
+        g_print("%s: unknown chunk size or cipher.\n", filename);
+        goto LBL_1;
+    }
+
+    guint8 key_id[8];
+    encrypt_key_id(key, key_id);
+    if (memcmp(key_id, header + 16, 8)) {
+        g_print("%s: encrypted with another key.\n", filename);
+        goto LBL_1;
+    }
+
+    ctx = encrypt_ctx_new(key, header, FALSE);
+
+    out = g_open(out_name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (!ctx || out < 0) {
+        g_print("%s: %s.\n", out_name, g_strerror(errno));
+        goto LBL_1;
+    }
+
+    // Read one byte more than a record: a full record at the end of file may be the final one
+    gsize len = encrypt_read(fd, record, ENCRYPT_RECORD_SIZE + 1);
+
+    while (len > 0) {
+        gboolean more = (len > ENCRYPT_RECORD_SIZE);
+        gsize rec_len = MIN(len, (gsize)ENCRYPT_RECORD_SIZE);
+
+        if (final) {
+            g_print("%s: data after the final chunk.\n", filename);
+            goto LBL_1;
+        }
+
+        if (more) {
+            // Chunks in the middle are full and not final
+            ok = encrypt_open(ctx, header, index, FALSE, record, rec_len, data);
+        } else {
+            final = encrypt_open(ctx, header, index, TRUE, record, rec_len, data);
+            ok = final || (rec_len == ENCRYPT_RECORD_SIZE && encrypt_open(ctx, header, index, FALSE, record, rec_len, data));
+        }
+
+        if (!ok) {
+            g_print("%s: chunk %" G_GUINT64_FORMAT " (bytes %" G_GUINT64_FORMAT "-) is damaged.\n", filename, index,
+                    ENCRYPT_HEADER_LEN + index * ENCRYPT_RECORD_SIZE);
+            goto LBL_1;
+        }
+
+        if (!encrypt_write(out, data, rec_len - ENCRYPT_RECORD_OVERHEAD)) {
+            g_print("%s: %s.\n", out_name, g_strerror(errno));
+            ok = FALSE;
+            goto LBL_1;
+        }
+
+        index++;
+
+        // Next record. The extra byte is its first byte.
+        if (more) {
+            record[0] = record[ENCRYPT_RECORD_SIZE];
+            len = 1 + encrypt_read(fd, record + 1, ENCRYPT_RECORD_SIZE);
+        } else {
+            len = 0;
+        }
+    }
+
+    if (!final) {
+        // Recording did not finish (crash). The chunks that were written are decrypted.
+        g_print("%s: the file is truncated; %" G_GUINT64_FORMAT " chunks decrypted.\n", filename, index);
+        ok = FALSE;
+    }
+
+LBL_1:
+    if (ok) {
+        g_print("%s: decrypted to %s.\n", filename, out_name);
+    }
+
+    if (ctx) EVP_CIPHER_CTX_free(ctx);
+    if (fd >= 0) close(fd);
+    if (out >= 0) close(out);
+
+    OPENSSL_cleanse(key, sizeof(key));
+    OPENSSL_cleanse(data, ENCRYPT_CHUNK_SIZE);
+
+    g_free(data);
+    g_free(record);
+    g_free(err_msg);
+    g_free(out_name);
+
+    return ok;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+// ---------------------------------------------------------------------
+
+void encrypt_benchmark(guint mbytes) {
+    // $ audio-recorder --benchmark=encryption
+    // Encrypt and decrypt mbytes in records, as the element and --decrypt do. Compare with the bitrates of recordings.
+    guint8 key[ENCRYPT_KEY_LEN];
+    guint8 header[ENCRYPT_HEADER_LEN];
+
+    if (RAND_bytes(key, sizeof(key)) != 1 || !encrypt_build_header(key, header)) {
+        LOG_ERROR("Encryption benchmark: Cannot get random bytes.\n");
+        return;
+    }
+
+    EVP_CIPHER_CTX *enc_ctx = encrypt_ctx_new(key, header, TRUE);
+    EVP_CIPHER_CTX *dec_ctx = encrypt_ctx_new(key, header, FALSE);
+
+    guint8 *data = g_malloc(ENCRYPT_CHUNK_SIZE);
+    guint8 *record = g_malloc(ENCRYPT_RECORD_SIZE);
+
+    gsize i = 0;
+    for (i = 0; i < ENCRYPT_CHUNK_SIZE; i++) {
+        data[i] = (guint8)(i * 31 + 7);
+    }
+
+    guint64 n_chunks = (guint64)mbytes * 1024 * 1024 / ENCRYPT_CHUNK_SIZE;
+    gboolean ok = (enc_ctx && dec_ctx);
+
+    gint64 t0 = g_get_monotonic_time();
+
+    guint64 c = 0;
+    for (c = 0; ok && c < n_chunks; c++) {
+        ok = encrypt_seal(enc_ctx, header, c, (guint32)c, FALSE, data, ENCRYPT_CHUNK_SIZE, record);
+    }
+
+    gdouble enc_sec = (g_get_monotonic_time() - t0) / (gdouble)G_USEC_PER_SEC;
+
+    // Decrypt the same record (authenticates, like --decrypt)
+    t0 = g_get_monotonic_time();
+
+    for (c = 0; ok && c < n_chunks; c++) {
+        ok = encrypt_open(dec_ctx, header, n_chunks - 1, FALSE, record, ENCRYPT_RECORD_SIZE, data);
+    }
+
+    gdouble dec_sec = (g_get_monotonic_time() - t0) / (gdouble)G_USEC_PER_SEC;
+
+    gdouble mb = n_chunks * (gdouble)ENCRYPT_CHUNK_SIZE / (1024.0 * 1024.0);
+    gdouble enc_rate = mb / MAX(enc_sec, 1e-6);
+    gdouble dec_rate = mb / MAX(dec_sec, 1e-6);
+
+    g_print("Encryption benchmark: AES-256-GCM, %s, %u MB in %d kB chunks.\n", OpenSSL_version(OPENSSL_VERSION),
+            mbytes, ENCRYPT_CHUNK_SIZE / 1024);
+
+#if defined(__x86_64__) || defined(__i386__)
+    g_print("CPU: AES-NI %s, PCLMULQDQ %s.\n", (__builtin_cpu_supports("aes") ? "yes" : "no"),
+            (__builtin_cpu_supports("pclmul") ? "yes" : "no"));
+#endif
+
+    if (!ok) {
+        g_print("Encryption benchmark FAILED.\n");
+    } else {
+        g_print("encrypt\t%.0f MB/s\ndecrypt\t%.0f MB/s\n", enc_rate, dec_rate);
+
+        // Bitrates (bytes/s): the biggest lossless recordings, CD quality WAV and a 320 kbit/s MP3
+        struct {
+            const gchar *name;
+            gdouble rate;
+        } rates[] = {
+            {"wav 32ch/96kHz/32bit", 32 * 96000 * 4.0},
+            {"wav 8ch/48kHz/24bit", 8 * 48000 * 3.0},
+            {"wav 2ch/44.1kHz/16bit", 2 * 44100 * 2.0},
+            {"mp3 320kbit/s", 320000 / 8.0},
+        };
+
+        g_print("profile\tMB_per_s\ttimes_realtime\n");
+
+        for (i = 0; i < G_N_ELEMENTS(rates); i++) {
+            g_print("%s\t%.3f\t%.0f\n", rates[i].name, rates[i].rate / (1024.0 * 1024.0), enc_rate * 1024.0 * 1024.0 / rates[i].rate);
+        }
+    }
+
+    if (enc_ctx) EVP_CIPHER_CTX_free(enc_ctx);
+    if (dec_ctx) EVP_CIPHER_CTX_free(dec_ctx);
+
+    g_free(data);
+    g_free(record);
+}
@@ -0,0 +1,50 @@
+#ifndef _GST_ENCRYPT_H
+#define _GST_ENCRYPT_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-encrypt.c.
+//#define DEBUG_ENCRYPT
+
+#if defined(DEBUG_ENCRYPT) || defined(DEBUG_ALL)
+#define LOG_ENCRYPT LOG_MSG
+#else
+#define LOG_ENCRYPT(x, ...)
+#endif
+
+// Factory name of the encryption stage in front of the sink queue
+#define ENCRYPT_FACTORY "arencrypt"
+
+// First 8 bytes of an encrypted file
+#define ENCRYPT_MAGIC "AR-ENC01"
+
+// The file is encrypted in chunks of this size. Each chunk is a record: nonce, ciphertext, tag (see gst-encrypt.c).
+#define ENCRYPT_CHUNK_SIZE (64 * 1024)
+
+// Key: 32 bytes (AES-256)
+#define ENCRYPT_KEY_LEN 32
+
+// Register the "arencrypt" element.
+// Without OpenSSL (HAVE_CRYPTO undefined) gst-encrypt-none.c is built instead: a recording with the
+// "encryption" setting on fails to start, and --decrypt only prints an error.
+void encrypt_module_init();
+
+// Encrypt the recordings ("encryption" setting)?
+gboolean encrypt_enabled();
+
+// Give the key ("encryption-key" setting) to the encryption stage of pipeline. Set the muxers to write no
+// cleartext temp files. Return FALSE and set err_msg if there is no key; the recording must not start then.
+gboolean encrypt_setup_pipeline(GstElement *pipeline, gchar **err_msg);
+
+// Is filename an encrypted recording?
+gboolean encrypt_is_file(const gchar *filename);
+
+// Decrypt filename to output (NULL = "name-decrypted.ext"). Key from key_source (NULL = "encryption-key" setting).
+// Print the result.
+gboolean encrypt_decrypt_file(const gchar *filename, const gchar *output, const gchar *key_source);
+
+// Encryption and decryption throughput compared with the bitrates of the profiles. Print the results.
+void encrypt_benchmark(guint mbytes);
+
+#endif
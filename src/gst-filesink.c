@@ -0,0 +1,794 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <glib/gstdio.h>
+#include <gst/base/gstbasesink.h>
+
+#include "gst-filesink.h"
+#include "log.h"
+#include "dconf.h"
+#include "utility.h"
+#include "support.h"
+
+// High-throughput file sink for the recordings.
+//
+// The stock filesink writes every encoder buffer as it comes (a few kB). With many parallel or lossless
+// recordings this gives lots of small writes and fragmented files. "arfilesink" instead:
+//  - Collects the buffers into one large aligned buffer ("sink-buffer-size" setting) and writes it with one pwrite().
+//  - Reserves disk space in large extents with fallocate(FALLOC_FL_KEEP_SIZE). The file size is not changed,
+//    so a crashed recording has no trailing zeros. Unused blocks are released at close.
+//  - Keeps the page cache clean ("sink-io-mode" setting):
+//      buffered  plain writes.
+//      fadvise   write-behind with sync_file_range(), then posix_fadvise(DONTNEED) for the written range.
+//      direct    aligned blocks through an O_DIRECT descriptor. Falls back to fadvise if O_DIRECT is not supported.
+//  - Syncs the data to disk at close or after each write ("sink-fsync" setting).
+//
+// Muxers seek back to rewrite their headers (a byte segment). The buffer is written out first, so the sink
+// behaves like filesink. Setting "fast-sink" selects this sink for new pipelines.
+
+typedef enum {IO_BUFFERED, IO_FADVISE, IO_DIRECT} FileSinkIoMode;
+typedef enum {FSYNC_NEVER, FSYNC_CLOSE, FSYNC_FLUSH} FileSinkFsync;
+
+typedef struct {
+    GstBaseSink parent;
+
+    // Properties
+    gchar *location;
+    gboolean append;
+    guint buffer_size;
+    gchar *io_mode;
+    gchar *fsync;
+    guint64 preallocate;
+
+    // Open file
+    gint fd;
+    gint direct_fd;
+    FileSinkIoMode mode;
+    FileSinkFsync sync;
+
+    // Write buffer holds file bytes [buf_offset, buf_offset + buf_len). It is written when buf_len reaches
+    // buf_limit, so the next write starts at an aligned offset.
+    guint8 *buf;
+    gsize buf_len;
+    gsize buf_limit;
+    guint64 buf_offset;
+
+    // Next write offset, and the file length
+    guint64 position;
+    guint64 end;
+
+    // Disk space is reserved up to this offset
+    guint64 alloc_end;
+
+    // Last written range (fadvise mode)
+    guint64 prev_offset;
+    gsize prev_len;
+
+    FileSinkStats stats;
+} ArFileSink;
+
+typedef struct {
+    GstBaseSinkClass parent_class;
+} ArFileSinkClass;
+
+enum {
+    PROP_0,
+    PROP_LOCATION,
+    PROP_APPEND,
+    PROP_BUFFER_SIZE,
+    PROP_IO_MODE,
+    PROP_FSYNC,
+    PROP_PREALLOCATE,
+};
+
+// Defaults of the element properties
+#define FILESINK_BUFFER_SIZE (4 * 1024 * 1024)
+#define FILESINK_PREALLOCATE (64 * 1024 * 1024)
+
+GType ar_file_sink_get_type(void);
+
+#define AR_TYPE_FILE_SINK (ar_file_sink_get_type())
+#define AR_FILE_SINK(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), AR_TYPE_FILE_SINK, ArFileSink))
+#define AR_IS_FILE_SINK(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), AR_TYPE_FILE_SINK))
+
+G_DEFINE_TYPE(ArFileSink, ar_file_sink, GST_TYPE_BASE_SINK);
+
+static GstStaticPadTemplate g_sink_template = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+static void ar_file_sink_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec);
+static void ar_file_sink_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+static void ar_file_sink_finalize(GObject *object);
+
+static gboolean ar_file_sink_start(GstBaseSink *basesink);
+static gboolean ar_file_sink_stop(GstBaseSink *basesink);
+static GstFlowReturn ar_file_sink_render(GstBaseSink *basesink, GstBuffer *buffer);
+static gboolean ar_file_sink_event(GstBaseSink *basesink, GstEvent *event);
+static gboolean ar_file_sink_query(GstBaseSink *basesink, GstQuery *query);
+
+static gboolean ar_file_sink_flush(ArFileSink *sink);
+
+static void ar_file_sink_class_init(ArFileSinkClass *klass) {
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS(klass);
+
+    gobject_class->set_property = ar_file_sink_set_property;
+    gobject_class->get_property = ar_file_sink_get_property;
+    gobject_class->finalize = ar_file_sink_finalize;
+
+    g_object_class_install_property(gobject_class, PROP_LOCATION,
+                                    g_param_spec_string("location", "File Location", "Location of the file to write",
+                                            NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property(gobject_class, PROP_APPEND,
+                                    g_param_spec_boolean("append", "Append", "Append to an already existing file",
+                                            FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property(gobject_class, PROP_BUFFER_SIZE,
+                                    g_param_spec_uint("buffer-size", "Buffer size", "Size of the write buffer in bytes (rounded up to 4 kB)",
+                                            FILESINK_ALIGN, G_MAXUINT / 2, FILESINK_BUFFER_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property(gobject_class, PROP_IO_MODE,
+                                    g_param_spec_string("io-mode", "I/O mode", "How to keep the page cache clean: buffered, fadvise or direct",
+                                            "fadvise", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property(gobject_class, PROP_FSYNC,
+                                    g_param_spec_string("fsync", "Fsync policy", "When to sync the file to disk: never, close or flush",
+                                            "close", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property(gobject_class, PROP_PREALLOCATE,
+                                    g_param_spec_uint64("preallocate", "Preallocate", "Reserve disk space in extents of this many bytes (0 = off)",
+                                            0, G_MAXUINT64, FILESINK_PREALLOCATE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    gst_element_class_set_static_metadata(element_class, "Audio-recorder file sink", "Sink/File",
+                                          "Write the stream to a file with large aligned writes", "Osmo Antero");
+
+    gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&g_sink_template));
+
+    basesink_class->start = ar_file_sink_start;
+    basesink_class->stop = ar_file_sink_stop;
+    basesink_class->render = ar_file_sink_render;
+    basesink_class->event = ar_file_sink_event;
+    basesink_class->query = ar_file_sink_query;
+}
+
+static void ar_file_sink_init(ArFileSink *sink) {
+    sink->location = NULL;
+    sink->append = FALSE;
+    sink->buffer_size = FILESINK_BUFFER_SIZE;
+    sink->io_mode = g_strdup("fadvise");
+    sink->fsync = g_strdup("close");
+    sink->preallocate = FILESINK_PREALLOCATE;
+
+    sink->fd = -1;
+    sink->direct_fd = -1;
+
+    // Files are written as they come. Do not wait for the clock.
+    gst_base_sink_set_sync(GST_BASE_SINK(sink), FALSE);
+}
+
+static void ar_file_sink_finalize(GObject *object) {
+    ArFileSink *sink = AR_FILE_SINK(object);
+
+    g_free(sink->location);
+    g_free(sink->io_mode);
+    g_free(sink->fsync);
+
+    G_OBJECT_CLASS(ar_file_sink_parent_class)->finalize(object);
+}
+
+static void ar_file_sink_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec) {
+    ArFileSink *sink = AR_FILE_SINK(object);
+
+    switch (prop_id) {
+    case PROP_LOCATION:
+        g_free(sink->location);
+        sink->location = g_value_dup_string(value);
+        break;
+
+    case PROP_APPEND:
+        sink->append = g_value_get_boolean(value);
+        break;
+
+    case PROP_BUFFER_SIZE:
+        // Whole O_DIRECT blocks
+        sink->buffer_size = (g_value_get_uint(value) + FILESINK_ALIGN - 1) / FILESINK_ALIGN * FILESINK_ALIGN;
+        break;
+
+    case PROP_IO_MODE:
+        g_free(sink->io_mode);
+        sink->io_mode = g_value_dup_string(value);
+        break;
+
+    case PROP_FSYNC:
+        g_free(sink->fsync);
+        sink->fsync = g_value_dup_string(value);
+        break;
+
+    case PROP_PREALLOCATE:
+        sink->preallocate = g_value_get_uint64(value);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    }
+}
+
+static void ar_file_sink_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+    ArFileSink *sink = AR_FILE_SINK(object);
+
+    switch (prop_id) {
+    case PROP_LOCATION:
+        g_value_set_string(value, sink->location);
+        break;
+
+    case PROP_APPEND:
+        g_value_set_boolean(value, sink->append);
+        break;
+
+    case PROP_BUFFER_SIZE:
+        g_value_set_uint(value, sink->buffer_size);
+        break;
+
+    case PROP_IO_MODE:
+        g_value_set_string(value, sink->io_mode);
+        break;
+
+    case PROP_FSYNC:
+        g_value_set_string(value, sink->fsync);
+        break;
+
+    case PROP_PREALLOCATE:
+        g_value_set_uint64(value, sink->preallocate);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    }
+}
+
+static void ar_file_sink_restart_buffer(ArFileSink *sink, guint64 offset) {
+    // Start collecting at offset. The first write ends at an aligned offset.
+    sink->buf_offset = offset;
+    sink->buf_len = 0;
+    sink->buf_limit = sink->buffer_size - (offset % FILESINK_ALIGN);
+}
+
+static gboolean ar_file_sink_start(GstBaseSink *basesink) {
+    ArFileSink *sink = AR_FILE_SINK(basesink);
+
+    if (!sink->location) {
+        GST_ELEMENT_ERROR(sink, RESOURCE, NOT_FOUND, ("No file name specified for writing."), (NULL));
+        return FALSE;
+    }
+
+    sink->mode = IO_FADVISE;
+    if (!g_strcmp0(sink->io_mode, "buffered")) {
+        sink->mode = IO_BUFFERED;
+    } else if (!g_strcmp0(sink->io_mode, "direct")) {
+        sink->mode = IO_DIRECT;
+    }
+
+    sink->sync = FSYNC_CLOSE;
+    if (!g_strcmp0(sink->fsync, "never")) {
+        sink->sync = FSYNC_NEVER;
+    } else if (!g_strcmp0(sink->fsync, "flush")) {
+        sink->sync = FSYNC_FLUSH;
+    }
+
+    sink->fd = g_open(sink->location, O_WRONLY | O_CREAT | O_CLOEXEC | (sink->append ? 0 : O_TRUNC), 0666);
+    if (sink->fd < 0) {
+        GST_ELEMENT_ERROR(sink, RESOURCE, OPEN_WRITE, ("Could not open file \"%s\" for writing.", sink->location), GST_ERROR_SYSTEM);
+        return FALSE;
+    }
+
+    if (sink->mode == IO_DIRECT) {
+        // Second descriptor for the aligned blocks. The buffered one writes the unaligned head and tail.
+        sink->direct_fd = g_open(sink->location, O_WRONLY | O_DIRECT | O_CLOEXEC, 0);
+        if (sink->direct_fd < 0) {
+            LOG_MSG("O_DIRECT is not supported for %s (%s). Using fadvise mode.\n", sink->location, g_strerror(errno));
+            sink->mode = IO_FADVISE;
+        }
+    }
+
+    gpointer buf = NULL;
+    if (posix_memalign(&buf, FILESINK_ALIGN, sink->buffer_size)) {
+        GST_ELEMENT_ERROR(sink, RESOURCE, NO_SPACE_LEFT, ("Cannot allocate a write buffer of %u bytes.", sink->buffer_size), (NULL));
+        return FALSE;
+    }
+    sink->buf = (guint8*)buf;
+
+    sink->end = 0;
+    if (sink->append) {
+        off_t size = lseek(sink->fd, 0, SEEK_END);
+        sink->end = (size > 0 ? (guint64)size : 0);
+    }
+
+    sink->position = sink->end;
+    sink->alloc_end = sink->end;
+    sink->prev_len = 0;
+
+    memset(&sink->stats, 0, sizeof(FileSinkStats));
+
+    ar_file_sink_restart_buffer(sink, sink->position);
+
+    LOG_FILESINK("arfilesink: writing %s, buffer %u bytes, io-mode %s, fsync %s, preallocate %" G_GUINT64_FORMAT ".\n",
+                 sink->location, sink->buffer_size, sink->io_mode, sink->fsync, sink->preallocate);
+
+    return TRUE;
+}
+
+static void ar_file_sink_reserve(ArFileSink *sink, guint64 end) {
+    // Reserve the next extent. KEEP_SIZE: the file size grows with the data only.
+    if (!sink->preallocate || end <= sink->alloc_end) return;
+
+    guint64 new_end = end + sink->preallocate;
+
+    sink->stats.io_calls++;
+    if (fallocate(sink->fd, FALLOC_FL_KEEP_SIZE, sink->alloc_end, new_end - sink->alloc_end)) {
+        // Eg. EOPNOTSUPP on tmpfs or NFS. Not an error.
+        LOG_FILESINK("arfilesink: cannot preallocate %s (%s).\n", sink->location, g_strerror(errno));
+        sink->preallocate = 0;
+        return;
+    }
+
+    sink->stats.preallocated += new_end - sink->alloc_end;
+    sink->alloc_end = new_end;
+}
+
+static void ar_file_sink_writeback(ArFileSink *sink, guint64 offset, gsize len) {
+    // Start writeback of this range and wait for the previous one. Then drop the previous one from the page cache.
+    sink->stats.io_calls++;
+    sync_file_range(sink->fd, offset, len, SYNC_FILE_RANGE_WRITE);
+
+    if (sink->prev_len) {
+        sink->stats.io_calls += 2;
+        sync_file_range(sink->fd, sink->prev_offset, sink->prev_len,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(sink->fd, sink->prev_offset, sink->prev_len, POSIX_FADV_DONTNEED);
+    }
+
+    sink->prev_offset = offset;
+    sink->prev_len = len;
+}
+
+static gboolean ar_file_sink_flush(ArFileSink *sink) {
+    // Write the buffer to the file
+    if (sink->fd < 0 || !sink->buf_len) return TRUE;
+
+    guint64 offset = sink->buf_offset;
+    gsize len = sink->buf_len;
+
+    ar_file_sink_reserve(sink, offset + len);
+
+    // Whole aligned blocks bypass the page cache
+    gboolean direct = (sink->direct_fd >= 0 && !(offset % FILESINK_ALIGN) && !(len % FILESINK_ALIGN));
+    gint fd = (direct ? sink->direct_fd : sink->fd);
+
+    gsize done = 0;
+    while (done < len) {
+        sink->stats.write_calls++;
+        ssize_t n = pwrite(fd, sink->buf + done, len - done, offset + done);
+
+        if (n < 0 && errno == EINTR) continue;
+
+        if (n <= 0) {
+            if (errno == ENOSPC) {
+                GST_ELEMENT_ERROR(sink, RESOURCE, NO_SPACE_LEFT, (NULL), (NULL));
+            } else {
+                GST_ELEMENT_ERROR(sink, RESOURCE, WRITE, ("Error while writing to file \"%s\".", sink->location), GST_ERROR_SYSTEM);
+            }
+            return FALSE;
+        }
+
+        done += n;
+    }
+
+    sink->stats.bytes += len;
+    if (direct) sink->stats.direct_writes++;
+
+    sink->end = MAX(sink->end, offset + len);
+
+    if (sink->mode == IO_FADVISE) {
+        ar_file_sink_writeback(sink, offset, len);
+    }
+
+    if (sink->sync == FSYNC_FLUSH) {
+        sink->stats.io_calls++;
+        fdatasync(sink->fd);
+    }
+
+    ar_file_sink_restart_buffer(sink, offset + len);
+
+    return TRUE;
+}
+
+static gboolean ar_file_sink_write(ArFileSink *sink, const guint8 *data, gsize size) {
+    // Add data at the current position. A seek (non-contiguous position) writes the buffer first.
+    if (sink->position != sink->buf_offset + sink->buf_len) {
+        if (!ar_file_sink_flush(sink)) return FALSE;
+        ar_file_sink_restart_buffer(sink, sink->position);
+    }
+
+    while (size > 0) {
+        gsize n = MIN(size, sink->buf_limit - sink->buf_len);
+        memcpy(sink->buf + sink->buf_len, data, n);
+
+        sink->buf_len += n;
+        sink->position += n;
+        data += n;
+        size -= n;
+
+        if (sink->buf_len >= sink->buf_limit && !ar_file_sink_flush(sink)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static GstFlowReturn ar_file_sink_render(GstBaseSink *basesink, GstBuffer *buffer) {
+    ArFileSink *sink = AR_FILE_SINK(basesink);
+
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        return GST_FLOW_ERROR;
+    }
+
+    gboolean ok = ar_file_sink_write(sink, map.data, map.size);
+
+    gst_buffer_unmap(buffer, &map);
+
+    return (ok ? GST_FLOW_OK : GST_FLOW_ERROR);
+}
+
+static gboolean ar_file_sink_event(GstBaseSink *basesink, GstEvent *event) {
+    ArFileSink *sink = AR_FILE_SINK(basesink);
+
+    switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_SEGMENT: {
+        // Muxers seek back to rewrite headers. In append mode the old data is kept (like O_APPEND).
+        const GstSegment *segment = NULL;
+        gst_event_parse_segment(event, &segment);
+
+        if (segment->format == GST_FORMAT_BYTES && !sink->append && sink->fd >= 0) {
+            LOG_FILESINK("arfilesink: seek to %" G_GUINT64_FORMAT ".\n", segment->start);
+            sink->position = segment->start;
+        }
+        break;
+    }
+
+    case GST_EVENT_EOS:
+        if (!ar_file_sink_flush(sink)) {
+            gst_event_unref(event);
+            return FALSE;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return GST_BASE_SINK_CLASS(ar_file_sink_parent_class)->event(basesink, event);
+}
+
+static gboolean ar_file_sink_query(GstBaseSink *basesink, GstQuery *query) {
+    ArFileSink *sink = AR_FILE_SINK(basesink);
+
+    switch (GST_QUERY_TYPE(query)) {
+    case GST_QUERY_POSITION: {
+        GstFormat format;
+        gst_query_parse_position(query, &format, NULL);
+
+        if (format == GST_FORMAT_BYTES || format == GST_FORMAT_DEFAULT) {
+            gst_query_set_position(query, GST_FORMAT_BYTES, sink->position);
+            return TRUE;
+        }
+        break;
+    }
+
+    case GST_QUERY_SEEKING: {
+        // Muxers ask this before they write seekable headers
+        GstFormat format;
+        gst_query_parse_seeking(query, &format, NULL, NULL, NULL);
+
+        gboolean seekable = ((format == GST_FORMAT_BYTES || format == GST_FORMAT_DEFAULT) && !sink->append);
+        gst_query_set_seeking(query, format, seekable, 0, -1);
+        return TRUE;
+    }
+
+    default:
+        break;
+    }
+
+    return GST_BASE_SINK_CLASS(ar_file_sink_parent_class)->query(basesink, query);
+}
+
+static gboolean ar_file_sink_stop(GstBaseSink *basesink) {
+    ArFileSink *sink = AR_FILE_SINK(basesink);
+
+    gboolean ok = TRUE;
+
+    if (sink->fd >= 0) {
+        // The tail is not aligned. It goes through the buffered descriptor.
+        if (sink->direct_fd >= 0) {
+            close(sink->direct_fd);
+            sink->direct_fd = -1;
+        }
+
+        ok = ar_file_sink_flush(sink);
+
+        // Release the reserved blocks after the end of data
+        if (sink->alloc_end > sink->end) {
+            sink->stats.io_calls++;
+            if (ftruncate(sink->fd, sink->end)) {
+                LOG_ERROR("arfilesink: cannot truncate %s (%s).\n", sink->location, g_strerror(errno));
+            }
+        }
+
+        if (sink->sync != FSYNC_NEVER) {
+            sink->stats.io_calls++;
+            fdatasync(sink->fd);
+        }
+
+        if (sink->prev_len) {
+            posix_fadvise(sink->fd, sink->prev_offset, sink->prev_len, POSIX_FADV_DONTNEED);
+        }
+
+        close(sink->fd);
+        sink->fd = -1;
+
+        LOG_FILESINK("arfilesink: closed %s. %" G_GUINT64_FORMAT " bytes, %u writes (%u direct), %u other I/O calls, "
+                     "%" G_GUINT64_FORMAT " bytes preallocated.\n", sink->location, sink->stats.bytes, sink->stats.write_calls,
+                     sink->stats.direct_writes, sink->stats.io_calls, sink->stats.preallocated);
+    }
+
+    free(sink->buf);
+    sink->buf = NULL;
+
+    return ok;
+}
+
+void filesink_module_init() {
+    LOG_DEBUG("Init gst-filesink.c.\n");
+
+    // The sink is part of the program, not a plugin
+    gst_element_register(NULL, FILESINK_FACTORY, GST_RANK_NONE, AR_TYPE_FILE_SINK);
+}
+
+const gchar *filesink_factory() {
+    gboolean fast = FALSE;
+    conf_get_boolean_value("fast-sink", &fast);
+
+    return (fast ? FILESINK_FACTORY : "filesink");
+}
+
+void filesink_configure(GstElement *sink) {
+    if (!AR_IS_FILE_SINK(sink)) return;
+
+    gint kbytes = 0;
+    conf_get_int_value("sink-buffer-size", &kbytes);
+    if (kbytes > 0) {
+        g_object_set(G_OBJECT(sink), "buffer-size", (guint)MIN(kbytes, 512 * 1024) * 1024, NULL);
+    }
+
+    gchar *io_mode = NULL;
+    conf_get_string_value("sink-io-mode", &io_mode);
+    if (!str_length0(io_mode)) {
+        g_object_set(G_OBJECT(sink), "io-mode", io_mode, NULL);
+    }
+    g_free(io_mode);
+
+    gchar *fsync = NULL;
+    conf_get_string_value("sink-fsync", &fsync);
+    if (!str_length0(fsync)) {
+        g_object_set(G_OBJECT(sink), "fsync", fsync, NULL);
+    }
+    g_free(fsync);
+
+    gint mbytes = 0;
+    conf_get_int_value("sink-preallocate", &mbytes);
+    g_object_set(G_OBJECT(sink), "preallocate", (guint64)MAX(mbytes, 0) * 1024 * 1024, NULL);
+}
+
+gboolean filesink_get_stats(GstElement *sink, FileSinkStats *stats) {
+    if (!AR_IS_FILE_SINK(sink)) return FALSE;
+
+    *stats = AR_FILE_SINK(sink)->stats;
+    return TRUE;
+}
+
+// Benchmark
+
+typedef struct {
+    const gchar *name;
+    const gchar *factory;
+    const gchar *props;
+} FileSinkVariant;
+
+static const FileSinkVariant g_variants[] = {
+    {"filesink",          "filesink",       ""},
+    {"arfilesink 1M",     FILESINK_FACTORY, "buffer-size=1048576 io-mode=buffered fsync=never"},
+    {"arfilesink 8M",     FILESINK_FACTORY, "buffer-size=8388608 io-mode=buffered fsync=never"},
+    {"arfilesink fadvise", FILESINK_FACTORY, "buffer-size=8388608 io-mode=fadvise fsync=never"},
+    {"arfilesink direct", FILESINK_FACTORY, "buffer-size=8388608 io-mode=direct fsync=never"},
+};
+
+#define FILESINK_N_VARIANTS (sizeof(g_variants) / sizeof(g_variants[0]))
+
+static guint64 filesink_write_syscalls() {
+    // Write syscalls of this process so far ("syscw" in /proc/self/io)
+    guint64 n = 0;
+
+    gchar *text = NULL;
+    if (g_file_get_contents("/proc/self/io", &text, NULL, NULL)) {
+        gchar *p = strstr(text, "syscw:");
+        if (p) {
+            n = g_ascii_strtoull(p + strlen("syscw:"), NULL, 10);
+        }
+        g_free(text);
+    }
+
+    return n;
+}
+
+static gboolean filesink_bench_run(const FileSinkVariant *v, guint mbytes, const guint8 *data, gdouble *mb_per_sec,
+                                   guint64 *syscalls, FileSinkStats *stats) {
+    // Push mbytes of 1-8 kB buffers through appsrc ! <sink>. The time includes the final fdatasync().
+    gboolean ok = FALSE;
+
+    memset(stats, 0, sizeof(FileSinkStats));
+
+    gchar *filename = g_strdup_printf("%s/audio-recorder-sink-bench-%d", g_get_tmp_dir(), (gint)getpid());
+
+    gchar *cmd = g_strdup_printf("appsrc name=src format=bytes block=true max-bytes=1048576 ! %s name=sink sync=false %s",
+                                 v->factory, v->props);
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(cmd, &error);
+    g_free(cmd);
+
+    GstElement *appsrc = NULL;
+    GstElement *sink = NULL;
+    GstBus *bus = NULL;
+
+    if (error) {
+        LOG_ERROR("Cannot create pipeline for %s: %s\n", v->name, error->message);
+        g_error_free(error);
+        goto LBL_1;
+    }
+
+    appsrc = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    g_object_set(G_OBJECT(sink), "location", filename, NULL);
+
+    guint64 calls = filesink_write_syscalls();
+    gint64 t0 = g_get_monotonic_time();
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    // Encoder-like buffer sizes. Same sequence on every run.
+    guint64 total = (guint64)mbytes * 1024 * 1024;
+    guint64 pushed = 0;
+    guint32 seed = 2463534242U;
+
+    while (pushed < total) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        gsize size = MIN(1024 + seed % (7 * 1024), total - pushed);
+
+        GstBuffer *buf = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, (gpointer)data, 8 * 1024, 0, size, NULL, NULL);
+
+        GstFlowReturn ret;
+        g_signal_emit_by_name(appsrc, "push-buffer", buf, &ret);
+        gst_buffer_unref(buf);
+
+        if (ret != GST_FLOW_OK) goto LBL_1;
+
+        pushed += size;
+    }
+
+    GstFlowReturn ret;
+    g_signal_emit_by_name(appsrc, "end-of-stream", &ret);
+
+    bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+    gboolean eos = (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+    if (msg) gst_message_unref(msg);
+
+    if (!eos) goto LBL_1;
+
+    // Close the file
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+
+    // Data is on the disk
+    gint fd = g_open(filename, O_WRONLY, 0);
+    if (fd >= 0) {
+        fdatasync(fd);
+        close(fd);
+    }
+
+    gint64 t1 = g_get_monotonic_time();
+
+    *syscalls = filesink_write_syscalls() - calls;
+    *mb_per_sec = (total / (1024.0 * 1024.0)) / ((t1 - t0) / (gdouble)G_USEC_PER_SEC);
+
+    filesink_get_stats(sink, stats);
+
+    ok = TRUE;
+
+LBL_1:
+    if (pipeline) {
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+    }
+
+    if (bus) gst_object_unref(bus);
+    if (appsrc) gst_object_unref(appsrc);
+    if (sink) gst_object_unref(sink);
+
+    g_remove(filename);
+    g_free(filename);
+
+    return ok;
+}
+
+void filesink_benchmark(guint mbytes) {
+    // $ audio-recorder --benchmark=sink
+    // Syscalls are the write calls of the whole process (/proc/self/io). Writes and other I/O calls are counted by arfilesink.
+    guint8 *data = g_malloc(8 * 1024);
+
+    guint i = 0;
+    for (i = 0; i < 8 * 1024; i++) {
+        data[i] = (guint8)(i * 31 + 7);
+    }
+
+    g_print("File sink benchmark: %u MB in 1-8 kB buffers to %s.\n", mbytes, g_get_tmp_dir());
+    g_print("sink\tMB_per_s\twrite_syscalls\tsink_writes\tdirect_writes\tother_io_calls\n");
+
+    for (i = 0; i < FILESINK_N_VARIANTS; i++) {
+        const FileSinkVariant *v = &g_variants[i];
+
+        gdouble mb_per_sec = 0.0;
+        guint64 syscalls = 0;
+        FileSinkStats stats;
+
+        if (!filesink_bench_run(v, mbytes, data, &mb_per_sec, &syscalls, &stats)) {
+            g_print("%s\t-\t-\t-\t-\t-\n", v->name);
+            continue;
+        }
+
+        if (!g_strcmp0(v->factory, FILESINK_FACTORY)) {
+            g_print("%s\t%.1f\t%" G_GUINT64_FORMAT "\t%u\t%u\t%u\n", v->name, mb_per_sec, syscalls,
+                    stats.write_calls, stats.direct_writes, stats.io_calls);
+        } else {
+            g_print("%s\t%.1f\t%" G_GUINT64_FORMAT "\t-\t-\t-\n", v->name, mb_per_sec, syscalls);
+        }
+    }
+
+    g_free(data);
+}
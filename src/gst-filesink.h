@@ -0,0 +1,46 @@
+#ifndef _GST_FILESINK_H
+#define _GST_FILESINK_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-filesink.c.
+//#define DEBUG_FILESINK
+
+#if defined(DEBUG_FILESINK) || defined(DEBUG_ALL)
+#define LOG_FILESINK LOG_MSG
+#else
+#define LOG_FILESINK(x, ...)
+#endif
+
+// Factory name of the recorder's own file sink
+#define FILESINK_FACTORY "arfilesink"
+
+// Write size and file offset alignment for O_DIRECT
+#define FILESINK_ALIGN 4096
+
+typedef struct {
+    guint64 bytes;          // Bytes written to the file
+    guint write_calls;      // pwrite() calls
+    guint direct_writes;    // ... of which went through the O_DIRECT descriptor
+    guint io_calls;         // Other I/O calls: fallocate(), sync_file_range(), posix_fadvise(), fdatasync(), ftruncate()
+    guint64 preallocated;   // Bytes reserved with fallocate()
+} FileSinkStats;
+
+// Register the "arfilesink" element
+void filesink_module_init();
+
+// Factory of the recording sink: "arfilesink" if the "fast-sink" setting is on, else "filesink"
+const gchar *filesink_factory();
+
+// Set buffer size, I/O mode, fsync policy and preallocation of an arfilesink from the settings.
+// Does nothing for other elements.
+void filesink_configure(GstElement *sink);
+
+// I/O counters of an arfilesink. Return FALSE for other elements.
+gboolean filesink_get_stats(GstElement *sink, FileSinkStats *stats);
+
+// Throughput and write syscalls of filesink vs. arfilesink with different settings. Print the results.
+void filesink_benchmark(guint mbytes);
+
+#endif
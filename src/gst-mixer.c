@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+
+#include "gst-mixer.h"
+#include "log.h"
+#include "support.h"
+
+// Live gain and mute for the inputs of a running recording.
+//
+// Each input branch gets a gain stage (a pad probe). Gain changes are applied sample by sample with a linear ramp,
+// so muting, un-muting, adding and removing a device are click-free. Nothing in the pipeline is stopped or rebuilt.
+// The time from the request to the first buffer with the new gain is logged (reconfiguration latency).
+
+// Ramp time for a full-scale (0 <-> 1.0) gain change
+#define MIXER_RAMP_MS 20
+
+#define MIXER_MAX_GAIN 4.0
+
+// Call the done function of mixer_fade_out() after this time even if the input has stopped flowing
+#define MIXER_FADE_TIMEOUT_MS 1000
+
+#define MIXER_INPUTS_KEY "mixer-inputs"
+
+typedef struct {
+    gchar *device;
+
+    GstPad *pad;
+    gulong probe_id;
+
+    // Format from the caps event. Only interleaved F32LE and S16LE can be ramped.
+    gint rate;
+    gint channels;
+    gboolean is_float;
+    gboolean format_known;
+    gboolean supported;
+
+    // Set by the user
+    gdouble gain;
+    gboolean mute;
+
+    // Gain applied to the last sample
+    gdouble current;
+
+    // Monotonic time of the last request (for the latency metric). 0: none.
+    gint64 request_time;
+
+    gboolean fading_out;
+    gboolean done_called;
+    GSourceFunc done;
+    gpointer done_data;
+    guint fade_timeout_id;
+
+    gboolean detached;
+} MixerInput;
+
+// Protects gain, mute, request_time and fade-out fields (fading_out, done_called, done, done_data)
+G_LOCK_DEFINE_STATIC(g_mixer);
+
+static void mixer_input_free(MixerInput *in) {
+    if (in->fade_timeout_id) {
+        g_source_remove(in->fade_timeout_id);
+    }
+    g_free(in->device);
+    if (in->pad) {
+        gst_object_unref(in->pad);
+    }
+    g_free(in);
+}
+
+static GPtrArray *mixer_get_inputs(GstElement *pipeline, gboolean create) {
+    // Inputs of the pipeline. They live as long as the pipeline.
+    if (!GST_IS_ELEMENT(pipeline)) return NULL;
+
+    GPtrArray *inputs = g_object_get_data(G_OBJECT(pipeline), MIXER_INPUTS_KEY);
+    if (!inputs && create) {
+        inputs = g_ptr_array_new_with_free_func((GDestroyNotify)mixer_input_free);
+        g_object_set_data_full(G_OBJECT(pipeline), MIXER_INPUTS_KEY, inputs, (GDestroyNotify)g_ptr_array_unref);
+    }
+    return inputs;
+}
+
+static void mixer_parse_caps(MixerInput *in, GstCaps *caps) {
+    // Read rate, channels and sample format
+    GstStructure *s = gst_caps_get_structure(caps, 0);
+
+    in->rate = 0;
+    in->channels = 0;
+    gst_structure_get_int(s, "rate", &in->rate);
+    gst_structure_get_int(s, "channels", &in->channels);
+
+    const gchar *format = gst_structure_get_string(s, "format");
+    const gchar *layout = gst_structure_get_string(s, "layout");
+
+    in->is_float = !g_strcmp0(format, "F32LE");
+    in->supported = (in->rate > 0 && in->channels > 0) &&
+                    (in->is_float || !g_strcmp0(format, "S16LE")) &&
+                    (!layout || !g_strcmp0(layout, "interleaved"));
+
+    in->format_known = TRUE;
+}
+
+static void mixer_apply_gain(MixerInput *in, GstBuffer *buf, gdouble target) {
+    // Multiply samples by the gain. Ramp linearly from in->current to target.
+    GstMapInfo map;
+    if (!gst_buffer_map(buf, &map, GST_MAP_READWRITE)) return;
+
+    gint ch = in->channels;
+    gint n = map.size / ((in->is_float ? 4 : 2) * ch);
+
+    gdouble slope = 1000.0 / (in->rate * MIXER_RAMP_MS);
+    gdouble g = in->current;
+
+    gfloat *f = (gfloat*)map.data;
+    gint16 *s = (gint16*)map.data;
+
+    gint i = 0;
+    for (i = 0; i < n; i++) {
+        // Next gain value
+        if (g < target) {
+            g = MIN(g + slope, target);
+        } else if (g > target) {
+            g = MAX(g - slope, target);
+        }
+
+        gint c = 0;
+        for (c = 0; c < ch; c++) {
+            if (in->is_float) {
+                f[i * ch + c] *= g;
+            } else {
+                gdouble v = s[i * ch + c] * g;
+                s[i * ch + c] = (gint16)CLAMP(v, -32768.0, 32767.0);
+            }
+        }
+    }
+
+    in->current = g;
+
+    gst_buffer_unmap(buf, &map);
+}
+
+static GstPadProbeReturn mixer_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    // Runs in the streaming thread of the input
+    MixerInput *in = (MixerInput*)user_data;
+
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+        if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+            GstCaps *caps = NULL;
+            gst_event_parse_caps(event, &caps);
+            mixer_parse_caps(in, caps);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    if (!in->supported) return GST_PAD_PROBE_OK;
+
+    G_LOCK(g_mixer);
+
+    gdouble target = ((in->mute || in->fading_out) ? 0.0 : in->gain);
+
+    gint64 request_time = in->request_time;
+    in->request_time = 0;
+
+    G_UNLOCK(g_mixer);
+
+    if (!(in->current == 1.0 && target == 1.0)) {
+        GstBuffer *buf = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+        GST_PAD_PROBE_INFO_DATA(info) = buf;
+
+        mixer_apply_gain(in, buf, target);
+    }
+
+    if (request_time) {
+        LOG_MSG("Input %s: gain %.2f applied after %.1f ms (ramp %d ms).\n", in->device, target,
+                (g_get_monotonic_time() - request_time) / 1000.0, MIXER_RAMP_MS);
+    }
+
+    // Faded out?
+    GSourceFunc done = NULL;
+    gpointer done_data = NULL;
+
+    G_LOCK(g_mixer);
+
+    if (in->fading_out && in->current == 0.0 && !in->done_called) {
+        in->done_called = TRUE;
+        done = in->done;
+        done_data = in->done_data;
+    }
+
+    G_UNLOCK(g_mixer);
+
+    if (done) {
+        g_idle_add(done, done_data);
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+void mixer_attach(GstElement *pipeline, GstPad *pad, const gchar *device, gboolean fade_in) {
+    // Add a gain stage to an input
+    if (!GST_IS_PAD(pad)) return;
+
+    MixerInput *in = g_malloc0(sizeof(MixerInput));
+    in->device = g_strdup(device ? device : "default-device");
+    in->pad = gst_object_ref(pad);
+    in->gain = 1.0;
+    in->current = (fade_in ? 0.0 : 1.0);
+    in->request_time = (fade_in ? g_get_monotonic_time() : 0);
+
+    g_ptr_array_add(mixer_get_inputs(pipeline, TRUE), in);
+
+    in->probe_id = gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, mixer_probe, in, NULL);
+}
+
+static MixerInput *mixer_find(GstElement *pipeline, const gchar *device) {
+    GPtrArray *inputs = mixer_get_inputs(pipeline, FALSE);
+    if (!(inputs && device)) return NULL;
+
+    guint i = 0;
+    for (i = 0; i < inputs->len; i++) {
+        MixerInput *in = g_ptr_array_index(inputs, i);
+        if (!in->detached && !g_strcmp0(in->device, device)) {
+            return in;
+        }
+    }
+    return NULL;
+}
+
+void mixer_detach(GstElement *pipeline, const gchar *device) {
+    // Remove the gain stage of device
+    MixerInput *in = mixer_find(pipeline, device);
+    if (!in) return;
+
+    gst_pad_remove_probe(in->pad, in->probe_id);
+    in->detached = TRUE;
+}
+
+void mixer_reset(GstElement *pipeline) {
+    // Prepare a stopped pipeline for a new recording. All inputs back to gain 1.0, not muted.
+    GPtrArray *inputs = mixer_get_inputs(pipeline, FALSE);
+    if (!inputs) return;
+
+    guint i = inputs->len;
+    while (i-- > 0) {
+        MixerInput *in = g_ptr_array_index(inputs, i);
+
+        if (in->detached) {
+            g_ptr_array_remove_index(inputs, i);
+            continue;
+        }
+
+        in->gain = 1.0;
+        in->mute = FALSE;
+        in->current = 1.0;
+        in->request_time = 0;
+        in->fading_out = FALSE;
+        in->done_called = FALSE;
+        in->done = NULL;
+        in->done_data = NULL;
+
+        if (in->fade_timeout_id) {
+            g_source_remove(in->fade_timeout_id);
+        }
+        in->fade_timeout_id = 0;
+    }
+}
+
+static void mixer_set_pad_volume(MixerInput *in) {
+    // Format cannot be ramped. Set the mixer pad's volume/mute properties (if the mixer has them).
+    // Only the sink pads of audiomixer have them. In the simple (one device) pipeline the peer is a capsfilter
+    // or a converter, and "adder" pads have no volume either; then the gain and mute are not applied.
+    GstPad *peer = gst_pad_get_peer(in->pad);
+    if (!peer) return;
+
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(peer), "volume")) {
+        g_object_set(G_OBJECT(peer), "volume", in->gain, "mute", in->mute, NULL);
+    } else {
+        LOG_MSG("Input %s: cannot set gain or mute. The format is not F32LE/S16LE and %s has no volume.\n",
+                in->device, GST_OBJECT_NAME(peer));
+    }
+
+    gst_object_unref(peer);
+}
+
+static gboolean mixer_update(GstElement *pipeline, const gchar *device, gdouble gain, gint mute) {
+    // Set gain (if >= 0) and mute (if >= 0) of device, or of all inputs if device is NULL
+    GPtrArray *inputs = mixer_get_inputs(pipeline, FALSE);
+    if (!inputs) return FALSE;
+
+    gboolean found = FALSE;
+    gint64 now = g_get_monotonic_time();
+
+    guint i = 0;
+    for (i = 0; i < inputs->len; i++) {
+        MixerInput *in = g_ptr_array_index(inputs, i);
+        if (in->detached || (device && g_strcmp0(in->device, device))) continue;
+
+        found = TRUE;
+
+        G_LOCK(g_mixer);
+
+        if (gain >= 0.0) in->gain = MIN(gain, MIXER_MAX_GAIN);
+        if (mute >= 0) in->mute = mute;
+        in->request_time = now;
+
+        G_UNLOCK(g_mixer);
+
+        if (in->format_known && !in->supported) {
+            mixer_set_pad_volume(in);
+        }
+
+        LOG_MIXER("Input %s: set gain=%.2f mute=%d.\n", in->device, in->gain, in->mute);
+    }
+
+    return found;
+}
+
+gboolean mixer_set_gain(GstElement *pipeline, const gchar *device, gdouble gain) {
+    return mixer_update(pipeline, device, MAX(gain, 0.0), -1);
+}
+
+gboolean mixer_set_mute(GstElement *pipeline, const gchar *device, gboolean mute) {
+    return mixer_update(pipeline, device, -1.0, (mute ? 1 : 0));
+}
+
+static gboolean mixer_fade_timeout_cb(gpointer user_data) {
+    // The input did not reach silence in time (it has stopped flowing). Call done anyway.
+    MixerInput *in = (MixerInput*)user_data;
+
+    in->fade_timeout_id = 0;
+
+    GSourceFunc done = NULL;
+    gpointer done_data = NULL;
+
+    G_LOCK(g_mixer);
+
+    if (in->fading_out && !in->done_called) {
+        in->done_called = TRUE;
+        done = in->done;
+        done_data = in->done_data;
+    }
+
+    G_UNLOCK(g_mixer);
+
+    if (done) {
+        LOG_MSG("Input %s: no data in %d ms. Fade-out is complete.\n", in->device, MIXER_FADE_TIMEOUT_MS);
+        done(done_data);
+    }
+
+    // Remove this source
+    return FALSE;
+}
+
+gboolean mixer_fade_out(GstElement *pipeline, const gchar *device, GSourceFunc done, gpointer data) {
+    // Ramp device down to silence, then call done in the main loop
+    MixerInput *in = mixer_find(pipeline, device);
+    if (!in) return FALSE;
+
+    if (!in->supported) {
+        // Cannot ramp this format
+        g_idle_add(done, data);
+        return TRUE;
+    }
+
+    G_LOCK(g_mixer);
+
+    in->done = done;
+    in->done_data = data;
+    in->done_called = FALSE;
+    in->fading_out = TRUE;
+    in->request_time = g_get_monotonic_time();
+
+    G_UNLOCK(g_mixer);
+
+    if (in->fade_timeout_id) {
+        g_source_remove(in->fade_timeout_id);
+    }
+    in->fade_timeout_id = g_timeout_add(MIXER_FADE_TIMEOUT_MS, mixer_fade_timeout_cb, in);
+
+    return TRUE;
+}
@@ -0,0 +1,33 @@
+#ifndef _GST_MIXER_H
+#define _GST_MIXER_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-mixer.c.
+//#define DEBUG_MIXER
+
+#if defined(DEBUG_MIXER) || defined(DEBUG_ALL)
+#define LOG_MIXER LOG_MSG
+#else
+#define LOG_MIXER(x, ...)
+#endif
+
+// Add a gain stage to an input. pad is the source pad of the input branch.
+// If fade_in is TRUE, the input starts silent and ramps up (a device added during recording).
+void mixer_attach(GstElement *pipeline, GstPad *pad, const gchar *device, gboolean fade_in);
+
+// Remove the gain stage of device
+void mixer_detach(GstElement *pipeline, const gchar *device);
+
+// Prepare a stopped pipeline for a new recording
+void mixer_reset(GstElement *pipeline);
+
+// Set gain [0 - 4.0] or mute. device NULL means all inputs. Return FALSE if device is not an input.
+gboolean mixer_set_gain(GstElement *pipeline, const gchar *device, gdouble gain);
+gboolean mixer_set_mute(GstElement *pipeline, const gchar *device, gboolean mute);
+
+// Ramp device down to silence, then call done (in the main loop). done is also called if the input stops flowing.
+gboolean mixer_fade_out(GstElement *pipeline, const gchar *device, GSourceFunc done, gpointer data);
+
+#endif
@@ -16,8 +16,16 @@
  * or <http://www.gnu.org/licenses/>.
 */
 #include <math.h>
+#include <sys/resource.h>
 #include "gst-pipeline.h"
 #include "audio-sources.h"
+#include "gst-capture.h"
+#include "gst-drift.h"
+#include "gst-mixer.h"
+#include "gst-filesink.h"
+#include "gst-encrypt.h"
+#include "gst-devices.h"
+#include "media-profiles.h"
 
 /*
  Create Gstreamer pipelines for recording.
@@ -34,6 +42,60 @@ static GstElement *pipeline_create_complex_VAD(PipelineParms *parms, gchar **err
 static GString *pipeline_create_command_str_simple(PipelineParms *parms);
 static GString *pipeline_create_command_str_complex(PipelineParms *parms);
 
+// Conversion elements needed between the audio sources and the encoder
+typedef struct {
+    gboolean resample;
+    gboolean convert;
+
+    // Caps for the sources when no conversion is needed (else NULL)
+    GstCaps *src_caps;
+} ConversionPlan;
+
+static void pipeline_plan_conversions(GList *dev_list, GstElement *bin, GstElement *level, GstElement *mixer, GstCaps *test_caps, ConversionPlan *plan);
+static gboolean pipeline_link_conversions(GstElement *pipeline, GstElement *from, GstElement *to, ConversionPlan *plan);
+static void pipeline_set_conversions(GstElement *pipeline, ConversionPlan *plan);
+
+// Typed model of a pipeline graph. The builders describe what they create, and the model is saved with the pipeline.
+// pipeline_reconfigure() compares the model with new parameters and rebuilds only the nodes that changed.
+typedef enum {
+    NODE_SOURCE,   // Audio source ! capsfilter [! queue ! mixer]. Key: device id.
+    NODE_DSP,      // mixer, level, audioresample, audioconvert. Key: element (factory) name.
+    NODE_ENCODER,  // Bin with capsfilter + encoder + muxer. Key: profile string.
+    NODE_SINK,     // Bin with [arencrypt] + queue + filesink (or arfilesink), or fakesink. Key: pipeline_sink_key().
+} PipelineNodeType;
+
+typedef struct {
+    PipelineNodeType type;
+    gchar *key;
+
+    // Source (capture front-end), DSP element, encoder bin or sink. Owned by the pipeline.
+    GstElement *elem;
+
+    // NODE_SOURCE: capsfilter, and queue to the mixer (complex pipelines only)
+    GstElement *filter;
+    GstElement *queue;
+} PipelineNode;
+
+typedef struct {
+    gchar *source_name;
+
+    // Inputs are mixed (the pipeline has a "mixer")
+    gboolean complex;
+
+    // VAD pipeline. No encoder.
+    gboolean vad;
+
+    // Nodes in creation order
+    GList *nodes;
+} PipelineModel;
+
+static void pipeline_model_new(GstElement *pipeline, const gchar *source_name, gboolean complex, gboolean vad);
+static PipelineNode *pipeline_model_add(GstElement *pipeline, PipelineNodeType type, const gchar *key, GstElement *elem);
+
+static GstElement *pipeline_create_encoder(const gchar *profile_str, gchar **err_msg);
+static GstElement *pipeline_create_sink(const gchar *factory, gchar **err_msg);
+static gboolean pipeline_link_source(GstElement *pipeline, GstElement *source, GstElement *next, GstCaps *caps, GstElement **filter);
+
 void pipeline_free_parms(PipelineParms *parms) {
     if (!parms) return;
     g_free(parms->source);
@@ -54,23 +116,283 @@ static GstElement *create_element(const gchar *elem, const gchar *name) {
     return e;
 }
 
-GstElement *pipeline_create(PipelineParms *parms, gchar **err_msg) {
-    if (!parms) return NULL;
+static GstCaps *caps_keep_rate(GstCaps *caps, gboolean rate) {
+    // Return copy of caps with the rate field only (rate=TRUE), or without the rate field (rate=FALSE)
+    GstCaps *c = gst_caps_copy(caps);
+
+    guint i = 0;
+    for (i = 0; i < gst_caps_get_size(c); i++) {
+        GstStructure *s = gst_caps_get_structure(c, i);
+        if (rate) {
+            gst_structure_remove_fields(s, "format", "layout", "channels", "channel-mask", NULL);
+        } else {
+            gst_structure_remove_field(s, "rate");
+        }
+    }
 
-    // Create a GStreamer pipeline for audio recording
-    GstElement *pipeline = NULL;
+    return gst_caps_simplify(c);
+}
+
+static GstCaps *pipeline_match_caps(const gchar *device, GstCaps *wanted, GstCaps *test_caps) {
+    // What can the device deliver of wanted caps? NULL if not known.
+    if (test_caps) {
+        return gst_caps_intersect(test_caps, wanted);
+    }
+
+    // Cached in the device registry
+    return gstdev_match_caps(device, wanted);
+}
+
+static GstCaps *pipeline_sink_template_caps(GstElement *elem) {
+    // Caps of the sink pad template of elem (eg. "sink_%u" of audiomixer), or NULL
+    GstElementFactory *factory = (elem ? gst_element_get_factory(elem) : NULL);
+    if (!factory) return NULL;
+
+    const GList *item = gst_element_factory_get_static_pad_templates(factory);
+    for (; item; item = g_list_next(item)) {
+        GstStaticPadTemplate *templ = (GstStaticPadTemplate*)item->data;
+        if (templ->direction == GST_PAD_SINK) {
+            return gst_static_pad_template_get_caps(templ);
+        }
+    }
+    return NULL;
+}
+
+static GstCaps *pipeline_accept_dsp(GstCaps *accept, GstElement *elem) {
+    // Narrow accept to the caps that elem (level, mixer) takes in. Takes accept.
+    GstCaps *templ = pipeline_sink_template_caps(elem);
+    if (!templ) return accept;
+
+    GstCaps *caps = gst_caps_intersect(accept, templ);
+    gst_caps_unref(templ);
+    gst_caps_unref(accept);
+    return caps;
+}
+
+static void pipeline_plan_conversions(GList *dev_list, GstElement *bin, GstElement *level, GstElement *mixer, GstCaps *test_caps, ConversionPlan *plan) {
+    // Decide which conversions are needed between the devices and the encoder.
+    // Devices that deliver the caps of the profile (capsfilter + encoder) need no audioresample or audioconvert.
+    // Without conversions the source caps also pass the level element and the mixer (NULL in a simple pipeline),
+    // so they must accept them too.
+    // test_caps: use these device caps instead of the registry (for benchmarks).
+    plan->resample = TRUE;
+    plan->convert = TRUE;
+    plan->src_caps = NULL;
+
+    // Recording from the system's default source. Its caps are not known.
+    if (g_list_length(dev_list) < 1) return;
+
+    // Caps accepted by the profile
+    GstPad *pad = gst_element_get_static_pad(bin, "sink");
+    if (!pad) return;
+
+    GstCaps *accept = gst_pad_query_caps(pad, NULL);
+    gst_object_unref(pad);
+
+    if (!accept || gst_caps_is_empty(accept) || gst_caps_is_any(accept)) {
+        if (accept) gst_caps_unref(accept);
+        return;
+    }
+
+    // Eg. level and audiomixer take no 24 bit samples
+    accept = pipeline_accept_dsp(accept, level);
+    accept = pipeline_accept_dsp(accept, mixer);
+
+    GstCaps *accept_rate = caps_keep_rate(accept, TRUE);
+    GstCaps *common = gst_caps_ref(accept);
+
+    gboolean known = TRUE;
+    gboolean rate_ok = TRUE;
+
+    GList *item = g_list_first(dev_list);
+    while (item && known) {
+        const gchar *device = (gchar*)item->data;
+
+        GstCaps *match = pipeline_match_caps(device, accept, test_caps);
+        GstCaps *match_rate = pipeline_match_caps(device, accept_rate, test_caps);
+
+        if (!(match && match_rate)) {
+            // Unknown device (eg. the system's default source)
+            known = FALSE;
+
+        } else {
+            rate_ok = rate_ok && !gst_caps_is_empty(match_rate);
+
+            GstCaps *tmp = gst_caps_intersect(common, match);
+            gst_caps_unref(common);
+            common = tmp;
+        }
+
+        if (match) gst_caps_unref(match);
+        if (match_rate) gst_caps_unref(match_rate);
+
+        item = g_list_next(item);
+    }
+
+    if (known && !gst_caps_is_empty(common)) {
+        // Zero conversion. All devices deliver the encoder's caps directly.
+        plan->resample = FALSE;
+        plan->convert = FALSE;
+        plan->src_caps = gst_caps_fixate(common);
+        common = NULL;
+
+    } else if (known) {
+        // Devices deliver the right rate. Only audioconvert is needed.
+        plan->resample = !rate_ok;
+    }
+
+    if (common) gst_caps_unref(common);
+    gst_caps_unref(accept_rate);
+    gst_caps_unref(accept);
+}
+
+static gboolean pipeline_link_conversions(GstElement *pipeline, GstElement *from, GstElement *to, ConversionPlan *plan) {
+    // Link from ! [audioresample] ! [audioconvert] ! to
+    GstElement *prev = from;
+
+    if (plan->resample) {
+        GstElement *resample = create_element("audioresample", NULL);
+        gst_bin_add(GST_BIN(pipeline), resample);
+        pipeline_model_add(pipeline, NODE_DSP, "audioresample", resample);
+
+        if (!gst_element_link(prev, resample)) return FALSE;
+        prev = resample;
+    }
+
+    if (plan->convert) {
+        GstElement *convert = create_element("audioconvert", NULL);
+        gst_bin_add(GST_BIN(pipeline), convert);
+        pipeline_model_add(pipeline, NODE_DSP, "audioconvert", convert);
+
+        if (!gst_element_link(prev, convert)) return FALSE;
+        prev = convert;
+    }
+
+    return gst_element_link(prev, to);
+}
+
+static gchar *pipeline_conversions_str(ConversionPlan *plan) {
+    // Describe the conversions. Caller should g_free() this value.
+    if (plan->resample && plan->convert) {
+        return g_strdup("audioresample, audioconvert");
+    } else if (plan->resample) {
+        return g_strdup("audioresample");
+    } else if (plan->convert) {
+        return g_strdup("audioconvert");
+    }
+
+    gchar *caps = (plan->src_caps ? gst_caps_to_string(plan->src_caps) : g_strdup("-"));
+    gchar *str = g_strdup_printf("none (devices deliver %s)", caps);
+    g_free(caps);
+    return str;
+}
+
+static void pipeline_set_conversions(GstElement *pipeline, ConversionPlan *plan) {
+    // Save description of the active conversions. See pipeline_get_conversions().
+    gchar *str = pipeline_conversions_str(plan);
+    LOG_DEBUG("Conversions in the pipeline: %s.\n", str);
+
+    g_object_set_data_full(G_OBJECT(pipeline), "conversions", str, g_free);
+}
+
+const gchar *pipeline_get_conversions(GstElement *pipeline) {
+    // Return description of the conversions in the recording pipeline
+    if (!GST_IS_ELEMENT(pipeline)) return NULL;
+    return (const gchar*)g_object_get_data(G_OBJECT(pipeline), "conversions");
+}
+
+static GstElement *pipeline_create_encoder(const gchar *profile_str, gchar **err_msg) {
+    // Create a queue + GstCapsfilter + all encoder elements from profile_str.
+    // The queue decouples the encoder from the capture. Its fill level shows the CPU pressure (see gst-pressure.c).
+    gchar *str = g_strdup_printf("queue name=%s max-size-time=%" G_GUINT64_FORMAT " max-size-bytes=0 max-size-buffers=0 ! "
+                                 "capsfilter caps=%s", PIPELINE_ENCODER_QUEUE, (guint64)PIPELINE_ENCODER_QUEUE_TIME, profile_str);
+
+    GError *error = NULL;
+    GstElement *bin = gst_parse_bin_from_description(str, TRUE, &error);
+    if (error) {
+        // Set err_msg
+        gchar *tmp = g_strdup_printf("%s. (%s)", error->message, str);
+        *err_msg = g_strdup_printf(_("Cannot create audio pipeline. %s.\n"), tmp);
+        g_free(tmp);
+        g_error_free(error);
+
+        if (bin) gst_object_unref(bin);
+        bin = NULL;
+    }
+
+    g_free(str);
+
+    return bin;
+}
+
+static const gchar *pipeline_sink_key() {
+    // Key of the sink node: file sink factory, and the encryption stage
+    if (!encrypt_enabled()) return filesink_factory();
+
+    gchar *str = g_strdup_printf("%s ! %s", ENCRYPT_FACTORY, filesink_factory());
+    const gchar *key = g_intern_string(str);
+    g_free(str);
+
+    return key;
+}
+
+static GstElement *pipeline_create_sink(const gchar *factory, gchar **err_msg) {
+    // Create a queue + file sink. The queue is a memory ring that absorbs disk stalls, so they do not reach
+    // the encoder and the capture. When it is nearly full, a spool file takes the overflow (see gst-stall.c).
+    // Encrypted recordings are encrypted before the queue; the spool file gets no cleartext (see gst-encrypt.c).
+    gint mbytes = PIPELINE_SINK_QUEUE_MB;
+    conf_get_int_value("stall-buffer-size", &mbytes);
+    mbytes = CLAMP(mbytes, 1, 2048);
+
+    gchar *encrypt = (encrypt_enabled() ? g_strdup_printf("%s name=%s ! ", ENCRYPT_FACTORY, PIPELINE_ENCRYPT) : g_strdup(""));
+
+    gchar *str = g_strdup_printf("%squeue name=%s max-size-time=0 max-size-bytes=%u max-size-buffers=0 ! %s name=filesink",
+                                 encrypt, PIPELINE_SINK_QUEUE, (guint)mbytes * 1024 * 1024, factory);
+    g_free(encrypt);
+
+    GError *error = NULL;
+    GstElement *bin = gst_parse_bin_from_description(str, TRUE, &error);
+    if (error) {
+        // Set err_msg
+        gchar *tmp = g_strdup_printf("%s. (%s)", error->message, str);
+        *err_msg = g_strdup_printf(_("Cannot create audio pipeline. %s.\n"), tmp);
+        g_free(tmp);
+        g_error_free(error);
+
+        if (bin) gst_object_unref(bin);
+        bin = NULL;
+    }
+
+    g_free(str);
+
+    return bin;
+}
+
+static gboolean pipeline_need_mixer(PipelineParms *parms) {
+    // Record from 2 or more devices?
 
     // Wash the device list. User may have disconnected microphones and webcams.
     // Invalid devices will crash the GStreamer pipeline.
     // Remove invalid devices.
     GList *new_list = audio_sources_wash_device_list(parms->dev_list);
 
-    if (g_list_length(new_list) < 1) {
-        new_list = g_list_append(new_list, NULL);
-    }
+    gboolean ret = (g_list_length(new_list) >= 2);
+
+    // Free new_list
+    str_list_free(new_list);
+    new_list = NULL;
+
+    return ret;
+}
+
+GstElement *pipeline_create(PipelineParms *parms, gchar **err_msg) {
+    if (!parms) return NULL;
+
+    // Create a GStreamer pipeline for audio recording
+    GstElement *pipeline = NULL;
 
     // Zero or one device?
-    if (g_list_length(new_list) < 2) {
+    if (!pipeline_need_mixer(parms)) {
 
         // Create a simple pipeline that can record from max 1 device
         pipeline = pipeline_create_simple(parms, err_msg);
@@ -81,10 +403,6 @@ GstElement *pipeline_create(PipelineParms *parms, gchar **err_msg) {
         pipeline = pipeline_create_complex(parms, err_msg);
     }
 
-    // Free new_list
-    str_list_free(new_list);
-    new_list = NULL;
-
     return pipeline;
 }
 
@@ -103,53 +421,75 @@ static GstElement *pipeline_create_simple(PipelineParms *parms, gchar **err_msg)
 
     GstElement *pipeline = gst_pipeline_new("Audio-Recorder");
 
-    // Source
-    const gchar *source_name = (parms->source ? parms->source : "pulsesrc");
-    GstElement *source = create_element(source_name, NULL);
+    ConversionPlan plan = {TRUE, TRUE, NULL};
 
-    // Set device
-    const gchar *device = g_list_nth_data(parms->dev_list, 0);
-    if (device) {
-        g_object_set(G_OBJECT(source), "device", device, NULL);
+    GstElement *level = create_element("level", "level");
+
+    GstElement *bin = pipeline_create_encoder(parms->profile_str, err_msg);
+    if (!bin) {
+        goto LBL_1;
     }
 
-    GstElement *level = create_element("level", "level");
+    // Link audioresample and audioconvert only if the device cannot deliver the profile's caps
+    pipeline_plan_conversions(parms->dev_list, bin, level, NULL, NULL, &plan);
 
-    gchar *str = g_strdup_printf("capsfilter caps=%s", parms->profile_str);
+    // Source. The capture front-end keeps recording if the device disappears (see gst-capture.c).
+    const gchar *source_name = (parms->source ? parms->source : "pulsesrc");
+    const gchar *device = g_list_nth_data(parms->dev_list, 0);
+    GstElement *source = capture_create_source(pipeline, source_name, device, plan.src_caps);
 
-    GError *error = NULL;
-    GstElement *bin = gst_parse_bin_from_description(str, TRUE, &error);
-    if (error) {
-        // Set err_msg
-        gchar *tmp = g_strdup_printf("%s. (%s)", error->message, str);
-        *err_msg = g_strdup_printf(_("Cannot create audio pipeline. %s.\n"), tmp);
-        g_free(tmp);
-        g_error_free(error);
-        g_free(str);
+    // Queue + filesink (or arfilesink, see gst-filesink.c). Caller must set the "location" property of "filesink".
+    const gchar *sink_factory = filesink_factory();
+    GstElement *sink = pipeline_create_sink(sink_factory, err_msg);
+    if (!sink) {
         goto LBL_1;
     }
 
-    g_free(str);
+    gst_bin_add_many(GST_BIN(pipeline), level, bin, sink, NULL);
 
-    GstElement *resample = create_element("audioresample", NULL);
-    GstElement *convert = create_element("audioconvert", NULL);
+    pipeline_model_new(pipeline, source_name, FALSE, FALSE);
+    pipeline_model_add(pipeline, NODE_DSP, "level", level);
 
-    // Filesink. Caller must set its "location" property.
-    GstElement *filesink = create_element("filesink", "filesink");
+    // Link source -> capsfilter -> level. Set the source caps if no conversion is needed.
+    GstElement *filter = NULL;
+    gboolean ok = pipeline_link_source(pipeline, source, level, plan.src_caps, &filter);
 
-    gst_bin_add_many(GST_BIN(pipeline), source, level, resample, convert, bin, filesink, NULL);
+    PipelineNode *node = pipeline_model_add(pipeline, NODE_SOURCE, device, source);
+    node->filter = filter;
 
-    // Link
-    if (!gst_element_link_many(source, level, resample, convert, bin, filesink, NULL)) {
+    // Link level -> [audioresample] -> [audioconvert] -> bin -> sink
+    ok = ok && pipeline_link_conversions(pipeline, level, bin, &plan);
+    ok = ok && gst_element_link(bin, sink);
+
+    pipeline_model_add(pipeline, NODE_ENCODER, parms->profile_str, bin);
+    pipeline_model_add(pipeline, NODE_SINK, pipeline_sink_key(), sink);
+
+    if (!ok) {
         *err_msg = g_strdup_printf(_("Cannot create audio pipeline. %s.\n"), "Cannot link.");
         goto LBL_1;
     }
 
+    // Live gain and mute (see gst-mixer.c)
+    GstPad *pad = gst_element_get_static_pad(level, "sink");
+    mixer_attach(pipeline, pad, device, FALSE);
+    gst_object_unref(pad);
+
+    pipeline_set_conversions(pipeline, &plan);
+
+    // Keep the source caps for sources added later
+    if (plan.src_caps) {
+        g_object_set_data_full(G_OBJECT(pipeline), "source-caps", gst_caps_ref(plan.src_caps), (GDestroyNotify)gst_caps_unref);
+    }
+
+    if (plan.src_caps) gst_caps_unref(plan.src_caps);
+
     // Ok
     return pipeline;
 
 LBL_1:
     // Got an error
+    if (plan.src_caps) gst_caps_unref(plan.src_caps);
+
     return NULL;
 }
 
@@ -180,6 +520,8 @@ static GstElement *pipeline_create_complex(PipelineParms *parms, gchar **err_msg
 
     GstElement *pipeline = gst_pipeline_new("Audio-Recorder");
 
+    ConversionPlan plan = {TRUE, TRUE, NULL};
+
     // Create either "audiomixer" or "adder". Audiomixer is an improved version of adder.
     GstElement *mixer = create_element("audiomixer", "mixer");
     if (!GST_IS_ELEMENT(mixer)) {
@@ -191,70 +533,684 @@ static GstElement *pipeline_create_complex(PipelineParms *parms, gchar **err_msg
 
     // Create a GstCapsfilter + all encoder elements from the GNOME's profile_str.
     // See: gconf-editor,  system -> gstreamer -> 0.10 -> audio -> profiles.
-    gchar *str = g_strdup_printf("capsfilter caps=%s", parms->profile_str);
+    GstElement *bin = pipeline_create_encoder(parms->profile_str, err_msg);
+    if (!bin) {
+        goto LBL_1;
+    }
 
-    GError *error = NULL;
-    GstElement *bin = gst_parse_bin_from_description(str, TRUE, &error);
-    if (error) {
-        // Set err_msg
-        gchar *tmp = g_strdup_printf("%s. (%s)", error->message, str);
-        *err_msg = g_strdup_printf(_("Cannot create audio pipeline. %s.\n"), tmp);
-        g_free(tmp);
-        g_error_free(error);
-        g_free(str);
+    // Link audioresample and audioconvert only if some device cannot deliver the profile's caps
+    pipeline_plan_conversions(parms->dev_list, bin, level, mixer, NULL, &plan);
+
+    // Queue + filesink (or arfilesink, see gst-filesink.c). Caller must set the "location" property of "filesink".
+    const gchar *sink_factory = filesink_factory();
+    GstElement *sink = pipeline_create_sink(sink_factory, err_msg);
+    if (!sink) {
         goto LBL_1;
     }
 
-    g_free(str);
+    gst_bin_add_many(GST_BIN(pipeline), mixer, level, bin, sink, NULL);
 
-    GstElement *resample = create_element("audioresample", NULL);
-    GstElement *convert = create_element("audioconvert", NULL);
+    const gchar *source_name = (parms->source ? parms->source : "pulsesrc");
 
-    // Filesink. Caller must set its "location" property.
-    GstElement *filesink = create_element("filesink", "filesink");
+    pipeline_model_new(pipeline, source_name, TRUE, FALSE);
+    pipeline_model_add(pipeline, NODE_DSP, "mixer", mixer);
+    pipeline_model_add(pipeline, NODE_DSP, "level", level);
 
-    gst_bin_add_many(GST_BIN(pipeline), mixer, level, resample, convert, bin, filesink, NULL);
+    // Wait for late inputs up to the latency budget
+    drift_setup_mixer(pipeline, mixer);
 
-    // Link
-    if (!gst_element_link_many(mixer, level, resample, convert, bin, filesink, NULL)) {
+    // Link mixer -> level -> [audioresample] -> [audioconvert] -> bin -> sink
+    if (!(gst_element_link(mixer, level) && pipeline_link_conversions(pipeline, level, bin, &plan) && gst_element_link(bin, sink))) {
         *err_msg = g_strdup_printf(_("Cannot create audio pipeline. %s.\n"), "Cannot link.");
         goto LBL_1;
     }
 
+    pipeline_model_add(pipeline, NODE_ENCODER, parms->profile_str, bin);
+    pipeline_model_add(pipeline, NODE_SINK, pipeline_sink_key(), sink);
+
     // Now create audio source for all devices
     GList *item = g_list_first(parms->dev_list);
     while (item) {
         // Device name
         const gchar *device = (gchar*)item->data;
 
-        // Source
-        const gchar *source_name = (parms->source ? parms->source : "pulsesrc");
-        GstElement *source = create_element(source_name, NULL);
-        g_object_set(G_OBJECT(source), "device", device, NULL);
+        // Source (with device failover, see gst-capture.c)
+        GstElement *source = capture_create_source(pipeline, source_name, device, plan.src_caps);
 
         //Queue
         GstElement *queue = create_element("queue", NULL);
-        gst_bin_add_many(GST_BIN(pipeline), source, queue, NULL);
+        gst_bin_add(GST_BIN(pipeline), queue);
 
-        // Link source# -> queue#
-        gst_element_link(source, queue);
+        // Link source# -> queue#. Set the source caps if no conversion is needed.
+        GstElement *filter = NULL;
+        pipeline_link_source(pipeline, source, queue, plan.src_caps, &filter);
 
         // Link queue# -> mixer
         // Gstreamer 1.0:
         gst_element_link_pads(queue, NULL, mixer, NULL);
 
+        // Each device has its own clock. Resample it to the pipeline clock and bound its queue (see gst-drift.c).
+        drift_attach(pipeline, queue, device);
+
+        // Live gain and mute (see gst-mixer.c)
+        GstPad *pad = gst_element_get_static_pad(queue, "src");
+        mixer_attach(pipeline, pad, device, FALSE);
+        gst_object_unref(pad);
+
+        PipelineNode *node = pipeline_model_add(pipeline, NODE_SOURCE, device, source);
+        node->filter = filter;
+        node->queue = queue;
+
         // Next source
         item = g_list_next(item);
     }
 
+    drift_setup_sources(pipeline);
+
+    pipeline_set_conversions(pipeline, &plan);
+
+    // Keep the source caps for sources added later
+    if (plan.src_caps) {
+        g_object_set_data_full(G_OBJECT(pipeline), "source-caps", gst_caps_ref(plan.src_caps), (GDestroyNotify)gst_caps_unref);
+    }
+
+    if (plan.src_caps) gst_caps_unref(plan.src_caps);
+
     // Ok
     return pipeline;
 
 LBL_1:
     // Got an error
+    if (plan.src_caps) gst_caps_unref(plan.src_caps);
+
+    return NULL;
+}
+
+// ------------------------------------------------------------
+// Pipeline model
+// ------------------------------------------------------------
+
+static const gchar *pipeline_node_key(const gchar *device) {
+    // Key of a source node. The system's default source has no device id.
+    return (device ? device : "default-device");
+}
+
+static void pipeline_node_free(PipelineNode *node) {
+    g_free(node->key);
+    g_free(node);
+}
+
+static void pipeline_model_free(PipelineModel *model) {
+    g_list_free_full(model->nodes, (GDestroyNotify)pipeline_node_free);
+    g_free(model->source_name);
+    g_free(model);
+}
+
+static void pipeline_model_new(GstElement *pipeline, const gchar *source_name, gboolean complex, gboolean vad) {
+    // Start the model of a new pipeline. It lives as long as the pipeline.
+    PipelineModel *model = g_malloc0(sizeof(PipelineModel));
+    model->source_name = g_strdup(source_name);
+    model->complex = complex;
+    model->vad = vad;
+
+    g_object_set_data_full(G_OBJECT(pipeline), "model", model, (GDestroyNotify)pipeline_model_free);
+}
+
+static PipelineModel *pipeline_get_model(GstElement *pipeline) {
+    if (!GST_IS_ELEMENT(pipeline)) return NULL;
+    return (PipelineModel*)g_object_get_data(G_OBJECT(pipeline), "model");
+}
+
+static PipelineNode *pipeline_model_add(GstElement *pipeline, PipelineNodeType type, const gchar *key, GstElement *elem) {
+    // Add a node. Return NULL if the pipeline has no model (eg. benchmark pipelines).
+    PipelineModel *model = pipeline_get_model(pipeline);
+    if (!model) return NULL;
+
+    PipelineNode *node = g_malloc0(sizeof(PipelineNode));
+    node->type = type;
+    node->key = g_strdup(type == NODE_SOURCE ? pipeline_node_key(key) : key);
+    node->elem = elem;
+
+    model->nodes = g_list_append(model->nodes, node);
+    return node;
+}
+
+static PipelineNode *pipeline_model_find(PipelineModel *model, PipelineNodeType type, const gchar *key) {
+    // Find node by type and key. key NULL: the first node of the type.
+    GList *item = g_list_first(model->nodes);
+    while (item) {
+        PipelineNode *node = (PipelineNode*)item->data;
+        if (node->type == type && (!key || !g_strcmp0(node->key, key))) {
+            return node;
+        }
+        item = g_list_next(item);
+    }
     return NULL;
 }
 
+static guint pipeline_model_count(PipelineModel *model, PipelineNodeType type) {
+    guint count = 0;
+
+    GList *item = g_list_first(model->nodes);
+    while (item) {
+        PipelineNode *node = (PipelineNode*)item->data;
+        if (node->type == type) count++;
+        item = g_list_next(item);
+    }
+    return count;
+}
+
+static void pipeline_model_remove(PipelineModel *model, PipelineNode *node) {
+    model->nodes = g_list_remove(model->nodes, node);
+    pipeline_node_free(node);
+}
+
+static gboolean pipeline_link_source(GstElement *pipeline, GstElement *source, GstElement *next, GstCaps *caps, GstElement **filter) {
+    // Link source -> capsfilter -> next (queue or level).
+    // The capsfilter sets the source caps (caps NULL: any caps). It is an element of its own, so the caps can be
+    // changed and the source can be removed later.
+    *filter = create_element("capsfilter", NULL);
+    g_object_set(G_OBJECT(*filter), "caps", caps, NULL);
+    gst_bin_add(GST_BIN(pipeline), *filter);
+
+    return gst_element_link_many(source, *filter, next, NULL);
+}
+
+static void pipeline_remove_element(GstElement *pipeline, GstElement *elem) {
+    gst_element_set_state(elem, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(pipeline), elem);
+}
+
+// ------------------------------------------------------------
+// Add, remove and swap nodes
+// ------------------------------------------------------------
+
+static gboolean pipeline_branch_add(GstElement *pipeline, PipelineModel *model, const gchar *device, gboolean running, gchar **err_msg) {
+    // Complex pipeline: add source ! capsfilter ! queue ! mixer for device.
+    // If running is TRUE, start the branch. It fades in.
+    GstElement *mixer = gst_bin_get_by_name(GST_BIN(pipeline), "mixer");
+    if (!mixer) {
+        *err_msg = g_strdup_printf(_("Cannot find audio element %s.\n"), "mixer");
+        return FALSE;
+    }
+
+    GstCaps *caps = (GstCaps*)g_object_get_data(G_OBJECT(pipeline), "source-caps");
+
+    GstElement *source = NULL;
+    if (model->vad) {
+        // Plain source for VAD
+        source = create_element(model->source_name, NULL);
+        if (source) {
+            if (device) {
+                g_object_set(G_OBJECT(source), "device", device, NULL);
+            }
+            gst_bin_add(GST_BIN(pipeline), source);
+        }
+    } else {
+        source = capture_create_source(pipeline, model->source_name, device, caps);
+    }
+
+    if (!source) {
+        *err_msg = g_strdup_printf(_("Cannot find audio element %s.\n"), model->source_name);
+        gst_object_unref(mixer);
+        return FALSE;
+    }
+
+    GstElement *queue = create_element("queue", NULL);
+    gst_bin_add(GST_BIN(pipeline), queue);
+
+    GstElement *filter = NULL;
+    gboolean ok = (model->vad ? gst_element_link(source, queue) : pipeline_link_source(pipeline, source, queue, caps, &filter));
+    ok = ok && gst_element_link_pads(queue, NULL, mixer, NULL);
+
+    gst_object_unref(mixer);
+
+    if (!ok) {
+        *err_msg = g_strdup_printf(_("Cannot add device %s. %s.\n"), pipeline_node_key(device), "Cannot link");
+
+        capture_remove_source(pipeline, source);
+        if (filter) {
+            pipeline_remove_element(pipeline, filter);
+        }
+        pipeline_remove_element(pipeline, queue);
+        return FALSE;
+    }
+
+    if (!model->vad) {
+        // Drift compensation (see gst-drift.c)
+        drift_attach(pipeline, queue, device);
+
+        // Live gain and mute (see gst-mixer.c). A source added during recording starts silent and fades in.
+        GstPad *pad = gst_element_get_static_pad(queue, "src");
+        mixer_attach(pipeline, pad, device, running);
+        gst_object_unref(pad);
+
+        drift_setup_sources(pipeline);
+    }
+
+    PipelineNode *node = pipeline_model_add(pipeline, NODE_SOURCE, device, source);
+    node->filter = filter;
+    node->queue = queue;
+
+    if (running) {
+        // Start downstream elements first
+        gst_element_sync_state_with_parent(queue);
+        if (filter) {
+            gst_element_sync_state_with_parent(filter);
+        }
+        capture_start_source(pipeline, source);
+    }
+
+    return TRUE;
+}
+
+static void pipeline_branch_remove(GstElement *pipeline, PipelineModel *model, PipelineNode *node) {
+    // Complex pipeline: stop source ! capsfilter ! queue of node, unlink it from the mixer and remove it
+    mixer_detach(pipeline, node->key);
+    drift_detach(pipeline, node->queue);
+
+    capture_remove_source(pipeline, node->elem);
+
+    if (node->filter) {
+        pipeline_remove_element(pipeline, node->filter);
+    }
+
+    // Unlink queue -> mixer and release the mixer's request pad
+    GstPad *src_pad = gst_element_get_static_pad(node->queue, "src");
+    GstPad *mixer_pad = gst_pad_get_peer(src_pad);
+
+    gst_element_set_state(node->queue, GST_STATE_NULL);
+
+    if (mixer_pad) {
+        gst_pad_unlink(src_pad, mixer_pad);
+
+        GstElement *mixer = gst_pad_get_parent_element(mixer_pad);
+        if (mixer) {
+            gst_element_release_request_pad(mixer, mixer_pad);
+            gst_object_unref(mixer);
+        }
+        gst_object_unref(mixer_pad);
+    }
+    gst_object_unref(src_pad);
+
+    gst_bin_remove(GST_BIN(pipeline), node->queue);
+
+    pipeline_model_remove(model, node);
+}
+
+static gboolean pipeline_attach_source(GstElement *pipeline, PipelineModel *model, GstElement *level, const gchar *device, gboolean running) {
+    // Simple pipeline: add source ! capsfilter for device in front of level. Return FALSE if it cannot be linked.
+    GstCaps *caps = (GstCaps*)g_object_get_data(G_OBJECT(pipeline), "source-caps");
+
+    GstElement *source = capture_create_source(pipeline, model->source_name, device, caps);
+    if (!source) return FALSE;
+
+    GstElement *filter = NULL;
+    if (!pipeline_link_source(pipeline, source, level, caps, &filter)) {
+        // Take the half-linked elements out again
+        capture_remove_source(pipeline, source);
+        pipeline_remove_element(pipeline, filter);
+        return FALSE;
+    }
+
+    PipelineNode *node = pipeline_model_add(pipeline, NODE_SOURCE, device, source);
+    node->filter = filter;
+
+    // Live gain and mute (see gst-mixer.c)
+    GstPad *pad = gst_element_get_static_pad(level, "sink");
+    mixer_attach(pipeline, pad, device, running);
+    gst_object_unref(pad);
+
+    if (running) {
+        gst_element_sync_state_with_parent(filter);
+        capture_start_source(pipeline, source);
+    }
+
+    return TRUE;
+}
+
+static gboolean pipeline_swap_source(GstElement *pipeline, PipelineModel *model, PipelineNode *node, const gchar *device, gboolean running, gchar **err_msg) {
+    // Simple pipeline: replace the source (and its capsfilter) in front of the level element
+    PipelineNode *level = pipeline_model_find(model, NODE_DSP, "level");
+    if (!level) return FALSE;
+
+    // Device of the old node (NULL: the system's default source)
+    gchar *old_device = g_strdup(g_strcmp0(node->key, pipeline_node_key(NULL)) ? node->key : NULL);
+
+    mixer_detach(pipeline, node->key);
+    capture_remove_source(pipeline, node->elem);
+
+    if (node->filter) {
+        pipeline_remove_element(pipeline, node->filter);
+    }
+
+    pipeline_model_remove(model, node);
+
+    gboolean ok = pipeline_attach_source(pipeline, model, level->elem, device, running);
+
+    if (!ok) {
+        *err_msg = g_strdup_printf(_("Cannot add device %s. %s.\n"), pipeline_node_key(device), "Cannot link");
+
+        // The pipeline must keep a source. Put the old one back.
+        if (!pipeline_attach_source(pipeline, model, level->elem, old_device, running)) {
+            LOG_ERROR("Cannot restore device %s.\n", pipeline_node_key(old_device));
+        }
+    }
+
+    g_free(old_device);
+    return ok;
+}
+
+static gboolean pipeline_plan_changed(GstElement *pipeline, PipelineNode *encoder, PipelineParms *parms) {
+    // Would the devices of parms need other conversions (or source caps) than the pipeline has now?
+    PipelineModel *model = pipeline_get_model(pipeline);
+    PipelineNode *level = pipeline_model_find(model, NODE_DSP, "level");
+    PipelineNode *mixer = pipeline_model_find(model, NODE_DSP, "mixer");
+
+    ConversionPlan plan = {TRUE, TRUE, NULL};
+    pipeline_plan_conversions(parms->dev_list, encoder->elem, (level ? level->elem : NULL), (mixer ? mixer->elem : NULL), NULL, &plan);
+
+    gchar *str = pipeline_conversions_str(&plan);
+    gboolean changed = g_strcmp0(str, pipeline_get_conversions(pipeline));
+    g_free(str);
+
+    if (plan.src_caps) gst_caps_unref(plan.src_caps);
+
+    return changed;
+}
+
+static gboolean pipeline_rebuild_encoder(GstElement *pipeline, PipelineModel *model, PipelineParms *parms, gboolean new_encoder, gchar **err_msg) {
+    // Stopped pipeline: rebuild level -> [audioresample] -> [audioconvert] -> encoder.
+    // If new_encoder is FALSE, keep the encoder bin and replace the conversions only.
+    PipelineNode *level = pipeline_model_find(model, NODE_DSP, "level");
+    PipelineNode *encoder = pipeline_model_find(model, NODE_ENCODER, NULL);
+    PipelineNode *sink = pipeline_model_find(model, NODE_SINK, NULL);
+
+    if (!(level && encoder && sink)) return FALSE;
+
+    GstElement *bin = encoder->elem;
+    if (new_encoder) {
+        bin = pipeline_create_encoder(parms->profile_str, err_msg);
+        if (!bin) return FALSE;
+    }
+
+    // Remove the old conversions (and encoder)
+    GList *item = g_list_first(model->nodes);
+    while (item) {
+        PipelineNode *node = (PipelineNode*)item->data;
+        item = g_list_next(item);
+
+        gboolean conversion = (node->type == NODE_DSP && (!g_strcmp0(node->key, "audioresample") || !g_strcmp0(node->key, "audioconvert")));
+
+        if (conversion || (new_encoder && node->type == NODE_ENCODER)) {
+            pipeline_remove_element(pipeline, node->elem);
+            pipeline_model_remove(model, node);
+        }
+    }
+
+    // Level may be linked directly to the encoder
+    gst_element_unlink(level->elem, bin);
+
+    gboolean ok = TRUE;
+    if (new_encoder) {
+        gst_bin_add(GST_BIN(pipeline), bin);
+        pipeline_model_add(pipeline, NODE_ENCODER, parms->profile_str, bin);
+
+        ok = gst_element_link(bin, sink->elem);
+    }
+
+    PipelineNode *mixer = pipeline_model_find(model, NODE_DSP, "mixer");
+
+    ConversionPlan plan = {TRUE, TRUE, NULL};
+    pipeline_plan_conversions(parms->dev_list, bin, level->elem, (mixer ? mixer->elem : NULL), NULL, &plan);
+
+    ok = ok && pipeline_link_conversions(pipeline, level->elem, bin, &plan);
+
+    if (!ok) {
+        *err_msg = g_strdup_printf(_("Cannot create audio pipeline. %s.\n"), "Cannot link.");
+        goto LBL_1;
+    }
+
+    // New source caps
+    item = g_list_first(model->nodes);
+    while (item) {
+        PipelineNode *node = (PipelineNode*)item->data;
+        if (node->type == NODE_SOURCE && node->filter) {
+            g_object_set(G_OBJECT(node->filter), "caps", plan.src_caps, NULL);
+        }
+        item = g_list_next(item);
+    }
+
+    capture_set_caps(pipeline, plan.src_caps);
+
+    if (plan.src_caps) {
+        g_object_set_data_full(G_OBJECT(pipeline), "source-caps", gst_caps_ref(plan.src_caps), (GDestroyNotify)gst_caps_unref);
+    } else {
+        g_object_set_data(G_OBJECT(pipeline), "source-caps", NULL);
+    }
+
+    pipeline_set_conversions(pipeline, &plan);
+
+LBL_1:
+    if (plan.src_caps) gst_caps_unref(plan.src_caps);
+
+    return ok;
+}
+
+static gboolean pipeline_reconfigure_ex(GstElement *pipeline, PipelineParms *parms, gboolean complex, gchar **err_msg) {
+    // Compare the model of pipeline with parms. Rebuild only the sources and the encoder that changed.
+    gint64 t0 = g_get_monotonic_time();
+
+    PipelineModel *model = pipeline_get_model(pipeline);
+    if (!model) return FALSE;
+
+    // From 1 device to many (or back), or another source element? Rebuild all.
+    const gchar *source_name = (parms->source ? parms->source : "pulsesrc");
+    if (complex != model->complex || g_strcmp0(source_name, model->source_name)) {
+        LOG_DEBUG("Pipeline topology has changed. Rebuild the pipeline.\n");
+        return FALSE;
+    }
+
+    // Another file sink ("fast-sink" setting), or encryption on/off? Rebuild all.
+    PipelineNode *sink = pipeline_model_find(model, NODE_SINK, NULL);
+    if (!model->vad && sink && g_strcmp0(sink->key, pipeline_sink_key())) {
+        LOG_DEBUG("File sink has changed. Rebuild the pipeline.\n");
+        return FALSE;
+    }
+
+    GstState state = GST_STATE_NULL;
+    gst_element_get_state(pipeline, &state, NULL, 0);
+    gboolean running = (state >= GST_STATE_PAUSED);
+
+    // A stopped recording pipeline starts a new recording. Reset the per-recording state.
+    if (!running && !model->vad) {
+        if (!capture_reset(pipeline)) {
+            LOG_DEBUG("A source has failed over. Rebuild the pipeline.\n");
+            return FALSE;
+        }
+
+        drift_reset(pipeline);
+        mixer_reset(pipeline);
+    }
+
+    // Wanted devices. The simple pipeline records from the first device.
+    GList *wanted = NULL;
+    if (complex) {
+        wanted = g_list_copy(parms->dev_list);
+    } else {
+        wanted = g_list_append(NULL, g_list_nth_data(parms->dev_list, 0));
+    }
+
+    // Diff: sources to remove and devices to add
+    GList *removed = NULL;
+    GList *added = NULL;
+
+    GList *item = g_list_first(model->nodes);
+    while (item) {
+        PipelineNode *node = (PipelineNode*)item->data;
+        if (node->type == NODE_SOURCE) {
+            GList *w = g_list_first(wanted);
+            while (w && g_strcmp0(pipeline_node_key(w->data), node->key)) {
+                w = g_list_next(w);
+            }
+
+            if (!w) {
+                removed = g_list_append(removed, node);
+            }
+        }
+        item = g_list_next(item);
+    }
+
+    item = g_list_first(wanted);
+    while (item) {
+        const gchar *device = (const gchar*)item->data;
+        if (!pipeline_model_find(model, NODE_SOURCE, pipeline_node_key(device))) {
+            added = g_list_append(added, (gpointer)device);
+        }
+        item = g_list_next(item);
+    }
+
+    PipelineNode *encoder = pipeline_model_find(model, NODE_ENCODER, NULL);
+
+    gboolean new_encoder = (encoder && g_strcmp0(encoder->key, parms->profile_str));
+    gboolean replan = new_encoder || (encoder && (removed || added) && pipeline_plan_changed(pipeline, encoder, parms));
+
+    guint n_removed = g_list_length(removed);
+    guint n_added = g_list_length(added);
+    guint n_kept = pipeline_model_count(model, NODE_SOURCE) - n_removed;
+
+    gboolean ok = TRUE;
+
+    // Cannot change the encoder of a running recording
+    if (replan && running) {
+        *err_msg = g_strdup(_("Cannot change the encoder or the conversions of a running recording.\n"));
+        ok = FALSE;
+    }
+
+    if (ok && replan) {
+        ok = pipeline_rebuild_encoder(pipeline, model, parms, new_encoder, err_msg);
+    }
+
+    if (ok && !complex && removed) {
+        ok = pipeline_swap_source(pipeline, model, (PipelineNode*)removed->data, (const gchar*)added->data, running, err_msg);
+
+    } else if (ok && complex) {
+        // Add first. The mixer always has inputs.
+        item = g_list_first(added);
+        while (item && ok) {
+            ok = pipeline_branch_add(pipeline, model, (const gchar*)item->data, running, err_msg);
+            item = g_list_next(item);
+        }
+
+        item = g_list_first(removed);
+        while (item && ok) {
+            pipeline_branch_remove(pipeline, model, (PipelineNode*)item->data);
+            item = g_list_next(item);
+        }
+    }
+
+    if (ok) {
+        LOG_MSG("Reconfigured pipeline in %.1f ms: %u sources kept, %u removed, %u added, encoder %s.\n",
+                (g_get_monotonic_time() - t0) / 1000.0, n_kept, n_removed, n_added,
+                (new_encoder ? "replaced" : (replan ? "kept, conversions replaced" : "kept")));
+    }
+
+    g_list_free(wanted);
+    g_list_free(removed);
+    g_list_free(added);
+
+    return ok;
+}
+
+gboolean pipeline_reconfigure(GstElement *pipeline, PipelineParms *parms, gchar **err_msg) {
+    // Update pipeline to parms. Rebuild only the sources and the encoder that changed.
+    PipelineModel *model = pipeline_get_model(pipeline);
+    if (!(model && parms)) return FALSE;
+
+    // The VAD pipeline always has a mixer
+    gboolean complex = (model->vad || pipeline_need_mixer(parms));
+
+    return pipeline_reconfigure_ex(pipeline, parms, complex, err_msg);
+}
+
+gboolean pipeline_add_source(GstElement *pipeline, const gchar *device, gchar **err_msg) {
+    // Add an input to a running (complex) pipeline. The other inputs and the encoder keep running.
+    gint64 t0 = g_get_monotonic_time();
+
+    PipelineModel *model = pipeline_get_model(pipeline);
+    if (!(model && model->complex)) {
+        // Simple pipeline (1 device). It has no mixer.
+        *err_msg = g_strdup(_("Cannot add a device to this recording. Start the recording with 2 or more devices.\n"));
+        return FALSE;
+    }
+
+    if (pipeline_model_find(model, NODE_SOURCE, pipeline_node_key(device))) {
+        *err_msg = g_strdup_printf(_("Device %s is already recording.\n"), pipeline_node_key(device));
+        return FALSE;
+    }
+
+    if (!pipeline_branch_add(pipeline, model, device, TRUE, err_msg)) {
+        return FALSE;
+    }
+
+    LOG_MSG("Added input %s in %.1f ms.\n", pipeline_node_key(device), (g_get_monotonic_time() - t0) / 1000.0);
+
+    return TRUE;
+}
+
+typedef struct {
+    GstElement *pipeline;
+    gchar *device;
+    gint64 start_time;
+} PipelineRemoval;
+
+static gboolean pipeline_remove_source_cb(gpointer user_data) {
+    // Input has faded out. Stop and remove it. Called in the main loop.
+    PipelineRemoval *rm = (PipelineRemoval*)user_data;
+
+    PipelineModel *model = pipeline_get_model(rm->pipeline);
+    PipelineNode *node = (model ? pipeline_model_find(model, NODE_SOURCE, rm->device) : NULL);
+
+    if (node) {
+        pipeline_branch_remove(rm->pipeline, model, node);
+
+        LOG_MSG("Removed input %s in %.1f ms.\n", rm->device, (g_get_monotonic_time() - rm->start_time) / 1000.0);
+    }
+
+    gst_object_unref(rm->pipeline);
+    g_free(rm->device);
+    g_free(rm);
+
+    return FALSE;
+}
+
+gboolean pipeline_remove_source(GstElement *pipeline, const gchar *device, gchar **err_msg) {
+    // Remove an input from a running pipeline. The input fades out first.
+    PipelineModel *model = pipeline_get_model(pipeline);
+
+    if (!(model && model->complex && device && pipeline_model_find(model, NODE_SOURCE, device))) {
+        *err_msg = g_strdup_printf(_("Device %s is not recording.\n"), (device ? device : ""));
+        return FALSE;
+    }
+
+    if (pipeline_model_count(model, NODE_SOURCE) < 2) {
+        *err_msg = g_strdup(_("Cannot remove the last recording device.\n"));
+        return FALSE;
+    }
+
+    PipelineRemoval *rm = g_malloc0(sizeof(PipelineRemoval));
+    rm->pipeline = gst_object_ref(pipeline);
+    rm->device = g_strdup(device);
+    rm->start_time = g_get_monotonic_time();
+
+    if (!mixer_fade_out(pipeline, device, pipeline_remove_source_cb, rm)) {
+        // No gain stage. Remove at once.
+        g_idle_add(pipeline_remove_source_cb, rm);
+    }
+
+    return TRUE;
+}
+
 GstElement *pipeline_create_VAD(PipelineParms *parms, gchar **err_msg) {
     if (!parms) return NULL;
     // Create a GStreamer pipeline for VAD, Voice Activity Detection.
@@ -376,6 +1332,13 @@ static GstElement *pipeline_create_complex_VAD(PipelineParms *parms, gchar **err
         goto LBL_1;
     }
 
+    const gchar *source_name = (parms->source ? parms->source : "pulsesrc");
+
+    pipeline_model_new(pipeline, source_name, TRUE, TRUE);
+    pipeline_model_add(pipeline, NODE_DSP, "mixer", mixer);
+    pipeline_model_add(pipeline, NODE_DSP, "level", level);
+    pipeline_model_add(pipeline, NODE_SINK, "fakesink", fakesink);
+
     // Now create audio source for all devices
     GList *item = g_list_first(parms->dev_list);
     while (item) {
@@ -383,7 +1346,6 @@ static GstElement *pipeline_create_complex_VAD(PipelineParms *parms, gchar **err
         const gchar *device = (gchar*)item->data;
 
         // Source
-        const gchar *source_name = (parms->source ? parms->source : "pulsesrc");
         GstElement *source = create_element(source_name, NULL);
 
         if (device) {
@@ -402,6 +1364,9 @@ static GstElement *pipeline_create_complex_VAD(PipelineParms *parms, gchar **err
         // Gstreamer 1.0:
         gst_element_link_pads(queue, NULL, mixer, NULL);
 
+        PipelineNode *node = pipeline_model_add(pipeline, NODE_SOURCE, device, source);
+        node->queue = queue;
+
         // Next source
         item = g_list_next(item);
     }
@@ -648,3 +1613,296 @@ static GString *pipeline_create_command_str_complex(PipelineParms *parms) {
 }
 
 
+static gdouble pipeline_cpu_time() {
+    // Process CPU time (user + system) in milliseconds. Includes the GStreamer threads.
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+static gdouble pipeline_benchmark_run(const gchar *profile_str, GstCaps *dev_caps, gboolean planned, guint n_buffers, gchar **conversions) {
+    // Encode n_buffers from a simulated device with dev_caps. Return CPU time in ms, or -1 on error.
+    // audiotestsrc ! capsfilter caps=dev_caps ! level ! [audioresample] ! [audioconvert] ! profile ! fakesink
+    gdouble cpu_time = -1.0;
+
+    ConversionPlan plan = {TRUE, TRUE, NULL};
+
+    gchar *str = g_strdup_printf("capsfilter caps=%s", profile_str);
+    GError *error = NULL;
+    GstElement *bin = gst_parse_bin_from_description(str, TRUE, &error);
+    g_free(str);
+
+    if (error) {
+        // Missing plugin?
+        if (bin) gst_object_unref(bin);
+        g_error_free(error);
+        return -1.0;
+    }
+
+    GstElement *pipeline = gst_pipeline_new("Benchmark");
+
+    GstElement *source = create_element("audiotestsrc", NULL);
+    g_object_set(G_OBJECT(source), "num-buffers", n_buffers, NULL);
+
+    GstElement *level = create_element("level", NULL);
+    GstElement *sink = create_element("fakesink", NULL);
+
+    gst_bin_add_many(GST_BIN(pipeline), source, level, bin, sink, NULL);
+
+    if (planned) {
+        GList *dev_list = g_list_append(NULL, "benchmark-device");
+        pipeline_plan_conversions(dev_list, bin, level, NULL, dev_caps, &plan);
+        g_list_free(dev_list);
+    }
+
+    GstCaps *caps = (plan.src_caps ? plan.src_caps : dev_caps);
+
+    if (!(gst_element_link_filtered(source, level, caps) &&
+            pipeline_link_conversions(pipeline, level, bin, &plan) &&
+            gst_element_link(bin, sink))) {
+        goto LBL_1;
+    }
+
+    *conversions = pipeline_conversions_str(&plan);
+
+    gdouble t = pipeline_cpu_time();
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+    if (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS) {
+        cpu_time = pipeline_cpu_time() - t;
+    }
+
+    if (msg) gst_message_unref(msg);
+    gst_object_unref(bus);
+
+LBL_1:
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    if (plan.src_caps) gst_caps_unref(plan.src_caps);
+
+    return cpu_time;
+}
+
+void pipeline_benchmark(guint n_buffers) {
+    // CPU time of all profiles, with the conversions always linked (old pipeline) and with planned conversions.
+    // Two simulated devices: one with the profile's own rate and channels (S16LE) and a typical 48 kHz stereo device.
+    // $ audio-recorder --benchmark=conversions
+    g_print("Conversion benchmark, %u buffers of 1024 samples per run, CPU time in ms:\n", n_buffers);
+    g_print("  %-32s %-8s %9s %9s  %s\n", "profile", "device", "always", "planned", "planned conversions");
+
+    GList *item = g_list_first(profiles_get_list());
+    while (item) {
+        ProfileRec *rec = (ProfileRec*)item->data;
+
+        // Raw caps of the profile, eg. "audio/x-raw,rate=44100,channels=2"
+        gchar **parts = g_strsplit(rec->pipe, "!", 2);
+        GstCaps *wanted = (parts[0] ? gst_caps_from_string(g_strstrip(parts[0])) : NULL);
+        g_strfreev(parts);
+
+        gint rate = 44100;
+        gint channels = 2;
+        if (wanted && gst_caps_get_size(wanted) > 0) {
+            GstStructure *s = gst_caps_get_structure(wanted, 0);
+            gst_structure_get_int(s, "rate", &rate);
+            gst_structure_get_int(s, "channels", &channels);
+        }
+
+        if (wanted) gst_caps_unref(wanted);
+
+        GstCaps *devices[2];
+        devices[0] = gst_caps_new_simple("audio/x-raw", "format", G_TYPE_STRING, "S16LE", "layout", G_TYPE_STRING, "interleaved",
+                                         "rate", G_TYPE_INT, rate, "channels", G_TYPE_INT, channels, NULL);
+        devices[1] = gst_caps_new_simple("audio/x-raw", "format", G_TYPE_STRING, "S16LE", "layout", G_TYPE_STRING, "interleaved",
+                                         "rate", G_TYPE_INT, 48000, "channels", G_TYPE_INT, 2, NULL);
+
+        const gchar *dev_names[2] = {"native", "48kHz"};
+
+        gint i = 0;
+        for (i = 0; i < 2; i++) {
+            gchar *conv_always = NULL;
+            gchar *conv_planned = NULL;
+
+            gdouble t_always = pipeline_benchmark_run(rec->pipe, devices[i], FALSE, n_buffers, &conv_always);
+            gdouble t_planned = pipeline_benchmark_run(rec->pipe, devices[i], TRUE, n_buffers, &conv_planned);
+
+            if (t_always < 0.0 || t_planned < 0.0) {
+                g_print("  %-32s %-8s %9s %9s  %s\n", rec->id, dev_names[i], "-", "-", "(profile not available)");
+            } else {
+                g_print("  %-32s %-8s %9.1f %9.1f  %s\n", rec->id, dev_names[i], t_always, t_planned, conv_planned);
+            }
+
+            g_free(conv_always);
+            g_free(conv_planned);
+
+            gst_caps_unref(devices[i]);
+        }
+
+        item = g_list_next(item);
+    }
+}
+
+
+static PipelineParms *pipeline_benchmark_parms(const gchar *profile_str, const gchar *dev1, const gchar *dev2) {
+    PipelineParms *parms = g_malloc0(sizeof(PipelineParms));
+    parms->source = g_strdup("pulsesrc");
+    parms->dev_list = g_list_append(NULL, g_strdup(dev1));
+    parms->dev_list = g_list_append(parms->dev_list, g_strdup(dev2));
+    parms->profile_str = g_strdup(profile_str);
+    return parms;
+}
+
+static GstElement *pipeline_benchmark_elem(GstElement *pipeline, PipelineNodeType type, const gchar *key) {
+    PipelineNode *node = pipeline_model_find(pipeline_get_model(pipeline), type, key);
+    return (node ? node->elem : NULL);
+}
+
+static void pipeline_benchmark_check(const gchar *what, gboolean ok, guint *passed, guint *failed) {
+    if (ok) {
+        (*passed)++;
+    } else {
+        (*failed)++;
+        g_print("  FAIL: %s\n", what);
+    }
+}
+
+gboolean pipeline_benchmark_reconfigure(guint rounds) {
+    // Full rebuild vs. pipeline_reconfigure() of a 2-device recording pipeline.
+    // Check that the elements that did not change keep their identity. Return FALSE if a check failed
+    // (or the benchmark could not run).
+    // $ audio-recorder --benchmark=reconfigure
+    GstElementFactory *factory = gst_element_factory_find("pulsesrc");
+    if (!factory) {
+        g_print("Reconfigure benchmark: pulsesrc is not available.\n");
+        return FALSE;
+    }
+    gst_object_unref(factory);
+
+    // Two profiles with installed encoders
+    const gchar *profiles[2] = {NULL, NULL};
+    guint n = 0;
+
+    GList *item = g_list_first(profiles_get_list());
+    while (item && n < 2) {
+        ProfileRec *rec = (ProfileRec*)item->data;
+
+        gchar *err_msg = NULL;
+        GstElement *bin = pipeline_create_encoder(rec->pipe, &err_msg);
+        if (bin) {
+            profiles[n++] = rec->pipe;
+            gst_object_unref(bin);
+        }
+        g_free(err_msg);
+
+        item = g_list_next(item);
+    }
+
+    if (n < 2) {
+        g_print("Reconfigure benchmark: needs 2 available profiles.\n");
+        return FALSE;
+    }
+
+    PipelineParms *parms_a = pipeline_benchmark_parms(profiles[0], "benchmark-device-1", "benchmark-device-2");
+    PipelineParms *parms_b = pipeline_benchmark_parms(profiles[1], "benchmark-device-1", "benchmark-device-2");
+    PipelineParms *parms_c = pipeline_benchmark_parms(profiles[1], "benchmark-device-1", "benchmark-device-3");
+
+    gdouble t_rebuild = 0.0;
+    gdouble t_encoder = 0.0;
+    gdouble t_source = 0.0;
+
+    guint passed = 0;
+    guint failed = 0;
+
+    guint i = 0;
+    for (i = 0; i < rounds; i++) {
+        gchar *err_msg = NULL;
+
+        // Full rebuild
+        gint64 t0 = g_get_monotonic_time();
+        GstElement *pipeline = pipeline_create_complex(parms_b, &err_msg);
+        t_rebuild += (g_get_monotonic_time() - t0) / 1000.0;
+
+        if (pipeline) gst_object_unref(pipeline);
+
+        pipeline = pipeline_create_complex(parms_a, &err_msg);
+        if (!pipeline) {
+            g_print("Reconfigure benchmark: %s", (err_msg ? err_msg : "cannot create pipeline.\n"));
+            g_free(err_msg);
+            break;
+        }
+
+        GstElement *source1 = pipeline_benchmark_elem(pipeline, NODE_SOURCE, "benchmark-device-1");
+        GstElement *source2 = pipeline_benchmark_elem(pipeline, NODE_SOURCE, "benchmark-device-2");
+        GstElement *mixer = pipeline_benchmark_elem(pipeline, NODE_DSP, "mixer");
+        GstElement *level = pipeline_benchmark_elem(pipeline, NODE_DSP, "level");
+        GstElement *sink = pipeline_benchmark_elem(pipeline, NODE_SINK, NULL);
+        GstElement *encoder = pipeline_benchmark_elem(pipeline, NODE_ENCODER, NULL);
+
+        // New profile. Only the encoder changes.
+        t0 = g_get_monotonic_time();
+        gboolean ok = pipeline_reconfigure_ex(pipeline, parms_b, TRUE, &err_msg);
+        t_encoder += (g_get_monotonic_time() - t0) / 1000.0;
+
+        pipeline_benchmark_check("profile change: reconfigure", ok, &passed, &failed);
+        if (!ok) {
+            g_print("    %s", (err_msg ? err_msg : "\n"));
+        }
+        g_free(err_msg);
+        err_msg = NULL;
+
+        pipeline_benchmark_check("profile change: sources kept",
+                                 source1 == pipeline_benchmark_elem(pipeline, NODE_SOURCE, "benchmark-device-1") &&
+                                 source2 == pipeline_benchmark_elem(pipeline, NODE_SOURCE, "benchmark-device-2"), &passed, &failed);
+        pipeline_benchmark_check("profile change: mixer, level and sink kept",
+                                 mixer == pipeline_benchmark_elem(pipeline, NODE_DSP, "mixer") &&
+                                 level == pipeline_benchmark_elem(pipeline, NODE_DSP, "level") &&
+                                 sink == pipeline_benchmark_elem(pipeline, NODE_SINK, NULL), &passed, &failed);
+        pipeline_benchmark_check("profile change: new encoder",
+                                 encoder != pipeline_benchmark_elem(pipeline, NODE_ENCODER, NULL), &passed, &failed);
+
+        encoder = pipeline_benchmark_elem(pipeline, NODE_ENCODER, NULL);
+
+        // New device. Only that source changes.
+        t0 = g_get_monotonic_time();
+        ok = pipeline_reconfigure_ex(pipeline, parms_c, TRUE, &err_msg);
+        t_source += (g_get_monotonic_time() - t0) / 1000.0;
+
+        pipeline_benchmark_check("device change: reconfigure", ok, &passed, &failed);
+        if (!ok) {
+            g_print("    %s", (err_msg ? err_msg : "\n"));
+        }
+
+        pipeline_benchmark_check("device change: other source kept",
+                                 source1 == pipeline_benchmark_elem(pipeline, NODE_SOURCE, "benchmark-device-1"), &passed, &failed);
+        pipeline_benchmark_check("device change: old source removed, new source added",
+                                 !pipeline_benchmark_elem(pipeline, NODE_SOURCE, "benchmark-device-2") &&
+                                 pipeline_benchmark_elem(pipeline, NODE_SOURCE, "benchmark-device-3"), &passed, &failed);
+        pipeline_benchmark_check("device change: encoder, mixer and sink kept",
+                                 encoder == pipeline_benchmark_elem(pipeline, NODE_ENCODER, NULL) &&
+                                 mixer == pipeline_benchmark_elem(pipeline, NODE_DSP, "mixer") &&
+                                 sink == pipeline_benchmark_elem(pipeline, NODE_SINK, NULL), &passed, &failed);
+
+        g_free(err_msg);
+        gst_object_unref(pipeline);
+    }
+
+    if (i > 0) {
+        g_print("Reconfigure benchmark, %u rounds, average time in ms:\n", i);
+        g_print("  %-24s %9.2f\n", "full rebuild", t_rebuild / i);
+        g_print("  %-24s %9.2f\n", "new profile", t_encoder / i);
+        g_print("  %-24s %9.2f\n", "new device", t_source / i);
+        g_print("Identity checks: %u passed, %u failed. %s\n", passed, failed, (failed ? "FAIL" : "PASS"));
+    }
+
+    pipeline_free_parms(parms_a);
+    pipeline_free_parms(parms_b);
+    pipeline_free_parms(parms_c);
+
+    return (i == rounds && !failed);
+}
@@ -25,11 +25,40 @@ typedef struct {
 
 } PipelineParms;
 
+// Queue in front of the encoder (in the encoder bin). Find it with gst_bin_get_by_name().
+#define PIPELINE_ENCODER_QUEUE "encqueue"
+#define PIPELINE_ENCODER_QUEUE_TIME (2 * GST_SECOND)
+
+// Queue in front of the file sink (in the sink bin). Size in MB from the "stall-buffer-size" setting.
+#define PIPELINE_SINK_QUEUE "sinkqueue"
+#define PIPELINE_SINK_QUEUE_MB 32
+
+// Encryption stage in front of the sink queue ("encryption" setting, see gst-encrypt.c)
+#define PIPELINE_ENCRYPT "encrypt"
+
 void pipeline_free_parms(PipelineParms *parms);
 
 GstElement *pipeline_create(PipelineParms *parms, gchar **err_msg);
 GstElement *pipeline_create_VAD(PipelineParms *parms, gchar **err_msg);
 
 GString *pipeline_create_command_str(PipelineParms *parms);
+
+// Conversions (audioresample, audioconvert) in the recording pipeline, or "none (...)"
+const gchar *pipeline_get_conversions(GstElement *pipeline);
+
+// Update a pipeline to new parameters. Only the sources and the encoder that changed are rebuilt.
+// Return FALSE if the pipeline must be created again (eg. from 1 device to many).
+gboolean pipeline_reconfigure(GstElement *pipeline, PipelineParms *parms, gchar **err_msg);
+
+// Add or remove an input device while recording (complex pipeline only). The other inputs keep recording.
+gboolean pipeline_add_source(GstElement *pipeline, const gchar *device, gchar **err_msg);
+gboolean pipeline_remove_source(GstElement *pipeline, const gchar *device, gchar **err_msg);
+
+// CPU time of all profiles with and without needless conversions
+void pipeline_benchmark(guint n_buffers);
+
+// Time of pipeline_reconfigure() vs. a full rebuild. Checks that unchanged elements are kept.
+// Return FALSE if a check failed.
+gboolean pipeline_benchmark_reconfigure(guint rounds);
 #endif
 
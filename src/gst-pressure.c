@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+
+#include "gst-pressure.h"
+#include "gst-pipeline.h"
+#include "gst-spool.h"
+#include "gst-recorder.h"
+#include "dbus-server.h"
+#include "log.h"
+#include "dconf.h"
+#include "support.h"
+
+// Adaptive encoding under CPU pressure.
+//
+// The encoder bin starts with a queue (PIPELINE_ENCODER_QUEUE). If the encoder cannot keep up, the queue fills.
+// Instead of letting the capture block (and drop audio), the recording degrades in steps:
+//  1. Spill raw audio to a disk-backed spool (gst-spool.c). The spool activates itself at its high-water mark.
+//  2. Lower the encoder's complexity/quality, if the backlog keeps growing.
+//  3. Continue the session with a cheaper profile in a new file (segment).
+// Each step is logged and sent as a DBus event (see dbus-server.c).
+//
+// Settings: "adaptive-encoding" (on/off), "adaptive-encoding-profile" (profile for step 3, "" = cheapest installed).
+
+// Check the backlog this often
+#define PRESSURE_POLL_MS 250
+
+// Backlog (queue + spool, in seconds of audio) that triggers step 2 and step 3
+#define PRESSURE_LOWER_QUALITY_SEC 10.0
+#define PRESSURE_NEW_SEGMENT_SEC 30.0
+
+// Give a step this much time to take effect before the next one
+#define PRESSURE_STEP_GRACE_MS 5000
+
+// Max. time to wait for the spool at the end of a recording
+#define PRESSURE_DRAIN_TIMEOUT_MS 10000
+
+typedef enum {
+    PRESSURE_NONE,
+    PRESSURE_SPILL,
+    PRESSURE_LOWER_QUALITY,
+    PRESSURE_NEW_SEGMENT,
+} PressureStep;
+
+// Cheap settings for step 2. Some encoders read these only when they start; then step 3 does the job.
+static const struct {
+    const gchar *factory;
+    const gchar *property;
+    const gchar *value;
+} g_cheap_settings[] = {
+    {"vorbisenc", "quality", "0.1"},
+    {"lamemp3enc", "encoding-engine-quality", "fast"},
+    {"flacenc", "quality", "0"},
+    {"speexenc", "complexity", "1"},
+    {"opusenc", "complexity", "0"},
+    {NULL, NULL, NULL}
+};
+
+static GstElement *g_pressure_pipeline = NULL;
+static GstElement *g_encqueue = NULL;
+static guint g_poll_id = 0;
+
+static PressureStep g_step = PRESSURE_NONE;
+static gint64 g_step_time = 0;
+static gboolean g_spilling = FALSE;
+
+static void pressure_event(const gchar *name, gchar *detail) {
+    // Log the step and tell DBus clients. Takes detail.
+    LOG_MSG("Adaptive encoding: %s\n", detail);
+
+    dbus_service_emit_event(name, detail);
+    g_free(detail);
+}
+
+static void pressure_set_step(PressureStep step) {
+    g_step = step;
+    g_step_time = g_get_monotonic_time();
+}
+
+static guint pressure_lower_quality() {
+    // Step 2. Set cheap values on the encoder elements. Return number of properties changed.
+    GstObject *bin = gst_object_get_parent(GST_OBJECT(g_encqueue));
+    if (!GST_IS_BIN(bin)) {
+        if (bin) gst_object_unref(bin);
+        return 0;
+    }
+
+    guint count = 0;
+
+    GstIterator *it = gst_bin_iterate_elements(GST_BIN(bin));
+    GValue value = G_VALUE_INIT;
+
+    while (gst_iterator_next(it, &value) == GST_ITERATOR_OK) {
+        GstElement *elem = GST_ELEMENT(g_value_get_object(&value));
+        GstElementFactory *factory = gst_element_get_factory(elem);
+
+        const gchar *name = (factory ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)) : NULL);
+
+        gint i = 0;
+        for (i = 0; name && g_cheap_settings[i].factory; i++) {
+            if (g_strcmp0(g_cheap_settings[i].factory, name)) continue;
+            if (!g_object_class_find_property(G_OBJECT_GET_CLASS(elem), g_cheap_settings[i].property)) continue;
+
+            gst_util_set_object_arg(G_OBJECT(elem), g_cheap_settings[i].property, g_cheap_settings[i].value);
+
+            LOG_PRESSURE("Set %s %s=%s.\n", name, g_cheap_settings[i].property, g_cheap_settings[i].value);
+            count++;
+        }
+
+        g_value_reset(&value);
+    }
+
+    g_value_unset(&value);
+    gst_iterator_free(it);
+
+    gst_object_unref(bin);
+
+    return count;
+}
+
+static gboolean pressure_new_segment_cb(gpointer user_data) {
+    // Step 3. Restart in a new file with a cheaper profile. Runs in the main loop (replaces the pipeline).
+    gchar *id = rec_start_cheaper_segment();
+
+    if (id) {
+        pressure_event("pressure-new-segment", g_strdup_printf("Continuing in a new file with profile \"%s\".", id));
+    } else {
+        pressure_event("pressure-no-cheaper-profile", g_strdup("No cheaper profile installed. Recording continues as before."));
+    }
+
+    g_free(id);
+    return FALSE;
+}
+
+static gboolean pressure_poll_cb(gpointer user_data) {
+    // Measure the backlog in front of the encoder and take the next step if needed
+    if (!g_encqueue) {
+        g_poll_id = 0;
+        return FALSE;
+    }
+
+    SpoolMetrics m;
+    memset(&m, 0, sizeof(m));
+    spool_get_metrics(g_encqueue, &m);
+
+    guint64 level = 0;
+    g_object_get(G_OBJECT(g_encqueue), "current-level-time", &level, NULL);
+
+    gdouble backlog = (gdouble)(level + m.pending_time) / GST_SECOND;
+
+    // Step 1 is taken by the spool itself
+    if (m.active && !g_spilling) {
+        g_spilling = TRUE;
+
+        if (g_step < PRESSURE_SPILL) {
+            pressure_set_step(PRESSURE_SPILL);
+        }
+
+        pressure_event("pressure-spill", g_strdup_printf("Encoder cannot keep up. Spooling raw audio to disk (%.1f s queued).", backlog));
+
+    } else if (!m.active && g_spilling) {
+        g_spilling = FALSE;
+
+        pressure_event("pressure-recovered", g_strdup_printf("Encoder caught up. Spooled %.1f MB so far, longest stall %.0f ms.",
+                       m.spooled_bytes / (1024.0 * 1024.0), m.max_stall_ms));
+    }
+
+    LOG_PRESSURE("Backlog %.2f s, spool %" G_GUINT64_FORMAT " bytes, step %d.\n", backlog, m.pending_bytes, g_step);
+
+    if (!g_spilling) return TRUE;
+
+    // Let the previous step take effect
+    if (g_get_monotonic_time() - g_step_time < PRESSURE_STEP_GRACE_MS * G_TIME_SPAN_MILLISECOND) return TRUE;
+
+    if (g_step == PRESSURE_SPILL && backlog > PRESSURE_LOWER_QUALITY_SEC) {
+        pressure_set_step(PRESSURE_LOWER_QUALITY);
+
+        guint count = pressure_lower_quality();
+        pressure_event("pressure-lower-quality", g_strdup_printf("%.1f s behind. Lowered encoder complexity/quality (%u settings).", backlog, count));
+
+    } else if (g_step == PRESSURE_LOWER_QUALITY && backlog > PRESSURE_NEW_SEGMENT_SEC) {
+        pressure_set_step(PRESSURE_NEW_SEGMENT);
+
+        LOG_MSG("Adaptive encoding: %.1f s behind. Switching to a cheaper profile.\n", backlog);
+
+        // Replaces the pipeline. Do it outside this callback.
+        g_idle_add(pressure_new_segment_cb, NULL);
+    }
+
+    return TRUE;
+}
+
+void pressure_set_pipeline(GstElement *pipeline) {
+    // Watch the encoder of pipeline (or stop watching if NULL)
+    if (g_poll_id) {
+        g_source_remove(g_poll_id);
+    }
+    g_poll_id = 0;
+
+    if (g_encqueue) {
+        gst_object_unref(g_encqueue);
+    }
+    g_encqueue = NULL;
+
+    if (g_pressure_pipeline) {
+        gst_object_unref(g_pressure_pipeline);
+    }
+    g_pressure_pipeline = NULL;
+
+    g_step = PRESSURE_NONE;
+    g_step_time = 0;
+    g_spilling = FALSE;
+
+    if (!GST_IS_BIN(pipeline)) return;
+
+    gboolean enabled = TRUE;
+    conf_get_boolean_value("adaptive-encoding", &enabled);
+    if (!enabled) return;
+
+    g_encqueue = gst_bin_get_by_name(GST_BIN(pipeline), PIPELINE_ENCODER_QUEUE);
+    if (!g_encqueue) return;
+
+    g_pressure_pipeline = gst_object_ref(pipeline);
+
+    // Step 1. A reused pipeline keeps its spool; forget data of the last recording.
+    spool_attach(g_encqueue);
+    spool_reset(g_encqueue);
+
+    g_poll_id = g_timeout_add(PRESSURE_POLL_MS, pressure_poll_cb, NULL);
+}
+
+void pressure_prepare_stop(GstElement *pipeline) {
+    // EOS has been sent. Let the spooled audio (and the EOS) reach the encoder.
+    if (!GST_IS_BIN(pipeline)) return;
+
+    GstElement *queue = gst_bin_get_by_name(GST_BIN(pipeline), PIPELINE_ENCODER_QUEUE);
+    if (!queue) return;
+
+    SpoolMetrics m;
+    if (spool_get_metrics(queue, &m)) {
+
+        if (m.pending_bytes) {
+            LOG_MSG("Adaptive encoding: Draining %.1f s of spooled audio.\n", (gdouble)m.pending_time / GST_SECOND);
+        }
+
+        spool_drain(queue, PRESSURE_DRAIN_TIMEOUT_MS);
+
+        if (m.activations) {
+            LOG_MSG("Adaptive encoding: Spool was used %u times, %.1f MB, peak %.1f MB, longest stall %.0f ms.\n", m.activations,
+                    m.spooled_bytes / (1024.0 * 1024.0), m.peak_bytes / (1024.0 * 1024.0), m.max_stall_ms);
+        }
+
+        if (m.dropped_bytes) {
+            LOG_ERROR("Adaptive encoding: %.1f MB of audio dropped. The spool file failed and the memory was full.\n",
+                      m.dropped_bytes / (1024.0 * 1024.0));
+        }
+    }
+
+    gst_object_unref(queue);
+}
@@ -0,0 +1,23 @@
+#ifndef _GST_PRESSURE_H
+#define _GST_PRESSURE_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-pressure.c.
+//#define DEBUG_PRESSURE
+
+#if defined(DEBUG_PRESSURE) || defined(DEBUG_ALL)
+#define LOG_PRESSURE LOG_MSG
+#else
+#define LOG_PRESSURE(x, ...)
+#endif
+
+// Watch the encoder of the running recording pipeline (or stop watching if NULL).
+// Degrades the encoding step by step if the encoder cannot keep up.
+void pressure_set_pipeline(GstElement *pipeline);
+
+// Recording is being stopped (EOS has been sent). Wait until spooled audio has reached the encoder.
+void pressure_prepare_stop(GstElement *pipeline);
+
+#endif
@@ -29,6 +29,23 @@
 #include "timer.h"
 
 #include "gst-pipeline.h"
+#include "gst-capture.h"
+#include "gst-drift.h"
+#include "gst-mixer.h"
+#include "gst-pressure.h"
+#include "gst-transcode.h"
+#include "gst-recovery.h"
+#include "gst-filesink.h"
+#include "gst-stall.h"
+#include "gst-append.h"
+#include "gst-rf64.h"
+#include "gst-seek.h"
+#include "gst-checksum.h"
+#include "gst-encrypt.h"
+#include "gst-diskspace.h"
+#include "gst-retention.h"
+#include "gst-devices.h"
+#include "socket-server.h"
 
 #include <gst/pbutils/missing-plugins.h>
 
@@ -38,31 +55,132 @@
 // GStreamer pipeline
 static GstElement *g_pipeline = NULL;
 
+// Stopped pipeline of the last recording. The next recording reconfigures it (see pipeline_reconfigure()).
+static GstElement *g_spare_pipeline = NULL;
+
+// Pipeline got an error. Do not reuse it.
+static gboolean g_pipeline_failed = FALSE;
+
+// Profile of the rest of the session after adaptive encoding switched to a cheaper one (see gst-pressure.c), or NULL
+static gchar *g_profile_override = NULL;
+
+// Starting a new segment of the session (not a new recording)
+static gboolean g_new_segment = FALSE;
+
+// Folder of the rest of the session after the disk-space guard moved it to the fallback folder (see gst-diskspace.c), or NULL
+static gchar *g_folder_override = NULL;
+
+// Deferred transcode: convert the recording to this profile after it has stopped, or NULL
+static gchar *g_transcode_target = NULL;
+
+// Container-aware append: the recording goes to g_append_part and is merged into g_append_target, or NULLs
+static gchar *g_append_target = NULL;
+static gchar *g_append_part = NULL;
+
+// Start time of the recording (seconds since the epoch), for the retention index
+static gint64 g_start_time = 0;
+
 // Flag to test if EOS (end of stream) message was seen
 static gboolean g_got_EOS_message = FALSE;
 
+// Stop without blocking: the pipeline has got EOS and writes its buffers; it is shut down at its EOS message
+// (see rec_stop_recording_async())
+static gboolean g_stopping = FALSE;
+static guint g_stop_timeout_id = 0;
+static gint64 g_stop_duration = 0;
+static gboolean g_stop_delete_file = FALSE;
+
+// A recorded file and its pipeline
+typedef struct {
+    GstElement *pipeline;
+    gboolean failed;
+
+    // File written by the pipeline, and "track/last-file-name" of the recording
+    gchar *filename;
+    gchar *last_file_name;
+
+    // See g_append_target, g_append_part, g_transcode_target and g_start_time
+    gchar *append_target;
+    gchar *append_part;
+    gchar *transcode_target;
+    gint64 start_time;
+    gint64 duration;
+
+    // Old segment of a switch: EOS has been sent, and the timeout for its EOS message
+    gboolean eos_sent;
+    guint timeout_id;
+} RecSegment;
+
+// Segment switch: the old segment records until the new one plays, then drains (see rec_switch_segment()), or NULL
+static RecSegment *g_retiring = NULL;
+
+// Max time for a pipeline to reach EOS after a switch or a stop (the spool and the sink queue drain)
+#define REC_EOS_TIMEOUT_MS (40 * 1000)
+
 static gboolean rec_level_message_cb(GstBus *bus, GstMessage *message, void *user_data);
 
 GstElement *rec_create_pipeline(PipelineParms *parms, GError **error);
 
 void rec_set_state_to_null();
 
+static void rec_destroy_spare_pipeline();
+
+static void rec_retire_stop();
+
 static gchar *rec_create_filename(gchar *track, gchar *artist, gchar *album);
 static gchar *rec_generate_unique_filename();
 static gchar *check_audio_folder(gchar *audio_folder);
 static gchar *rec_get_profile_id();
+static gchar *rec_get_saved_profile_id();
 
 void rec_module_init() {
     LOG_DEBUG("Init gst-recorder.c.\n");
 
     g_pipeline = NULL;
+    g_spare_pipeline = NULL;
+
+    capture_module_init();
+
+    // Before the conversions resumed by transcode_module_init()
+    rf64_module_init();
+
+    encrypt_module_init();
+
+    transcode_module_init();
+
+    recovery_module_init();
+
+    filesink_module_init();
+
+    append_module_init();
+
+    diskspace_module_init();
+
+    retention_module_init();
 }
 
 void rec_module_exit() {
     LOG_DEBUG("Clean up gst-recorder.c.\n");
 
-    // Stop evt. recording
+    // Stop evt. recording, and the old segment of a switch
     rec_stop_recording(FALSE);
+    rec_retire_stop();
+
+    rec_destroy_spare_pipeline();
+
+    capture_module_exit();
+
+    // Let the merges finish before the conversions of their results
+    append_module_exit();
+
+    // Unfinished conversions are resumed at next start
+    transcode_module_exit();
+
+    recovery_module_exit();
+
+    diskspace_module_exit();
+
+    retention_module_exit();
 }
 
 void rec_set_state_to_null() {
@@ -179,6 +297,15 @@ gboolean rec_start_recording() {
         return TRUE;
     }
 
+    // A new recording uses the saved profile and folder again
+    if (!g_new_segment) {
+        g_free(g_profile_override);
+        g_profile_override = NULL;
+
+        g_free(g_folder_override);
+        g_folder_override = NULL;
+    }
+
     // Get data from Gsettings
 
     gchar *track_name = NULL;
@@ -227,15 +354,16 @@ gboolean rec_start_recording() {
     // Parms to construct a pipeline
     PipelineParms *parms = g_malloc0(sizeof(PipelineParms));
 
-    // Append to file?
+    // Append to file? A new segment has another format; it goes to a new file.
     conf_get_boolean_value("append-to-file", &parms->append);
+    parms->append = parms->append && !g_new_segment;
 
     if (parms->append && g_file_test(last_file_name, G_FILE_TEST_IS_REGULAR)) {
         // Record to an existing file
         parms->filename = g_strdup(last_file_name);
     }
     // Did we get a track-name from a Media Player, Skype?
-    else if (str_length(track_name, NAME_MAX) > 0) {
+    else if (str_length(track_name, NAME_MAX) > 0 && !g_new_segment) {
         // We have track, album and artist names. Create filename from these.
         parms->filename = rec_create_filename(track_name, artist_name, album_name);
 
@@ -266,10 +394,73 @@ gboolean rec_start_recording() {
     // Get the saved media profile id (aac, mp3, cdlossless, cdlossy, etc).
     profile_id = rec_get_profile_id();
 
-    // Get partial pipline for this profile_id
-    parms->profile_str = profiles_get_pipeline(profile_id);
+    // Recording in a cheap format? Convert to the saved profile afterwards.
+    g_free(g_transcode_target);
+    g_transcode_target = rec_get_saved_profile_id();
+
+    // An encrypted recording is not converted or merged afterwards; that would need its cleartext on disk
+    gboolean encrypted = encrypt_enabled();
+
+    if (!g_strcmp0(g_transcode_target, profile_id) || encrypted) {
+        g_free(g_transcode_target);
+        g_transcode_target = NULL;
+    }
+
+    // Get partial pipline for this profile_id. Crash-safe variant if "crash-safe" is set.
+    // WAV is written by arwavenc; it switches to RF64 beyond 4 GB. Seek indexes ("seek-index" setting).
+    gchar *profile_str = profiles_get_pipeline(profile_id);
+    gchar *wav_str = rf64_adapt_profile(profile_str);
+    gchar *safe_str = recovery_adapt_profile(wav_str);
+    parms->profile_str = seek_adapt_profile(safe_str);
+    g_free(safe_str);
+    g_free(wav_str);
+    g_free(profile_str);
     parms->file_ext = profiles_get_extension(profile_id);
 
+    // Appending to an existing file? Encoded streams cannot simply be concatenated (see gst-append.c).
+    g_free(g_append_target);
+    g_free(g_append_part);
+    g_append_target = NULL;
+    g_append_part = NULL;
+
+    if (parms->append && g_file_test(parms->filename, G_FILE_TEST_IS_REGULAR)) {
+
+        AppendMode mode = append_get_mode(parms->filename, parms->file_ext);
+        if (encrypted || encrypt_is_file(parms->filename)) {
+            mode = APPEND_NEW_FILE;
+        }
+
+        switch (mode) {
+        case APPEND_MERGE:
+            // Record to a part file. It is merged into the old file when the recording stops.
+            g_append_target = parms->filename;
+            g_append_part = append_part_filename(g_append_target);
+
+            parms->filename = g_strdup(g_append_part);
+            parms->append = FALSE;
+            break;
+
+        case APPEND_NEW_FILE:
+            // Old file has another format
+            LOG_MSG("Cannot append to %s (another format, or encrypted). Recording to a new file.\n", parms->filename);
+
+            g_free(parms->filename);
+            parms->filename = rec_generate_unique_filename();
+            purify_filename(parms->filename, FALSE);
+
+            conf_save_string_value("track/last-file-name", parms->filename);
+            parms->append = FALSE;
+            break;
+
+        default:
+            // Append the bytes
+            break;
+        }
+    } else {
+        // Nothing to append to. parms->append now means a raw append to existing data.
+        parms->append = FALSE;
+    }
+
 
 #if 0
     // Debugging:
@@ -291,7 +482,9 @@ gboolean rec_start_recording() {
 #endif
 
     // Show filename in the GUI
-    rec_manager_set_filename_label(parms->filename);
+    rec_manager_set_filename_label(g_append_target ? g_append_target : parms->filename);
+
+    g_start_time = g_get_real_time() / G_USEC_PER_SEC;
 
     // Get audio source and device list
     gchar *audio_source = NULL;
@@ -343,6 +536,32 @@ gboolean rec_start_recording() {
     } else {
         // Alles Ok. Clear error label in the GUI.
         rec_manager_set_error_text(NULL);
+
+        // Fail over to a backup device if a device disappears during recording
+        capture_set_pipeline(g_pipeline);
+
+        // Adapt the encoding if the encoder cannot keep up
+        pressure_set_pipeline(g_pipeline);
+
+        // Isolate the capture from disk stalls (see gst-stall.c)
+        stall_set_pipeline(g_pipeline);
+
+        // Predict the remaining recording time. Act before the disk is full (see gst-diskspace.c).
+        diskspace_set_pipeline(g_pipeline, parms->filename, !g_new_segment);
+
+        // Journal and checkpoints. The file can be repaired if we crash.
+        // Not an encrypted file; its records survive a crash, and the repair would write into the ciphertext.
+        // Its sidecar index would point into the ciphertext.
+        if (!encrypted) {
+            recovery_begin(parms->filename);
+
+            // Sidecar seek index ("seek-sidecar" setting)
+            seek_index_begin(g_pipeline, parms->filename, parms->append);
+        }
+
+        // Checksum sidecar ("checksum" setting). Segments of a session go to one manifest.
+        // A raw append (parms->append) continues after the old data.
+        checksum_begin(g_pipeline, parms->filename, !g_new_segment, parms->append);
     }
 
     LOG_DEBUG("------------------------\n");
@@ -381,10 +600,178 @@ gint64 rec_get_stream_time() {
     return secs;
 }
 
-void rec_stop_recording(gboolean delete_file) {
-    // Stop recording, terminate pipeline
+static gboolean rec_message_from(GstMessage *msg, GstElement *pipeline) {
+    // Message of pipeline or of one of its elements?
+    if (!(GST_IS_MESSAGE(msg) && GST_IS_ELEMENT(pipeline))) return FALSE;
 
-    if (!GST_IS_PIPELINE(g_pipeline)) return;
+    GstObject *obj = GST_MESSAGE_SRC(msg);
+    while (obj && obj != GST_OBJECT(pipeline)) {
+        obj = GST_OBJECT_PARENT(obj);
+    }
+    return (obj != NULL);
+}
+
+static RecSegment *rec_segment_take(gint64 duration) {
+    // Take the pipeline and the files of the running recording. g_pipeline is NULL afterwards.
+    RecSegment *seg = g_malloc0(sizeof(RecSegment));
+
+    seg->pipeline = g_pipeline;
+    seg->failed = g_pipeline_failed;
+    seg->filename = rec_get_output_filename();
+    conf_get_string_value("track/last-file-name", &seg->last_file_name);
+
+    seg->append_target = g_append_target;
+    seg->append_part = g_append_part;
+    seg->transcode_target = g_transcode_target;
+    seg->start_time = g_start_time;
+    seg->duration = duration;
+
+    g_pipeline = NULL;
+    g_pipeline_failed = FALSE;
+
+    g_append_target = NULL;
+    g_append_part = NULL;
+    g_transcode_target = NULL;
+
+    return seg;
+}
+
+static void rec_segment_finish(RecSegment *seg, gboolean delete_file) {
+    // The pipeline of seg has been shut down. Finish its file, then merge, convert, index or delete it. Frees seg.
+
+    // File is complete
+    recovery_end(seg->filename);
+    seek_index_end(seg->pipeline);
+    checksum_end(seg->pipeline);
+
+    // Keep the pipeline for the next recording. Destroy a failed pipeline.
+    rec_destroy_spare_pipeline();
+
+    if (seg->failed) {
+        gst_object_unref(GST_OBJECT(seg->pipeline));
+    } else {
+        g_spare_pipeline = seg->pipeline;
+    }
+    seg->pipeline = NULL;
+
+    if (seg->append_part) {
+        // Merge the new part into the old file in the background. The result is then converted.
+        if (delete_file) {
+            // Delete the new part only
+            LOG_DEBUG("Deleted file:\"%s\"\n", seg->append_part);
+            g_remove(seg->append_part);
+            seek_index_remove(seg->append_part);
+            checksum_remove(seg->append_part);
+        } else {
+            gboolean keep = FALSE;
+            conf_get_boolean_value("transcode-keep-source", &keep);
+
+            append_queue(seg->append_target, seg->append_part, seg->transcode_target, keep);
+        }
+    }
+    // Convert the cheap recording to the saved profile in the background (see gst-transcode.c)
+    else if (seg->transcode_target && !delete_file) {
+        gboolean keep = FALSE;
+        conf_get_boolean_value("transcode-keep-source", &keep);
+
+        transcode_queue(seg->last_file_name, seg->transcode_target, keep);
+    }
+
+    // Index the finished recording. Old recordings may have to go (see gst-retention.c).
+    // After the merge and the conversion are queued; the retention pass leaves their files alone.
+    if (!delete_file) {
+        retention_add_file((seg->append_part ? seg->append_target : seg->last_file_name), seg->start_time, seg->duration);
+    }
+
+    // Delete the recorded file? Never the file we were appending to.
+    if (delete_file && !seg->append_part) {
+        LOG_DEBUG("Deleted file:\"%s\"\n", seg->last_file_name);
+
+        // Remove it
+        g_remove(seg->last_file_name);
+        seek_index_remove(seg->last_file_name);
+        checksum_remove(seg->last_file_name);
+
+        // Erase last saved file name
+        conf_save_string_value("track/last-file-name", "");
+
+        // Update filename in the GUI
+        rec_manager_set_filename_label("");
+    }
+
+    g_free(seg->filename);
+    g_free(seg->last_file_name);
+    g_free(seg->append_target);
+    g_free(seg->append_part);
+    g_free(seg->transcode_target);
+    g_free(seg);
+}
+
+static void rec_retire_send_eos() {
+    // The old segment of a switch stops recording. It is finished at its EOS message (see rec_eos_msg_cb()).
+    if (!g_retiring || g_retiring->eos_sent) return;
+
+    g_retiring->eos_sent = TRUE;
+
+    LOG_DEBUG("Segment switch: sending EOS to the pipeline of %s.\n", g_retiring->filename);
+
+    gst_element_send_event(g_retiring->pipeline, gst_event_new_eos());
+    gst_element_send_event(g_retiring->pipeline, gst_event_new_eos());
+}
+
+static void rec_retire_finish(gboolean drained) {
+    // Shut down the old segment of a switch and finish its file
+    RecSegment *seg = g_retiring;
+    if (!seg) return;
+
+    g_retiring = NULL;
+
+    if (seg->timeout_id) {
+        g_source_remove(seg->timeout_id);
+    }
+    seg->timeout_id = 0;
+
+    if (!drained) {
+        LOG_ERROR("Segment switch: EOS did not reach %s in %d ms. Closing it anyway.\n", seg->filename, REC_EOS_TIMEOUT_MS);
+    }
+
+    gst_element_set_state(seg->pipeline, GST_STATE_NULL);
+
+    LOG_DEBUG("--------- Pipeline of the old segment closed ----------\n\n");
+
+    rec_segment_finish(seg, FALSE);
+}
+
+static gboolean rec_retire_timeout_cb(gpointer user_data) {
+    if (g_retiring) {
+        g_retiring->timeout_id = 0;
+    }
+    rec_retire_finish(FALSE);
+    return FALSE;
+}
+
+static gboolean rec_retire_done_cb(gpointer user_data) {
+    // Out of the bus handler. user_data is the pipeline that got EOS (or an error).
+    if (g_retiring && (GstElement*)user_data == g_retiring->pipeline) {
+        rec_retire_finish(TRUE);
+    }
+    return FALSE;
+}
+
+static void rec_retire_stop() {
+    // Quit. Let the buffers of the old segment reach its file, and finish it now.
+    if (!g_retiring) return;
+
+    rec_retire_send_eos();
+
+    pressure_prepare_stop(g_retiring->pipeline);
+    stall_prepare_stop(g_retiring->pipeline);
+
+    rec_retire_finish(TRUE);
+}
+
+static gint64 rec_stop_begin() {
+    // First half of the stop: send EOS. Return the length of the recording.
 
     // Get recording state
     gint state = -1;
@@ -397,12 +784,46 @@ void rec_stop_recording(gboolean delete_file) {
         timer_module_reset(GST_STATE_NULL);
     }
 
-    LOG_DEBUG("rec_stop_recording(%s)\n", (delete_file ? "delete_file=TRUE" : "delete_file=FALSE"));
+    // Length of the recording, for the retention index
+    gint64 duration = rec_get_stream_time();
+
+    // Final drift metrics of multi-device recordings
+    drift_report(g_pipeline);
+
+    // No more checkpoints. The muxer writes the final headers.
+    recovery_prepare_stop();
+
+    // Let EOS pass through the capture sources (see gst-capture.c)
+    capture_prepare_stop(g_pipeline);
+    capture_set_pipeline(NULL);
 
     // Send EOS message. This will terminate the stream/file properly. This is very important for ACC (.m4a) files.
     gst_element_send_event(g_pipeline, gst_event_new_eos());
     gst_element_send_event(g_pipeline, gst_event_new_eos());
 
+    // The old segment of a switch ends too, whether the new one has started playing or not
+    rec_retire_send_eos();
+
+    return duration;
+}
+
+static void rec_stop_finish(gboolean delete_file, gint64 duration, gboolean drain) {
+    // Second half of the stop: let the buffers reach the file (if drain), shut down the pipeline, finish the file.
+
+    if (drain) {
+        // Audio spooled under CPU pressure must reach the encoder before the EOS
+        pressure_prepare_stop(g_pipeline);
+    }
+    pressure_set_pipeline(NULL);
+
+    if (drain) {
+        // Audio buffered during a disk stall must reach the file
+        stall_prepare_stop(g_pipeline);
+    }
+    stall_set_pipeline(NULL);
+
+    diskspace_set_pipeline(NULL, NULL, FALSE);
+
     g_usleep(GST_USECOND * 5);
 
     // Set pipeline state to NULL
@@ -411,35 +832,160 @@ void rec_stop_recording(gboolean delete_file) {
     // Shutdown the entire pipeline
     gst_element_set_state(g_pipeline, GST_STATE_NULL);
 
-    // Destroy it
-    if (GST_IS_OBJECT(g_pipeline))
-        gst_object_unref(GST_OBJECT(g_pipeline));
+    RecSegment *seg = rec_segment_take(duration);
 
-    g_pipeline = NULL;
+    LOG_DEBUG("--------- Pipeline closed ----------\n\n");
+
+    rec_segment_finish(seg, delete_file);
+
+    // Notice:
+    // The rec_state_changed_cb() function will reset the GUI by calling rec_manager_update_gui();
+}
 
-    LOG_DEBUG("--------- Pipeline closed and destroyed ----------\n\n");
+static void rec_stop_cancel() {
+    // A synchronous stop (or a new recording) takes over a stop that waits for EOS
+    if (!g_stopping) return;
 
-    // Delete the recorded file?
-    if (delete_file) {
-        // Get last saved file name
-        gchar *filename = NULL;
-        conf_get_string_value("track/last-file-name", &filename);
+    g_stopping = FALSE;
+    g_stop_delete_file = FALSE;
 
-        LOG_DEBUG("Deleted file:\"%s\"\n", filename);
+    if (g_stop_timeout_id) {
+        g_source_remove(g_stop_timeout_id);
+    }
+    g_stop_timeout_id = 0;
+}
 
-        // Remove it
-        g_remove(filename);
-        g_free(filename);
+void rec_stop_recording(gboolean delete_file) {
+    // Stop recording, terminate pipeline
 
-        // Erase last saved file name
-        conf_save_string_value("track/last-file-name", "");
+    if (!GST_IS_PIPELINE(g_pipeline)) return;
 
-        // Update filename in the GUI
-        rec_manager_set_filename_label("");
+    LOG_DEBUG("rec_stop_recording(%s)\n", (delete_file ? "delete_file=TRUE" : "delete_file=FALSE"));
+
+    // EOS has been sent already if a stop was waiting for it
+    gint64 duration = (g_stopping ? g_stop_duration : rec_stop_begin());
+    delete_file = (delete_file || (g_stopping && g_stop_delete_file));
+    rec_stop_cancel();
+
+    rec_stop_finish(delete_file, duration, TRUE);
+}
+
+static void rec_stop_eos_finish(gboolean drained) {
+    // The recording is complete (or its EOS timed out). End the session.
+    gboolean delete_file = g_stop_delete_file;
+
+    rec_stop_cancel();
+
+    if (!drained) {
+        LOG_ERROR("Stop: EOS did not reach the file in %d ms. Closing it anyway.\n", REC_EOS_TIMEOUT_MS);
     }
 
-    // Notice:
-    // The rec_state_changed_cb() function will reset the GUI by calling rec_manager_update_gui();
+    rec_stop_finish(delete_file, g_stop_duration, drained);
+
+    // The GUI is reset by rec_state_changed_cb()
+}
+
+static gboolean rec_stop_timeout_cb(gpointer user_data) {
+    g_stop_timeout_id = 0;
+    rec_stop_eos_finish(FALSE);
+    return FALSE;
+}
+
+static gboolean rec_stop_eos_cb(gpointer user_data) {
+    // Out of the bus handler; the pipeline is shut down and may be reused
+    if (g_stopping) {
+        rec_stop_eos_finish(TRUE);
+    }
+    return FALSE;
+}
+
+static gboolean rec_switch_segment() {
+    // Continue the session in a new file (g_profile_override, g_folder_override). Main thread.
+    // The new segment starts while the old one still records. The old pipeline gets EOS when the new one plays
+    // (see rec_state_changed_cb()), writes its buffers (spool, sink queue) while the main loop runs, and is finished
+    // at its EOS message. The two files overlap by a moment; no audio is lost between them.
+    // Both pipelines read the devices meanwhile. Sound servers (pulsesrc) have several clients per device.
+    if (!GST_IS_PIPELINE(g_pipeline) || g_stopping || g_retiring) return FALSE;
+
+    gint state = -1;
+    gint pending = -1;
+    rec_get_state(&state, &pending);
+
+    // A paused pipeline passes no EOS, and its buffers cannot drain. It records nothing to lose either.
+    if (state != GST_STATE_PLAYING) {
+        rec_stop_finish(FALSE, rec_stop_begin(), FALSE);
+
+        g_new_segment = TRUE;
+        gboolean ok = rec_start_recording();
+        g_new_segment = FALSE;
+
+        return ok;
+    }
+
+    // The old segment keeps recording. Its length, for the retention index.
+    gint64 duration = rec_get_stream_time();
+
+    // Final drift metrics of multi-device recordings
+    drift_report(g_pipeline);
+
+    // No more checkpoints. The muxer writes the final headers.
+    recovery_prepare_stop();
+
+    // Let EOS pass through the capture sources (see gst-capture.c). Failover, pressure and disk space watch the new segment.
+    capture_prepare_stop(g_pipeline);
+    capture_set_pipeline(NULL);
+    pressure_set_pipeline(NULL);
+    stall_set_pipeline(NULL);
+    diskspace_set_pipeline(NULL, NULL, FALSE);
+
+    g_retiring = rec_segment_take(duration);
+    g_retiring->timeout_id = g_timeout_add(REC_EOS_TIMEOUT_MS, rec_retire_timeout_cb, NULL);
+
+    g_new_segment = TRUE;
+    gboolean ok = rec_start_recording();
+    g_new_segment = FALSE;
+
+    // No new segment. The old one ends now.
+    if (!GST_IS_PIPELINE(g_pipeline)) {
+        rec_retire_send_eos();
+    }
+
+    return ok;
+}
+
+void rec_stop_recording_async(gboolean delete_file) {
+    // Stop recording without blocking the main loop. The pipeline gets EOS and writes its buffers (spool, sink queue);
+    // it is shut down from rec_eos_msg_cb(), or after REC_EOS_TIMEOUT_MS.
+    if (!GST_IS_PIPELINE(g_pipeline)) return;
+
+    LOG_DEBUG("rec_stop_recording_async(%s)\n", (delete_file ? "delete_file=TRUE" : "delete_file=FALSE"));
+
+    if (g_stopping) {
+        // EOS has been sent
+        g_stop_delete_file = (g_stop_delete_file || delete_file);
+        return;
+    }
+
+    gint state = -1;
+    gint pending = -1;
+    rec_get_state(&state, &pending);
+
+    // A paused pipeline passes no EOS
+    if (state != GST_STATE_PLAYING) {
+        rec_stop_recording(delete_file);
+        return;
+    }
+
+    // Send EOS. rec_stop_eos_finish() is called at its EOS message or after a timeout.
+    g_stopping = TRUE;
+    g_stop_delete_file = delete_file;
+    g_stop_duration = rec_stop_begin();
+
+    // No more steps of the stopping pipeline
+    pressure_set_pipeline(NULL);
+    diskspace_set_pipeline(NULL, NULL, FALSE);
+
+    g_stop_timeout_id = g_timeout_add(REC_EOS_TIMEOUT_MS, rec_stop_timeout_cb, NULL);
 }
 
 void rec_stop_and_reset() {
@@ -492,15 +1038,20 @@ static gboolean rec_level_message_cb(GstBus *bus, GstMessage *message, void *use
 
     static guint64 last_stream_time_t = 0L;
     static guint64 last_stream_time_fz = 0L;
+    static gint64 last_stat_time = 0L;
 
     // Calling with NULL arguments?
     // This will reset the static variables, then exit.
     if (!message) {
         last_stream_time_t = 0L;
         last_stream_time_fz = 0L;
+        last_stat_time = 0L;
         return TRUE;
     }
 
+    // Levels of the recording, not of the old segment of a switch
+    if (!rec_message_from(message, g_pipeline)) return TRUE;
+
     guint64 stream_time = 0L;
 
     if (message->type == GST_MESSAGE_ELEMENT) {
@@ -647,8 +1198,16 @@ static gboolean rec_level_message_cb(GstBus *bus, GstMessage *message, void *use
 
 
             // Update file size in the GUI.
-            if (stream_time < 10 || (stream_time - last_stream_time_fz > 3/*seconds*/)) {
-                // Update more frequently if stream_time < 10 seconds, after that, update each 3.rd second.
+            // Update more frequently if stream_time < 10 seconds, after that, update each 3.rd second.
+            gboolean update_label = (stream_time < 10 || (stream_time - last_stream_time_fz > 3/*seconds*/));
+
+            // Control socket clients get the byte count once per second. Their own interval is applied in socket-server.c.
+            gint64 now = g_get_monotonic_time();
+            gboolean update_bytes = (socket_server_has_subscribers(SOCKET_EVENT_BYTES) &&
+                                     now - last_stat_time >= G_USEC_PER_SEC);
+
+            if (update_label || update_bytes) {
+                last_stat_time = now;
 
                 gchar *filename = rec_manager_get_output_filename();
                 gchar *size_txt = NULL;
@@ -656,19 +1215,33 @@ static gboolean rec_level_message_cb(GstBus *bus, GstMessage *message, void *use
                 // Get file size.
                 // Ref: https://developer.gnome.org/glib/2.34/glib-File-Utilities.html#g-stat
                 GStatBuf fstat;
-                if (g_stat(filename, &fstat))
+                if (g_stat(filename, &fstat)) {
                     LOG_ERROR("Cannot get file information of %s.\n", filename);
-                else
+                } else {
                     size_txt = format_file_size(fstat.st_size);
+                    rec_manager_set_file_size((guint64)fstat.st_size);
+                }
+
+                if (update_label) {
+                    // Show file size and the predicted recording time
+                    DiskSpaceInfo ds;
+                    if (size_txt && diskspace_get_info(&ds) && ds.remaining_sec >= 0) {
+                        gchar *left = diskspace_format_remaining(ds.remaining_sec);
+                        gchar *txt = g_strdup_printf(_("%s (%s left)"), size_txt, left);
+                        g_free(left);
+
+                        g_free(size_txt);
+                        size_txt = txt;
+                    }
 
-                // Show file size
-                rec_manager_set_size_label(size_txt);
+                    rec_manager_set_size_label(size_txt);
+
+                    // Save last stream_time
+                    last_stream_time_fz = stream_time;
+                }
 
                 g_free(filename);
                 g_free(size_txt);
-
-                // Save last stream_time
-                last_stream_time_fz = stream_time;
             }
         }
     }
@@ -700,6 +1273,9 @@ static void rec_state_changed_cb(GstBus *bus, GstMessage *msg, void *userdata) {
     case GST_STATE_PLAYING:
         // We are playing. Inform the GUI.
         rec_manager_update_gui();
+
+        // The new segment records. The old one can stop.
+        rec_retire_send_eos();
         break;
 
     case GST_STATE_READY:
@@ -738,6 +1314,28 @@ static void rec_pipeline_error_cb(GstBus *bus, GstMessage *msg, void *userdata)
 
     LOG_DEBUG("\nGot pipeline error: %s.\n", error->message);
 
+    // Error in the old segment of a switch. No EOS will come; close it (this does not stop the new segment).
+    if (g_retiring && rec_message_from(msg, g_retiring->pipeline)) {
+        LOG_ERROR("Segment switch: %s. Closing %s.\n", error->message, g_retiring->filename);
+        g_retiring->failed = TRUE;
+        g_idle_add(rec_retire_done_cb, g_retiring->pipeline);
+
+        g_free(dbg);
+        g_error_free(error);
+        return;
+    }
+
+    // Error from a capture device (eg. unplugged USB microphone)? Fail over and keep recording.
+    if (capture_handle_error(msg)) {
+        LOG_MSG("Audio device error: %s. Switching to backup device.\n", error->message);
+        g_free(dbg);
+        g_error_free(error);
+        return;
+    }
+
+    // Do not reuse this pipeline
+    g_pipeline_failed = TRUE;
+
     if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ELEMENT) {
         ;
     }
@@ -757,10 +1355,22 @@ static void rec_pipeline_error_cb(GstBus *bus, GstMessage *msg, void *userdata)
 }
 
 static void rec_eos_msg_cb(GstBus *bus, GstMessage *msg, void *userdata) {
+    // The old segment of a switch is complete. The new one records already.
+    if (g_retiring && rec_message_from(msg, g_retiring->pipeline)) {
+        LOG_DEBUG("Got EOS message of the old segment %s.\n", g_retiring->filename);
+        g_idle_add(rec_retire_done_cb, g_retiring->pipeline);
+        return;
+    }
+
     LOG_DEBUG("Got EOS message. Finishing recording.\n");
 
     // We've seen EOS. Set g_got_EOS_message to TRUE.
     g_got_EOS_message = TRUE;
+
+    // The recording is complete. End the session (see rec_stop_eos_finish()).
+    if (g_stopping && GST_MESSAGE_SRC(msg) == GST_OBJECT(g_pipeline)) {
+        g_idle_add(rec_stop_eos_cb, NULL);
+    }
 }
 
 GstElement *rec_create_pipeline(PipelineParms *parms, GError **error) {
@@ -786,8 +1396,25 @@ GstElement *rec_create_pipeline(PipelineParms *parms, GError **error) {
     LOG_DEBUG("filename=%s\n", parms->filename);
     LOG_DEBUG("append to file=%s\n", (parms->append ? "TRUE" : "FALSE"));
 
-    // Create pipeline from the parms
-    GstElement *pipeline = pipeline_create(parms, &err_msg);
+    // Reuse the pipeline of the last recording. Rebuild only the parts that changed.
+    GstElement *pipeline = NULL;
+    gboolean reused = FALSE;
+
+    if (g_spare_pipeline && pipeline_reconfigure(g_spare_pipeline, parms, &err_msg)) {
+        pipeline = g_spare_pipeline;
+        g_spare_pipeline = NULL;
+        reused = TRUE;
+    }
+
+    if (!reused) {
+        // Cannot reconfigure. Create pipeline from the parms.
+        g_free(err_msg);
+        err_msg = NULL;
+
+        rec_destroy_spare_pipeline();
+
+        pipeline = pipeline_create(parms, &err_msg);
+    }
 
     // Errors?
     if (!GST_IS_PIPELINE(pipeline) || err_msg) {
@@ -804,27 +1431,51 @@ GstElement *rec_create_pipeline(PipelineParms *parms, GError **error) {
 
     g_object_set(G_OBJECT(filesink), "location", parms->filename, NULL);
     g_object_set(G_OBJECT(filesink), "append", parms->append, NULL);
+
+    // Buffer size, I/O mode and fsync policy of arfilesink ("fast-sink" setting)
+    filesink_configure(filesink);
     g_object_unref(filesink);
 
-    // Add a message handler
-    GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+    // Muxers write playable data regularly (see gst-recovery.c)
+    recovery_setup_pipeline(pipeline);
+
+    // Part of an appended recording must be mergeable (MP4 fragments)
+    if (g_append_part) {
+        append_setup_pipeline(pipeline);
+    }
+
+    // Xing TOC, Ogg skeleton, MP4 moov at the start (see gst-seek.c)
+    seek_setup_pipeline(pipeline);
+
+    // Key of the encryption stage. No key, no recording (see gst-encrypt.c).
+    if (!encrypt_setup_pipeline(pipeline, &err_msg)) {
+        goto LBL_1;
+    }
 
-    // gst_bus_add_watch (bus, bus_info_cb, NULL);
-    gst_bus_add_signal_watch(bus);
+    // Report the conversions (audioresample, audioconvert) of this recording
+    LOG_MSG("Recording to %s. Conversions: %s.\n", parms->filename, pipeline_get_conversions(pipeline));
 
-    // Detect state changes
-    g_signal_connect(bus, "message::state-changed", G_CALLBACK(rec_state_changed_cb), NULL);
+    // Add a message handler. A reused pipeline has it already.
+    GstBus *bus = (reused ? NULL : gst_pipeline_get_bus(GST_PIPELINE(pipeline)));
 
-    // Monitor sound level/amplitude
-    g_signal_connect(bus, "message::element", G_CALLBACK(rec_level_message_cb), NULL);
+    if (bus) {
+        // gst_bus_add_watch (bus, bus_info_cb, NULL);
+        gst_bus_add_signal_watch(bus);
 
-    // Catch error messages
-    g_signal_connect(bus, "message::error", G_CALLBACK(rec_pipeline_error_cb), NULL);
+        // Detect state changes
+        g_signal_connect(bus, "message::state-changed", G_CALLBACK(rec_state_changed_cb), NULL);
 
-    // EOS
-    g_signal_connect(bus, "message::eos", G_CALLBACK(rec_eos_msg_cb), NULL);
+        // Monitor sound level/amplitude
+        g_signal_connect(bus, "message::element", G_CALLBACK(rec_level_message_cb), NULL);
 
-    gst_object_unref(bus);
+        // Catch error messages
+        g_signal_connect(bus, "message::error", G_CALLBACK(rec_pipeline_error_cb), NULL);
+
+        // EOS
+        g_signal_connect(bus, "message::eos", G_CALLBACK(rec_eos_msg_cb), NULL);
+
+        gst_object_unref(bus);
+    }
 
     // Assume all is OK
     gboolean ret = TRUE;
@@ -870,6 +1521,15 @@ LBL_1:
     return NULL;
 }
 
+static void rec_destroy_spare_pipeline() {
+    if (!GST_IS_OBJECT(g_spare_pipeline)) return;
+
+    gst_element_set_state(g_spare_pipeline, GST_STATE_NULL);
+    gst_object_unref(GST_OBJECT(g_spare_pipeline));
+
+    g_spare_pipeline = NULL;
+}
+
 gchar *rec_get_output_filename() {
     // Return current output filename
 
@@ -890,11 +1550,158 @@ gchar *rec_get_output_filename() {
     return filename;
 }
 
+// ------------------------------------------------------------
+// Live control of the inputs (see gst-mixer.c)
+// ------------------------------------------------------------
+
+static gboolean rec_check_pipeline(gchar **err_msg) {
+    if (GST_IS_PIPELINE(g_pipeline)) return TRUE;
+
+    if (err_msg) {
+        *err_msg = g_strdup(_("Not recording.\n"));
+    }
+    return FALSE;
+}
+
+gboolean rec_set_source_gain(const gchar *dev_id, gdouble gain, gchar **err_msg) {
+    // Set gain of an input device (NULL = all inputs) without stopping the recording
+    if (!rec_check_pipeline(err_msg)) return FALSE;
+
+    if (!mixer_set_gain(g_pipeline, dev_id, gain)) {
+        if (err_msg) *err_msg = g_strdup_printf(_("Device %s is not recording.\n"), (dev_id ? dev_id : ""));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean rec_set_source_mute(const gchar *dev_id, gboolean mute, gchar **err_msg) {
+    // Mute or un-mute an input device (NULL = all inputs) without stopping the recording
+    if (!rec_check_pipeline(err_msg)) return FALSE;
+
+    if (!mixer_set_mute(g_pipeline, dev_id, mute)) {
+        if (err_msg) *err_msg = g_strdup_printf(_("Device %s is not recording.\n"), (dev_id ? dev_id : ""));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean rec_add_source(const gchar *dev_id, gchar **err_msg) {
+    // Add an input device to the running recording
+    if (!rec_check_pipeline(err_msg)) return FALSE;
+
+    if (!(dev_id && gstdev_device_exists(dev_id))) {
+        if (err_msg) *err_msg = g_strdup_printf(_("Unknown device %s.\n"), (dev_id ? dev_id : ""));
+        return FALSE;
+    }
+
+    gchar *msg = NULL;
+    gboolean ret = pipeline_add_source(g_pipeline, dev_id, &msg);
+
+    if (!ret) {
+        LOG_ERROR("%s", msg);
+    }
+
+    if (err_msg) {
+        *err_msg = msg;
+    } else {
+        g_free(msg);
+    }
+    return ret;
+}
+
+gboolean rec_remove_source(const gchar *dev_id, gchar **err_msg) {
+    // Remove an input device from the running recording
+    if (!rec_check_pipeline(err_msg)) return FALSE;
+
+    gchar *msg = NULL;
+    gboolean ret = pipeline_remove_source(g_pipeline, dev_id, &msg);
+
+    if (err_msg) {
+        *err_msg = msg;
+    } else {
+        g_free(msg);
+    }
+    return ret;
+}
+
 // ------------------------------------------------------------
 // Support functions
 // ------------------------------------------------------------
 
+gchar *rec_start_cheaper_segment() {
+    // Adaptive encoding: continue the recording in a new file with a cheaper profile.
+    // Return the new profile id (caller should g_free() it), or NULL if there is none.
+    if (!GST_IS_PIPELINE(g_pipeline) || g_stopping || g_retiring) return NULL;
+
+    gchar *cur_id = rec_get_profile_id();
+
+    // Profile chosen by the user?
+    gchar *id = NULL;
+    conf_get_string_value("adaptive-encoding-profile", &id);
+    str_trim(id);
+
+    if (!(profiles_check_id(id) && g_strcmp0(id, cur_id))) {
+        g_free(id);
+
+        const ProfileRec *rec = profiles_find_cheaper(cur_id);
+        id = (rec ? g_strdup(rec->id) : NULL);
+    }
+
+    g_free(cur_id);
+
+    if (!id) return NULL;
+
+    g_free(g_profile_override);
+    g_profile_override = g_strdup(id);
+
+    // The old segment records until the new one plays
+    gboolean ok = rec_switch_segment();
+
+    if (!ok) {
+        g_free(id);
+        id = NULL;
+    }
+
+    return id;
+}
+
+gboolean rec_start_segment_in_folder(const gchar *folder) {
+    // Disk-space guard: continue the recording in a new file in folder. Return FALSE if it did not start.
+    if (!GST_IS_PIPELINE(g_pipeline) || g_stopping || g_retiring) return FALSE;
+
+    g_free(g_folder_override);
+    g_folder_override = g_strdup(folder);
+
+    // The old file (on the full disk) records until the new one in folder plays. The disk-space reserve covers it.
+    return rec_switch_segment();
+}
+
 static gchar *rec_get_profile_id() {
+    // Return media profile id to record with.
+    // The saved one, the cheaper one chosen by adaptive encoding, or a cheap one for deferred transcode.
+    if (g_profile_override && profiles_check_id(g_profile_override)) {
+        return g_strdup(g_profile_override);
+    }
+
+    gchar *id = rec_get_saved_profile_id();
+
+    gboolean deferred = FALSE;
+    conf_get_boolean_value("deferred-transcode", &deferred);
+
+    // An encrypted recording cannot be converted afterwards
+    if (deferred && !encrypt_enabled()) {
+        const ProfileRec *rec = profiles_find_cheaper(id);
+        if (rec) {
+            g_free(id);
+            id = g_strdup(rec->id);
+        }
+    }
+
+    // The caller should g_free() this value
+    return id;
+}
+
+static gchar *rec_get_saved_profile_id() {
     // Return saved media profile id.
     gchar *id = NULL;
     conf_get_string_value("media-format", &id);
@@ -939,8 +1746,8 @@ static gchar *rec_generate_unique_filename() {
     // And take its file extension (.ogg, .mp3, .flac, etc)
     gchar *file_ext = profiles_get_extension(profile_id);
 
-    // Audio folder
-    gchar *audio_folder = get_audio_folder();
+    // Audio folder (or the fallback folder of the disk-space guard)
+    gchar *audio_folder = (g_folder_override ? g_strdup(g_folder_override) : get_audio_folder());
 
     // Check if it is writable
     audio_folder = check_audio_folder(audio_folder);
@@ -19,6 +19,10 @@ gboolean rec_is_recording();
 
 gboolean rec_start_recording();
 void rec_stop_recording(gboolean delete_file);
+
+// Stop without blocking: the pipeline is shut down when its buffered audio has reached the file
+void rec_stop_recording_async(gboolean delete_file);
+
 void rec_pause_recording();
 void rec_continue_recording();
 
@@ -29,6 +33,20 @@ gint64 rec_get_stream_time();
 
 gchar *rec_get_output_filename();
 
+// Adaptive encoding: continue in a new file with a cheaper profile. Return the profile id or NULL.
+// Does not block. The old file records until the new one plays (see rec_switch_segment()).
+gchar *rec_start_cheaper_segment();
+
+// Disk-space guard: continue the recording in a new file in folder (the rest of the session goes there).
+// Does not block, like rec_start_cheaper_segment(). The new file gets the audio before the old one has drained.
+gboolean rec_start_segment_in_folder(const gchar *folder);
+
+// Live control of the inputs. dev_id NULL means all inputs (gain and mute only).
+gboolean rec_set_source_gain(const gchar *dev_id, gdouble gain, gchar **err_msg);
+gboolean rec_set_source_mute(const gchar *dev_id, gboolean mute, gchar **err_msg);
+gboolean rec_add_source(const gchar *dev_id, gchar **err_msg);
+gboolean rec_remove_source(const gchar *dev_id, gchar **err_msg);
+
 void rec_test_func();
 
 //void rec_treshold_message(GstClockTime timestamp, gboolean above, gdouble threshold);
@@ -0,0 +1,563 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <glib/gstdio.h>
+
+#include "gst-recovery.h"
+#include "gst-rf64.h"
+#include "media-profiles.h"
+#include "proc-info.h"
+#include "log.h"
+#include "dconf.h"
+#include "utility.h"
+#include "support.h"
+
+// Crash-safe recordings.
+//
+// If the program dies, the muxer never gets EOS and cannot finalize the file. To keep such files playable:
+//  - MP4/M4A is written as fragmented MP4 (mp4mux fragment-duration). The moov atom is at the start.
+//  - Ogg pages are flushed regularly (oggmux max-page-delay).
+//  - WAV headers are rewritten with the current length at each checkpoint (as RF64 beyond 4 GB).
+//  - Each checkpoint fsyncs the file ("fsync-interval" setting, seconds).
+//
+// A journal lists the recordings in progress. At startup, recordings left in the journal are repaired in
+// a background thread, without re-encoding: the WAV header gets its real length, a torn Ogg page or MP4 fragment
+// at the end is cut off.
+//
+// Setting "crash-safe" turns this on/off.
+
+// MP4 fragment length (ms)
+#define RECOVERY_FRAGMENT_MS 2000
+
+// Max. time between Ogg pages
+#define RECOVERY_PAGE_DELAY (500 * GST_MSECOND)
+
+// Ogg repair looks for the last complete page in this many bytes at the end of the file (a page is max. 65307 bytes)
+#define RECOVERY_OGG_TAIL (256 * 1024)
+
+// Checkpoint thread
+static GMutex g_ck_lock;
+static GCond g_ck_cond;
+static GThread *g_ck_thread = NULL;
+static gboolean g_ck_quit = FALSE;
+static gchar *g_ck_filename = NULL;
+static gint g_ck_interval = 0;
+
+// Journal file is changed by the main thread and the repair thread
+G_LOCK_DEFINE_STATIC(g_journal);
+
+static guint32 g_ogg_crc_table[256];
+
+static gboolean recovery_enabled() {
+    gboolean enabled = FALSE;
+    conf_get_boolean_value("crash-safe", &enabled);
+    return enabled;
+}
+
+void recovery_module_init() {
+    LOG_DEBUG("Init gst-recovery.c.\n");
+
+    g_mutex_init(&g_ck_lock);
+    g_cond_init(&g_ck_cond);
+
+    // CRC of Ogg pages (polynomial 0x04c11db7, no reflection)
+    guint32 i = 0;
+    for (i = 0; i < 256; i++) {
+        guint32 r = i << 24;
+        gint j = 0;
+        for (j = 0; j < 8; j++) {
+            r = (r & 0x80000000) ? ((r << 1) ^ 0x04c11db7) : (r << 1);
+        }
+        g_ogg_crc_table[i] = r;
+    }
+}
+
+void recovery_module_exit() {
+    LOG_DEBUG("Clean up gst-recovery.c.\n");
+
+    recovery_prepare_stop();
+}
+
+// ---------------------------------------------------------------------
+// Pipeline setup
+// ---------------------------------------------------------------------
+
+gchar *recovery_adapt_profile(const gchar *profile_str) {
+    // avmux_mp4 writes the moov atom at EOS. Use fragmented mp4mux instead.
+    if (!(recovery_enabled() && profile_str)) return g_strdup(profile_str);
+
+    if (!profiles_has_element("mp4mux")) return g_strdup(profile_str);
+
+    GRegex *re = g_regex_new("\\b(avmux_mp4|ffmux_mp4)\\b", 0, 0, NULL);
+    gchar *str = g_regex_replace_literal(re, profile_str, -1, 0, "mp4mux", 0, NULL);
+    g_regex_unref(re);
+
+    return str;
+}
+
+void recovery_setup_pipeline(GstElement *pipeline) {
+    // Make the muxers write playable data regularly
+    if (!(GST_IS_BIN(pipeline) && recovery_enabled())) return;
+
+    GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    GValue value = G_VALUE_INIT;
+
+    while (gst_iterator_next(it, &value) == GST_ITERATOR_OK) {
+        GstElement *elem = GST_ELEMENT(g_value_get_object(&value));
+        GObjectClass *klass = G_OBJECT_GET_CLASS(elem);
+
+        // mp4mux, qtmux
+        if (g_object_class_find_property(klass, "fragment-duration")) {
+            g_object_set(G_OBJECT(elem), "fragment-duration", (guint)RECOVERY_FRAGMENT_MS, NULL);
+            LOG_RECOVERY("%s: fragment-duration=%d ms.\n", GST_ELEMENT_NAME(elem), RECOVERY_FRAGMENT_MS);
+        }
+
+        // oggmux
+        if (g_object_class_find_property(klass, "max-page-delay")) {
+            g_object_set(G_OBJECT(elem), "max-page-delay", (guint64)RECOVERY_PAGE_DELAY, NULL);
+            LOG_RECOVERY("%s: max-page-delay=%" G_GUINT64_FORMAT " ms.\n", GST_ELEMENT_NAME(elem), RECOVERY_PAGE_DELAY / GST_MSECOND);
+        }
+
+        g_value_reset(&value);
+    }
+
+    g_value_unset(&value);
+    gst_iterator_free(it);
+}
+
+// ---------------------------------------------------------------------
+// Repair functions. They work on an open file.
+// ---------------------------------------------------------------------
+
+static gboolean recovery_read(gint fd, guint8 *buf, gsize len, off_t offset) {
+    gsize done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return FALSE;
+        done += n;
+    }
+    return TRUE;
+}
+
+static gboolean recovery_fix_wav(gint fd, off_t size) {
+    // Set RIFF and data sizes from the file size. Beyond 4 GB the header becomes RF64 (see gst-rf64.c).
+    WavHeader wh;
+    if (!rf64_read_header(fd, size, &wh)) return FALSE;
+
+    return rf64_write_sizes(fd, &wh, size - wh.data_off, size);
+}
+
+guint32 recovery_ogg_crc(guint8 *page, gsize len) {
+    // CRC of an Ogg page. The CRC field is counted as zeros.
+    guint8 saved[4];
+    memcpy(saved, page + 22, 4);
+    memset(page + 22, 0, 4);
+
+    guint32 crc = 0;
+    gsize i = 0;
+    for (i = 0; i < len; i++) {
+        crc = (crc << 8) ^ g_ogg_crc_table[((crc >> 24) & 0xff) ^ page[i]];
+    }
+
+    memcpy(page + 22, saved, 4);
+    return crc;
+}
+
+static gboolean recovery_fix_ogg(gint fd, off_t size) {
+    // Cut off a torn page at the end and mark the last page as end of stream
+    off_t tail = MIN(size, RECOVERY_OGG_TAIL);
+    off_t start = size - tail;
+
+    guint8 *buf = g_malloc(tail);
+    gboolean ok = FALSE;
+
+    if (!recovery_read(fd, buf, tail, start)) goto LBL_1;
+
+    off_t last = -1;
+    gsize last_len = 0;
+
+    off_t i = 0;
+    while (i + 27 <= tail) {
+        if (memcmp(buf + i, "OggS", 4)) {
+            i++;
+            continue;
+        }
+
+        guint nseg = buf[i + 26];
+        if (i + 27 + nseg > tail) break;
+
+        gsize len = 27 + nseg;
+        guint s = 0;
+        for (s = 0; s < nseg; s++) {
+            len += buf[i + 27 + s];
+        }
+
+        // Torn page?
+        if (i + (off_t)len > tail) break;
+
+        if (recovery_ogg_crc(buf + i, len) == GST_READ_UINT32_LE(buf + i + 22)) {
+            last = i;
+            last_len = len;
+            i += len;
+        } else {
+            i++;
+        }
+    }
+
+    if (last < 0) goto LBL_1;
+
+    off_t end = start + last + last_len;
+    if (end < size && ftruncate(fd, end) != 0) goto LBL_1;
+
+    // Set the end-of-stream flag
+    if (!(buf[last + 5] & 0x04)) {
+        buf[last + 5] |= 0x04;
+        GST_WRITE_UINT32_LE(buf + last + 22, recovery_ogg_crc(buf + last, last_len));
+
+        if (pwrite(fd, buf + last, last_len, start + last) != (ssize_t)last_len) goto LBL_1;
+    }
+
+    LOG_RECOVERY("Ogg: cut %" G_GINT64_FORMAT " bytes.\n", (gint64)(size - end));
+    ok = TRUE;
+
+LBL_1:
+    g_free(buf);
+    return ok;
+}
+
+gboolean recovery_finish_ogg(gint fd) {
+    off_t size = lseek(fd, 0, SEEK_END);
+    return (size > 0 && recovery_fix_ogg(fd, size));
+}
+
+static gboolean recovery_fix_mp4(gint fd, off_t size) {
+    // Fragmented MP4: cut off a torn box or a moof without its mdat at the end
+    off_t pos = 0;
+    off_t good_end = 0;
+    off_t moof = -1;
+    gboolean has_moov = FALSE;
+
+    while (pos + 8 <= size) {
+        guint8 h[16];
+        if (!recovery_read(fd, h, 8, pos)) break;
+
+        guint64 box = GST_READ_UINT32_BE(h);
+        if (box == 1) {
+            if (pos + 16 > size || !recovery_read(fd, h + 8, 8, pos + 8)) break;
+            box = GST_READ_UINT64_BE(h + 8);
+        } else if (box == 0) {
+            box = size - pos;
+        }
+
+        // Torn box?
+        if (box < 8 || pos + (off_t)box > size) break;
+
+        if (!memcmp(h + 4, "moov", 4)) {
+            has_moov = TRUE;
+        } else if (!memcmp(h + 4, "moof", 4)) {
+            moof = pos;
+        } else if (!memcmp(h + 4, "mdat", 4)) {
+            moof = -1;
+        }
+
+        pos += box;
+        good_end = (moof >= 0 ? moof : pos);
+    }
+
+    if (!has_moov) {
+        // Not fragmented (eg. "crash-safe" was off). The index is missing; cannot repair without re-encoding.
+        return FALSE;
+    }
+
+    if (good_end < size && ftruncate(fd, good_end) != 0) return FALSE;
+
+    LOG_RECOVERY("MP4: cut %" G_GINT64_FORMAT " bytes.\n", (gint64)(size - good_end));
+    return TRUE;
+}
+
+static gboolean recovery_repair_file(const gchar *filename) {
+    // Repair an interrupted recording. Format is detected from the content.
+    gint fd = g_open(filename, O_RDWR, 0);
+    if (fd < 0) return FALSE;
+
+    off_t size = lseek(fd, 0, SEEK_END);
+
+    guint8 magic[8];
+    gboolean ok = FALSE;
+    const gchar *format = "";
+
+    if (size < 8 || !recovery_read(fd, magic, 8, 0)) {
+        // Empty file. Nothing to save.
+        format = "empty";
+
+    } else if (!memcmp(magic, "RIFF", 4) || !memcmp(magic, "RF64", 4)) {
+        format = "WAV";
+        ok = recovery_fix_wav(fd, size);
+
+    } else if (!memcmp(magic, "OggS", 4)) {
+        format = "Ogg";
+        ok = recovery_fix_ogg(fd, size);
+
+    } else if (!memcmp(magic + 4, "ftyp", 4)) {
+        format = "MP4";
+        ok = recovery_fix_mp4(fd, size);
+
+    } else {
+        // FLAC, MP3: frames are self-contained. Players handle a missing length.
+        format = "stream";
+        ok = TRUE;
+    }
+
+    if (ok) {
+        fsync(fd);
+    }
+
+    close(fd);
+
+    if (ok) {
+        LOG_MSG("Recovered %s recording %s.\n", format, filename);
+    } else {
+        LOG_ERROR("Cannot recover %s recording %s.\n", format, filename);
+    }
+
+    return ok;
+}
+
+// ---------------------------------------------------------------------
+// Journal of recordings in progress
+// ---------------------------------------------------------------------
+
+static gchar *recovery_journal_filename() {
+    // Eg. ~/.local/share/audio-recorder/recordings.journal
+    // Caller should g_free() this value
+    return g_build_filename(g_get_user_data_dir(), "audio-recorder", "recordings.journal", NULL);
+}
+
+static GKeyFile *recovery_journal_load() {
+    GKeyFile *key_file = g_key_file_new();
+
+    gchar *filename = recovery_journal_filename();
+    g_key_file_load_from_file(key_file, filename, G_KEY_FILE_NONE, NULL);
+    g_free(filename);
+
+    return key_file;
+}
+
+static void recovery_journal_save(GKeyFile *key_file) {
+    gchar *filename = recovery_journal_filename();
+    gchar *path = g_path_get_dirname(filename);
+    g_mkdir_with_parents(path, 0700);
+
+    GError *error = NULL;
+    g_key_file_save_to_file(key_file, filename, &error);
+    if (error) {
+        LOG_ERROR("Cannot save journal %s. %s\n", filename, error->message);
+        g_error_free(error);
+    }
+
+    g_free(path);
+    g_free(filename);
+}
+
+static gchar *recovery_journal_group(const gchar *filename) {
+    // File names may have characters that are not allowed in group names
+    gchar *sum = g_compute_checksum_for_string(G_CHECKSUM_MD5, filename, -1);
+    gchar *group = g_strdup_printf("Recording %s", sum);
+    g_free(sum);
+    return group;
+}
+
+static void recovery_journal_set(const gchar *filename, gboolean add) {
+    // Add or remove filename
+    G_LOCK(g_journal);
+
+    GKeyFile *key_file = recovery_journal_load();
+    gchar *group = recovery_journal_group(filename);
+
+    if (add) {
+        g_key_file_set_string(key_file, group, "Filename", filename);
+        g_key_file_set_integer(key_file, group, "PID", (gint)getpid());
+        g_key_file_set_int64(key_file, group, "Started", g_get_real_time() / G_USEC_PER_SEC);
+    } else if (!g_key_file_remove_group(key_file, group, NULL)) {
+        // Not in the journal (an encrypted recording, or recovery is off)
+        goto LBL_1;
+    }
+
+    recovery_journal_save(key_file);
+
+LBL_1:
+
+    g_free(group);
+    g_key_file_free(key_file);
+
+    G_UNLOCK(g_journal);
+}
+
+// ---------------------------------------------------------------------
+// Checkpoints of the running recording
+// ---------------------------------------------------------------------
+
+static void recovery_checkpoint(const gchar *filename) {
+    // Make the file playable as it is now, and push it to the disk
+    gint fd = g_open(filename, O_RDWR, 0);
+    if (fd < 0) return;
+
+    off_t size = lseek(fd, 0, SEEK_END);
+
+    guint8 magic[4];
+    if (size > 12 && recovery_read(fd, magic, 4, 0) && (!memcmp(magic, "RIFF", 4) || !memcmp(magic, "RF64", 4))) {
+        recovery_fix_wav(fd, size);
+    }
+
+    // fsync flushes the file, not only this descriptor
+    fdatasync(fd);
+    close(fd);
+
+    LOG_RECOVERY("Checkpoint of %s at %" G_GINT64_FORMAT " bytes.\n", filename, (gint64)size);
+}
+
+static gpointer recovery_checkpoint_thread(gpointer user_data) {
+    g_mutex_lock(&g_ck_lock);
+
+    while (!g_ck_quit) {
+        gint64 end_time = g_get_monotonic_time() + g_ck_interval * G_TIME_SPAN_SECOND;
+
+        // Wait for the interval (or quit)
+        while (!g_ck_quit && g_cond_wait_until(&g_ck_cond, &g_ck_lock, end_time));
+        if (g_ck_quit) break;
+
+        g_mutex_unlock(&g_ck_lock);
+        recovery_checkpoint(g_ck_filename);
+        g_mutex_lock(&g_ck_lock);
+    }
+
+    g_mutex_unlock(&g_ck_lock);
+    return NULL;
+}
+
+void recovery_begin(const gchar *filename) {
+    // Recording to filename has started
+    recovery_prepare_stop();
+
+    if (!(filename && recovery_enabled())) return;
+
+    recovery_journal_set(filename, TRUE);
+
+    g_free(g_ck_filename);
+    g_ck_filename = g_strdup(filename);
+
+    g_ck_interval = 10;
+    conf_get_int_value("fsync-interval", &g_ck_interval);
+    if (g_ck_interval <= 0) return;
+
+    g_ck_quit = FALSE;
+    g_ck_thread = g_thread_new("checkpoint", recovery_checkpoint_thread, NULL);
+}
+
+void recovery_prepare_stop() {
+    // Stop the checkpoints. The muxer will finalize the file.
+    if (!g_ck_thread) return;
+
+    g_mutex_lock(&g_ck_lock);
+    g_ck_quit = TRUE;
+    g_cond_broadcast(&g_ck_cond);
+    g_mutex_unlock(&g_ck_lock);
+
+    g_thread_join(g_ck_thread);
+    g_ck_thread = NULL;
+}
+
+void recovery_end(const gchar *filename) {
+    // Recording to filename has been finalized. The next segment of a switch may be recording already.
+    if (!filename) return;
+
+    if (!g_strcmp0(filename, g_ck_filename)) {
+        recovery_prepare_stop();
+
+        g_free(g_ck_filename);
+        g_ck_filename = NULL;
+    }
+
+    recovery_journal_set(filename, FALSE);
+}
+
+// ---------------------------------------------------------------------
+// Startup recovery
+// ---------------------------------------------------------------------
+
+static gpointer recovery_scan_thread(gpointer user_data) {
+    // Repair recordings left in the journal by a crashed instance
+    GList *files = NULL;
+
+    // Running instances of this program. A live PID alone is not enough; it may have been re-used by another program.
+    // One /proc scan for all journal entries. A cached scan is re-used and re-validated (see proc-info.c).
+    GList *instances = proc_find_by_name(PACKAGE, TRUE);
+
+    G_LOCK(g_journal);
+
+    GKeyFile *key_file = recovery_journal_load();
+    gchar **groups = g_key_file_get_groups(key_file, NULL);
+
+    guint i = 0;
+    for (i = 0; groups && groups[i]; i++) {
+        gint pid = g_key_file_get_integer(key_file, groups[i], "PID", NULL);
+
+        // Our own recording, or a live instance?
+        if (pid == (gint)getpid() || (pid > 0 && g_list_find(instances, GINT_TO_POINTER(pid)))) continue;
+
+        gchar *filename = g_key_file_get_string(key_file, groups[i], "Filename", NULL);
+        if (filename) {
+            files = g_list_append(files, filename);
+        }
+    }
+
+    g_strfreev(groups);
+    g_key_file_free(key_file);
+
+    G_UNLOCK(g_journal);
+
+    g_list_free(instances);
+
+    GList *n = g_list_first(files);
+    while (n) {
+        gchar *filename = (gchar*)n->data;
+
+        if (g_file_test(filename, G_FILE_TEST_IS_REGULAR)) {
+            recovery_repair_file(filename);
+        }
+
+        recovery_journal_set(filename, FALSE);
+
+        n = g_list_next(n);
+    }
+
+    str_list_free(files);
+
+    return NULL;
+}
+
+void recovery_scan() {
+    // Repair interrupted recordings in the background
+    GThread *thread = g_thread_new("recovery", recovery_scan_thread, NULL);
+    g_thread_unref(thread);
+}
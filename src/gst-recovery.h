@@ -0,0 +1,43 @@
+#ifndef _GST_RECOVERY_H
+#define _GST_RECOVERY_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-recovery.c.
+//#define DEBUG_RECOVERY
+
+#if defined(DEBUG_RECOVERY) || defined(DEBUG_ALL)
+#define LOG_RECOVERY LOG_MSG
+#else
+#define LOG_RECOVERY(x, ...)
+#endif
+
+void recovery_module_init();
+void recovery_module_exit();
+
+// Crash-safe variant of profile_str (eg. fragmented mp4mux instead of avmux_mp4). Caller should g_free() this value.
+gchar *recovery_adapt_profile(const gchar *profile_str);
+
+// Set muxer properties of the recording pipeline for crash safety (MP4 fragments, Ogg page flushes)
+void recovery_setup_pipeline(GstElement *pipeline);
+
+// Recording to filename has started. Add it to the journal and start periodic checkpoints (header rewrite, fsync).
+void recovery_begin(const gchar *filename);
+
+// Recording is being stopped. Stop the checkpoints before the muxer writes its final headers.
+void recovery_prepare_stop();
+
+// Recording to filename has been finalized. Remove it from the journal.
+void recovery_end(const gchar *filename);
+
+// Repair files of recordings that were interrupted by a crash (in a background thread)
+void recovery_scan();
+
+// CRC of an Ogg page (the CRC field is counted as zeros)
+guint32 recovery_ogg_crc(guint8 *page, gsize len);
+
+// Cut off a torn page at the end of an open Ogg file and set the end-of-stream flag of the last page
+gboolean recovery_finish_ogg(gint fd);
+
+#endif
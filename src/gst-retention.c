@@ -0,0 +1,627 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#include <glib/gstdio.h>
+
+#include "gst-retention.h"
+#include "gst-seek.h"
+#include "gst-checksum.h"
+#include "gst-transcode.h"
+#include "gst-append.h"
+#include "rec-manager.h"
+#include "dbus-server.h"
+#include "log.h"
+#include "dconf.h"
+#include "utility.h"
+#include "support.h"
+
+// Retention of recordings.
+//
+// Always-on recorders fill their disks. Instead of a cron job that walks the audio folder, the recorder keeps an
+// index of the recordings it has made (file name, start time, duration, size), ordered by start time.
+// The index is updated when a recording is complete (rec_stop_recording()), merged (gst-append.c) or
+// converted (gst-transcode.c). It is saved as a journal of lines in ~/.local/share/audio-recorder/recordings.index:
+//   +<TAB>start<TAB>duration<TAB>size<TAB>filename    (added or changed)
+//   -<TAB>filename                                    (deleted)
+// and rewritten when most of its lines are stale.
+//
+// Policies (0 = off): "retention-max-size" (MB of all indexed recordings), "retention-max-age" (days) and
+// "retention-min-free" (MB free in the audio folder). They are checked after each recording, hourly, and when the
+// disk-space guard warns. A worker thread at low CPU and I/O priority deletes the oldest recordings (and their
+// sidecars) until all policies hold. It never deletes the running recording or the files of queued conversions and
+// merges, and never scans folders. If the indexed recordings cannot free enough space, the free space policy is
+// skipped for the pass.
+// Files deleted by the user are dropped from the index when they come up.
+// Event: "retention-deleted".
+
+// Nice value of the worker
+#define RETENTION_NICE 15
+
+// Check the policies this often (max. age), and this long after start
+#define RETENTION_CHECK_SEC 3600
+#define RETENTION_START_DELAY_SEC 60
+
+// Rewrite the index when it has this many lines and half of them are stale
+#define RETENTION_COMPACT_LINES 256
+
+typedef struct {
+    gchar *filename;
+    gint64 start_time;   // Seconds since the epoch
+    gint64 duration;     // Seconds
+    guint64 size;
+} RetentionEntry;
+
+typedef struct {
+    guint64 max_bytes;
+    gint64 max_age;
+    guint64 min_free_bytes;
+
+    // Audio folder (for "retention-min-free")
+    gchar *folder;
+
+    // Files in use (set of filenames)
+    GHashTable *exclude;
+
+    guint deleted;
+    guint missing;
+    guint64 deleted_bytes;
+} RetentionJob;
+
+G_LOCK_DEFINE_STATIC(g_index);
+
+// Protected by g_index. Entries oldest first, and by filename.
+static GQueue g_entries = G_QUEUE_INIT;
+static GHashTable *g_links = NULL;
+static guint64 g_total_bytes = 0;
+static guint g_index_lines = 0;
+
+static GThreadPool *g_pool = NULL;
+static gint g_quit = 0;
+
+static guint g_check_id = 0;
+static guint g_start_id = 0;
+
+static void retention_entry_free(RetentionEntry *e) {
+    if (!e) return;
+    g_free(e->filename);
+    g_free(e);
+}
+
+static guint64 retention_file_size(const gchar *filename) {
+    GStatBuf fstat;
+    if (g_stat(filename, &fstat)) return 0;
+
+    return (guint64)fstat.st_size;
+}
+
+// ---------------------------------------------------------------------
+// Index. Callers hold g_index.
+// ---------------------------------------------------------------------
+
+static gchar *retention_index_filename() {
+    // Eg. ~/.local/share/audio-recorder/recordings.index
+    // Caller should g_free() this value
+    return g_build_filename(g_get_user_data_dir(), "audio-recorder", "recordings.index", NULL);
+}
+
+static gchar *retention_entry_line(const RetentionEntry *e) {
+    // File names may have tabs and newlines
+    gchar *name = g_strescape(e->filename, NULL);
+
+    gchar *line = g_strdup_printf("+\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%" G_GUINT64_FORMAT "\t%s\n",
+                                  e->start_time, e->duration, e->size, name);
+    g_free(name);
+    return line;
+}
+
+static void retention_index_write(const gchar *line) {
+    // Append line to the index file
+    gchar *filename = retention_index_filename();
+    gchar *path = g_path_get_dirname(filename);
+    g_mkdir_with_parents(path, 0700);
+
+    FILE *f = g_fopen(filename, "a");
+    if (!(f && fputs(line, f) >= 0)) {
+        LOG_ERROR("Cannot write index %s. %s\n", filename, g_strerror(errno));
+    }
+
+    if (f) {
+        fclose(f);
+    }
+
+    g_index_lines++;
+
+    g_free(path);
+    g_free(filename);
+}
+
+static void retention_index_compact() {
+    // Rewrite the index with the live entries only
+    if (g_index_lines < RETENTION_COMPACT_LINES || g_index_lines < 2 * g_queue_get_length(&g_entries)) return;
+
+    GString *str = g_string_new(NULL);
+
+    GList *n = g_queue_peek_head_link(&g_entries);
+    while (n) {
+        gchar *line = retention_entry_line((RetentionEntry*)n->data);
+        g_string_append(str, line);
+        g_free(line);
+
+        n = g_list_next(n);
+    }
+
+    gchar *filename = retention_index_filename();
+
+    GError *error = NULL;
+    g_file_set_contents(filename, str->str, str->len, &error);
+
+    if (error) {
+        LOG_ERROR("Cannot save index %s. %s\n", filename, error->message);
+        g_error_free(error);
+    } else {
+        LOG_RETENTION("Compacted index %s from %u to %u lines.\n", filename, g_index_lines, g_queue_get_length(&g_entries));
+        g_index_lines = g_queue_get_length(&g_entries);
+    }
+
+    g_free(filename);
+    g_string_free(str, TRUE);
+}
+
+static RetentionEntry *retention_lookup(const gchar *filename) {
+    GList *link = g_hash_table_lookup(g_links, filename);
+    return (link ? (RetentionEntry*)link->data : NULL);
+}
+
+static void retention_unlink(const gchar *filename) {
+    GList *link = g_hash_table_lookup(g_links, filename);
+    if (!link) return;
+
+    RetentionEntry *e = (RetentionEntry*)link->data;
+
+    g_total_bytes -= MIN(e->size, g_total_bytes);
+
+    g_hash_table_remove(g_links, filename);
+    g_queue_delete_link(&g_entries, link);
+
+    retention_entry_free(e);
+}
+
+static void retention_set(const gchar *filename, gint64 start_time, gint64 duration, guint64 size, gboolean save) {
+    // Add or replace the entry of filename. Keep the entries in start order.
+    retention_unlink(filename);
+
+    RetentionEntry *e = g_malloc0(sizeof(RetentionEntry));
+    e->filename = g_strdup(filename);
+    e->start_time = start_time;
+    e->duration = duration;
+    e->size = size;
+
+    // Recordings come in start order; search from the newest end
+    GList *n = g_queue_peek_tail_link(&g_entries);
+    while (n && ((RetentionEntry*)n->data)->start_time > start_time) {
+        n = g_list_previous(n);
+    }
+
+    if (n) {
+        g_queue_insert_after(&g_entries, n, e);
+        n = g_list_next(n);
+    } else {
+        g_queue_push_head(&g_entries, e);
+        n = g_queue_peek_head_link(&g_entries);
+    }
+
+    g_hash_table_insert(g_links, e->filename, n);
+    g_total_bytes += size;
+
+    if (save) {
+        gchar *line = retention_entry_line(e);
+        retention_index_write(line);
+        g_free(line);
+    }
+}
+
+static void retention_forget(const gchar *filename) {
+    if (!retention_lookup(filename)) return;
+
+    retention_unlink(filename);
+
+    gchar *name = g_strescape(filename, NULL);
+    gchar *line = g_strdup_printf("-\t%s\n", name);
+    retention_index_write(line);
+    g_free(line);
+    g_free(name);
+
+    retention_index_compact();
+}
+
+static void retention_index_load() {
+    gchar *filename = retention_index_filename();
+
+    gchar *text = NULL;
+    if (!g_file_get_contents(filename, &text, NULL, NULL)) {
+        g_free(filename);
+        return;
+    }
+
+    gchar **lines = g_strsplit(text, "\n", -1);
+
+    gint i = 0;
+    for (i = 0; lines[i]; i++) {
+        if (!*lines[i]) continue;
+
+        g_index_lines++;
+
+        gchar **parts = g_strsplit(lines[i], "\t", 5);
+
+        if (!g_strcmp0(parts[0], "+") && g_strv_length(parts) == 5) {
+            gchar *name = g_strcompress(parts[4]);
+            retention_set(name, g_ascii_strtoll(parts[1], NULL, 10), g_ascii_strtoll(parts[2], NULL, 10),
+                          g_ascii_strtoull(parts[3], NULL, 10), FALSE);
+            g_free(name);
+
+        } else if (!g_strcmp0(parts[0], "-") && g_strv_length(parts) == 2) {
+            gchar *name = g_strcompress(parts[1]);
+            retention_unlink(name);
+            g_free(name);
+        }
+
+        g_strfreev(parts);
+    }
+
+    LOG_RETENTION("Loaded index %s. %u recordings, %.1f MB.\n", filename, g_queue_get_length(&g_entries),
+                  g_total_bytes / (1024.0 * 1024.0));
+
+    retention_index_compact();
+
+    g_strfreev(lines);
+    g_free(text);
+    g_free(filename);
+}
+
+// ---------------------------------------------------------------------
+// Index updates
+// ---------------------------------------------------------------------
+
+void retention_add_file(const gchar *filename, gint64 start_time, gint64 duration) {
+    if (str_length0(filename) < 1 || !g_links) return;
+
+    guint64 size = retention_file_size(filename);
+
+    G_LOCK(g_index);
+
+    // Appended to: the file started with its first part
+    RetentionEntry *e = retention_lookup(filename);
+    if (e) {
+        start_time = MIN(start_time, e->start_time);
+        duration += e->duration;
+    }
+
+    retention_set(filename, start_time, duration, size, TRUE);
+
+    G_UNLOCK(g_index);
+
+    LOG_RETENTION("Indexed %s. %" G_GINT64_FORMAT " s, %.1f MB.\n", filename, duration, size / (1024.0 * 1024.0));
+
+    retention_enforce();
+}
+
+void retention_file_changed(const gchar *filename) {
+    if (!g_links) return;
+
+    guint64 size = retention_file_size(filename);
+
+    G_LOCK(g_index);
+
+    RetentionEntry *e = retention_lookup(filename);
+    if (e && e->size != size) {
+        retention_set(filename, e->start_time, e->duration, size, TRUE);
+    }
+
+    G_UNLOCK(g_index);
+}
+
+void retention_file_converted(const gchar *src, const gchar *dest, gboolean src_removed) {
+    // May be called from a worker thread
+    if (!g_links) return;
+
+    guint64 size = retention_file_size(dest);
+
+    G_LOCK(g_index);
+
+    // Only the recordings we have made
+    RetentionEntry *e = retention_lookup(src);
+    if (e) {
+        retention_set(dest, e->start_time, e->duration, size, TRUE);
+
+        if (src_removed) {
+            retention_forget(src);
+        }
+    }
+
+    G_UNLOCK(g_index);
+}
+
+// ---------------------------------------------------------------------
+// Policies
+// ---------------------------------------------------------------------
+
+static gboolean retention_done_cb(gpointer user_data) {
+    // A pass has finished. Runs in the main loop.
+    RetentionJob *job = (RetentionJob*)user_data;
+
+    if (job->deleted) {
+        gchar *msg = g_strdup_printf("Deleted %u old recordings (%.1f MB).", job->deleted, job->deleted_bytes / (1024.0 * 1024.0));
+        LOG_MSG("Retention: %s\n", msg);
+
+        dbus_service_emit_event("retention-deleted", msg);
+        g_free(msg);
+    }
+
+    g_free(job->folder);
+    g_hash_table_destroy(job->exclude);
+    g_free(job);
+    return FALSE;
+}
+
+static void retention_run(gpointer data, gpointer user_data) {
+    // Delete the oldest recordings until the policies hold. Runs in the worker thread.
+    RetentionJob *job = (RetentionJob*)data;
+
+    lower_thread_priority(RETENTION_NICE);
+
+    // Copy the entries, oldest first. Deletions go to the index one by one.
+    GPtrArray *list = g_ptr_array_new_with_free_func((GDestroyNotify)retention_entry_free);
+
+    G_LOCK(g_index);
+
+    guint64 total = g_total_bytes;
+
+    GList *n = g_queue_peek_head_link(&g_entries);
+    while (n) {
+        RetentionEntry *e = (RetentionEntry*)n->data;
+
+        RetentionEntry *copy = g_malloc(sizeof(RetentionEntry));
+        *copy = *e;
+        copy->filename = g_strdup(e->filename);
+        g_ptr_array_add(list, copy);
+
+        n = g_list_next(n);
+    }
+
+    G_UNLOCK(g_index);
+
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+
+    // Free space counts only on the disk of the audio folder
+    guint64 free_bytes = 0;
+    dev_t folder_dev = 0;
+
+    if (job->min_free_bytes) {
+        struct statvfs st;
+        GStatBuf fstat;
+
+        if (statvfs(job->folder, &st) || g_stat(job->folder, &fstat)) {
+            LOG_ERROR("Retention: Cannot read the free space of %s. %s\n", job->folder, g_strerror(errno));
+            job->min_free_bytes = 0;
+        } else {
+            free_bytes = (guint64)st.f_bavail * (guint64)st.f_frsize;
+            folder_dev = fstat.st_dev;
+        }
+    }
+
+    if (job->min_free_bytes && free_bytes < job->min_free_bytes) {
+        // Can the indexed recordings free enough at all? Other files may fill the disk. Then the pass would
+        // delete every recording on it and still miss the target.
+        guint64 reclaimable = 0;
+
+        guint i = 0;
+        for (i = 0; i < list->len; i++) {
+            RetentionEntry *e = (RetentionEntry*)g_ptr_array_index(list, i);
+            if (g_hash_table_contains(job->exclude, e->filename)) continue;
+
+            GStatBuf fstat;
+            if (!g_stat(e->filename, &fstat) && fstat.st_dev == folder_dev) {
+                reclaimable += (guint64)fstat.st_blocks * 512;
+            }
+        }
+
+        if (free_bytes + reclaimable < job->min_free_bytes) {
+            LOG_ERROR("Retention: Cannot free %.1f MB on the disk of %s. Its recordings take only %.1f MB. "
+                      "No recording is deleted for \"retention-min-free\".\n",
+                      (job->min_free_bytes - free_bytes) / (1024.0 * 1024.0), job->folder, reclaimable / (1024.0 * 1024.0));
+            job->min_free_bytes = 0;
+        }
+    }
+
+    guint i = 0;
+    for (i = 0; i < list->len && !g_atomic_int_get(&g_quit); i++) {
+        RetentionEntry *e = (RetentionEntry*)g_ptr_array_index(list, i);
+
+        gboolean too_old = (job->max_age && e->start_time < now - job->max_age);
+        gboolean too_big = (job->max_bytes && total > job->max_bytes);
+        gboolean too_full = (job->min_free_bytes && free_bytes < job->min_free_bytes);
+
+        // The rest is newer
+        if (!(too_old || too_big || too_full)) break;
+
+        if (g_hash_table_contains(job->exclude, e->filename)) continue;
+
+        GStatBuf fstat;
+        if (g_stat(e->filename, &fstat)) {
+            if (errno == ENOENT) {
+                // Deleted by the user
+                G_LOCK(g_index);
+                retention_forget(e->filename);
+                G_UNLOCK(g_index);
+
+                total -= MIN(e->size, total);
+                job->missing++;
+            }
+            continue;
+        }
+
+        // Deleting it would not free the audio folder's disk
+        if (!(too_old || too_big) && fstat.st_dev != folder_dev) continue;
+
+        if (g_remove(e->filename)) {
+            LOG_ERROR("Retention: Cannot delete %s. %s\n", e->filename, g_strerror(errno));
+            continue;
+        }
+
+        seek_index_remove(e->filename);
+        checksum_remove(e->filename);
+
+        G_LOCK(g_index);
+        retention_forget(e->filename);
+        G_UNLOCK(g_index);
+
+        LOG_MSG("Retention: Deleted %s (%s%s%s).\n", e->filename, (too_old ? "age " : ""), (too_big ? "size " : ""),
+                (too_full ? "free space" : ""));
+
+        total -= MIN(e->size, total);
+
+        if (fstat.st_dev == folder_dev) {
+            free_bytes += (guint64)fstat.st_blocks * 512;
+        }
+
+        job->deleted++;
+        job->deleted_bytes += (guint64)fstat.st_size;
+    }
+
+    LOG_RETENTION("Pass done. %u deleted, %u missing, %.1f MB indexed.\n", job->deleted, job->missing, total / (1024.0 * 1024.0));
+
+    g_ptr_array_free(list, TRUE);
+
+    g_idle_add(retention_done_cb, job);
+}
+
+void retention_enforce() {
+    if (!g_pool || !g_links) return;
+
+    gint max_mb = 0;
+    gint max_days = 0;
+    gint min_free_mb = 0;
+    conf_get_int_value("retention-max-size", &max_mb);
+    conf_get_int_value("retention-max-age", &max_days);
+    conf_get_int_value("retention-min-free", &min_free_mb);
+
+    if (max_mb <= 0 && max_days <= 0 && min_free_mb <= 0) return;
+
+    // A pass is waiting. It sees this change too.
+    if (g_thread_pool_unprocessed(g_pool) > 0) return;
+
+    RetentionJob *job = g_malloc0(sizeof(RetentionJob));
+    job->max_bytes = (guint64)MAX(max_mb, 0) * 1024 * 1024;
+    job->max_age = (gint64)MAX(max_days, 0) * 24 * 3600;
+    job->min_free_bytes = (guint64)MAX(min_free_mb, 0) * 1024 * 1024;
+    job->folder = get_audio_folder();
+
+    job->exclude = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    // The running recording, and the file it may append to
+    gchar *filename = rec_manager_get_output_filename();
+    if (filename) g_hash_table_add(job->exclude, filename);
+
+    filename = NULL;
+    conf_get_string_value("track/last-file-name", &filename);
+    if (filename) g_hash_table_add(job->exclude, filename);
+
+    // Sources of the queued conversions, and the files of the queued merges
+    GList *files = g_list_concat(transcode_pending_files(), append_pending_files());
+
+    GList *n = g_list_first(files);
+    while (n) {
+        // The table takes the strings
+        g_hash_table_add(job->exclude, n->data);
+        n = g_list_next(n);
+    }
+    g_list_free(files);
+
+    g_thread_pool_push(g_pool, job, NULL);
+}
+
+static gboolean retention_check_cb(gpointer user_data) {
+    retention_enforce();
+
+    if (user_data) {
+        // First check after start
+        g_start_id = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void retention_module_init() {
+    LOG_DEBUG("Init gst-retention.c.\n");
+
+    g_atomic_int_set(&g_quit, 0);
+
+    g_links = g_hash_table_new(g_str_hash, g_str_equal);
+
+    G_LOCK(g_index);
+    retention_index_load();
+    G_UNLOCK(g_index);
+
+    // Exclusive thread. Shared GThreadPool threads would carry the low priority to other pools.
+    g_pool = g_thread_pool_new(retention_run, NULL, 1, TRUE, NULL);
+
+    g_start_id = g_timeout_add_seconds(RETENTION_START_DELAY_SEC, retention_check_cb, GINT_TO_POINTER(1));
+    g_check_id = g_timeout_add_seconds(RETENTION_CHECK_SEC, retention_check_cb, NULL);
+}
+
+void retention_module_exit() {
+    LOG_DEBUG("Clean up gst-retention.c.\n");
+
+    if (g_start_id) {
+        g_source_remove(g_start_id);
+    }
+    g_start_id = 0;
+
+    if (g_check_id) {
+        g_source_remove(g_check_id);
+    }
+    g_check_id = 0;
+
+    // Stop a running pass. The index is up to date.
+    g_atomic_int_set(&g_quit, 1);
+
+    if (g_pool) {
+        g_thread_pool_free(g_pool, TRUE, TRUE);
+    }
+    g_pool = NULL;
+
+    G_LOCK(g_index);
+
+    g_queue_foreach(&g_entries, (GFunc)retention_entry_free, NULL);
+    g_queue_clear(&g_entries);
+
+    if (g_links) {
+        g_hash_table_destroy(g_links);
+    }
+    g_links = NULL;
+    g_total_bytes = 0;
+    g_index_lines = 0;
+
+    G_UNLOCK(g_index);
+}
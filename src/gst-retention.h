@@ -0,0 +1,32 @@
+#ifndef _GST_RETENTION_H
+#define _GST_RETENTION_H
+
+#include <glib.h>
+
+// Uncomment this to show debug messages from gst-retention.c.
+//#define DEBUG_RETENTION
+
+#if defined(DEBUG_RETENTION) || defined(DEBUG_ALL)
+#define LOG_RETENTION LOG_MSG
+#else
+#define LOG_RETENTION(x, ...)
+#endif
+
+// Load the index of recordings. Check the policies now and then.
+void retention_module_init();
+void retention_module_exit();
+
+// A recording is complete. Add it to the index (or add to its duration if it was appended to). Main thread.
+void retention_add_file(const gchar *filename, gint64 start_time, gint64 duration);
+
+// The size of an indexed file has changed (eg. a merge has finished)
+void retention_file_changed(const gchar *filename);
+
+// An indexed file was converted to dest. The source has been deleted if src_removed.
+void retention_file_converted(const gchar *src, const gchar *dest, gboolean src_removed);
+
+// Delete the oldest recordings in the background if a policy ("retention-max-size", "retention-max-age",
+// "retention-min-free") is exceeded. Main thread.
+void retention_enforce();
+
+#endif
@@ -0,0 +1,497 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <gst/audio/audio.h>
+
+#include "gst-rf64.h"
+#include "log.h"
+#include "support.h"
+
+// WAV recordings beyond 4 GB.
+//
+// The RIFF and data sizes of a WAV file are 32 bits. wavenc lets them overflow after 4 GB and the file is
+// corrupt. The WAV profiles use "arwavenc" instead (see rf64_adapt_profile()):
+//  - It writes a standard WAV header with a 28 byte JUNK chunk after "WAVE" (EBU Tech 3306).
+//  - When the file is about to cross 4 GB, it seeks back and rewrites the header in place as RF64:
+//    "RIFF" becomes "RF64", the JUNK chunk becomes "ds64" with the 64-bit sizes, and the 32-bit sizes are set to -1.
+//    No audio data is moved.
+//  - At EOS it writes the final sizes (as WAV or RF64).
+// The header rewrites are byte segments, like the ones of wavenc, so filesink and arfilesink handle them.
+//
+// rf64_read_header() and rf64_write_sizes() update the sizes of an open file. The crash repair and the
+// checkpoints (gst-recovery.c) and the WAV merge (gst-append.c) use them, so a file that has crossed 4 GB
+// is upgraded there too.
+
+// WAV chunks before "data" must fit in this
+#define RF64_HEADER_MAX 4096
+
+// Offsets of our header: RIFF header, JUNK/ds64 chunk, fmt chunk
+#define RF64_DS64_OFF 12
+#define RF64_DS64_LEN 28
+#define RF64_FMT_OFF (RF64_DS64_OFF + 8 + RF64_DS64_LEN)
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+
+typedef struct {
+    GstElement parent;
+
+    GstPad *sinkpad;
+    GstPad *srcpad;
+
+    // Format (0 channels = no caps yet)
+    guint16 tag;
+    guint channels;
+    guint rate;
+    guint width;
+    guint block_align;
+
+    // Header length, and whether it has been written. Header is RF64 after the upgrade.
+    guint header_len;
+    gboolean header_sent;
+    gboolean rf64;
+
+    // Bytes of audio data
+    guint64 data_bytes;
+} ArWavEnc;
+
+typedef struct {
+    GstElementClass parent_class;
+} ArWavEncClass;
+
+GType ar_wav_enc_get_type(void);
+
+#define AR_TYPE_WAV_ENC (ar_wav_enc_get_type())
+#define AR_WAV_ENC(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), AR_TYPE_WAV_ENC, ArWavEnc))
+
+G_DEFINE_TYPE(ArWavEnc, ar_wav_enc, GST_TYPE_ELEMENT);
+
+static GstStaticPadTemplate g_sink_template = GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+        GST_STATIC_CAPS("audio/x-raw, "
+                        "format = (string) { S16LE, S24LE, S32LE, U8, F32LE, F64LE }, "
+                        "layout = (string) interleaved, "
+                        "rate = (int) [ 1, MAX ], "
+                        "channels = (int) [ 1, 65535 ]"));
+
+static GstStaticPadTemplate g_src_template = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+        GST_STATIC_CAPS("audio/x-wav"));
+
+static GstFlowReturn ar_wav_enc_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer);
+static gboolean ar_wav_enc_sink_event(GstPad *pad, GstObject *parent, GstEvent *event);
+static GstStateChangeReturn ar_wav_enc_change_state(GstElement *element, GstStateChange transition);
+
+static void ar_wav_enc_class_init(ArWavEncClass *klass) {
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+
+    gst_element_class_set_static_metadata(element_class, "Audio-recorder WAV writer", "Codec/Muxer/Audio",
+                                          "Write WAV and switch to RF64 beyond 4 GB", "Osmo Antero");
+
+    gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&g_sink_template));
+    gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&g_src_template));
+
+    element_class->change_state = ar_wav_enc_change_state;
+}
+
+static void ar_wav_enc_reset(ArWavEnc *enc) {
+    enc->tag = 0;
+    enc->channels = 0;
+    enc->rate = 0;
+    enc->width = 0;
+    enc->block_align = 0;
+
+    enc->header_len = 0;
+    enc->header_sent = FALSE;
+    enc->rf64 = FALSE;
+    enc->data_bytes = 0;
+}
+
+static void ar_wav_enc_init(ArWavEnc *enc) {
+    enc->sinkpad = gst_pad_new_from_static_template(&g_sink_template, "sink");
+    gst_pad_set_chain_function(enc->sinkpad, ar_wav_enc_chain);
+    gst_pad_set_event_function(enc->sinkpad, ar_wav_enc_sink_event);
+    gst_element_add_pad(GST_ELEMENT(enc), enc->sinkpad);
+
+    enc->srcpad = gst_pad_new_from_static_template(&g_src_template, "src");
+    gst_pad_use_fixed_caps(enc->srcpad);
+    gst_element_add_pad(GST_ELEMENT(enc), enc->srcpad);
+
+    ar_wav_enc_reset(enc);
+}
+
+static guint ar_wav_enc_build_header(ArWavEnc *enc, guint8 *h) {
+    // Header for the current data length. WAV with a JUNK chunk, or RF64 with a ds64 chunk.
+    gboolean extensible = (enc->channels > 2);
+    guint fmt_len = (extensible ? 40 : 16);
+
+    guint64 data_len = enc->data_bytes;
+    guint64 riff_len = enc->header_len - 8 + data_len + (data_len & 1);
+
+    memset(h, 0, enc->header_len);
+
+    memcpy(h, (enc->rf64 ? "RF64" : "RIFF"), 4);
+    GST_WRITE_UINT32_LE(h + 4, (enc->rf64 ? G_MAXUINT32 : (guint32)riff_len));
+    memcpy(h + 8, "WAVE", 4);
+
+    // JUNK is reserved space for ds64
+    guint8 *ds = h + RF64_DS64_OFF;
+    memcpy(ds, (enc->rf64 ? "ds64" : "JUNK"), 4);
+    GST_WRITE_UINT32_LE(ds + 4, RF64_DS64_LEN);
+
+    if (enc->rf64) {
+        GST_WRITE_UINT64_LE(ds + 8, riff_len);
+        GST_WRITE_UINT64_LE(ds + 16, data_len);
+        GST_WRITE_UINT64_LE(ds + 24, data_len / enc->block_align);
+    }
+
+    guint8 *fmt = h + RF64_FMT_OFF;
+    memcpy(fmt, "fmt ", 4);
+    GST_WRITE_UINT32_LE(fmt + 4, fmt_len);
+
+    guint8 *f = fmt + 8;
+    GST_WRITE_UINT16_LE(f, (extensible ? WAVE_FORMAT_EXTENSIBLE : enc->tag));
+    GST_WRITE_UINT16_LE(f + 2, enc->channels);
+    GST_WRITE_UINT32_LE(f + 4, enc->rate);
+    GST_WRITE_UINT32_LE(f + 8, enc->rate * enc->block_align);
+    GST_WRITE_UINT16_LE(f + 12, enc->block_align);
+    GST_WRITE_UINT16_LE(f + 14, enc->width);
+
+    if (extensible) {
+        // No speaker positions; the sub format GUID has the real format tag
+        static const guint8 guid[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71};
+
+        GST_WRITE_UINT16_LE(f + 16, 22);
+        GST_WRITE_UINT16_LE(f + 18, enc->width);
+        GST_WRITE_UINT32_LE(f + 20, 0);
+        GST_WRITE_UINT16_LE(f + 24, enc->tag);
+        memcpy(f + 26, guid, sizeof(guid));
+    }
+
+    guint8 *data = f + fmt_len;
+    memcpy(data, "data", 4);
+    GST_WRITE_UINT32_LE(data + 4, (enc->rf64 ? G_MAXUINT32 : (guint32)data_len));
+
+    return enc->header_len;
+}
+
+static gboolean ar_wav_enc_seek(ArWavEnc *enc, guint64 offset) {
+    // Byte segment: the sink writes from offset on
+    GstSegment segment;
+    gst_segment_init(&segment, GST_FORMAT_BYTES);
+    segment.start = offset;
+    segment.position = offset;
+
+    return gst_pad_push_event(enc->srcpad, gst_event_new_segment(&segment));
+}
+
+static GstFlowReturn ar_wav_enc_write_header(ArWavEnc *enc, guint64 resume) {
+    // Write the header at the start of the file. Then continue at resume (0 = after the header).
+    guint8 h[RF64_HEADER_MAX];
+    guint len = ar_wav_enc_build_header(enc, h);
+
+    ar_wav_enc_seek(enc, 0);
+
+    GstBuffer *buf = gst_buffer_new_allocate(NULL, len, NULL);
+    gst_buffer_fill(buf, 0, h, len);
+    GST_BUFFER_OFFSET(buf) = 0;
+
+    GstFlowReturn ret = gst_pad_push(enc->srcpad, buf);
+
+    if (ret == GST_FLOW_OK && resume) {
+        ar_wav_enc_seek(enc, resume);
+    }
+
+    enc->header_sent = TRUE;
+    return ret;
+}
+
+static GstFlowReturn ar_wav_enc_chain(GstPad *pad, GstObject *parent, GstBuffer *buffer) {
+    ArWavEnc *enc = AR_WAV_ENC(parent);
+
+    if (!enc->channels) {
+        gst_buffer_unref(buffer);
+        GST_ELEMENT_ERROR(enc, CORE, NEGOTIATION, (NULL), ("No audio format before the data."));
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    if (!enc->header_sent) {
+        ret = ar_wav_enc_write_header(enc, 0);
+        if (ret != GST_FLOW_OK) {
+            gst_buffer_unref(buffer);
+            return ret;
+        }
+    }
+
+    gsize size = gst_buffer_get_size(buffer);
+    guint64 end = enc->data_bytes + size;
+
+    // This buffer would overflow the 32-bit sizes. Switch the header to RF64 first.
+    if (!enc->rf64 && enc->header_len - 8 + end + (end & 1) > RF64_RIFF_MAX) {
+        LOG_MSG("WAV recording passes 4 GB. Changing the header to RF64 at %" G_GUINT64_FORMAT " bytes.\n", enc->header_len + enc->data_bytes);
+
+        enc->rf64 = TRUE;
+
+        ret = ar_wav_enc_write_header(enc, enc->header_len + enc->data_bytes);
+        if (ret != GST_FLOW_OK) {
+            gst_buffer_unref(buffer);
+            return ret;
+        }
+    }
+
+    buffer = gst_buffer_make_writable(buffer);
+    GST_BUFFER_OFFSET(buffer) = enc->header_len + enc->data_bytes;
+    GST_BUFFER_OFFSET_END(buffer) = enc->header_len + end;
+
+    enc->data_bytes = end;
+
+    return gst_pad_push(enc->srcpad, buffer);
+}
+
+static gboolean ar_wav_enc_set_caps(ArWavEnc *enc, GstCaps *caps) {
+    GstAudioInfo info;
+    if (!gst_audio_info_from_caps(&info, caps)) return FALSE;
+
+    guint16 tag = (GST_AUDIO_INFO_IS_FLOAT(&info) ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+    guint channels = GST_AUDIO_INFO_CHANNELS(&info);
+    guint rate = GST_AUDIO_INFO_RATE(&info);
+    guint width = GST_AUDIO_INFO_WIDTH(&info);
+
+    if (enc->header_sent) {
+        // Format of a WAV file cannot change
+        if (tag != enc->tag || channels != enc->channels || rate != enc->rate || width != enc->width) {
+            GST_ELEMENT_ERROR(enc, CORE, NEGOTIATION, (NULL), ("Audio format changed during the recording."));
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    enc->tag = tag;
+    enc->channels = channels;
+    enc->rate = rate;
+    enc->width = width;
+    enc->block_align = GST_AUDIO_INFO_BPF(&info);
+
+    enc->header_len = RF64_FMT_OFF + 8 + (channels > 2 ? 40 : 16) + 8;
+
+    LOG_RF64("arwavenc: %u channels, %u Hz, %u bits, header %u bytes.\n", channels, rate, width, enc->header_len);
+
+    GstCaps *src_caps = gst_caps_new_empty_simple("audio/x-wav");
+    gboolean ok = gst_pad_push_event(enc->srcpad, gst_event_new_caps(src_caps));
+    gst_caps_unref(src_caps);
+
+    return ok;
+}
+
+static gboolean ar_wav_enc_sink_event(GstPad *pad, GstObject *parent, GstEvent *event) {
+    ArWavEnc *enc = AR_WAV_ENC(parent);
+
+    switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_CAPS: {
+        GstCaps *caps = NULL;
+        gst_event_parse_caps(event, &caps);
+
+        gboolean ok = ar_wav_enc_set_caps(enc, caps);
+        gst_event_unref(event);
+        return ok;
+    }
+
+    case GST_EVENT_SEGMENT:
+        // Time segment of the audio. The file gets byte segments.
+        gst_event_unref(event);
+        return TRUE;
+
+    case GST_EVENT_EOS:
+        // Final sizes. An empty recording is still a valid file.
+        if (enc->channels) {
+            if (enc->header_sent && (enc->data_bytes & 1)) {
+                // Pad byte of an odd data chunk
+                GstBuffer *pad_buf = gst_buffer_new_allocate(NULL, 1, NULL);
+                gst_buffer_memset(pad_buf, 0, 0, 1);
+                gst_pad_push(enc->srcpad, pad_buf);
+            }
+
+            ar_wav_enc_write_header(enc, 0);
+
+            LOG_RF64("arwavenc: %" G_GUINT64_FORMAT " bytes of audio, %s header.\n", enc->data_bytes, (enc->rf64 ? "RF64" : "WAV"));
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return gst_pad_event_default(pad, parent, event);
+}
+
+static GstStateChangeReturn ar_wav_enc_change_state(GstElement *element, GstStateChange transition) {
+    ArWavEnc *enc = AR_WAV_ENC(element);
+
+    if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+        ar_wav_enc_reset(enc);
+    }
+
+    GstStateChangeReturn ret = GST_ELEMENT_CLASS(ar_wav_enc_parent_class)->change_state(element, transition);
+
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+        // A reused pipeline writes the next file from the start
+        ar_wav_enc_reset(enc);
+    }
+
+    return ret;
+}
+
+// ---------------------------------------------------------------------
+// Header of an open file
+// ---------------------------------------------------------------------
+
+static gboolean rf64_read(gint fd, guint8 *buf, gsize len, guint64 offset) {
+    gsize done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return FALSE;
+        done += n;
+    }
+    return TRUE;
+}
+
+static gboolean rf64_write(gint fd, const guint8 *buf, gsize len, guint64 offset) {
+    return (pwrite(fd, buf, len, offset) == (ssize_t)len);
+}
+
+gboolean rf64_read_header(gint fd, guint64 file_size, WavHeader *wh) {
+    guint8 h[RF64_HEADER_MAX];
+    gsize n = (gsize)MIN(file_size, (guint64)sizeof(h));
+
+    memset(wh, 0, sizeof(WavHeader));
+
+    if (n < 12 || !rf64_read(fd, h, n, 0)) return FALSE;
+
+    if (memcmp(h + 8, "WAVE", 4)) return FALSE;
+
+    if (!memcmp(h, "RF64", 4)) {
+        wh->rf64 = TRUE;
+    } else if (memcmp(h, "RIFF", 4)) {
+        return FALSE;
+    }
+
+    guint64 data64 = 0;
+
+    gsize pos = 12;
+    while (pos + 8 <= n) {
+        guint32 chunk = GST_READ_UINT32_LE(h + pos + 4);
+
+        if (!memcmp(h + pos, "ds64", 4) && chunk >= RF64_DS64_LEN && pos + 8 + RF64_DS64_LEN <= n) {
+            wh->ds64_off = pos;
+            data64 = GST_READ_UINT64_LE(h + pos + 16);
+
+        } else if (!memcmp(h + pos, "JUNK", 4) && chunk >= RF64_DS64_LEN && !wh->ds64_off) {
+            // Room for ds64
+            wh->ds64_off = pos;
+
+        } else if (!memcmp(h + pos, "fmt ", 4)) {
+            wh->fmt_len = chunk;
+            memcpy(wh->fmt, h + pos + 8, MIN(chunk, MIN(sizeof(wh->fmt), n - pos - 8)));
+            wh->block_align = GST_READ_UINT16_LE(wh->fmt + 12);
+
+        } else if (!memcmp(h + pos, "data", 4)) {
+            wh->data_off = pos + 8;
+            wh->data_len = ((wh->rf64 && chunk == G_MAXUINT32) ? data64 : chunk);
+
+            // Crashed or over 4 GB without RF64: data runs to the end of file
+            if (!wh->data_len || chunk == G_MAXUINT32 || wh->data_off + wh->data_len > file_size) {
+                if (!(wh->rf64 && data64 && wh->data_off + data64 <= file_size)) {
+                    wh->data_len = file_size - wh->data_off;
+                }
+            }
+
+            return (wh->fmt_len > 0 && (!wh->rf64 || wh->ds64_off));
+        }
+
+        pos += 8 + (gsize)chunk + (chunk & 1);
+    }
+
+    return FALSE;
+}
+
+gboolean rf64_write_sizes(gint fd, const WavHeader *wh, guint64 data_len, guint64 file_size) {
+    guint64 riff_len = file_size - 8;
+    guint8 v[4];
+
+    if (!wh->rf64 && (riff_len <= RF64_RIFF_MAX || !wh->ds64_off)) {
+        // Standard WAV. An old file without room for ds64 gets clamped sizes.
+        GST_WRITE_UINT32_LE(v, (guint32)MIN(riff_len, (guint64)RF64_RIFF_MAX));
+        if (!rf64_write(fd, v, 4, 4)) return FALSE;
+
+        GST_WRITE_UINT32_LE(v, (guint32)MIN(data_len, (guint64)RF64_RIFF_MAX));
+        return rf64_write(fd, v, 4, wh->data_off - 4);
+    }
+
+    // RF64. The ds64 chunk goes over the JUNK chunk; its length stays. The magic is changed last.
+    guint8 ds[8 + RF64_DS64_LEN];
+    memcpy(ds, "ds64", 4);
+    GST_WRITE_UINT32_LE(ds + 4, RF64_DS64_LEN);
+    GST_WRITE_UINT64_LE(ds + 8, riff_len);
+    GST_WRITE_UINT64_LE(ds + 16, data_len);
+    GST_WRITE_UINT64_LE(ds + 24, (wh->block_align ? data_len / wh->block_align : 0));
+    GST_WRITE_UINT32_LE(ds + 32, 0);
+
+    // Keep the chunk length of a bigger JUNK chunk
+    if (!rf64_read(fd, v, 4, wh->ds64_off + 4)) return FALSE;
+    memcpy(ds + 4, v, 4);
+
+    if (!rf64_write(fd, ds, sizeof(ds), wh->ds64_off)) return FALSE;
+
+    GST_WRITE_UINT32_LE(v, G_MAXUINT32);
+    if (!rf64_write(fd, v, 4, wh->data_off - 4)) return FALSE;
+    if (!rf64_write(fd, v, 4, 4)) return FALSE;
+
+    if (!wh->rf64) {
+        LOG_MSG("WAV file passed 4 GB. Changed the header to RF64.\n");
+        if (!rf64_write(fd, (const guint8*)"RF64", 4, 0)) return FALSE;
+    }
+
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------
+// Module
+// ---------------------------------------------------------------------
+
+void rf64_module_init() {
+    LOG_DEBUG("Init gst-rf64.c.\n");
+
+    // The writer is part of the program, not a plugin
+    gst_element_register(NULL, RF64_FACTORY, GST_RANK_NONE, AR_TYPE_WAV_ENC);
+}
+
+gchar *rf64_adapt_profile(const gchar *profile_str) {
+    // wavenc overflows after 4 GB
+    if (!profile_str) return NULL;
+
+    GRegex *re = g_regex_new("\\bwavenc\\b", 0, 0, NULL);
+    gchar *str = g_regex_replace_literal(re, profile_str, -1, 0, RF64_FACTORY, 0, NULL);
+    g_regex_unref(re);
+
+    return str;
+}
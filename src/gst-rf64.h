@@ -0,0 +1,47 @@
+#ifndef _GST_RF64_H
+#define _GST_RF64_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-rf64.c.
+//#define DEBUG_RF64
+
+#if defined(DEBUG_RF64) || defined(DEBUG_ALL)
+#define LOG_RF64 LOG_MSG
+#else
+#define LOG_RF64(x, ...)
+#endif
+
+// Factory name of the recorder's own WAV writer
+#define RF64_FACTORY "arwavenc"
+
+// Sizes of a WAV (RIFF) file are 32 bits. Bigger files are written as RF64.
+#define RF64_RIFF_MAX G_MAXUINT32
+
+// WAV or RF64 header of a file
+typedef struct {
+    gboolean rf64;        // "RF64" file with a ds64 chunk
+    guint64 ds64_off;     // Offset of the ds64 chunk, or of the JUNK chunk reserved for it (0 = none)
+
+    guint8 fmt[64];       // Payload of the fmt chunk
+    guint32 fmt_len;
+    guint block_align;
+
+    guint64 data_off;     // Samples
+    guint64 data_len;
+} WavHeader;
+
+// Register the "arwavenc" element
+void rf64_module_init();
+
+// Profile with "wavenc" replaced by "arwavenc". Caller should g_free() this value.
+gchar *rf64_adapt_profile(const gchar *profile_str);
+
+// Read the header of an open WAV or RF64 file. A crashed recording (data size 0 or too large) has its data to the end of file.
+gboolean rf64_read_header(gint fd, guint64 file_size, WavHeader *wh);
+
+// Write the RIFF and data sizes in place. A WAV file is upgraded to RF64 if it outgrows 4 GB and has room for ds64.
+gboolean rf64_write_sizes(gint fd, const WavHeader *wh, guint64 data_len, guint64 file_size);
+
+#endif
@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <glib/gstdio.h>
+
+#include "gst-seek.h"
+#include "media-profiles.h"
+#include "log.h"
+#include "dconf.h"
+#include "utility.h"
+#include "support.h"
+
+// Seek indexes for long recordings.
+//
+// A player that opens a 10 hour Ogg or MP3 file must bisect or scan it to seek. The recorder writes the indexes
+// while it encodes; there is no second pass over the file ("seek-index" setting):
+//  - MP3: xingmux writes a Xing header with a 100 point TOC (added to the profile if missing).
+//  - Ogg: oggmux adds a Skeleton track. It has no keyframe index; the sidecar below is the index of Ogg files.
+//  - MP4: mp4mux reserves room for the moov atom at the start of the file and updates it regularly (faststart
+//    layout in one pass). Fragmented MP4 (the "crash-safe" setting) has its moov at the start already.
+//
+// The sidecar index ("seek-sidecar" setting) is a text file next to the recording, "<recording>.seekidx".
+// Each line maps time to the byte offset of a page or frame that starts there, every "seek-sidecar-interval"
+// seconds:
+//      # audio-recorder seek index
+//      # interval-ms 10000
+//      0	0
+//      10000	160512
+// It is written (and flushed) as the data goes to the file, so it is usable after a crash of the program too.
+// A raw append to an existing file (eg. MP3) gets no new points: the old index stays valid for the old part.
+
+// Reserve the MP4 moov for this long recordings. Longer recordings get their moov at the end.
+#define SEEK_MP4_RESERVE (24 * 3600 * GST_SECOND)
+#define SEEK_MP4_UPDATE (10 * GST_SECOND)
+
+// Sidecar interval limits (seconds)
+#define SEEK_INTERVAL_MIN 1
+#define SEEK_INTERVAL_MAX 600
+
+typedef struct {
+    FILE *file;
+    gchar *filename;
+
+    GstPad *pad;
+    gulong probe_id;
+
+    // Next index point and its interval (ns)
+    GstClockTime next;
+    GstClockTime interval;
+
+    // File offset of the next buffer, and of the last index point
+    guint64 position;
+    guint64 last_offset;
+    gboolean have_point;
+
+    guint points;
+} SeekIndex;
+
+// Index of a recording, on its pipeline. The old segment of a switch still writes its index (see rec_switch_segment()).
+#define SEEK_INDEX_KEY "seek-index"
+
+static gboolean seek_enabled() {
+    gboolean enabled = TRUE;
+    conf_get_boolean_value("seek-index", &enabled);
+    return enabled;
+}
+
+// ---------------------------------------------------------------------
+// In-stream indexes
+// ---------------------------------------------------------------------
+
+gchar *seek_adapt_profile(const gchar *profile_str) {
+    if (!(profile_str && seek_enabled())) return g_strdup(profile_str);
+
+    gchar *str = g_strdup(profile_str);
+
+    // MP3 without a TOC
+    if (strstr(str, "lamemp3enc") && !strstr(str, "xingmux") && profiles_has_element("xingmux")) {
+        GRegex *re = g_regex_new("\\blamemp3enc\\b[^!]*", 0, 0, NULL);
+        gchar *tmp = g_regex_replace(re, str, -1, 0, "\\0 ! xingmux ", 0, NULL);
+        g_regex_unref(re);
+
+        g_free(str);
+        str = tmp;
+    }
+
+    // avmux_mp4 cannot reserve room for the moov atom
+    if (profiles_has_element("mp4mux")) {
+        GRegex *re = g_regex_new("\\b(avmux_mp4|ffmux_mp4)\\b", 0, 0, NULL);
+        gchar *tmp = g_regex_replace_literal(re, str, -1, 0, "mp4mux", 0, NULL);
+        g_regex_unref(re);
+
+        g_free(str);
+        str = tmp;
+    }
+
+    LOG_SEEK("Seek index profile: %s\n", str);
+    return str;
+}
+
+void seek_setup_pipeline(GstElement *pipeline) {
+    if (!(GST_IS_BIN(pipeline) && seek_enabled())) return;
+
+    GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipeline));
+    GValue value = G_VALUE_INIT;
+
+    while (gst_iterator_next(it, &value) == GST_ITERATOR_OK) {
+        GstElement *elem = GST_ELEMENT(g_value_get_object(&value));
+        GObjectClass *klass = G_OBJECT_GET_CLASS(elem);
+
+        // oggmux
+        if (g_object_class_find_property(klass, "skeleton")) {
+            g_object_set(G_OBJECT(elem), "skeleton", TRUE, NULL);
+            LOG_SEEK("%s: skeleton=TRUE.\n", GST_ELEMENT_NAME(elem));
+        }
+
+        // mp4mux, qtmux. Not with fragments (crash-safe recording); they have the moov at the start.
+        if (g_object_class_find_property(klass, "reserved-max-duration")) {
+            guint fragment = 0;
+            if (g_object_class_find_property(klass, "fragment-duration")) {
+                g_object_get(G_OBJECT(elem), "fragment-duration", &fragment, NULL);
+            }
+
+            if (!fragment) {
+                g_object_set(G_OBJECT(elem), "reserved-max-duration", (guint64)SEEK_MP4_RESERVE,
+                             "reserved-moov-update-period", (guint64)SEEK_MP4_UPDATE, NULL);
+                LOG_SEEK("%s: moov reserved for %d h.\n", GST_ELEMENT_NAME(elem), (gint)(SEEK_MP4_RESERVE / GST_SECOND / 3600));
+            }
+        }
+
+        g_value_reset(&value);
+    }
+
+    g_value_unset(&value);
+    gst_iterator_free(it);
+}
+
+// ---------------------------------------------------------------------
+// Sidecar index
+// ---------------------------------------------------------------------
+
+static gchar *seek_index_filename(const gchar *filename) {
+    // Caller should g_free() this value
+    return g_strdup_printf("%s.%s", filename, SEEK_INDEX_EXT);
+}
+
+static GstPadProbeReturn seek_index_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    // Data on its way to the file. Runs in the streaming thread of the sink.
+    SeekIndex *idx = (SeekIndex*)user_data;
+
+    if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+        // Muxers seek back to rewrite their headers
+        if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+            const GstSegment *segment = NULL;
+            gst_event_parse_segment(event, &segment);
+
+            if (segment->format == GST_FORMAT_BYTES) {
+                idx->position = segment->start;
+            }
+        }
+
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!buf) return GST_PAD_PROBE_OK;
+
+    GstClockTime ts = GST_BUFFER_PTS(buf);
+    if (!GST_CLOCK_TIME_IS_VALID(ts)) {
+        ts = GST_BUFFER_DTS(buf);
+    }
+
+    // A page or frame that can start decoding. Header rewrites (back in the file) are not index points.
+    gboolean sync = !(GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT) || GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_HEADER));
+
+    if (GST_CLOCK_TIME_IS_VALID(ts) && ts >= idx->next && sync && (!idx->have_point || idx->position > idx->last_offset)) {
+        fprintf(idx->file, "%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT "\n", ts / GST_MSECOND, idx->position);
+        fflush(idx->file);
+
+        idx->last_offset = idx->position;
+        idx->have_point = TRUE;
+        idx->points++;
+
+        idx->next = ts - (ts % idx->interval) + idx->interval;
+    }
+
+    idx->position += gst_buffer_get_size(buf);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static SeekIndex *seek_index_open(GstElement *pipeline, const gchar *filename, guint interval_ms) {
+    // Index the data that goes to the "filesink" element of pipeline
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "filesink");
+    if (!sink) return NULL;
+
+    GstPad *pad = gst_element_get_static_pad(sink, "sink");
+    gst_object_unref(sink);
+
+    if (!pad) return NULL;
+
+    gchar *index_name = seek_index_filename(filename);
+
+    FILE *file = fopen(index_name, "w");
+    if (!file) {
+        LOG_ERROR("Cannot create seek index %s.\n", index_name);
+        g_free(index_name);
+        gst_object_unref(pad);
+        return NULL;
+    }
+
+    fprintf(file, "# audio-recorder seek index\n# interval-ms %u\n", interval_ms);
+    fflush(file);
+
+    SeekIndex *idx = g_malloc0(sizeof(SeekIndex));
+    idx->file = file;
+    idx->filename = index_name;
+    idx->pad = pad;
+    idx->interval = interval_ms * GST_MSECOND;
+
+    idx->probe_id = gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                                      seek_index_probe, idx, NULL);
+
+    LOG_SEEK("Writing seek index %s every %u ms.\n", index_name, interval_ms);
+    return idx;
+}
+
+static void seek_index_close(SeekIndex *idx) {
+    // Pipeline has stopped
+    if (!idx) return;
+
+    gst_pad_remove_probe(idx->pad, idx->probe_id);
+    gst_object_unref(idx->pad);
+
+    fclose(idx->file);
+
+    LOG_SEEK("Seek index %s has %u points.\n", idx->filename, idx->points);
+
+    // Nothing was indexed (eg. a failed recording)
+    if (!idx->points) {
+        g_remove(idx->filename);
+    }
+
+    g_free(idx->filename);
+    g_free(idx);
+}
+
+void seek_index_begin(GstElement *pipeline, const gchar *filename, gboolean append) {
+    seek_index_end(pipeline);
+
+    gboolean sidecar = FALSE;
+    conf_get_boolean_value("seek-sidecar", &sidecar);
+
+    if (!(sidecar && GST_IS_BIN(pipeline) && filename)) return;
+
+    // The new stream starts at time 0 and byte 0, but goes after the old data. Keep the old index.
+    if (append) {
+        LOG_SEEK("Appending to %s. No new seek index points.\n", filename);
+        return;
+    }
+
+    // MP4 files have their index in the moov atom
+    if (g_str_has_suffix(filename, ".m4a") || g_str_has_suffix(filename, ".mp4")) return;
+
+    gint interval = 10;
+    conf_get_int_value("seek-sidecar-interval", &interval);
+    interval = CLAMP(interval, SEEK_INTERVAL_MIN, SEEK_INTERVAL_MAX);
+
+    SeekIndex *idx = seek_index_open(pipeline, filename, (guint)interval * 1000);
+    if (idx) {
+        g_object_set_data(G_OBJECT(pipeline), SEEK_INDEX_KEY, idx);
+    }
+}
+
+void seek_index_end(GstElement *pipeline) {
+    if (!G_IS_OBJECT(pipeline)) return;
+
+    seek_index_close(g_object_steal_data(G_OBJECT(pipeline), SEEK_INDEX_KEY));
+}
+
+void seek_index_remove(const gchar *filename) {
+    if (!filename) return;
+
+    gchar *index_name = seek_index_filename(filename);
+    g_remove(index_name);
+    g_free(index_name);
+}
+
+gboolean seek_index_lookup(const gchar *filename, guint64 time_ms, guint64 *offset) {
+    gchar *index_name = seek_index_filename(filename);
+
+    gchar *text = NULL;
+    gboolean found = FALSE;
+
+    if (g_file_get_contents(index_name, &text, NULL, NULL)) {
+        gchar *line = text;
+
+        while (line && *line) {
+            if (*line != '#') {
+                gchar *end = NULL;
+                guint64 t = g_ascii_strtoull(line, &end, 10);
+
+                if (end == line || t > time_ms) break;
+
+                *offset = g_ascii_strtoull(end, NULL, 10);
+                found = TRUE;
+            }
+
+            line = strchr(line, '\n');
+            if (line) line++;
+        }
+    }
+
+    g_free(text);
+    g_free(index_name);
+
+    return found;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+// ---------------------------------------------------------------------
+
+typedef struct {
+    const gchar *name;
+    const gchar *ext;
+    const gchar *encoder;
+} SeekBenchFormat;
+
+static const SeekBenchFormat g_bench_formats[] = {
+    {"ogg", "ogg", "vorbisenc ! oggmux"},
+    {"ogg+skeleton", "ogg", "vorbisenc ! oggmux skeleton=true"},
+    {"mp3", "mp3", "lamemp3enc"},
+    {"mp3+xing", "mp3", "lamemp3enc ! xingmux"},
+};
+
+#define SEEK_BENCH_N_FORMATS (sizeof(g_bench_formats) / sizeof(g_bench_formats[0]))
+
+// Random seeks per file
+#define SEEK_BENCH_SEEKS 20
+
+static gboolean seek_bench_wait(GstElement *pipeline, GstMessageType type) {
+    // Wait for a message of type (or an error), max. 60 s
+    GstBus *bus = gst_element_get_bus(pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, 60 * GST_SECOND, type | GST_MESSAGE_ERROR);
+    gst_object_unref(bus);
+
+    gboolean ok = (msg && GST_MESSAGE_TYPE(msg) == type);
+    if (msg) gst_message_unref(msg);
+
+    return ok;
+}
+
+static gboolean seek_bench_encode(const SeekBenchFormat *f, guint hours, const gchar *filename, gdouble *encode_sec, guint *points) {
+    // Hours of 8 kHz mono noise as fast as the encoder goes. The sidecar index is written on the way.
+    gchar *cmd = g_strdup_printf("audiotestsrc wave=pink-noise samplesperbuffer=8000 num-buffers=%u ! "
+                                 "audio/x-raw,rate=8000,channels=1 ! audioconvert ! %s ! filesink name=filesink location=\"%s\"",
+                                 hours * 3600, f->encoder, filename);
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(cmd, &error);
+    g_free(cmd);
+
+    if (error) {
+        LOG_ERROR("Cannot create pipeline for %s: %s\n", f->name, error->message);
+        g_error_free(error);
+        if (pipeline) gst_object_unref(pipeline);
+        return FALSE;
+    }
+
+    SeekIndex *idx = seek_index_open(pipeline, filename, 10000);
+
+    gint64 t0 = g_get_monotonic_time();
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    gboolean ok = seek_bench_wait(pipeline, GST_MESSAGE_EOS);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+
+    *encode_sec = (g_get_monotonic_time() - t0) / (gdouble)G_USEC_PER_SEC;
+    *points = (idx ? idx->points : 0);
+
+    seek_index_close(idx);
+    gst_object_unref(pipeline);
+
+    return ok;
+}
+
+static void seek_bench_drop_cache(const gchar *filename) {
+    // Seek on a cold file, like an editor that opens yesterday's recording
+    gint fd = g_open(filename, O_RDONLY, 0);
+    if (fd < 0) return;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+static gboolean seek_bench_seeks(const gchar *filename, guint hours, gdouble *open_ms, gdouble *mean_ms, gdouble *max_ms) {
+    // Accurate time seeks to random positions. Each one waits for the preroll at the new position.
+    gchar *cmd = g_strdup_printf("filesrc location=\"%s\" ! decodebin ! audioconvert ! fakesink sync=false", filename);
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(cmd, &error);
+    g_free(cmd);
+
+    if (error) {
+        g_error_free(error);
+        if (pipeline) gst_object_unref(pipeline);
+        return FALSE;
+    }
+
+    seek_bench_drop_cache(filename);
+
+    gint64 t0 = g_get_monotonic_time();
+
+    gst_element_set_state(pipeline, GST_STATE_PAUSED);
+    gboolean ok = seek_bench_wait(pipeline, GST_MESSAGE_ASYNC_DONE);
+
+    *open_ms = (g_get_monotonic_time() - t0) / 1000.0;
+    *mean_ms = 0.0;
+    *max_ms = 0.0;
+
+    // Same positions for every file
+    GRand *rand = g_rand_new_with_seed(46);
+
+    guint i = 0;
+    for (i = 0; ok && i < SEEK_BENCH_SEEKS; i++) {
+        gint64 pos = g_rand_int_range(rand, 0, hours * 3600) * GST_SECOND;
+
+        seek_bench_drop_cache(filename);
+
+        t0 = g_get_monotonic_time();
+
+        ok = gst_element_seek_simple(pipeline, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE, pos) &&
+             seek_bench_wait(pipeline, GST_MESSAGE_ASYNC_DONE);
+
+        gdouble ms = (g_get_monotonic_time() - t0) / 1000.0;
+
+        *mean_ms += ms / SEEK_BENCH_SEEKS;
+        *max_ms = MAX(*max_ms, ms);
+    }
+
+    g_rand_free(rand);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    return ok;
+}
+
+static gdouble seek_bench_lookups(const gchar *filename, guint hours) {
+    // Mean time (us) to find the byte offset in the sidecar index. This includes reading the index.
+    GRand *rand = g_rand_new_with_seed(46);
+
+    gint64 t0 = g_get_monotonic_time();
+
+    guint i = 0;
+    for (i = 0; i < SEEK_BENCH_SEEKS; i++) {
+        guint64 offset = 0;
+        seek_index_lookup(filename, (guint64)g_rand_int_range(rand, 0, hours * 3600) * 1000, &offset);
+    }
+
+    g_rand_free(rand);
+
+    return (g_get_monotonic_time() - t0) / (gdouble)SEEK_BENCH_SEEKS;
+}
+
+void seek_benchmark(guint hours) {
+    // $ audio-recorder --benchmark=seek
+    g_print("Seek benchmark: %u h of 8 kHz mono audio per format in %s. %d random accurate seeks on a cold page cache.\n",
+            hours, g_get_tmp_dir(), SEEK_BENCH_SEEKS);
+    g_print("format\tfile_MB\tencode_s\topen_ms\tseek_mean_ms\tseek_max_ms\tsidecar_points\tsidecar_lookup_us\n");
+
+    guint i = 0;
+    for (i = 0; i < SEEK_BENCH_N_FORMATS; i++) {
+        const SeekBenchFormat *f = &g_bench_formats[i];
+
+        gchar *filename = g_strdup_printf("%s/audio-recorder-seek-bench-%d.%s", g_get_tmp_dir(), (gint)getpid(), f->ext);
+
+        gdouble encode_sec = 0.0;
+        guint points = 0;
+
+        gdouble open_ms = 0.0;
+        gdouble mean_ms = 0.0;
+        gdouble max_ms = 0.0;
+
+        if (!seek_bench_encode(f, hours, filename, &encode_sec, &points) ||
+                !seek_bench_seeks(filename, hours, &open_ms, &mean_ms, &max_ms)) {
+            g_print("%s\t-\t-\t-\t-\t-\t-\t-\n", f->name);
+
+        } else {
+            g_print("%s\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\t%u\t%.1f\n", f->name, get_file_size(filename) / (1024.0 * 1024.0),
+                    encode_sec, open_ms, mean_ms, max_ms, points, seek_bench_lookups(filename, hours));
+        }
+
+        seek_index_remove(filename);
+        g_remove(filename);
+        g_free(filename);
+    }
+}
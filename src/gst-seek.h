@@ -0,0 +1,42 @@
+#ifndef _GST_SEEK_H
+#define _GST_SEEK_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-seek.c.
+//#define DEBUG_SEEK
+
+#if defined(DEBUG_SEEK) || defined(DEBUG_ALL)
+#define LOG_SEEK LOG_MSG
+#else
+#define LOG_SEEK(x, ...)
+#endif
+
+// File name extension of the sidecar index ("recording.ogg.seekidx")
+#define SEEK_INDEX_EXT "seekidx"
+
+// Profile with in-stream seek indexes: xingmux after lamemp3enc, mp4mux instead of avmux_mp4.
+// Caller should g_free() this value.
+gchar *seek_adapt_profile(const gchar *profile_str);
+
+// Set the muxers of pipeline to write their seek indexes: Ogg skeleton, MP4 moov reserved at the start
+void seek_setup_pipeline(GstElement *pipeline);
+
+// Write the sidecar index of the recording filename while pipeline runs ("seek-sidecar" setting).
+// append: the sink appends to the bytes already in filename (the old index is kept as it is).
+void seek_index_begin(GstElement *pipeline, const gchar *filename, gboolean append);
+
+// Recording of pipeline has stopped. Close its sidecar index.
+void seek_index_end(GstElement *pipeline);
+
+// Delete the sidecar index of filename (the recording was deleted or changed)
+void seek_index_remove(const gchar *filename);
+
+// Byte offset of the last index point at or before time_ms. Return FALSE if filename has no sidecar index.
+gboolean seek_index_lookup(const gchar *filename, guint64 time_ms, guint64 *offset);
+
+// Seek latency in Ogg and MP3 files of hours length, with and without the indexes. Print the results.
+void seek_benchmark(guint hours);
+
+#endif
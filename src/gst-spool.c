@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <glib/gstdio.h>
+
+#include "gst-spool.h"
+#include "log.h"
+#include "support.h"
+
+// Disk-backed spool in front of a queue.
+//
+// A probe on the pad that feeds the queue watches the queue's fill level. Above SPOOL_HIGH_WATER the probe writes
+// buffers (and serialized events) to an unlinked temporary file and drops them, so the upstream thread (capture)
+// never blocks. A drainer thread pushes the spooled data into the queue in the original order. When the spool is
+// empty and the queue is below SPOOL_LOW_WATER, data flows directly again and the file is truncated.
+// If the file cannot be written, buffers are kept in memory up to SPOOL_MEMORY_MAX bytes. Beyond that they are dropped.
+
+#define SPOOL_HIGH_WATER 0.75
+#define SPOOL_LOW_WATER 0.25
+
+// Drainer checks the queue level this often while it waits for room
+#define SPOOL_POLL_MS 20
+
+#define SPOOL_KEY "spool"
+
+// Buffers kept in memory when the spool file fails
+#define SPOOL_MEMORY_MAX (64 * 1024 * 1024)
+
+typedef struct {
+    // Serialized event, or buffer
+    GstEvent *event;
+
+    // Buffer kept in memory (the spool file failed), or NULL
+    GstBuffer *buffer;
+
+    // Buffer in the spool file
+    off_t offset;
+    gsize size;
+    GstClockTime pts;
+    GstClockTime dts;
+    GstClockTime duration;
+    guint64 offset_start;
+    guint64 offset_end;
+    guint flags;
+} SpoolRec;
+
+typedef struct {
+    GstElement *queue;  // Not referenced. The spool lives as long as the queue.
+
+    GstPad *sinkpad;    // Queue's sink pad. The drainer pushes here.
+    GstPad *peer;       // Pad that feeds the queue. Has the probe.
+    gulong probe_id;
+
+    GMutex lock;
+    GCond cond;
+
+    GThread *thread;
+    gboolean quit;
+
+    gint fd;
+    gchar *path;
+    off_t write_off;
+    gboolean file_failed;
+
+    gsize memory_bytes;     // Buffers kept in memory (file failed)
+    gboolean dropping;      // Memory is full. Buffers are dropped.
+
+    GQueue recs;
+    gboolean busy;      // Drainer is pushing a record
+    gboolean active;
+    gint64 active_since;
+
+    SpoolMetrics metrics;
+} Spool;
+
+static void spool_rec_free(SpoolRec *rec) {
+    if (rec->event) {
+        gst_event_unref(rec->event);
+    }
+    if (rec->buffer) {
+        gst_buffer_unref(rec->buffer);
+    }
+    g_free(rec);
+}
+
+static gdouble spool_queue_fill(Spool *sp) {
+    // Fill level of the queue [0 - 1.0]. The highest of the limits in use (time, bytes, buffers).
+    guint64 cur_time = 0;
+    guint64 max_time = 0;
+    guint cur_bytes = 0;
+    guint max_bytes = 0;
+    guint cur_buffers = 0;
+    guint max_buffers = 0;
+
+    g_object_get(G_OBJECT(sp->queue), "current-level-time", &cur_time, "max-size-time", &max_time,
+                 "current-level-bytes", &cur_bytes, "max-size-bytes", &max_bytes,
+                 "current-level-buffers", &cur_buffers, "max-size-buffers", &max_buffers, NULL);
+
+    gdouble fill = 0.0;
+    if (max_time) fill = MAX(fill, (gdouble)cur_time / max_time);
+    if (max_bytes) fill = MAX(fill, (gdouble)cur_bytes / max_bytes);
+    if (max_buffers) fill = MAX(fill, (gdouble)cur_buffers / max_buffers);
+
+    return fill;
+}
+
+static void spool_clear(Spool *sp) {
+    // Drop all spooled data and truncate the file. Lock must be held.
+    g_queue_foreach(&sp->recs, (GFunc)spool_rec_free, NULL);
+    g_queue_clear(&sp->recs);
+
+    if (sp->active) {
+        gdouble stall = (g_get_monotonic_time() - sp->active_since) / 1000.0;
+        sp->metrics.max_stall_ms = MAX(sp->metrics.max_stall_ms, stall);
+
+        LOG_SPOOL("Spool of %s inactive after %.1f ms.\n", GST_ELEMENT_NAME(sp->queue), stall);
+    }
+
+    sp->active = FALSE;
+    sp->metrics.active = FALSE;
+    sp->metrics.pending_bytes = 0;
+    sp->metrics.pending_time = 0;
+
+    if (sp->fd != -1 && sp->write_off > 0) {
+        if (ftruncate(sp->fd, 0) != 0) {
+            LOG_ERROR("Cannot truncate spool file %s. %s\n", sp->path, g_strerror(errno));
+        }
+    }
+    sp->write_off = 0;
+
+    sp->memory_bytes = 0;
+    sp->dropping = FALSE;
+
+    g_cond_broadcast(&sp->cond);
+}
+
+static gboolean spool_open_file(Spool *sp) {
+    // Create the spool file. It is unlinked at once, so it disappears when closed (or if we crash).
+    if (sp->fd != -1) return TRUE;
+    if (sp->file_failed) return FALSE;
+
+    GError *error = NULL;
+    sp->fd = g_file_open_tmp("audio-recorder-spool-XXXXXX", &sp->path, &error);
+    if (sp->fd == -1) {
+        LOG_ERROR("Cannot create spool file. %s\n", (error ? error->message : ""));
+        if (error) g_error_free(error);
+
+        sp->file_failed = TRUE;
+        return FALSE;
+    }
+
+    g_unlink(sp->path);
+    return TRUE;
+}
+
+static void spool_add(Spool *sp, GstBuffer *buf, GstEvent *event) {
+    // Append a buffer or an event to the spool. Lock must be held.
+    SpoolRec *rec = g_malloc0(sizeof(SpoolRec));
+
+    if (event) {
+        rec->event = event;
+        goto LBL_1;
+    }
+
+    rec->size = gst_buffer_get_size(buf);
+    rec->pts = GST_BUFFER_PTS(buf);
+    rec->dts = GST_BUFFER_DTS(buf);
+    rec->duration = GST_BUFFER_DURATION(buf);
+    rec->offset_start = GST_BUFFER_OFFSET(buf);
+    rec->offset_end = GST_BUFFER_OFFSET_END(buf);
+    rec->flags = GST_BUFFER_FLAGS(buf);
+
+    gboolean written = FALSE;
+
+    // Spool file has failed and the memory is full. Drop the buffer; the upstream thread must not block.
+    if (sp->file_failed && sp->memory_bytes + rec->size > SPOOL_MEMORY_MAX) {
+        if (!sp->dropping) {
+            LOG_ERROR("Spool of %s is full (%d MB in memory). Dropping audio.\n", GST_ELEMENT_NAME(sp->queue),
+                      SPOOL_MEMORY_MAX / (1024 * 1024));
+            sp->dropping = TRUE;
+        }
+
+        sp->metrics.dropped_bytes += rec->size;
+        g_free(rec);
+        return;
+    }
+
+    GstMapInfo map;
+    if (!sp->file_failed && spool_open_file(sp) && gst_buffer_map(buf, &map, GST_MAP_READ)) {
+        gsize done = 0;
+        while (done < map.size) {
+            ssize_t n = pwrite(sp->fd, map.data + done, map.size - done, sp->write_off + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += n;
+        }
+        gst_buffer_unmap(buf, &map);
+
+        written = (done == rec->size);
+        if (!written) {
+            LOG_ERROR("Cannot write spool file %s. %s. Spooling to memory.\n", sp->path, g_strerror(errno));
+            sp->file_failed = TRUE;
+        }
+    }
+
+    if (written) {
+        rec->offset = sp->write_off;
+        sp->write_off += rec->size;
+    } else {
+        rec->buffer = gst_buffer_ref(buf);
+        sp->memory_bytes += rec->size;
+    }
+
+    sp->metrics.spooled_bytes += rec->size;
+    sp->metrics.pending_bytes += rec->size;
+    sp->metrics.peak_bytes = MAX(sp->metrics.peak_bytes, sp->metrics.pending_bytes);
+
+    if (GST_CLOCK_TIME_IS_VALID(rec->duration)) {
+        sp->metrics.pending_time += rec->duration;
+    }
+
+LBL_1:
+    g_queue_push_tail(&sp->recs, rec);
+    g_cond_broadcast(&sp->cond);
+}
+
+static GstBuffer *spool_read(Spool *sp, SpoolRec *rec) {
+    // Read buffer of rec back from the spool file
+    if (rec->buffer) {
+        GstBuffer *buf = rec->buffer;
+        rec->buffer = NULL;
+
+        g_mutex_lock(&sp->lock);
+        sp->memory_bytes -= MIN(rec->size, sp->memory_bytes);
+        g_mutex_unlock(&sp->lock);
+
+        return buf;
+    }
+
+    guint8 *data = g_malloc(rec->size);
+
+    gsize done = 0;
+    while (done < rec->size) {
+        ssize_t n = pread(sp->fd, data + done, rec->size - done, rec->offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+
+    if (done != rec->size) {
+        LOG_ERROR("Cannot read spool file %s. %s\n", sp->path, g_strerror(errno));
+        g_free(data);
+        return NULL;
+    }
+
+    GstBuffer *buf = gst_buffer_new_wrapped(data, rec->size);
+    GST_BUFFER_PTS(buf) = rec->pts;
+    GST_BUFFER_DTS(buf) = rec->dts;
+    GST_BUFFER_DURATION(buf) = rec->duration;
+    GST_BUFFER_OFFSET(buf) = rec->offset_start;
+    GST_BUFFER_OFFSET_END(buf) = rec->offset_end;
+    GST_BUFFER_FLAGS(buf) = rec->flags;
+
+    return buf;
+}
+
+static gpointer spool_drain_thread(gpointer user_data) {
+    // Push spooled data into the queue. Blocks in the queue while it is full.
+    Spool *sp = (Spool*)user_data;
+
+    g_mutex_lock(&sp->lock);
+
+    while (!sp->quit) {
+
+        SpoolRec *rec = g_queue_pop_head(&sp->recs);
+        if (!rec) {
+            if (!sp->active) {
+                g_cond_wait(&sp->cond, &sp->lock);
+                continue;
+            }
+
+            // Spool is empty. Go back to direct flow when the queue has room.
+            if (spool_queue_fill(sp) < SPOOL_LOW_WATER) {
+                spool_clear(sp);
+                continue;
+            }
+
+            g_cond_wait_until(&sp->cond, &sp->lock, g_get_monotonic_time() + SPOOL_POLL_MS * G_TIME_SPAN_MILLISECOND);
+            continue;
+        }
+
+        sp->busy = TRUE;
+
+        g_mutex_unlock(&sp->lock);
+
+        gboolean ok = TRUE;
+        GstFlowReturn ret = GST_FLOW_OK;
+
+        if (rec->event) {
+            ok = gst_pad_send_event(sp->sinkpad, rec->event);
+            rec->event = NULL;
+        } else {
+            GstBuffer *buf = spool_read(sp, rec);
+            ret = (buf ? gst_pad_chain(sp->sinkpad, buf) : GST_FLOW_ERROR);
+        }
+
+        g_mutex_lock(&sp->lock);
+
+        sp->busy = FALSE;
+        sp->metrics.drained_bytes += rec->size;
+        sp->metrics.pending_bytes -= MIN(rec->size, sp->metrics.pending_bytes);
+        if (GST_CLOCK_TIME_IS_VALID(rec->duration)) {
+            sp->metrics.pending_time -= MIN(rec->duration, sp->metrics.pending_time);
+        }
+
+        spool_rec_free(rec);
+
+        if (ret != GST_FLOW_OK || !ok) {
+            // Pipeline is stopping (or failed). The rest cannot be delivered.
+            LOG_SPOOL("Spool of %s stopped (%s). %" G_GUINT64_FORMAT " bytes dropped.\n", GST_ELEMENT_NAME(sp->queue),
+                      gst_flow_get_name(ret), sp->metrics.pending_bytes);
+            spool_clear(sp);
+        }
+
+        g_cond_broadcast(&sp->cond);
+    }
+
+    g_mutex_unlock(&sp->lock);
+
+    return NULL;
+}
+
+static GstPadProbeReturn spool_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    // Runs in the upstream streaming thread. The probe is on the pad that feeds the queue,
+    // so it never waits for the queue's stream lock (which the drainer holds while the queue is full).
+    Spool *sp = (Spool*)user_data;
+
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+        if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP) {
+            g_mutex_lock(&sp->lock);
+            spool_clear(sp);
+            g_mutex_unlock(&sp->lock);
+            return GST_PAD_PROBE_OK;
+        }
+
+        if (!GST_EVENT_IS_SERIALIZED(event)) return GST_PAD_PROBE_OK;
+
+        g_mutex_lock(&sp->lock);
+
+        if (!sp->active) {
+            g_mutex_unlock(&sp->lock);
+            return GST_PAD_PROBE_OK;
+        }
+
+        // Keep the event in order with the spooled buffers (eg. EOS)
+        spool_add(sp, NULL, gst_event_ref(event));
+
+        g_mutex_unlock(&sp->lock);
+        return GST_PAD_PROBE_DROP;
+    }
+
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    g_mutex_lock(&sp->lock);
+
+    if (!sp->active) {
+        if (spool_queue_fill(sp) < SPOOL_HIGH_WATER) {
+            g_mutex_unlock(&sp->lock);
+            return GST_PAD_PROBE_OK;
+        }
+
+        sp->active = TRUE;
+        sp->active_since = g_get_monotonic_time();
+        sp->metrics.active = TRUE;
+        sp->metrics.activations++;
+
+        LOG_SPOOL("Queue %s is full. Spooling to disk.\n", GST_ELEMENT_NAME(sp->queue));
+    }
+
+    spool_add(sp, buf, NULL);
+
+    g_mutex_unlock(&sp->lock);
+
+    return GST_PAD_PROBE_DROP;
+}
+
+static void spool_free(Spool *sp) {
+    // Called when the queue is finalized
+    g_mutex_lock(&sp->lock);
+    sp->quit = TRUE;
+    g_cond_broadcast(&sp->cond);
+    g_mutex_unlock(&sp->lock);
+
+    if (sp->thread) {
+        g_thread_join(sp->thread);
+    }
+
+    if (sp->peer) {
+        gst_pad_remove_probe(sp->peer, sp->probe_id);
+        gst_object_unref(sp->peer);
+    }
+    gst_object_unref(sp->sinkpad);
+
+    g_queue_foreach(&sp->recs, (GFunc)spool_rec_free, NULL);
+    g_queue_clear(&sp->recs);
+
+    if (sp->fd != -1) {
+        close(sp->fd);
+    }
+    g_free(sp->path);
+
+    g_mutex_clear(&sp->lock);
+    g_cond_clear(&sp->cond);
+
+    g_free(sp);
+}
+
+void spool_attach(GstElement *queue) {
+    // Add a spool in front of queue. The queue must be linked.
+    if (!GST_IS_ELEMENT(queue)) return;
+
+    // Already has a spool?
+    if (g_object_get_data(G_OBJECT(queue), SPOOL_KEY)) return;
+
+    GstPad *sinkpad = gst_element_get_static_pad(queue, "sink");
+    GstPad *peer = (sinkpad ? gst_pad_get_peer(sinkpad) : NULL);
+    if (!peer) {
+        LOG_ERROR("Cannot add spool to %s. The queue is not linked.\n", GST_ELEMENT_NAME(queue));
+        if (sinkpad) gst_object_unref(sinkpad);
+        return;
+    }
+
+    Spool *sp = g_malloc0(sizeof(Spool));
+    sp->queue = queue;
+    sp->sinkpad = sinkpad;
+    sp->peer = peer;
+    sp->fd = -1;
+
+    g_mutex_init(&sp->lock);
+    g_cond_init(&sp->cond);
+    g_queue_init(&sp->recs);
+
+    sp->thread = g_thread_new("spool", spool_drain_thread, sp);
+
+    g_object_set_data_full(G_OBJECT(queue), SPOOL_KEY, sp, (GDestroyNotify)spool_free);
+
+    sp->probe_id = gst_pad_add_probe(peer, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+                                     spool_probe, sp, NULL);
+}
+
+static Spool *spool_get(GstElement *queue) {
+    if (!GST_IS_ELEMENT(queue)) return NULL;
+    return (Spool*)g_object_get_data(G_OBJECT(queue), SPOOL_KEY);
+}
+
+gboolean spool_get_metrics(GstElement *queue, SpoolMetrics *m) {
+    Spool *sp = spool_get(queue);
+    if (!sp) return FALSE;
+
+    g_mutex_lock(&sp->lock);
+
+    *m = sp->metrics;
+
+    // Current stall counts too
+    if (sp->active) {
+        gdouble stall = (g_get_monotonic_time() - sp->active_since) / 1000.0;
+        m->max_stall_ms = MAX(m->max_stall_ms, stall);
+    }
+
+    g_mutex_unlock(&sp->lock);
+
+    return TRUE;
+}
+
+gboolean spool_drain(GstElement *queue, guint timeout_ms) {
+    // Wait until all spooled data is in the queue
+    Spool *sp = spool_get(queue);
+    if (!sp) return TRUE;
+
+    gint64 end_time = g_get_monotonic_time() + timeout_ms * G_TIME_SPAN_MILLISECOND;
+
+    g_mutex_lock(&sp->lock);
+
+    gboolean empty = (g_queue_is_empty(&sp->recs) && !sp->busy);
+    while (!empty) {
+        if (!g_cond_wait_until(&sp->cond, &sp->lock, end_time)) break;
+        empty = (g_queue_is_empty(&sp->recs) && !sp->busy);
+    }
+
+    if (!empty) {
+        LOG_ERROR("Spool of %s not drained in %u ms. %" G_GUINT64_FORMAT " bytes left.\n",
+                  GST_ELEMENT_NAME(queue), timeout_ms, sp->metrics.pending_bytes);
+    }
+
+    g_mutex_unlock(&sp->lock);
+
+    return empty;
+}
+
+void spool_reset(GstElement *queue) {
+    // Forget spooled data and metrics
+    Spool *sp = spool_get(queue);
+    if (!sp) return;
+
+    g_mutex_lock(&sp->lock);
+    spool_clear(sp);
+    memset(&sp->metrics, 0, sizeof(SpoolMetrics));
+    g_mutex_unlock(&sp->lock);
+}
@@ -0,0 +1,44 @@
+#ifndef _GST_SPOOL_H
+#define _GST_SPOOL_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-spool.c.
+//#define DEBUG_SPOOL
+
+#if defined(DEBUG_SPOOL) || defined(DEBUG_ALL)
+#define LOG_SPOOL LOG_MSG
+#else
+#define LOG_SPOOL(x, ...)
+#endif
+
+typedef struct {
+    gboolean active;          // Spilling now?
+    guint activations;        // How many times the spool has been activated
+
+    guint64 spooled_bytes;    // Total bytes written to the spool
+    guint64 drained_bytes;    // Total bytes pushed back to the queue
+    guint64 pending_bytes;    // Bytes in the spool now
+    guint64 peak_bytes;       // Largest spool size
+    guint64 dropped_bytes;    // Bytes dropped (spool file failed and the memory was full)
+
+    GstClockTime pending_time; // Audio time in the spool now
+
+    gdouble max_stall_ms;     // Longest time the spool was active (a stall the queue alone could not absorb)
+} SpoolMetrics;
+
+// Add a disk-backed spool in front of queue. When the queue is nearly full, buffers are written to a temporary
+// file instead of blocking the upstream thread. They are pushed back in order when the queue has room.
+void spool_attach(GstElement *queue);
+
+// Metrics of the spool of queue. Return FALSE if queue has no spool.
+gboolean spool_get_metrics(GstElement *queue, SpoolMetrics *m);
+
+// Wait (max timeout_ms) until the spool of queue is empty. Return TRUE if it is empty.
+gboolean spool_drain(GstElement *queue, guint timeout_ms);
+
+// Forget spooled data and metrics (a new recording starts)
+void spool_reset(GstElement *queue);
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+
+#include "gst-stall.h"
+#include "gst-pipeline.h"
+#include "dbus-server.h"
+#include "log.h"
+#include "support.h"
+
+// Disk-stall isolation.
+//
+// If the audio folder is on NFS or a USB disk, a write can stall for seconds. In a linear pipeline the stall
+// blocks the encoder and then the capture thread, and live audio is lost. The file sink is therefore behind
+// a queue (PIPELINE_SINK_QUEUE, see pipeline_create_sink()):
+//  1. The queue is a memory ring of "stall-buffer-size" MB. Short stalls are absorbed there.
+//  2. Near its limit, the overflow goes to a spool file in the local temp directory (gst-spool.c).
+//     The encoder and the capture never block.
+//  3. When the disk recovers, the spool drains into the queue in order.
+//
+// Metrics (longest stall, ring and spool size, drained bytes) are logged, sent as DBus events
+// ("disk-stall", "disk-recovered") and returned by stall_get_metrics().
+
+// Check the sink queue this often
+#define STALL_POLL_MS 250
+
+// The sink is behind if the ring holds more than this
+#define STALL_LEVEL_BYTES (256 * 1024)
+
+// Report stalls longer than this
+#define STALL_REPORT_MS 1000
+
+// Max. time to wait for the buffered data at the end of a recording
+#define STALL_DRAIN_TIMEOUT_MS 30000
+
+static GstElement *g_sinkqueue = NULL;
+static guint g_poll_id = 0;
+
+static StallMetrics g_metrics;
+static gboolean g_have_metrics = FALSE;
+
+static gint64 g_stall_since = 0;
+static gboolean g_reported = FALSE;
+
+// Set when EOS has left the sink queue (see stall_prepare_stop())
+static GMutex g_drain_lock;
+static GCond g_drain_cond;
+static gboolean g_drained = FALSE;
+
+static void stall_event(const gchar *name, gchar *detail) {
+    // Log and tell DBus clients. Takes detail.
+    LOG_MSG("Disk stall: %s\n", detail);
+
+    dbus_service_emit_event(name, detail);
+    g_free(detail);
+}
+
+static void stall_update() {
+    // Read the ring and spool levels. Start or end a stall.
+    guint bytes = 0;
+    g_object_get(G_OBJECT(g_sinkqueue), "current-level-bytes", &bytes, NULL);
+
+    SpoolMetrics sm;
+    memset(&sm, 0, sizeof(sm));
+    spool_get_metrics(g_sinkqueue, &sm);
+
+    g_metrics.ring_bytes = bytes;
+    g_metrics.ring_peak_bytes = MAX(g_metrics.ring_peak_bytes, bytes);
+    g_metrics.spool = sm;
+    g_metrics.max_stall_ms = MAX(g_metrics.max_stall_ms, sm.max_stall_ms);
+
+    gboolean behind = (bytes > STALL_LEVEL_BYTES || sm.active || sm.pending_bytes);
+    gint64 now = g_get_monotonic_time();
+
+    if (behind && !g_metrics.stalled) {
+        g_metrics.stalled = TRUE;
+        g_metrics.stalls++;
+        g_stall_since = now;
+        g_reported = FALSE;
+
+        LOG_STALL("Sink is behind. %u bytes in the ring.\n", bytes);
+    }
+
+    if (!g_metrics.stalled) return;
+
+    gdouble stall = (now - g_stall_since) / 1000.0;
+    g_metrics.max_stall_ms = MAX(g_metrics.max_stall_ms, stall);
+
+    if (behind && !g_reported && stall >= STALL_REPORT_MS) {
+        g_reported = TRUE;
+
+        stall_event("disk-stall", g_strdup_printf("Writing to the audio folder has stalled. Buffering %.1f MB in memory, %.1f MB in the spool file.",
+                    bytes / (1024.0 * 1024.0), sm.pending_bytes / (1024.0 * 1024.0)));
+
+    } else if (!behind) {
+        g_metrics.stalled = FALSE;
+
+        if (g_reported) {
+            stall_event("disk-recovered", g_strdup_printf("Disk caught up after %.0f ms. Longest stall %.0f ms, %.1f MB drained from the spool file.",
+                        stall, g_metrics.max_stall_ms, sm.drained_bytes / (1024.0 * 1024.0)));
+        }
+
+        LOG_STALL("Sink caught up after %.1f ms.\n", stall);
+    }
+}
+
+static gboolean stall_poll_cb(gpointer user_data) {
+    if (!g_sinkqueue) {
+        g_poll_id = 0;
+        return FALSE;
+    }
+
+    stall_update();
+
+    return TRUE;
+}
+
+void stall_set_pipeline(GstElement *pipeline) {
+    // Watch the sink queue of pipeline (or stop watching if NULL). The metrics are kept until the next recording.
+    if (g_poll_id) {
+        g_source_remove(g_poll_id);
+    }
+    g_poll_id = 0;
+
+    if (g_sinkqueue) {
+        gst_object_unref(g_sinkqueue);
+    }
+    g_sinkqueue = NULL;
+
+    if (!GST_IS_BIN(pipeline)) return;
+
+    g_sinkqueue = gst_bin_get_by_name(GST_BIN(pipeline), PIPELINE_SINK_QUEUE);
+    if (!g_sinkqueue) return;
+
+    memset(&g_metrics, 0, sizeof(g_metrics));
+    g_have_metrics = TRUE;
+    g_stall_since = 0;
+    g_reported = FALSE;
+
+    // A reused pipeline keeps its spool; forget data of the last recording
+    spool_attach(g_sinkqueue);
+    spool_reset(g_sinkqueue);
+
+    g_poll_id = g_timeout_add(STALL_POLL_MS, stall_poll_cb, NULL);
+}
+
+static GstPadProbeReturn stall_eos_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    // Streaming thread of the sink queue
+    if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_EOS) {
+        g_mutex_lock(&g_drain_lock);
+        g_drained = TRUE;
+        g_cond_broadcast(&g_drain_cond);
+        g_mutex_unlock(&g_drain_lock);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void stall_prepare_stop(GstElement *pipeline) {
+    // EOS has been sent. Let the spool and the ring reach the file before the pipeline is shut down.
+    // This blocks the caller. A normal stop does not call it; it waits for the EOS message in the main loop
+    // (see rec_stop_recording_async()). Only a stop that must complete at once (new recording, quit) waits here.
+    if (!GST_IS_BIN(pipeline)) return;
+
+    GstElement *queue = gst_bin_get_by_name(GST_BIN(pipeline), PIPELINE_SINK_QUEUE);
+    if (!queue) return;
+
+    if (queue == g_sinkqueue) {
+        stall_update();
+    }
+
+    guint bytes = 0;
+    g_object_get(G_OBJECT(queue), "current-level-bytes", &bytes, NULL);
+
+    SpoolMetrics sm;
+    memset(&sm, 0, sizeof(sm));
+    spool_get_metrics(queue, &sm);
+
+    if (bytes > STALL_LEVEL_BYTES || sm.pending_bytes) {
+        LOG_MSG("Disk stall: Writing %.1f MB of buffered audio.\n", (bytes + sm.pending_bytes) / (1024.0 * 1024.0));
+    }
+
+    // Nothing buffered. Do not wait (a paused pipeline passes no EOS).
+    if (!(bytes || sm.pending_bytes)) goto LBL_1;
+
+    // The spool feeds the queue in order, so EOS leaves the queue after all buffered audio.
+    // Wait for it (no polling). The pad probe wakes us up.
+    gint64 t0 = g_get_monotonic_time();
+    gint64 end_time = t0 + STALL_DRAIN_TIMEOUT_MS * G_TIME_SPAN_MILLISECOND;
+
+    GstPad *pad = gst_element_get_static_pad(queue, "src");
+
+    g_mutex_lock(&g_drain_lock);
+    g_drained = FALSE;
+    g_mutex_unlock(&g_drain_lock);
+
+    gulong probe_id = gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, stall_eos_probe, NULL, NULL);
+
+    // EOS passed before the probe? It is sticky.
+    GstEvent *eos = gst_pad_get_sticky_event(pad, GST_EVENT_EOS, 0);
+
+    g_mutex_lock(&g_drain_lock);
+
+    gboolean drained = (eos != NULL || g_drained);
+    while (!drained) {
+        if (!g_cond_wait_until(&g_drain_cond, &g_drain_lock, end_time)) break;
+        drained = g_drained;
+    }
+
+    g_mutex_unlock(&g_drain_lock);
+
+    gst_pad_remove_probe(pad, probe_id);
+
+    if (eos) {
+        gst_event_unref(eos);
+    }
+    gst_object_unref(pad);
+
+    if (!drained) {
+        g_object_get(G_OBJECT(queue), "current-level-bytes", &bytes, NULL);
+        LOG_ERROR("Disk stall: EOS not written in %d ms. %u bytes left in memory.\n", STALL_DRAIN_TIMEOUT_MS, bytes);
+    } else {
+        LOG_STALL("Sink queue drained in %.1f ms.\n", (g_get_monotonic_time() - t0) / 1000.0);
+    }
+
+LBL_1:
+    if (queue == g_sinkqueue) {
+        stall_update();
+
+        if (g_metrics.stalls) {
+            LOG_MSG("Disk stall: %u stalls, longest %.0f ms. Ring peak %.1f MB. Spool used %u times, peak %.1f MB, %.1f MB drained.\n",
+                    g_metrics.stalls, g_metrics.max_stall_ms, g_metrics.ring_peak_bytes / (1024.0 * 1024.0),
+                    g_metrics.spool.activations, g_metrics.spool.peak_bytes / (1024.0 * 1024.0),
+                    g_metrics.spool.drained_bytes / (1024.0 * 1024.0));
+        }
+
+        if (g_metrics.spool.dropped_bytes) {
+            LOG_ERROR("Disk stall: %.1f MB of audio dropped. The spool file failed and the memory was full.\n",
+                      g_metrics.spool.dropped_bytes / (1024.0 * 1024.0));
+        }
+    }
+
+    gst_object_unref(queue);
+}
+
+gboolean stall_get_metrics(StallMetrics *m) {
+    if (!g_have_metrics) return FALSE;
+
+    if (g_sinkqueue) {
+        stall_update();
+    }
+
+    *m = g_metrics;
+    return TRUE;
+}
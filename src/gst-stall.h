@@ -0,0 +1,39 @@
+#ifndef _GST_STALL_H
+#define _GST_STALL_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "gst-spool.h"
+
+// Uncomment this to show debug messages from gst-stall.c.
+//#define DEBUG_STALL
+
+#if defined(DEBUG_STALL) || defined(DEBUG_ALL)
+#define LOG_STALL LOG_MSG
+#else
+#define LOG_STALL(x, ...)
+#endif
+
+typedef struct {
+    gboolean stalled;         // Sink is behind now?
+    guint stalls;             // How many times the sink has stalled
+    gdouble max_stall_ms;     // Longest stall absorbed by the memory ring and the spool
+
+    guint64 ring_bytes;       // Bytes in the memory ring (sink queue) now
+    guint64 ring_peak_bytes;  // Largest ring level
+
+    SpoolMetrics spool;       // Overflow written to the local spool file (spool size, drained bytes...)
+} StallMetrics;
+
+// Watch the file sink of the running recording pipeline (or stop watching if NULL).
+// Disk stalls are absorbed in memory, then in a spool file, so they never block the capture.
+void stall_set_pipeline(GstElement *pipeline);
+
+// Recording is being stopped (EOS has been sent). Block until the buffered data has reached the file (or a timeout).
+void stall_prepare_stop(GstElement *pipeline);
+
+// Metrics of the running (or the last) recording. Return FALSE if there is none.
+gboolean stall_get_metrics(StallMetrics *m);
+
+#endif
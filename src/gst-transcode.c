@@ -0,0 +1,486 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <glib/gstdio.h>
+
+#include "gst-transcode.h"
+#include "media-profiles.h"
+#include "gst-rf64.h"
+#include "gst-seek.h"
+#include "gst-checksum.h"
+#include "gst-retention.h"
+#include "log.h"
+#include "dconf.h"
+#include "utility.h"
+#include "support.h"
+
+// Deferred transcoding.
+//
+// Long recordings on weak hardware can be captured to a cheap format (see "deferred-transcode" setting and
+// rec_get_profile_id() in gst-recorder.c) and converted to the selected profile afterwards.
+// A pool of worker threads runs the conversions at low CPU and I/O priority:
+//   filesrc ! decodebin ! audioconvert ! audioresample ! <profile> ! filesink
+//
+// Output goes to "<name>.<ext>.part" and is renamed when complete. A file whose output is newer than itself
+// is already converted and skipped, so jobs can be repeated safely.
+// Queued jobs are saved in the "transcode-pending" setting until they are done.
+
+// Nice value of the workers
+#define TRANSCODE_NICE 10
+
+// Workers check for abort this often
+#define TRANSCODE_POLL_MS 200
+
+typedef struct {
+    gchar *src;
+    gchar *dest;
+    gchar *profile_id;
+    gchar *profile_str;
+    gboolean keep;
+
+    // Job is in the "transcode-pending" list
+    gboolean persist;
+
+    gboolean ok;
+    gboolean aborted;
+} TranscodeJob;
+
+typedef struct {
+    gint converted;
+    gint skipped;
+    gint failed;
+} TranscodeStats;
+
+// Pool for jobs queued after recording
+static GThreadPool *g_transcode_pool = NULL;
+
+// Program is exiting. Abort running jobs.
+static gint g_transcode_quit = 0;
+
+static void transcode_job_free(TranscodeJob *job) {
+    g_free(job->src);
+    g_free(job->dest);
+    g_free(job->profile_id);
+    g_free(job->profile_str);
+    g_free(job);
+}
+
+static TranscodeJob *transcode_job_new(const gchar *filename, const gchar *profile_id, gboolean keep) {
+    // Create job. Return NULL if the profile is not valid or the file is already in the target format.
+    // Must be called in the main thread (media profiles are not thread safe).
+    if (!profiles_check_id(profile_id)) {
+        LOG_ERROR("Cannot convert %s. Unknown profile \"%s\".\n", filename, profile_id);
+        return NULL;
+    }
+
+    gchar *ext = profiles_get_extension(profile_id);
+
+    gchar *path = NULL;
+    gchar *base = NULL;
+    gchar *src_ext = NULL;
+    split_filename3((gchar*)filename, &path, &base, &src_ext);
+
+    TranscodeJob *job = NULL;
+
+    if (!base || !g_strcmp0(ext, src_ext)) {
+        goto LBL_1;
+    }
+
+    job = g_malloc0(sizeof(TranscodeJob));
+    job->src = g_strdup(filename);
+    job->dest = g_strdup_printf("%s%s.%s", (path ? path : ""), base, ext);
+    job->profile_id = g_strdup(profile_id);
+
+    // WAV beyond 4 GB is written as RF64
+    gchar *profile_str = profiles_get_pipeline(profile_id);
+    job->profile_str = rf64_adapt_profile(profile_str);
+    g_free(profile_str);
+
+    job->keep = keep;
+
+LBL_1:
+    g_free(ext);
+    g_free(path);
+    g_free(base);
+    g_free(src_ext);
+
+    return job;
+}
+
+static gboolean transcode_is_done(TranscodeJob *job) {
+    // Output exists and is newer than the source?
+    GStatBuf src_st;
+    GStatBuf dest_st;
+
+    if (g_stat(job->dest, &dest_st) != 0 || dest_st.st_size == 0) return FALSE;
+
+    // Source was deleted after an earlier conversion
+    if (g_stat(job->src, &src_st) != 0) return TRUE;
+
+    return (dest_st.st_mtime >= src_st.st_mtime);
+}
+
+static gboolean transcode_run(TranscodeJob *job, gchar **err_msg) {
+    // Convert job->src to job->dest. Runs in a worker thread.
+    gchar *str = g_strdup_printf("filesrc name=src ! decodebin ! audioconvert ! audioresample ! "
+                                 "capsfilter caps=%s ! filesink name=sink", job->profile_str);
+
+    gchar *part = g_strdup_printf("%s.part", job->dest);
+
+    gboolean ok = FALSE;
+
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(str, &error);
+    if (error) {
+        *err_msg = g_strdup_printf(_("Cannot create audio pipeline. %s.\n"), error->message);
+        g_error_free(error);
+
+        if (pipeline) gst_object_unref(pipeline);
+        goto LBL_1;
+    }
+
+    GstElement *src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    g_object_set(G_OBJECT(src), "location", job->src, NULL);
+    g_object_set(G_OBJECT(sink), "location", part, NULL);
+    gst_object_unref(src);
+    gst_object_unref(sink);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    GstBus *bus = gst_element_get_bus(pipeline);
+
+    while (TRUE) {
+        if (g_atomic_int_get(&g_transcode_quit)) {
+            job->aborted = TRUE;
+            break;
+        }
+
+        GstMessage *msg = gst_bus_timed_pop_filtered(bus, TRANSCODE_POLL_MS * GST_MSECOND, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+        if (!msg) continue;
+
+        if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS) {
+            ok = TRUE;
+        } else {
+            GError *err = NULL;
+            gst_message_parse_error(msg, &err, NULL);
+            *err_msg = g_strdup(err ? err->message : "");
+            if (err) g_error_free(err);
+        }
+
+        gst_message_unref(msg);
+        break;
+    }
+
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    if (ok && g_rename(part, job->dest) != 0) {
+        *err_msg = g_strdup_printf("Cannot rename %s. %s", part, g_strerror(errno));
+        ok = FALSE;
+    }
+
+LBL_1:
+    if (!ok) {
+        g_remove(part);
+    }
+
+    g_free(part);
+    g_free(str);
+
+    return ok;
+}
+
+static void transcode_pending_update(TranscodeJob *job, gboolean add) {
+    // Add job to, or remove it from the "transcode-pending" setting. Main thread only.
+    gchar *entry = g_strdup_printf("%d\t%s\t%s", (job->keep ? 1 : 0), job->profile_id, job->src);
+
+    GList *list = NULL;
+    conf_get_string_list("transcode-pending", &list);
+
+    GList *n = g_list_find_custom(list, entry, (GCompareFunc)g_strcmp0);
+    if (n) {
+        g_free(n->data);
+        list = g_list_delete_link(list, n);
+    }
+
+    if (add) {
+        list = g_list_append(list, g_strdup(entry));
+    }
+
+    conf_save_string_list("transcode-pending", list);
+
+    str_list_free(list);
+    g_free(entry);
+}
+
+static gboolean transcode_job_done_cb(gpointer user_data) {
+    // Job of the background pool has finished. Runs in the main loop.
+    TranscodeJob *job = (TranscodeJob*)user_data;
+
+    // An aborted job is resumed at next start
+    if (!job->aborted) {
+        transcode_pending_update(job, FALSE);
+    }
+
+    transcode_job_free(job);
+    return FALSE;
+}
+
+static void transcode_worker(gpointer data, gpointer user_data) {
+    // Run one job. Runs in a worker thread.
+    TranscodeJob *job = (TranscodeJob*)data;
+    TranscodeStats *stats = (TranscodeStats*)user_data;
+
+    // Threads it creates (GStreamer's streaming threads) inherit the priority
+    lower_thread_priority(TRANSCODE_NICE);
+
+    gchar *err_msg = NULL;
+    gint64 t0 = g_get_monotonic_time();
+
+    if (g_atomic_int_get(&g_transcode_quit)) {
+        job->aborted = TRUE;
+
+    } else if (transcode_is_done(job)) {
+        LOG_TRANSCODE("%s is already converted.\n", job->dest);
+        job->ok = TRUE;
+        if (stats) g_atomic_int_inc(&stats->skipped);
+
+    } else {
+        job->ok = transcode_run(job, &err_msg);
+
+        if (job->ok) {
+            LOG_MSG("Converted %s to %s in %.1f s.\n", job->src, job->dest, (g_get_monotonic_time() - t0) / (gdouble)G_USEC_PER_SEC);
+            if (stats) g_atomic_int_inc(&stats->converted);
+
+        } else if (!job->aborted) {
+            LOG_ERROR("Cannot convert %s. %s\n", job->src, (err_msg ? err_msg : ""));
+            if (stats) g_atomic_int_inc(&stats->failed);
+        }
+    }
+
+    // Replace the source with the converted file?
+    gboolean removed = FALSE;
+    if (job->ok && !job->keep && g_file_test(job->src, G_FILE_TEST_EXISTS)) {
+        removed = !g_remove(job->src);
+        seek_index_remove(job->src);
+        checksum_remove(job->src);
+    }
+
+    // The converted file takes the place of the source in the retention index
+    if (job->ok) {
+        retention_file_converted(job->src, job->dest, removed);
+    }
+
+    g_free(err_msg);
+
+    if (job->persist) {
+        g_idle_add(transcode_job_done_cb, job);
+    } else {
+        transcode_job_free(job);
+    }
+}
+
+static gint transcode_threads() {
+    // Number of workers. Setting "transcode-threads" (0 = all cores but one).
+    gint n = 0;
+    conf_get_int_value("transcode-threads", &n);
+
+    if (n <= 0) {
+        n = MAX((gint)g_get_num_processors() - 1, 1);
+    }
+    return n;
+}
+
+static GThreadPool *transcode_new_pool(gpointer user_data) {
+    // Exclusive threads. Shared GThreadPool threads would carry the low priority to other pools (eg. GStreamer's).
+    GError *error = NULL;
+    GThreadPool *pool = g_thread_pool_new(transcode_worker, user_data, transcode_threads(), TRUE, &error);
+    if (error) {
+        LOG_ERROR("Cannot create transcode workers. %s\n", error->message);
+        g_error_free(error);
+    }
+    return pool;
+}
+
+void transcode_module_init() {
+    LOG_DEBUG("Init gst-transcode.c.\n");
+
+    g_transcode_pool = NULL;
+    g_atomic_int_set(&g_transcode_quit, 0);
+}
+
+void transcode_module_exit() {
+    LOG_DEBUG("Clean up gst-transcode.c.\n");
+
+    if (!g_transcode_pool) return;
+
+    // Abort running jobs. Unfinished jobs stay in "transcode-pending".
+    g_atomic_int_set(&g_transcode_quit, 1);
+
+    g_thread_pool_free(g_transcode_pool, TRUE, TRUE);
+    g_transcode_pool = NULL;
+}
+
+static void transcode_push(TranscodeJob *job) {
+    // Start the background pool when needed
+    if (!g_transcode_pool) {
+        g_transcode_pool = transcode_new_pool(NULL);
+    }
+
+    if (!g_transcode_pool) {
+        transcode_job_free(job);
+        return;
+    }
+
+    job->persist = TRUE;
+    g_thread_pool_push(g_transcode_pool, job, NULL);
+}
+
+void transcode_queue(const gchar *filename, const gchar *profile_id, gboolean keep) {
+    // Convert filename in the background
+    TranscodeJob *job = transcode_job_new(filename, profile_id, keep);
+    if (!job) return;
+
+    LOG_MSG("Queued %s for conversion to %s.\n", job->src, job->dest);
+
+    transcode_pending_update(job, TRUE);
+    transcode_push(job);
+}
+
+void transcode_resume() {
+    // Queue jobs that were not finished when the program last exited
+    GList *list = NULL;
+    conf_get_string_list("transcode-pending", &list);
+
+    GList *n = g_list_first(list);
+    while (n) {
+        gchar **parts = g_strsplit((gchar*)n->data, "\t", 3);
+
+        if (g_strv_length(parts) == 3) {
+            TranscodeJob *job = transcode_job_new(parts[2], parts[1], !g_strcmp0(parts[0], "1"));
+            if (job) {
+                LOG_MSG("Resuming conversion of %s.\n", job->src);
+                transcode_push(job);
+            }
+        }
+
+        g_strfreev(parts);
+        n = g_list_next(n);
+    }
+
+    str_list_free(list);
+}
+
+GList *transcode_pending_files() {
+    // Source files of the queued and running jobs (see the "transcode-pending" setting)
+    GList *files = NULL;
+
+    GList *list = NULL;
+    conf_get_string_list("transcode-pending", &list);
+
+    GList *n = g_list_first(list);
+    while (n) {
+        gchar **parts = g_strsplit((gchar*)n->data, "\t", 3);
+
+        if (g_strv_length(parts) == 3) {
+            files = g_list_append(files, g_strdup(parts[2]));
+        }
+
+        g_strfreev(parts);
+        n = g_list_next(n);
+    }
+
+    str_list_free(list);
+
+    // Caller should free the list with str_list_free()
+    return files;
+}
+
+gint transcode_folder(const gchar *folder, const gchar *profile_id, gboolean keep) {
+    // Convert all recordings in folder to profile_id. Blocks until done.
+    if (!g_file_test(folder, G_FILE_TEST_IS_DIR)) {
+        LOG_ERROR("Cannot find folder %s.\n", folder);
+        return -1;
+    }
+
+    if (!profiles_check_id(profile_id)) {
+        LOG_ERROR("Unknown profile \"%s\".\n", profile_id);
+        return -1;
+    }
+
+    TranscodeStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    GThreadPool *pool = transcode_new_pool(&stats);
+    if (!pool) return -1;
+
+    // Extensions of all profiles
+    GList *exts = NULL;
+    GList *item = g_list_first(profiles_get_list());
+    while (item) {
+        ProfileRec *rec = (ProfileRec*)item->data;
+        if (rec->ext && !g_list_find_custom(exts, rec->ext, (GCompareFunc)g_strcmp0)) {
+            exts = g_list_append(exts, rec->ext);
+        }
+        item = g_list_next(item);
+    }
+
+    guint queued = 0;
+
+    GList *e = g_list_first(exts);
+    while (e) {
+        gchar *pattern = g_strdup_printf("*.%s", (gchar*)e->data);
+        GList *files = get_directory_listing((gchar*)folder, pattern);
+
+        GList *f = g_list_first(files);
+        while (f) {
+            TranscodeJob *job = transcode_job_new((gchar*)f->data, profile_id, keep);
+            if (job) {
+                g_thread_pool_push(pool, job, NULL);
+                queued++;
+            }
+            f = g_list_next(f);
+        }
+
+        str_list_free(files);
+        g_free(pattern);
+
+        e = g_list_next(e);
+    }
+
+    g_list_free(exts);
+
+    g_print("Converting %u files in %s to \"%s\" with %d workers.\n", queued, folder, profile_id, transcode_threads());
+
+    gint64 t0 = g_get_monotonic_time();
+
+    // Wait for all jobs
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    g_print("Converted %d, already done %d, failed %d in %.1f s.\n", stats.converted, stats.skipped, stats.failed,
+            (g_get_monotonic_time() - t0) / (gdouble)G_USEC_PER_SEC);
+
+    return stats.failed;
+}
@@ -0,0 +1,36 @@
+#ifndef _GST_TRANSCODE_H
+#define _GST_TRANSCODE_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+// Uncomment this to show debug messages from gst-transcode.c.
+//#define DEBUG_TRANSCODE
+
+#if defined(DEBUG_TRANSCODE) || defined(DEBUG_ALL)
+#define LOG_TRANSCODE LOG_MSG
+#else
+#define LOG_TRANSCODE(x, ...)
+#endif
+
+void transcode_module_init();
+
+// Abort running jobs (they are resumed at next start) and stop the workers
+void transcode_module_exit();
+
+// Convert filename to profile_id in the background. If keep is FALSE, filename is deleted after a successful conversion.
+// The job is saved in settings until it is done, so it survives a restart (see transcode_resume()).
+void transcode_queue(const gchar *filename, const gchar *profile_id, gboolean keep);
+
+// Queue the jobs that were not finished when the program last exited
+void transcode_resume();
+
+// Source files of the queued and running jobs. Main thread only. Free the list with str_list_free().
+GList *transcode_pending_files();
+
+// Convert all recordings in folder to profile_id with a pool of workers. Blocks until done.
+// Files that are already converted are skipped, so an interrupted run can simply be started again.
+// Return the number of failed files.
+gint transcode_folder(const gchar *folder, const gchar *profile_id, gboolean keep);
+
+#endif
@@ -112,8 +112,22 @@ void vad_start_VAD() {
     }
 
     // Changed?
+    if (changed && vad_is_running()) {
+        // Yes. Swap only the sources that changed. The pipeline keeps running.
+        gchar *err_msg = NULL;
+        if (pipeline_reconfigure(g_vad_pipeline, parms, &err_msg)) {
+            vad_save_parms(parms);
+            return;
+        }
+
+        if (err_msg) {
+            LOG_ERROR("%s", err_msg);
+            g_free(err_msg);
+        }
+    }
+
     if (changed) {
-        // Yes, stop VAD.
+        // Stop VAD. Create it again.
         vad_stop_VAD();
     }
 
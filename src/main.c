@@ -21,19 +21,34 @@
 #include <string.h>
 #include <math.h> // round()
 #include <locale.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
 
 #include <gst/pbutils/pbutils.h>
 
 #include "levelbar.h" // Level bar widget
 #include "support.h"
 #include "audio-sources.h"
+#include "gst-devices.h"
+#include "gst-capture.h"
+#include "gst-pipeline.h"
+#include "gst-bench.h"
+#include "gst-transcode.h"
+#include "gst-recovery.h"
+#include "gst-filesink.h"
+#include "gst-seek.h"
+#include "gst-checksum.h"
+#include "gst-encrypt.h"
 #include "rec-window.h"
 #include "dbus-server.h"
+#include "socket-server.h"
 #include "audio-sources.h"
 #include "media-profiles.h"
 #include "timer.h"
 #include "rec-manager.h"
 #include "utility.h"
+#include "proc-info.h"
 #include "dconf.h"
 #include "log.h"
 #include "settings.h"
@@ -51,6 +66,26 @@ static gint g_show_tray_icon = -1;  // Show/hide tray icon
 static gint g_reset_settings = -1;  // Reset all settings then restart
 static gint g_debug_threshold = -1; // Output RMS threshold value?
 static gchar *g_command_arg = NULL; // Argument of --command (-c)
+static gchar *g_benchmark_arg = NULL; // Argument of --benchmark (hidden option)
+static gchar *g_convert_arg = NULL;   // Folder of --convert
+static gchar *g_convert_profile = NULL; // Profile id of --convert-profile
+static gboolean g_convert_replace = FALSE; // Delete the originals after --convert
+static gchar *g_verify_arg = NULL;    // File of --verify
+static gchar *g_decrypt_arg = NULL;   // File of --decrypt
+static gchar *g_decrypt_output = NULL; // Output file of --decrypt-output
+static gchar *g_decrypt_key = NULL;   // Key file or "keyring:<name>" of --decrypt-key
+
+// contact_existing_instance() passes a pipe to the new instance in this environment variable
+#define AR_READY_FD_ENV "AUDIO_RECORDER_READY_FD"
+
+// Max time (ms) to wait for a new instance to start its DBus-server
+#define AR_READY_TIMEOUT 10000
+
+// Max time (ms) to wait for the running instance to exit after "quit"
+#define AR_QUIT_TIMEOUT 2000
+
+// Number of requests in "--command benchmark"
+#define AR_BENCHMARK_ROUNDS 500
 
 // Default timer text
 static const gchar *g_def_timer_text = ""
@@ -104,6 +139,59 @@ static GOptionEntry option_entries[] = {
         N_("Send a command to the recorder. Valid commands are; status,start,stop,pause,show,hide and quit. "
         "The status argument returns; 'not running','on','off' or 'paused'."), NULL
     },
+
+    // Translators: This is a command line option.
+    // Convert recordings in a folder, eg. after recording in a cheap format. Then exit.
+    {
+        "convert", 0, 0, G_OPTION_ARG_FILENAME, &g_convert_arg,
+        N_("Convert all recordings in a folder to the selected media format (or --convert-profile), then exit. "
+        "Files that are already converted are skipped."), NULL
+    },
+
+    // Translators: This is a command line option.
+    {
+        "convert-profile", 0, 0, G_OPTION_ARG_STRING, &g_convert_profile,
+        N_("Media format (profile id) for --convert."), NULL
+    },
+
+    // Translators: This is a command line option.
+    {
+        "convert-replace", 0, 0, G_OPTION_ARG_NONE, &g_convert_replace,
+        N_("Delete the original files after --convert."), NULL
+    },
+
+    // Translators: This is a command line option.
+    // Compare a recording with its checksum file (see "checksum" setting). Then exit.
+    {
+        "verify", 0, 0, G_OPTION_ARG_FILENAME, &g_verify_arg,
+        N_("Verify a recording against its checksum file, then exit."), NULL
+    },
+
+    // Translators: This is a command line option.
+    // Decrypt an encrypted recording (see "encryption" setting). Then exit.
+    {
+        "decrypt", 0, 0, G_OPTION_ARG_FILENAME, &g_decrypt_arg,
+        N_("Decrypt an encrypted recording, then exit."), NULL
+    },
+
+    // Translators: This is a command line option.
+    {
+        "decrypt-output", 0, 0, G_OPTION_ARG_FILENAME, &g_decrypt_output,
+        N_("Output file for --decrypt."), NULL
+    },
+
+    // Translators: This is a command line option.
+    {
+        "decrypt-key", 0, 0, G_OPTION_ARG_STRING, &g_decrypt_key,
+        N_("Key file (or keyring:name) for --decrypt. Default is the encryption-key setting."), NULL
+    },
+
+    // Run a benchmark, print the results and exit. For developers; not translated.
+    // $ audio-recorder --benchmark=devices
+    {
+        "benchmark", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &g_benchmark_arg,
+        "Run a benchmark and exit. Valid benchmarks are; devices, conversions, reconfigure, encoders, sink, seek, checksum, encryption.", NULL
+    },
     { NULL },
 };
 
@@ -112,6 +200,10 @@ static gboolean win_delete_cb(GtkWidget *widget, GdkEvent *event, gpointer data)
 static gpointer send_client_request(gchar *argv[], gpointer data);
 static void contact_existing_instance(gchar *argv[]);
 static gboolean ar_is_running();
+static void client_fast_path(gint argc, gchar *argv[]);
+static gboolean run_benchmark(gchar *name);
+static void run_convert(gchar *folder);
+static void notify_ready();
 
 static void combo_select_string(GtkComboBox *combo, gchar *str, gint sel_row);
 
@@ -544,9 +636,10 @@ void win_refresh_device_list() {
     // Add also Media Players, Skype (if installed) to the list. These can control the recording via DBus.
     audio_source_fill_combo(g_win.audio_device);
 
-    // Stop recording if dev_id removed from the system
+    // Stop recording if dev_id removed from the system.
+    // But not if the recording fails over to a backup device (see gst-capture.c).
     DeviceItem *rec = audio_sources_find_id(dev_id);
-    if (dev_id && rec == NULL) {
+    if (dev_id && rec == NULL && !capture_handles_device(dev_id)) {
 
         gint state = -1;
         gint pending = -1;
@@ -758,6 +851,8 @@ gboolean win_delete_cb(GtkWidget *widget, GdkEvent *event, gpointer data) {
 
     dbus_service_module_exit();
 
+    socket_server_module_exit();
+
     systray_module_exit();
 
     rec_manager_exit();
@@ -768,6 +863,8 @@ gboolean win_delete_cb(GtkWidget *widget, GdkEvent *event, gpointer data) {
 
     timer_module_exit();
 
+    proc_module_exit();
+
     // Allow exit.
     return FALSE;
 }
@@ -1362,6 +1459,15 @@ void win_create_window() {
 }
 
 int main(int argc, char *argv[]) {
+    // Started by contact_existing_instance() of another audio-recorder process?
+    gboolean spawned = (g_getenv(AR_READY_FD_ENV) != NULL);
+
+    // Send --command to a running instance before we initialize GTK and GStreamer.
+    // This will call exit() if the command was handled.
+    if (!spawned) {
+        client_fast_path(argc, argv);
+    }
+
     // Parse command line arguments
     GError *error = NULL;
     GOptionContext *context = g_option_context_new("Command line arguments.");
@@ -1398,7 +1504,7 @@ int main(int argc, char *argv[]) {
     }
 
     // Reset all settings and restart audio-recorder?
-    if (g_reset_settings != -1) {
+    if (g_reset_settings != -1 && !spawned) {
 
         // This will !reset! all settings after kill & restart
         conf_save_boolean_value("started-first-time", TRUE);
@@ -1406,12 +1512,9 @@ int main(int argc, char *argv[]) {
         // Flush the settings registry
         conf_flush_settings();
 
-        // Kill all previous instances
+        // Kill all previous instances (waits until they have exited)
         send_client_request(argv, "simple-kill");
 
-        // Wait 0.2s
-        g_usleep(G_USEC_PER_SEC * 0.2);
-
         // This will do a fork() + execvp() [*]
         g_command_arg = NULL;
         contact_existing_instance(argv);
@@ -1459,7 +1562,7 @@ int main(int argc, char *argv[]) {
     }
 
     // Started without --command (-c) argument?
-    if (g_command_arg == NULL) {
+    if (g_command_arg == NULL && g_benchmark_arg == NULL && g_convert_arg == NULL && g_verify_arg == NULL && g_decrypt_arg == NULL && !spawned) {
         // Try to contact already existing/running instance of audio-recorder
         gboolean is_running = ar_is_running();
 
@@ -1477,13 +1580,15 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if (g_command_arg != NULL) {
+    if (g_command_arg != NULL && !spawned) {
         // Try contacting existings instance of the program.
         // Fork() + ecexvp() a new instance if necessary.
         contact_existing_instance(argv);
     }
 
     // Initialize local modules
+    proc_module_init();
+
     media_profiles_init();
 
     rec_manager_init();
@@ -1492,9 +1597,41 @@ int main(int argc, char *argv[]) {
 
     timer_module_init();
 
+    // $ audio-recorder --benchmark=<name>
+    if (g_benchmark_arg) {
+        exit(run_benchmark(g_benchmark_arg) ? 0 : 1);
+    }
+
+    // $ audio-recorder --verify=<file>
+    if (g_verify_arg) {
+        exit(checksum_verify(g_verify_arg) ? 0 : 1);
+    }
+
+    // $ audio-recorder --decrypt=<file> [--decrypt-output=<file>] [--decrypt-key=<key file>]
+    if (g_decrypt_arg) {
+        exit(encrypt_decrypt_file(g_decrypt_arg, g_decrypt_output, g_decrypt_key) ? 0 : 1);
+    }
+
+    // $ audio-recorder --convert=<folder>
+    if (g_convert_arg) {
+        run_convert(g_convert_arg);
+    }
+
     // Setup DBus server for this program
     dbus_service_module_init();
 
+    // Tell the parent process (see contact_existing_instance()) that the server is up
+    notify_ready();
+
+    // Optional control socket (see "control-socket" setting)
+    socket_server_module_init();
+
+    // Repair recordings that were interrupted by a crash (see "crash-safe" setting)
+    recovery_scan();
+
+    // Finish conversions of recordings from the last session (see "deferred-transcode" setting)
+    transcode_resume();
+
     systray_module_init();
 
     // Show button images (normally not shown in the GNOME)
@@ -1587,6 +1724,8 @@ static gpointer send_client_request(gchar *argv[], gpointer data) {
     // $ audio-recorder --command show
     // $ audio-recorder --command quit
 
+    // $ audio-recorder --command benchmark  // Print round-trip times of client requests
+
     // You can also combine
     // $ audio-recorder --command start+show
     // $ audio-recorder --command stop+hide
@@ -1616,6 +1755,16 @@ static gpointer send_client_request(gchar *argv[], gpointer data) {
         exit(exit_val);
     }
 
+    if (!g_strcmp0(command, "benchmark")) {
+        // Measure request round-trip time
+        if (!dbus_service_client_benchmark(AR_BENCHMARK_ROUNDS)) {
+            g_print("not running\n");
+            exit_val = -1;
+        }
+        // Exit
+        exit(exit_val);
+    }
+
     // -------------------------------------------------
 
     if (g_strrstr(command, "start")) {
@@ -1690,11 +1839,12 @@ static gpointer send_client_request(gchar *argv[], gpointer data) {
     if (g_strrstr(command, "quit")) {
 
         // Call set_state("quit"). Terminate running instance of this application.
+        GPid server_pid = dbus_service_client_get_server_pid();
         ret = dbus_service_client_request("set_state", "quit");
         g_free(ret);
 
-        // Wait a while
-        g_usleep(G_USEC_PER_SEC * 0.2);
+        // Wait until it has exited
+        proc_wait_exit(server_pid, AR_QUIT_TIMEOUT);
 
         // Terminate possibly frozen instances of audio-recorder
         kill_frozen_instances(argv[0], -1/*all PIDs*/);
@@ -1706,11 +1856,12 @@ static gpointer send_client_request(gchar *argv[], gpointer data) {
     if (g_strrstr(command, "simple-kill")) {
 
         // Call set_state("quit"). Terminate running instance of this application.
+        GPid server_pid = dbus_service_client_get_server_pid();
         ret = dbus_service_client_request("set_state", "quit");
         g_free(ret);
 
-        // Wait
-        g_usleep(G_USEC_PER_SEC * 0.2);
+        // Wait until it has exited
+        proc_wait_exit(server_pid, AR_QUIT_TIMEOUT);
 
         // Terminate possibly frozen instances of audio-recorder
         kill_frozen_instances(argv[0], getpid());
@@ -1749,6 +1900,12 @@ static void contact_existing_instance(gchar *argv[]) {
         // Terminate all POSSIBLY FROZEN audio-recorder instances that do not respond to our dbus-requests.
         kill_frozen_instances(argv[0], getpid()/*will not kill myself*/);
 
+        // The child writes to this pipe when its DBus-server is up
+        gint ready_fds[2] = {-1, -1};
+        if (pipe(ready_fds) < 0) {
+            LOG_ERROR("Cannot create pipe. %s\n", g_strerror(errno));
+        }
+
         // Fork and exec a new instance of audio-recorder
         pid_t pid = 0;
         if((pid = fork()) < 0) {
@@ -1760,6 +1917,14 @@ static void contact_existing_instance(gchar *argv[]) {
 
             LOG_DEBUG("Fork() succeeded. Going to replace this child by execvp() call.\n");
 
+            // Pass the write end of the pipe to the new process
+            if (ready_fds[1] > -1) {
+                close(ready_fds[0]);
+                gchar *fd_str = g_strdup_printf("%d", ready_fds[1]);
+                g_setenv(AR_READY_FD_ENV, fd_str, TRUE);
+                g_free(fd_str);
+            }
+
             // Replace this child with a new audio-recorder process.
             // One important thing:
             // We could let this child simply run, but the child and parent processes (after fork())
@@ -1778,8 +1943,22 @@ static void contact_existing_instance(gchar *argv[]) {
         } else {
             // Parent process
 
-            // Sleep a while, let the child execvp()
-            g_usleep(G_USEC_PER_SEC * 0.3);
+            // Wait until the child has started its DBus-server (or died)
+            if (ready_fds[0] > -1) {
+                close(ready_fds[1]);
+
+                struct pollfd pfd = { .fd = ready_fds[0], .events = POLLIN, .revents = 0 };
+                gint ret = 0;
+                do {
+                    ret = poll(&pfd, 1, AR_READY_TIMEOUT);
+                } while (ret < 0 && errno == EINTR);
+
+                if (ret < 1) {
+                    LOG_ERROR("New instance of audio-recorder did not start in %d ms.\n", AR_READY_TIMEOUT);
+                }
+
+                close(ready_fds[0]);
+            }
 
             // Send request to the child (execute methode call over DBus)
             send_client_request(argv, g_command_arg);
@@ -1790,6 +1969,168 @@ static void contact_existing_instance(gchar *argv[]) {
     }
 }
 
+static void notify_ready() {
+    // We were started by contact_existing_instance(). Tell the parent that we are listening on DBus.
+    const gchar *fd_str = g_getenv(AR_READY_FD_ENV);
+    if (!fd_str) return;
+
+    gint fd = (gint)g_ascii_strtoll(fd_str, NULL, 10);
+    if (fd > 2) {
+        // Any byte will do. EOF (child died) is also seen by the parent.
+        if (write(fd, "1", 1) < 0) {
+            LOG_ERROR("Cannot notify parent process. %s\n", g_strerror(errno));
+        }
+        close(fd);
+    }
+
+    // Do not pass this to programs we may launch
+    g_unsetenv(AR_READY_FD_ENV);
+}
+
+static gboolean run_benchmark(gchar *name) {
+    // Run benchmark and print the results. Return FALSE if it failed (the exit status is 1).
+    // $ audio-recorder --benchmark=devices
+    gboolean ok = TRUE;
+
+    if (!g_strcmp0(name, "devices")) {
+        // Device validation with hundreds of virtual sources
+        gstdev_benchmark(500);
+    }
+
+    else if (!g_strcmp0(name, "conversions")) {
+        // CPU time of all profiles with and without needless audioresample/audioconvert
+        pipeline_benchmark(2000);
+    }
+
+    else if (!g_strcmp0(name, "reconfigure")) {
+        // Reconfigure vs. rebuild of the recording pipeline
+        ok = pipeline_benchmark_reconfigure(100);
+    }
+
+    else if (!g_strcmp0(name, "encoders")) {
+        // Realtime factor, CPU, memory, bitrate and start/stop latency of all media profiles
+        bench_profiles(BENCH_SECONDS);
+    }
+
+    else if (!g_strcmp0(name, "sink")) {
+        // Throughput and write syscalls of filesink vs. arfilesink (1 GB)
+        filesink_benchmark(1024);
+    }
+
+    else if (!g_strcmp0(name, "seek")) {
+        // Seek latency in 3 hour Ogg and MP3 files with and without the seek indexes
+        seek_benchmark(3);
+    }
+
+    else if (!g_strcmp0(name, "checksum")) {
+        // Throughput of xxh64 and sha256, and their CPU share at lossless bitrates (1 GB)
+        checksum_benchmark(1024);
+    }
+
+    else if (!g_strcmp0(name, "encryption")) {
+        // AES-256-GCM throughput vs. the bitrates of the profiles (1 GB)
+        encrypt_benchmark(1024);
+    }
+
+    else {
+        LOG_ERROR("Invalid argument in --benchmark=%s. Valid benchmarks are; devices, conversions, reconfigure, encoders, sink, seek, checksum, encryption.\n", name);
+        ok = FALSE;
+    }
+
+    return ok;
+}
+
+static void run_convert(gchar *folder) {
+    // Convert recordings in folder, then exit
+    // $ audio-recorder --convert=$HOME/Music --convert-profile=mp3
+    gchar *profile_id = g_strdup(g_convert_profile);
+    if (!profile_id) {
+        conf_get_string_value("media-format", &profile_id);
+    }
+
+    gint failed = transcode_folder(folder, profile_id, !g_convert_replace);
+
+    g_free(profile_id);
+
+    exit(failed == 0 ? 0 : 1);
+}
+
+static void client_fast_path(gint argc, gchar *argv[]) {
+    // Lightweight client. Send --command to the running instance and exit in a few milliseconds.
+    // No GTK, GDK or GStreamer initialization is needed for this.
+
+    // Parse a copy of argv. Ignore GTK and GStreamer options (they are parsed later).
+    gchar **args = g_new0(gchar*, argc + 1);
+    gint i = 0;
+    for (i = 0; i < argc; i++) {
+        args[i] = g_strdup(argv[i]);
+    }
+
+    GOptionContext *context = g_option_context_new(NULL);
+    g_option_context_set_help_enabled(context, FALSE);
+    g_option_context_set_ignore_unknown_options(context, TRUE);
+    g_option_context_add_main_entries(context, option_entries, NULL);
+
+    gboolean ok = g_option_context_parse_strv(context, &args, NULL);
+
+    g_option_context_free(context);
+    g_strfreev(args);
+
+    // --version, --reset, --benchmark, --convert, --verify and --decrypt are handled by main()
+    if (!ok || g_version_info != -1 || g_reset_settings != -1 || g_benchmark_arg || g_convert_arg || g_verify_arg || g_decrypt_arg) {
+        goto LBL_1;
+    }
+
+    // $ audio-recorder
+    // Show the existing instance
+    if (g_command_arg == NULL) {
+        if (ar_is_running()) {
+            send_client_request(argv, "show");
+            exit(0);
+        }
+        goto LBL_1;
+    }
+
+    gchar *command = g_ascii_strdown(g_command_arg, -1);
+    gboolean need_server = !(g_strrstr(command, "status") || g_strrstr(command, "quit") ||
+                             g_strrstr(command, "benchmark"));
+    g_free(command);
+
+    // status, quit and benchmark do not need a running instance. Others start it (see contact_existing_instance()).
+    if (!need_server || ar_is_running()) {
+        send_client_request(argv, g_command_arg);
+        exit(0);
+    }
+
+LBL_1:
+    // Not handled. Continue normal startup.
+    g_free(g_command_arg);
+    g_command_arg = NULL;
+
+    g_free(g_benchmark_arg);
+    g_benchmark_arg = NULL;
+
+    g_free(g_convert_arg);
+    g_convert_arg = NULL;
+
+    g_free(g_convert_profile);
+    g_convert_profile = NULL;
+
+    g_convert_replace = FALSE;
+
+    g_free(g_verify_arg);
+    g_verify_arg = NULL;
+
+    g_free(g_decrypt_arg);
+    g_decrypt_arg = NULL;
+
+    g_free(g_decrypt_output);
+    g_decrypt_output = NULL;
+
+    g_free(g_decrypt_key);
+    g_decrypt_key = NULL;
+}
+
 static gboolean ar_is_running() {
     // Try to contact existing instance of audio-recorder
     gchar *state = dbus_service_client_request("get_state", NULL);
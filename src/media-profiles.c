@@ -68,17 +68,66 @@ ProfileRec DefaultProfiles[] = {
 // List of media profiles
 static GList *g_profile_list = NULL;
 
+// Profiles by id. Built once by media_profiles_load().
+static GHashTable *g_profile_index = NULL;
+
+// Value of "saved-profiles" that g_profile_list was loaded from (or saved to)
+static GVariant *g_saved_profiles = NULL;
+
+// Watch "saved-profiles" for changes made outside this module (eg. dconf-editor)
+static GSettings *g_settings = NULL;
+
+// Installed elements by factory name (TRUE/FALSE), valid while g_element_cookie is the registry's cookie
+static GHashTable *g_element_cache = NULL;
+static guint32 g_element_cookie = 0;
+
 void free_func(gpointer data);
 
+static void profiles_validate(ProfileRec *rec);
+static guint32 profiles_registry_cookie();
+static void profiles_set_saved(GVariant *var);
+
+static void profiles_settings_changed(GSettings *settings, gchar *key, gpointer user_data) {
+    GVariant *var = g_settings_get_value(settings, "saved-profiles");
+
+    // Our own save?
+    if (g_saved_profiles && g_variant_equal(var, g_saved_profiles)) {
+        g_variant_unref(var);
+        return;
+    }
+
+    g_variant_unref(var);
+
+    // Reload on next access
+    LOG_DEBUG("Media profiles changed in GSettings. Reload them.\n");
+    media_profiles_clear();
+}
+
 void media_profiles_init() {
     LOG_DEBUG("Init media-profiles.c. \n");
+
+    g_settings = g_settings_new(APPLICATION_SETTINGS_SCHEMA);
+    g_signal_connect(g_settings, "changed::saved-profiles", G_CALLBACK(profiles_settings_changed), NULL);
+
+    // Read the key once. Then GSettings sends "changed" signals for it.
+    g_variant_unref(g_settings_get_value(g_settings, "saved-profiles"));
 }
 
 void media_profiles_exit() {
     LOG_DEBUG("Clean up media-profiles.c. \n");
 
+    if (g_settings) {
+        g_object_unref(g_settings);
+    }
+    g_settings = NULL;
+
     // Clean up. Free the list
     media_profiles_clear();
+
+    if (g_element_cache) {
+        g_hash_table_destroy(g_element_cache);
+    }
+    g_element_cache = NULL;
 }
 
 GList *profiles_get_list() {
@@ -87,6 +136,11 @@ GList *profiles_get_list() {
     return g_profile_list;
 }
 
+const ProfileRec *profiles_get_default(guint i) {
+    if (i >= sizeof(DefaultProfiles) / sizeof(DefaultProfiles[0])) return NULL;
+    return &DefaultProfiles[i];
+}
+
 void profiles_reset() {
     // Save empty [] to GSettings
 
@@ -94,13 +148,17 @@ void profiles_reset() {
     GVariantBuilder *builder = g_variant_builder_new(G_VARIANT_TYPE("a(ssss)"));
 
     GVariant *variant = g_variant_new("a(ssss)", builder);
-    conf_save_variant("saved-profiles", variant);
-
-    g_variant_builder_unref(builder);
+    g_variant_ref_sink(variant);
 
     // Clear lists
     media_profiles_clear();
 
+    conf_save_variant("saved-profiles", variant);
+    profiles_set_saved(variant);
+
+    g_variant_unref(variant);
+    g_variant_builder_unref(builder);
+
     // Reload
     media_profiles_load();
 }
@@ -121,12 +179,23 @@ void profiles_save_configuration() {
     }
 
     GVariant *variant = g_variant_new("a(ssss)", builder);
+    g_variant_ref_sink(variant);
+
     conf_save_variant("saved-profiles", variant);
+    profiles_set_saved(variant);
 
-    //g_variant_unref(variant);
+    g_variant_unref(variant);
     g_variant_builder_unref(builder);
 }
 
+static void profiles_set_saved(GVariant *var) {
+    // Remember the value of "saved-profiles". See profiles_settings_changed().
+    if (g_saved_profiles) {
+        g_variant_unref(g_saved_profiles);
+    }
+    g_saved_profiles = (var ? g_variant_ref(var) : NULL);
+}
+
 
 void profiles_delete(const gchar *id) {
     // Delete entry from g_profile_list
@@ -139,6 +208,8 @@ void profiles_delete(const gchar *id) {
         return;
     }
 
+    g_hash_table_remove(g_profile_index, rec->id);
+
     GList *ptr = g_list_find(g_profile_list, rec);
     g_profile_list = g_list_remove_link(g_profile_list, ptr);
     g_list_free_full(ptr, free_func);
@@ -164,6 +235,8 @@ void profiles_update(gchar *old_id, gchar *id, gchar *file_ext, gchar *pipe_text
     if (!rec) {
         new_rec = TRUE;
         rec = g_malloc0(sizeof(ProfileRec));
+    } else {
+        g_hash_table_remove(g_profile_index, rec->id);
     }
 
     g_free(rec->id);
@@ -179,6 +252,11 @@ void profiles_update(gchar *old_id, gchar *id, gchar *file_ext, gchar *pipe_text
         g_profile_list = g_list_append(g_profile_list, rec);
     }
 
+    g_hash_table_insert(g_profile_index, rec->id, rec);
+
+    // Check the new pipeline
+    profiles_validate(rec);
+
     profiles_save_configuration();
 
 }
@@ -187,10 +265,19 @@ ProfileRec *profiles_find_rec(const gchar *id) {
 
     media_profiles_load();
 
+    if (!id) return NULL;
+
+    return (ProfileRec*)g_hash_table_lookup(g_profile_index, id);
+}
+
+ProfileRec *profiles_find_for_ext(const gchar *ext) {
+
+    media_profiles_load();
+
     GList *item = g_list_first(g_profile_list);
     while (item) {
         ProfileRec *rec = (ProfileRec*)item->data;
-        if (!g_strcmp0(rec->id, id)) {
+        if (!g_strcmp0(rec->ext, ext)) {
             return rec;
         }
 
@@ -199,20 +286,48 @@ ProfileRec *profiles_find_rec(const gchar *id) {
     return NULL;
 }
 
-ProfileRec *profiles_find_for_ext(const gchar *ext) {
+static gint profiles_encoding_cost(const gchar *ext) {
+    // Rough CPU cost of encoding. Lower is cheaper.
+    const gchar *order[] = {"wav", "flac", "ogg", "spx", "mp3", NULL};
+
+    gint i = 0;
+    for (i = 0; order[i]; i++) {
+        if (!g_strcmp0(order[i], ext)) return i;
+    }
+    return i;
+}
 
+const ProfileRec *profiles_find_cheaper(const gchar *id) {
+    // Find the cheapest installed profile that costs less CPU than id. NULL if none.
     media_profiles_load();
 
+    const ProfileRec *cur = profiles_find_rec(id);
+    gint cost = profiles_encoding_cost(cur ? cur->ext : NULL);
+
+    const ProfileRec *best = NULL;
+    gint best_cost = cost;
+
     GList *item = g_list_first(g_profile_list);
     while (item) {
         ProfileRec *rec = (ProfileRec*)item->data;
-        if (!g_strcmp0(rec->ext, ext)) {
-            return rec;
+        gint c = profiles_encoding_cost(rec->ext);
+
+        if (c < best_cost && g_strcmp0(rec->id, id)) {
+            // Plugins installed? (cached check, no installer)
+            if (!rec->checked || rec->cookie != profiles_registry_cookie()) {
+                profiles_validate(rec);
+            }
+
+            if (rec->plugins_ok) {
+                best = rec;
+                best_cost = c;
+            }
         }
 
         item = g_list_next(item);
     }
-    return NULL;
+
+    return best;
 }
 
 void free_func(gpointer data) {
@@ -226,18 +341,32 @@ void free_func(gpointer data) {
     // g_free(rec->not_used);
     g_free(rec->pipe);
 
+    g_strfreev(rec->missing_elems);
+    g_strfreev(rec->details);
+
     g_free(rec);
 }
 
 void media_profiles_clear() {
+    if (g_profile_index) {
+        g_hash_table_destroy(g_profile_index);
+    }
+    g_profile_index = NULL;
+
     g_list_free_full(g_profile_list, free_func);
     g_profile_list = NULL;
+
+    profiles_set_saved(NULL);
 }
 
 static void load_modified_values() {
     GVariant *var = NULL;
     conf_get_variant_value("saved-profiles", &var);
 
+    if (!var) return;
+
+    profiles_set_saved(var);
+
     gsize n = g_variant_n_children(var);
 
     gsize i = 0;
@@ -271,6 +400,8 @@ static void load_modified_values() {
         //g_free(not_used)
         //g_free(pipe);
     }
+
+    g_variant_unref(var);
 }
 
 static void load_default_values() {
@@ -291,18 +422,34 @@ static void load_default_values() {
 }
 
 void media_profiles_load() {
-    if (g_list_length(g_profile_list) > 0) return;
+    // Loaded already?
+    if (g_profile_index) return;
 
     // Check first user modified values (from Gsettings).
     // See: dconf-editor, key: apps -> audio-recorder -> saved-profiles.
     load_modified_values();
 
-    if (g_list_length(g_profile_list) > 0) {
-        return;
+    if (!g_profile_list) {
+        // Take hard-coded values from media-profiles.c.
+        load_default_values();
     }
 
-    // Take hard-coded values from media-profiles.c.
-    load_default_values();
+    // Index by id. The first profile with a given id wins.
+    g_profile_index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    GList *item = g_list_first(g_profile_list);
+    while (item) {
+        ProfileRec *rec = (ProfileRec*)item->data;
+
+        if (rec->id && !g_hash_table_contains(g_profile_index, rec->id)) {
+            g_hash_table_insert(g_profile_index, rec->id, rec);
+        }
+
+        // Parse the pipeline and check its plugins now. Starting a recording uses the cached result.
+        profiles_validate(rec);
+
+        item = g_list_next(item);
+    }
 }
 
 gchar *profiles_get_extension(const gchar *id) {
@@ -431,7 +578,38 @@ GtkWidget *profiles_create_combobox() {
     return combo;
 }
 
-static gboolean profiles_check_plugin(const gchar *id, gchar **missing_elems[], gchar **details[]) {
+static guint32 profiles_registry_cookie() {
+    // Changes when plugins are added to or removed from the GStreamer registry
+    return gst_registry_get_feature_list_cookie(gst_registry_get());
+}
+
+gboolean profiles_has_element(const gchar *name) {
+    // Is the element factory installed? Looked up once per registry change (no lookups on the start path).
+    guint32 cookie = profiles_registry_cookie();
+
+    if (!g_element_cache || g_element_cookie != cookie) {
+        if (g_element_cache) {
+            g_hash_table_destroy(g_element_cache);
+        }
+        g_element_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_element_cookie = cookie;
+    }
+
+    gpointer value = NULL;
+    if (g_hash_table_lookup_extended(g_element_cache, name, NULL, &value)) {
+        return GPOINTER_TO_INT(value);
+    }
+
+    GstElementFactory *factory = gst_element_factory_find(name);
+    if (factory) {
+        gst_object_unref(factory);
+    }
+
+    g_hash_table_insert(g_element_cache, g_strdup(name), GINT_TO_POINTER(factory != NULL));
+    return (factory != NULL);
+}
+
+static gboolean profiles_check_plugin(const ProfileRec *rec, gchar **missing_elems[], gchar **details[]) {
     // Check if appropriate Gstreamer plugins have been installed for the given pipeline.
     // Return TRUE is everything is OK.
     // Return FALSE if some Gstreamer plugins (and gstreamer1.0-plugins-* packages) are missing.
@@ -439,10 +617,7 @@ static gboolean profiles_check_plugin(const gchar *id, gchar **missing_elems[],
 
     gboolean ok = TRUE;
 
-    const ProfileRec *rec = profiles_find_rec(id);
-    if (!rec) return FALSE;
-
-    LOG_DEBUG("Check and test pipeline for: %s (%s)\n", id, rec->pipe);
+    LOG_DEBUG("Check and test pipeline for: %s (%s)\n", rec->id, rec->pipe);
 
     // Pipeline to test
     gchar *pipe_str = g_strdup_printf("fakesrc ! %s ! fakesink", rec->pipe);
@@ -509,11 +684,25 @@ static gboolean profiles_check_plugin(const gchar *id, gchar **missing_elems[],
 
     g_free(pipe_str);
 
-    gst_object_unref(p);
+    if (p) {
+        gst_object_unref(p);
+    }
 
     return ok;
 }
 
+static void profiles_validate(ProfileRec *rec) {
+    // Parse the profile's pipeline and cache the result with the registry cookie
+    g_strfreev(rec->missing_elems);
+    g_strfreev(rec->details);
+    rec->missing_elems = NULL;
+    rec->details = NULL;
+
+    rec->plugins_ok = profiles_check_plugin(rec, &rec->missing_elems, &rec->details);
+    rec->cookie = profiles_registry_cookie();
+    rec->checked = TRUE;
+}
+
 
 #if 0
 static gboolean profiles_check_pipe(const gchar *pipe) {
@@ -639,16 +828,22 @@ gboolean profiles_test_plugin(gchar *id, gchar **err_msg) {
         return TRUE;
     }
 
-    gchar **missing_elems = NULL;
-    gchar **details = NULL;
-    gboolean ok = profiles_check_plugin(id, &missing_elems, &details);
+    // Check again only if the plugin registry has changed
+    if (!rec->checked || rec->cookie != profiles_registry_cookie()) {
+        profiles_validate(rec);
+    }
+
+    gboolean ok = rec->plugins_ok;
 
     gchar *str = NULL;
 
-    if (ok == FALSE && missing_elems && details) {
+    if (ok == FALSE && rec->missing_elems && rec->details) {
+
+        // The callback function frees this copy
+        gchar **details = g_strdupv(rec->details);
 
         // Convert missing_elems[] to string
-        str = g_strjoinv(", ", missing_elems);
+        str = g_strjoinv(", ", rec->missing_elems);
         LOG_ERROR("To support %s format you should install Gstreamer-plugins for %s.\n", rec->ext, str);
 
         GstInstallPluginsReturn ret = gst_install_plugins_async((const gchar * const*)details, NULL, plugin_inst_callback, (gpointer)details);
@@ -674,7 +869,6 @@ gboolean profiles_test_plugin(gchar *id, gchar **err_msg) {
     }
 
     g_free(str);
-    g_strfreev(missing_elems);
 
     return ok;
 }
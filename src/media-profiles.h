@@ -17,6 +17,13 @@ typedef struct {
     gchar *ext;
     gchar *not_used; // kept for future
     gchar *pipe;
+
+    // Cached plugin check. Valid while cookie equals the GStreamer registry's feature list cookie.
+    gboolean checked;
+    guint32 cookie;
+    gboolean plugins_ok;
+    gchar **missing_elems;
+    gchar **details;
 } ProfileRec;
 
 void media_profiles_init();
@@ -33,6 +40,9 @@ void profiles_delete(const gchar *id);
 void profiles_reset();
 
 GList *profiles_get_list();
+
+// Hard-coded profile i (NULL if i is out of range)
+const ProfileRec *profiles_get_default(guint i);
 ProfileRec *profiles_find_rec(const gchar *id);
 
 void media_profiles_load();
@@ -44,12 +54,18 @@ gchar *profiles_get_pipeline(const gchar *id);
 
 ProfileRec *profiles_find_for_ext(const gchar *ext);
 
+// Cheapest installed profile (by CPU cost of the encoder) that is cheaper than id. NULL if none.
+const ProfileRec *profiles_find_cheaper(const gchar *id);
+
 gchar *profiles_get_selected_name(GtkWidget *widget);
 
 GtkWidget *profiles_create_combobox();
 
 gboolean profiles_check_id(const gchar *id);
 
+// Is element factory name installed? Cached against the GStreamer registry cookie. Main thread only.
+gboolean profiles_has_element(const gchar *name);
+
 gboolean profiles_test_plugin(gchar *id, gchar **err_msg);
 
 #endif
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/syscall.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+
+#include "proc-info.h"
+#include "log.h"
+
+// Process inspection without running external tools (ps, pidof).
+// We read /proc/<pid>/comm directly and use pidfd (Linux 5.3+) for liveness checks,
+// signals and exit notification. On older kernels we fall back to kill().
+
+// Length of /proc/<pid>/comm (TASK_COMM_LEN - 1)
+#define PROC_COMM_LEN 15
+
+// Names -> PIDs from the last /proc scan
+static GHashTable *g_proc_cache = NULL;
+G_LOCK_DEFINE_STATIC(g_proc_cache);
+
+// Poll interval when pidfd is not available
+#define PROC_POLL_MS 500
+
+typedef struct {
+    GPid pid;
+    gint fd;
+    ProcExitFunc func;
+    gpointer user_data;
+} ProcWatch;
+
+void proc_module_init() {
+    LOG_DEBUG("Init proc-info.c.\n");
+
+    // Notice: kill_frozen_instances() may scan /proc before this. Keep g_proc_cache.
+}
+
+void proc_module_exit() {
+    LOG_DEBUG("Clean up proc-info.c.\n");
+
+    proc_cache_clear();
+}
+
+void proc_cache_clear() {
+    // Forget the cached /proc scan
+    G_LOCK(g_proc_cache);
+
+    if (g_proc_cache) {
+        g_hash_table_destroy(g_proc_cache);
+    }
+    g_proc_cache = NULL;
+
+    G_UNLOCK(g_proc_cache);
+}
+
+static gboolean proc_read_comm(GPid pid, gchar *comm, gsize len) {
+    // Read /proc/<pid>/comm. This is the name "ps -C" matches against.
+    gchar path[64];
+    g_snprintf(path, sizeof(path), "/proc/%d/comm", (gint)pid);
+
+    FILE *f = fopen(path, "r");
+    if (!f) return FALSE;
+
+    gboolean ok = (fgets(comm, len, f) != NULL);
+    fclose(f);
+
+    if (ok) {
+        // Remove trailing "\n"
+        comm[strcspn(comm, "\n")] = '\0';
+    }
+
+    return ok;
+}
+
+static gboolean proc_name_matches(const gchar *comm, const gchar *name) {
+    // The kernel truncates comm to PROC_COMM_LEN characters
+    return !strncmp(comm, name, PROC_COMM_LEN) && strlen(comm) == MIN(strlen(name), PROC_COMM_LEN);
+}
+
+static void proc_free_pid_list(gpointer data) {
+    g_list_free((GList*)data);
+}
+
+static GHashTable *proc_scan() {
+    // Scan /proc once. Return table of comm -> GList of PIDs.
+    GHashTable *table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, proc_free_pid_list);
+
+    GDir *dir = g_dir_open("/proc", 0, NULL);
+    if (!dir) {
+        return table;
+    }
+
+    const gchar *entry = NULL;
+    while ((entry = g_dir_read_name(dir))) {
+
+        // Numeric directories only
+        if (!g_ascii_isdigit(*entry)) continue;
+
+        gchar *end = NULL;
+        gint64 pid = g_ascii_strtoll(entry, &end, 10);
+        if (!end || *end != '\0' || pid < 1) continue;
+
+        gchar comm[PROC_COMM_LEN + 2];
+        if (!proc_read_comm((GPid)pid, comm, sizeof(comm))) {
+            // Process exited during the scan
+            continue;
+        }
+
+        GList *pids = g_hash_table_lookup(table, comm);
+        if (pids) {
+            // Append keeps the list head (and the table value) unchanged
+            pids = g_list_append(pids, GINT_TO_POINTER((gint)pid));
+        } else {
+            g_hash_table_insert(table, g_strdup(comm), g_list_append(NULL, GINT_TO_POINTER((gint)pid)));
+        }
+    }
+
+    g_dir_close(dir);
+
+    LOG_PROC("Scanned /proc. Found %d process names.\n", g_hash_table_size(table));
+
+    return table;
+}
+
+GList *proc_find_by_name(const gchar *name, gboolean use_cache) {
+    // Return list of PIDs for the given program name.
+    // Caller should g_list_free() the list.
+    GList *result = NULL;
+
+    if (!name || !*name) return NULL;
+
+    // Key in the table is the (possibly truncated) comm
+    gchar *key = g_strndup(name, PROC_COMM_LEN);
+
+    G_LOCK(g_proc_cache);
+
+    if (!(use_cache && g_proc_cache)) {
+        if (g_proc_cache) {
+            g_hash_table_destroy(g_proc_cache);
+        }
+        g_proc_cache = proc_scan();
+        use_cache = FALSE;
+    }
+
+    GList *item = g_list_first(g_hash_table_lookup(g_proc_cache, key));
+    while (item) {
+        GPid pid = (GPid)GPOINTER_TO_INT(item->data);
+
+        if (use_cache) {
+            // Re-validate. The PID may have exited or been re-used.
+            gchar comm[PROC_COMM_LEN + 2];
+            if (!(proc_read_comm(pid, comm, sizeof(comm)) && proc_name_matches(comm, name))) {
+                item = g_list_next(item);
+                continue;
+            }
+        }
+
+        result = g_list_append(result, GINT_TO_POINTER((gint)pid));
+        item = g_list_next(item);
+    }
+
+    G_UNLOCK(g_proc_cache);
+
+    g_free(key);
+
+    return result;
+}
+
+GPid proc_get_pid(const gchar *name) {
+    // Return the first PID for the given program name, or -1
+    GList *pids = proc_find_by_name(name, FALSE);
+
+    GPid pid = -1;
+    if (pids) {
+        pid = (GPid)GPOINTER_TO_INT(pids->data);
+    }
+
+    g_list_free(pids);
+    return pid;
+}
+
+gint proc_open_pidfd(GPid pid) {
+    // Open a pidfd for the process (Linux 5.3+). Return -1 on error.
+    // Ref: man 2 pidfd_open
+#ifdef SYS_pidfd_open
+    if (pid < 1) return -1;
+    return (gint)syscall(SYS_pidfd_open, (pid_t)pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+gboolean proc_is_alive(GPid pid) {
+    // Check if process id (pid) is alive and running
+    if (pid < 1) return FALSE;
+
+    gint fd = proc_open_pidfd(pid);
+    if (fd > -1) {
+        // Readable pidfd means the process has exited (zombie)
+        struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+        gboolean alive = (poll(&pfd, 1, 0) == 0);
+        close(fd);
+        return alive;
+    }
+
+    if (errno == ESRCH) {
+        return FALSE;
+    }
+
+    // No pidfd support. Signal 0 tests existence only.
+    return (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+gboolean proc_send_signal(GPid pid, gint sig) {
+    // Send signal to the process. Return TRUE on success.
+    if (pid < 1) return FALSE;
+
+#ifdef SYS_pidfd_send_signal
+    gint fd = proc_open_pidfd(pid);
+    if (fd > -1) {
+        // Ref: man 2 pidfd_send_signal
+        gint ret = (gint)syscall(SYS_pidfd_send_signal, fd, sig, NULL, 0);
+        close(fd);
+        return (ret == 0);
+    }
+#endif
+
+    return (kill(pid, sig) == 0);
+}
+
+gboolean proc_wait_exit(GPid pid, gint timeout_ms) {
+    // Wait until the process exits. Return TRUE if it exited within timeout_ms.
+    gint fd = proc_open_pidfd(pid);
+
+    if (fd > -1) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+        gint ret = 0;
+
+        do {
+            ret = poll(&pfd, 1, timeout_ms);
+        } while (ret < 0 && errno == EINTR);
+
+        close(fd);
+        return (ret > 0);
+    }
+
+    // No pidfd. Poll the process table in small steps.
+    gint64 end_time = g_get_monotonic_time() + (gint64)timeout_ms * 1000;
+    while (proc_is_alive(pid)) {
+        if (g_get_monotonic_time() >= end_time) {
+            return FALSE;
+        }
+        g_usleep(G_USEC_PER_SEC / 50);
+    }
+
+    return TRUE;
+}
+
+static void proc_watch_free(gpointer data) {
+    ProcWatch *w = (ProcWatch*)data;
+
+    if (w->fd > -1) {
+        close(w->fd);
+    }
+    g_free(w);
+}
+
+static gboolean proc_watch_fd_cb(gint fd, GIOCondition condition, gpointer user_data) {
+    // The pidfd became readable; the process has exited
+    ProcWatch *w = (ProcWatch*)user_data;
+
+    LOG_PROC("Process %d has exited.\n", w->pid);
+
+    w->func(w->pid, w->user_data);
+
+    // Remove this source
+    return FALSE;
+}
+
+static gboolean proc_watch_timer_cb(gpointer user_data) {
+    // Fallback for kernels without pidfd
+    ProcWatch *w = (ProcWatch*)user_data;
+
+    if (proc_is_alive(w->pid)) {
+        // Continue calling this function
+        return TRUE;
+    }
+
+    w->func(w->pid, w->user_data);
+
+    // Remove this source
+    return FALSE;
+}
+
+guint proc_watch_exit(GPid pid, ProcExitFunc func, gpointer user_data) {
+    // Call func from the main loop when the process exits.
+    // Return GSource id (can be removed with g_source_remove()), or 0 if the process does not exist.
+    if (!(func && proc_is_alive(pid))) return 0;
+
+    ProcWatch *w = g_malloc0(sizeof(ProcWatch));
+    w->pid = pid;
+    w->func = func;
+    w->user_data = user_data;
+    w->fd = proc_open_pidfd(pid);
+
+    if (w->fd > -1) {
+        return g_unix_fd_add_full(G_PRIORITY_DEFAULT, w->fd, G_IO_IN, proc_watch_fd_cb, w, proc_watch_free);
+    }
+
+    return g_timeout_add_full(G_PRIORITY_DEFAULT, PROC_POLL_MS, proc_watch_timer_cb, w, proc_watch_free);
+}
@@ -0,0 +1,46 @@
+#ifndef _PROC_INFO_H
+#define _PROC_INFO_H
+
+#include <glib.h>
+
+// Uncomment this to show debug messages from proc-info.c.
+//#define DEBUG_PROC
+
+#if defined(DEBUG_PROC) || defined(DEBUG_ALL)
+#define LOG_PROC LOG_MSG
+#else
+#define LOG_PROC(x, ...)
+#endif
+
+void proc_module_init();
+void proc_module_exit();
+
+// Return list of PIDs (GINT_TO_POINTER(pid)) for the given program name.
+// If use_cache is TRUE, the last /proc scan is re-used (entries are re-validated).
+// Free the list with g_list_free().
+GList *proc_find_by_name(const gchar *name, gboolean use_cache);
+
+// Return the first PID for the given program name, or -1.
+GPid proc_get_pid(const gchar *name);
+
+// Is process alive?
+gboolean proc_is_alive(GPid pid);
+
+// Open a pidfd for the process. Return -1 if not supported (old kernel) or the process is gone.
+// The caller should close() the fd.
+gint proc_open_pidfd(GPid pid);
+
+// Send signal to the process. Uses pidfd when possible (safe against PID reuse).
+gboolean proc_send_signal(GPid pid, gint sig);
+
+// Wait until the process exits (poll() on its pidfd). Return TRUE if it exited within timeout_ms.
+gboolean proc_wait_exit(GPid pid, gint timeout_ms);
+
+// Call func(pid, user_data) from the main loop when the process exits. Return GSource id, or 0.
+typedef void (*ProcExitFunc)(GPid pid, gpointer user_data);
+guint proc_watch_exit(GPid pid, ProcExitFunc func, gpointer user_data);
+
+// Forget the cached /proc scan
+void proc_cache_clear();
+
+#endif
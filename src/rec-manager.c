@@ -24,6 +24,7 @@
 #include "support.h"
 #include "gst-recorder.h"
 #include "dbus-player.h"
+#include "socket-server.h"
 
 // Command queue
 static GAsyncQueue *g_cmd_queue = NULL;
@@ -148,11 +149,17 @@ gint64 rec_manager_get_stream_time() {
 void rec_manager_update_gui() {
     // Update GUI to reflect the status of recording
     win_update_gui();
+
+    // Notify control socket clients
+    socket_server_publish_state();
 }
 
 void rec_manager_update_level_bar(gdouble norm_rms, gdouble norm_peak) {
     // Update gtklevelbar
     win_update_level_bar(norm_rms, norm_peak);
+
+    // Notify control socket clients
+    socket_server_publish_level(norm_rms, norm_peak);
 }
 
 const gchar *rec_manager_get_state_name(gint state) {
@@ -216,6 +223,11 @@ void rec_manager_set_size_label(gchar *label_txt) {
     win_set_size_label(label_txt);
 }
 
+void rec_manager_set_file_size(guint64 bytes) {
+    // Notify control socket clients
+    socket_server_publish_bytes(bytes);
+}
+
 void rec_manager_set_error_text(gchar *error_txt) {
     // Set error label
     win_set_error_text(error_txt);
@@ -226,6 +238,26 @@ void rec_manager_get_state(gint *status, gint *pending) {
     rec_get_state(status, pending);
 }
 
+gboolean rec_manager_set_source_gain(gchar *dev_id, gdouble gain, gchar **err_msg) {
+    // Set gain of an input. The recording continues.
+    return rec_set_source_gain(dev_id, gain, err_msg);
+}
+
+gboolean rec_manager_set_source_mute(gchar *dev_id, gboolean mute, gchar **err_msg) {
+    // Mute/un-mute an input. The recording continues.
+    return rec_set_source_mute(dev_id, mute, err_msg);
+}
+
+gboolean rec_manager_add_source(gchar *dev_id, gchar **err_msg) {
+    // Add an input device to the recording
+    return rec_add_source(dev_id, err_msg);
+}
+
+gboolean rec_manager_remove_source(gchar *dev_id, gchar **err_msg) {
+    // Remove an input device from the recording
+    return rec_remove_source(dev_id, err_msg);
+}
+
 gchar *rec_manager_get_output_filename() {
     // Return output filename
     return rec_get_output_filename();
@@ -363,7 +395,7 @@ gboolean rec_manager_command_thread(gpointer user_data) {
 
     switch (cmd->type) {
     case RECORDING_STOP:
-        rec_stop_recording(del_flag/*delete file?*/);
+        rec_stop_recording_async(del_flag/*delete file?*/);
         break;
 
     case RECORDING_START:
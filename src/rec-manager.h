@@ -14,6 +14,7 @@ void rec_manager_update_gui();
 
 void rec_manager_set_time_label(gchar *label_txt);
 void rec_manager_set_size_label(gchar *label_txt);
+void rec_manager_set_file_size(guint64 bytes);
 void rec_manager_set_error_text(gchar *error_txt);
 void rec_manager_set_filename_label(gchar *filename);
 
@@ -35,6 +36,12 @@ void rec_manager_send_gui_msg(gchar *msg);
 
 gchar *rec_manager_get_output_filename();
 
+// Live control of the inputs. dev_id NULL means all inputs (gain and mute only).
+gboolean rec_manager_set_source_gain(gchar *dev_id, gdouble gain, gchar **err_msg);
+gboolean rec_manager_set_source_mute(gchar *dev_id, gboolean mute, gchar **err_msg);
+gboolean rec_manager_add_source(gchar *dev_id, gchar **err_msg);
+gboolean rec_manager_remove_source(gchar *dev_id, gchar **err_msg);
+
 void rec_manager_flip_recording();
 
 void rec_manager_update_level_bar(gdouble norm_rms, gdouble norm_peak);
@@ -24,6 +24,8 @@
 
 #include "audio-sources.h"
 #include "gst-pipeline.h"
+#include "gst-bench.h"
+#include "rec-manager.h"
 
 static GtkWidget *g_profiles = NULL;
 static GtkWidget *g_saved_id = NULL; // Hidden field to hold currect selection of g_profiles
@@ -250,10 +252,10 @@ static void title_changed(GtkComboBox *widget, gpointer data) {
     g_free(name);
 }
 
-static void show_cmd_dialog(gchar *cmd) {
-    // Show dialog with the GStreamer command
+static void show_cmd_dialog(const gchar *title, gchar *cmd) {
+    // Show dialog with the GStreamer command (or benchmark results)
 
-    GtkWidget *dialog = gtk_dialog_new_with_buttons(_("Recording command"),
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(title,
                         NULL,
                         GTK_DIALOG_DESTROY_WITH_PARENT,
                         _("_OK"),
@@ -343,7 +345,7 @@ static void show_recording_command() {
     gchar *cmd = g_string_free(str, FALSE);
 
     // Show gst_launch command in a dialog
-    show_cmd_dialog(cmd);
+    show_cmd_dialog(_("Recording command"), cmd);
 
     g_free(old_name);
     g_free(name);
@@ -360,6 +362,82 @@ static void show_cmd_clicked(GtkButton *button, gpointer user_data) {
     show_recording_command();
 }
 
+typedef struct {
+    GtkWidget *button;
+    gchar *name;
+    gchar *pipe_text;
+    gchar *result;
+} BenchJob;
+
+static gboolean benchmark_done(gpointer user_data) {
+    // Show the results. Called in the main loop.
+    BenchJob *job = (BenchJob*)user_data;
+
+    gchar *text = NULL;
+    if (rec_manager_is_recording()) {
+        // CPU time and peak RSS are measured for the whole process (see gst-bench.c)
+        text = g_strdup_printf("%s\n\n%s\n%s", _("A recording was started during the benchmark. The CPU and memory figures include it."),
+                               bench_header(), job->result);
+    } else {
+        text = g_strdup_printf("%s\n%s", bench_header(), job->result);
+    }
+
+    // Translators: Dialog title in Additional settings -> Recording commands -> [Benchmark].
+    show_cmd_dialog(_("Benchmark"), text);
+
+    g_free(text);
+
+    gtk_widget_set_sensitive(job->button, TRUE);
+    g_object_unref(job->button);
+
+    g_free(job->name);
+    g_free(job->pipe_text);
+    g_free(job->result);
+    g_free(job);
+
+    return FALSE;
+}
+
+static gpointer benchmark_thread(gpointer user_data) {
+    // Encode test audio with the draft profile. Takes some seconds.
+    BenchJob *job = (BenchJob*)user_data;
+
+    job->result = bench_profile(job->name, job->pipe_text, BENCH_DRAFT_SECONDS);
+
+    g_idle_add(benchmark_done, job);
+
+    return NULL;
+}
+
+static void benchmark_clicked(GtkButton *button, gpointer user_data) {
+    // Benchmark the profile as it is in the fields (it need not be saved)
+    if (!check_fields()) {
+        return;
+    }
+
+    // CPU time and peak RSS are measured for the whole process. A running recording would be counted in.
+    if (rec_manager_is_recording()) {
+        // Translators: Dialog title in Additional settings -> Recording commands -> [Benchmark].
+        show_cmd_dialog(_("Benchmark"), _("Stop the recording before running the benchmark."));
+        return;
+    }
+
+    BenchJob *job = g_malloc0(sizeof(BenchJob));
+    job->button = g_object_ref(GTK_WIDGET(button));
+
+    gchar *old_name = NULL;
+    gchar *file_ext = NULL;
+    read_fields(&old_name, &job->name, &file_ext, &job->pipe_text);
+
+    g_free(old_name);
+    g_free(file_ext);
+
+    gtk_widget_set_sensitive(job->button, FALSE);
+
+    GThread *thread = g_thread_new("profile-benchmark", benchmark_thread, job);
+    g_thread_unref(thread);
+}
+
 static void reset_clicked(GtkButton *button, gpointer user_data) {
     load_defaults();
 }
@@ -445,6 +523,11 @@ GtkWidget *page_to_edit_pipelines() {
     g_signal_connect(button0, "clicked", G_CALLBACK(reset_clicked), NULL);
     gtk_box_pack_start(GTK_BOX(box0), button0, TRUE, FALSE, 0);
 
+    // Translators: Button label in Additional settings -> Recording commands.
+    button0 = gtk_button_new_with_label(_("Benchmark"));
+    g_signal_connect(button0, "clicked", G_CALLBACK(benchmark_clicked), NULL);
+    gtk_box_pack_start(GTK_BOX(box0), button0, TRUE, FALSE, 0);
+
     gtk_box_pack_start(GTK_BOX(vbox3), box0, FALSE, FALSE, 0);
 
     box0 = gtk_button_box_new(GTK_ORIENTATION_HORIZONTAL);
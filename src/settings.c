@@ -26,6 +26,7 @@
 #include "help.h"
 #include "dbus-skype.h"
 #include "rec-manager-struct.h"
+#include "rec-manager.h"
 
 extern GtkWidget *page_to_edit_pipelines();
 
@@ -174,6 +175,24 @@ static void device_list_checkbox_toggled(GtkCellRendererToggle *toggle, gchar *p
 
     // Save device list in GConf (for g_current_type)
     device_list_save();
+
+    // Recording from these devices? Add or remove the device without restarting the recording.
+    gint saved_type = -1;
+    conf_get_int_value("audio-device-type", &saved_type);
+
+    if (!(g_current_type == USER_DEFINED && saved_type == USER_DEFINED && rec_manager_is_recording())) return;
+
+    gchar *dev_id = NULL;
+    gtk_tree_model_get(model, &iter, COL_ID, &dev_id, -1);
+
+    gchar *err_msg = NULL;
+    gboolean ok = (!active ? rec_manager_add_source(dev_id, &err_msg) : rec_manager_remove_source(dev_id, &err_msg));
+    if (!ok) {
+        rec_manager_send_gui_msg(err_msg);
+    }
+
+    g_free(err_msg);
+    g_free(dev_id);
 }
 
 static GtkWidget *create_listbox() {
@@ -0,0 +1,561 @@
+/*
+ * Copyright (c) 2011-2017 Osmo Antero.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License (GPL3), or any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Library General Public License 3 for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 3 along with this program; if not, see /usr/share/common-licenses/GPL file
+ * or <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+
+#include "log.h"
+#include "dconf.h"
+#include "dbus-server.h"
+#include "socket-server.h"
+
+// Optional control socket (Unix domain socket) for machines without a desktop (DBus) session.
+// Set the socket path in "control-socket" setting. An empty value disables it.
+// A plain file name (no "/") is created in $XDG_RUNTIME_DIR.
+//
+// The protocol is line based. Each request gets one reply line.
+//
+//  start|stop|pause|show|hide|quit   -> "OK" | "ERROR <reason>". Same as set_state() in dbus-server.c.
+//  status                            -> "STATE on|off|paused"
+//  subscribe <event> [interval_ms]   -> "OK". Event is one of: state, level, bytes.
+//                                       The server sends at most one event per interval_ms to this client.
+//                                       Events held back by the interval are coalesced (the latest value wins).
+//  unsubscribe <event>               -> "OK"
+//
+// Events are sent as "EVENT <event> <values>", eg. "EVENT level 0.318 0.502".
+//
+// All clients are served by the main loop (non-blocking I/O, no threads).
+//
+// $ socat - UNIX-CONNECT:$XDG_RUNTIME_DIR/audio-recorder.sock
+
+// Max length of a request line
+#define SOCKET_MAX_LINE 256
+
+// Size of the input buffer. A client that sends more than SOCKET_MAX_LINE bytes without a newline is closed,
+// so the buffer never grows.
+#define SOCKET_INPUT_BUFFER (4 * SOCKET_MAX_LINE)
+
+// Max unsent data per client. Events are dropped while a client is this much behind.
+#define SOCKET_MAX_BACKLOG (64 * 1024)
+
+// How often to check held back (rate limited) events, in milliseconds
+#define SOCKET_FLUSH_MS 20
+
+static const gchar *g_event_names[SOCKET_EVENT_N] = { "state", "level", "bytes" };
+
+typedef struct {
+    GSocketConnection *connection;
+    GBufferedInputStream *input;
+    GPollableOutputStream *output;
+    GCancellable *cancellable;
+
+    // Unsent data and the source that waits until the socket is writable
+    GString *outbuf;
+    GSource *out_source;
+    gboolean broken;
+
+    // Subscriptions. interval < 0: not subscribed.
+    gint64 interval[SOCKET_EVENT_N];
+    gint64 last_sent[SOCKET_EVENT_N];
+    gchar *pending[SOCKET_EVENT_N];
+} SocketClient;
+
+static GSocketService *g_socket_service = NULL;
+static gchar *g_socket_path = NULL;
+
+// List of SocketClient*
+static GList *g_clients = NULL;
+
+// Number of subscribers per event
+static gint g_subscribers[SOCKET_EVENT_N];
+
+// Timer for held back events
+static guint g_flush_id = 0;
+
+static gboolean socket_server_start(const gchar *path);
+static void socket_client_close(SocketClient *c);
+static void socket_client_read_next(SocketClient *c);
+static gboolean socket_client_flush(SocketClient *c);
+
+void socket_server_module_init() {
+    LOG_DEBUG("Init socket-server.c.\n");
+
+    memset(g_subscribers, 0, sizeof(g_subscribers));
+
+    gchar *path = NULL;
+    conf_get_string_value("control-socket", &path);
+
+    if (path && *path) {
+        socket_server_start(path);
+    }
+
+    g_free(path);
+}
+
+void socket_server_module_exit() {
+    LOG_DEBUG("Clean up socket-server.c.\n");
+
+    if (g_flush_id) {
+        g_source_remove(g_flush_id);
+    }
+    g_flush_id = 0;
+
+    while (g_clients) {
+        socket_client_close((SocketClient*)g_clients->data);
+    }
+
+    if (g_socket_service) {
+        g_socket_service_stop(g_socket_service);
+        g_socket_listener_close(G_SOCKET_LISTENER(g_socket_service));
+        g_object_unref(g_socket_service);
+    }
+    g_socket_service = NULL;
+
+    if (g_socket_path) {
+        g_unlink(g_socket_path);
+    }
+    g_free(g_socket_path);
+    g_socket_path = NULL;
+}
+
+gboolean socket_server_has_subscribers(enum SocketEvent event) {
+    return (g_subscribers[event] > 0);
+}
+
+static gboolean socket_client_writable_cb(GObject *stream, gpointer user_data) {
+    // Socket became writable. Send rest of outbuf.
+    SocketClient *c = (SocketClient*)user_data;
+
+    // This source is destroyed when we return FALSE
+    g_source_unref(c->out_source);
+    c->out_source = NULL;
+
+    // Will create a new source if the socket is still full
+    socket_client_flush(c);
+
+    return FALSE;
+}
+
+static gboolean socket_client_flush(SocketClient *c) {
+    // Write outbuf without blocking. Return FALSE if the connection is broken.
+    while (c->outbuf->len > 0 && !c->broken) {
+
+        GError *error = NULL;
+        gssize n = g_pollable_output_stream_write_nonblocking(c->output, c->outbuf->str, c->outbuf->len, NULL, &error);
+
+        if (n < 0) {
+
+            if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+                g_error_free(error);
+
+                // Wait until the socket is writable
+                if (!c->out_source) {
+                    c->out_source = g_pollable_output_stream_create_source(c->output, NULL);
+                    g_source_set_callback(c->out_source, (GSourceFunc)socket_client_writable_cb, c, NULL);
+                    g_source_attach(c->out_source, NULL);
+                }
+                return TRUE;
+            }
+
+            // Peer has gone. The reader will see EOF and close this client.
+            LOG_SOCKET("Cannot write to control socket client. %s\n", error->message);
+            g_error_free(error);
+
+            c->broken = TRUE;
+            g_string_truncate(c->outbuf, 0);
+            return FALSE;
+        }
+
+        g_string_erase(c->outbuf, 0, n);
+    }
+
+    return !c->broken;
+}
+
+static void socket_client_write(SocketClient *c, const gchar *line, gboolean is_event) {
+    // Queue line and send it
+    if (c->broken) return;
+
+    if (is_event && c->outbuf->len > SOCKET_MAX_BACKLOG) {
+        // Slow client. Drop the event.
+        LOG_SOCKET("Control socket client is %d bytes behind. Dropped event: %s\n", (gint)c->outbuf->len, line);
+        return;
+    }
+
+    g_string_append(c->outbuf, line);
+    g_string_append_c(c->outbuf, '\n');
+
+    // Already waiting for the socket?
+    if (c->out_source) return;
+
+    socket_client_flush(c);
+}
+
+static void socket_client_close(SocketClient *c) {
+    // Disconnect and free the client
+    LOG_SOCKET("Control socket client disconnected.\n");
+
+    g_clients = g_list_remove(g_clients, c);
+
+    // Cancel pending read. Its callback will not touch c.
+    g_cancellable_cancel(c->cancellable);
+
+    if (c->out_source) {
+        g_source_destroy(c->out_source);
+        g_source_unref(c->out_source);
+    }
+
+    gint i = 0;
+    for (i = 0; i < SOCKET_EVENT_N; i++) {
+        if (c->interval[i] > -1) {
+            g_subscribers[i]--;
+        }
+        g_free(c->pending[i]);
+    }
+
+    g_io_stream_close(G_IO_STREAM(c->connection), NULL, NULL);
+
+    g_object_unref(c->input);
+    g_object_unref(c->connection);
+    g_object_unref(c->cancellable);
+    g_string_free(c->outbuf, TRUE);
+    g_free(c);
+}
+
+static gint socket_event_by_name(const gchar *name) {
+    // Return SocketEvent for the name, or -1
+    gint i = 0;
+    for (i = 0; i < SOCKET_EVENT_N; i++) {
+        if (!g_strcmp0(name, g_event_names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void socket_client_handle_line(SocketClient *c, gchar *line) {
+    // Execute one request
+    g_strstrip(line);
+    if (*line == '\0') return;
+
+    gchar **args = g_strsplit_set(line, " \t", 3);
+    gchar *cmd = g_ascii_strdown(args[0], -1);
+    gchar *reply = NULL;
+
+    LOG_SOCKET("Control socket request: %s\n", line);
+
+    // $ status
+    if (!g_strcmp0(cmd, "status")) {
+        reply = g_strdup_printf("STATE %s", dbus_service_get_state());
+    }
+
+    // $ subscribe level 100
+    else if (!g_strcmp0(cmd, "subscribe") || !g_strcmp0(cmd, "unsubscribe")) {
+
+        gint event = (args[1] ? socket_event_by_name(args[1]) : -1);
+        if (event < 0) {
+            reply = g_strdup("ERROR Unknown event");
+            goto LBL_1;
+        }
+
+        gboolean subscribe = !g_strcmp0(cmd, "subscribe");
+
+        if (subscribe) {
+            gint64 interval_ms = (args[1] && args[2] ? g_ascii_strtoll(args[2], NULL, 10) : 0);
+
+            if (c->interval[event] < 0) {
+                g_subscribers[event]++;
+            }
+            c->interval[event] = MAX(interval_ms, 0) * 1000;
+            c->last_sent[event] = 0;
+
+        } else if (c->interval[event] > -1) {
+            g_subscribers[event]--;
+            c->interval[event] = -1;
+            g_free(c->pending[event]);
+            c->pending[event] = NULL;
+        }
+
+        reply = g_strdup("OK");
+    }
+
+    // $ start|stop|pause|show|hide|quit
+    else if (dbus_service_set_state(cmd)) {
+        reply = g_strdup("OK");
+    }
+
+    else {
+        reply = g_strdup("ERROR Unknown command");
+    }
+
+LBL_1:
+    socket_client_write(c, reply, FALSE);
+
+    g_free(reply);
+    g_free(cmd);
+    g_strfreev(args);
+}
+
+static gchar *socket_client_take_line(SocketClient *c, gboolean *garbage) {
+    // Take one complete line from the input buffer. Return NULL if there is none.
+    // Sets garbage if the line is too long or not UTF-8.
+    gsize avail = 0;
+    const gchar *buf = (const gchar*)g_buffered_input_stream_peek_buffer(c->input, &avail);
+
+    const gchar *nl = (avail > 0 ? memchr(buf, '\n', avail) : NULL);
+    if (!nl) return NULL;
+
+    gsize len = (gsize)(nl - buf);
+    gchar *line = NULL;
+
+    if (len > SOCKET_MAX_LINE || !g_utf8_validate(buf, len, NULL)) {
+        *garbage = TRUE;
+    } else {
+        // "\r" of "\r\n" is removed by g_strstrip() in socket_client_handle_line()
+        line = g_strndup(buf, len);
+    }
+
+    // The data is in the buffer, so this does not block
+    g_input_stream_skip(G_INPUT_STREAM(c->input), len + 1, NULL, NULL);
+
+    return line;
+}
+
+static void socket_client_read_cb(GObject *source, GAsyncResult *result, gpointer user_data) {
+    // Got more data (or EOF)
+    GError *error = NULL;
+    gssize n = g_buffered_input_stream_fill_finish(G_BUFFERED_INPUT_STREAM(source), result, &error);
+
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        // The client has been closed and freed
+        g_error_free(error);
+        return;
+    }
+
+    SocketClient *c = (SocketClient*)user_data;
+
+    if (n <= 0) {
+        // EOF or error
+        if (error) {
+            LOG_SOCKET("Cannot read from control socket client. %s\n", error->message);
+            g_error_free(error);
+        }
+        socket_client_close(c);
+        return;
+    }
+
+    socket_client_read_next(c);
+}
+
+static void socket_client_read_next(SocketClient *c) {
+    // Handle the complete lines in the buffer, then wait for more data.
+    // We do not use g_data_input_stream_read_line_async() because it grows its buffer until it finds a newline.
+    gboolean garbage = FALSE;
+    gchar *line = NULL;
+
+    while ((line = socket_client_take_line(c, &garbage))) {
+        socket_client_handle_line(c, line);
+        g_free(line);
+    }
+
+    if (garbage || g_buffered_input_stream_get_available(c->input) > SOCKET_MAX_LINE) {
+        // Too long line or not text
+        LOG_SOCKET("Control socket client sent garbage.\n");
+        socket_client_close(c);
+        return;
+    }
+
+    g_buffered_input_stream_fill_async(c->input, -1, G_PRIORITY_DEFAULT, c->cancellable, socket_client_read_cb, c);
+}
+
+static gboolean socket_server_incoming_cb(GSocketService *service, GSocketConnection *connection,
+        GObject *source_object, gpointer user_data) {
+    // New client
+    LOG_SOCKET("Control socket client connected.\n");
+
+    SocketClient *c = g_malloc0(sizeof(SocketClient));
+    c->connection = g_object_ref(connection);
+    c->input = G_BUFFERED_INPUT_STREAM(g_buffered_input_stream_new_sized(g_io_stream_get_input_stream(G_IO_STREAM(connection)),
+                                       SOCKET_INPUT_BUFFER));
+    c->output = G_POLLABLE_OUTPUT_STREAM(g_io_stream_get_output_stream(G_IO_STREAM(connection)));
+    c->cancellable = g_cancellable_new();
+    c->outbuf = g_string_new(NULL);
+
+    gint i = 0;
+    for (i = 0; i < SOCKET_EVENT_N; i++) {
+        c->interval[i] = -1;
+    }
+
+    g_clients = g_list_prepend(g_clients, c);
+
+    socket_client_read_next(c);
+
+    // TRUE: We handled the connection
+    return TRUE;
+}
+
+static gboolean socket_server_start(const gchar *path) {
+    // Listen on Unix domain socket
+    GError *error = NULL;
+
+    if (strchr(path, '/')) {
+        g_socket_path = g_strdup(path);
+    } else {
+        g_socket_path = g_build_filename(g_get_user_runtime_dir(), path, NULL);
+    }
+
+    gchar *dir = g_path_get_dirname(g_socket_path);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+
+    // Remove stale socket file from a previous (crashed) run
+    GStatBuf fstat;
+    if (!g_lstat(g_socket_path, &fstat) && S_ISSOCK(fstat.st_mode)) {
+        g_unlink(g_socket_path);
+    }
+
+    GSocketAddress *address = g_unix_socket_address_new(g_socket_path);
+
+    g_socket_service = g_socket_service_new();
+
+    gboolean ok = g_socket_listener_add_address(G_SOCKET_LISTENER(g_socket_service), address,
+                  G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT,
+                  NULL, NULL, &error);
+    g_object_unref(address);
+
+    if (!ok) {
+        LOG_ERROR("Cannot create control socket %s. %s\n", g_socket_path, error->message);
+        g_error_free(error);
+
+        g_object_unref(g_socket_service);
+        g_socket_service = NULL;
+
+        g_free(g_socket_path);
+        g_socket_path = NULL;
+        return FALSE;
+    }
+
+    // Only this user may control the recorder
+    g_chmod(g_socket_path, 0600);
+
+    g_signal_connect(g_socket_service, "incoming", G_CALLBACK(socket_server_incoming_cb), NULL);
+    g_socket_service_start(g_socket_service);
+
+    LOG_DEBUG("Audio Recorder is listening on control socket %s.\n", g_socket_path);
+
+    return TRUE;
+}
+
+static gboolean socket_server_flush_cb(gpointer user_data) {
+    // Send held back events whose interval has elapsed
+    gint64 now = g_get_monotonic_time();
+    gboolean more = FALSE;
+
+    GList *item = g_list_first(g_clients);
+    while (item) {
+        SocketClient *c = (SocketClient*)item->data;
+
+        gint i = 0;
+        for (i = 0; i < SOCKET_EVENT_N; i++) {
+            if (!c->pending[i]) continue;
+
+            if (now - c->last_sent[i] >= c->interval[i]) {
+                socket_client_write(c, c->pending[i], TRUE);
+                c->last_sent[i] = now;
+
+                g_free(c->pending[i]);
+                c->pending[i] = NULL;
+            } else {
+                more = TRUE;
+            }
+        }
+
+        item = g_list_next(item);
+    }
+
+    if (!more) {
+        g_flush_id = 0;
+    }
+
+    // TRUE: Continue calling this function
+    return more;
+}
+
+static void socket_server_publish(enum SocketEvent event, const gchar *line) {
+    // Send event to its subscribers. Hold it back if the client's interval has not elapsed.
+    gint64 now = g_get_monotonic_time();
+
+    GList *item = g_list_first(g_clients);
+    while (item) {
+        SocketClient *c = (SocketClient*)item->data;
+        item = g_list_next(item);
+
+        if (c->interval[event] < 0) continue;
+
+        if (now - c->last_sent[event] >= c->interval[event]) {
+            socket_client_write(c, line, TRUE);
+            c->last_sent[event] = now;
+
+            g_free(c->pending[event]);
+            c->pending[event] = NULL;
+            continue;
+        }
+
+        // The latest value wins
+        g_free(c->pending[event]);
+        c->pending[event] = g_strdup(line);
+
+        if (!g_flush_id) {
+            g_flush_id = g_timeout_add(SOCKET_FLUSH_MS, socket_server_flush_cb, NULL);
+        }
+    }
+}
+
+void socket_server_publish_state() {
+    if (!g_subscribers[SOCKET_EVENT_STATE]) return;
+
+    gchar *line = g_strdup_printf("EVENT state %s", dbus_service_get_state());
+    socket_server_publish(SOCKET_EVENT_STATE, line);
+    g_free(line);
+}
+
+void socket_server_publish_level(gdouble norm_rms, gdouble norm_peak) {
+    if (!g_subscribers[SOCKET_EVENT_LEVEL]) return;
+
+    gchar rms_str[G_ASCII_DTOSTR_BUF_SIZE];
+    gchar peak_str[G_ASCII_DTOSTR_BUF_SIZE];
+
+    // Locale independent decimal point
+    gchar *line = g_strdup_printf("EVENT level %s %s",
+                                  g_ascii_formatd(rms_str, sizeof(rms_str), "%.3f", norm_rms),
+                                  g_ascii_formatd(peak_str, sizeof(peak_str), "%.3f", norm_peak));
+    socket_server_publish(SOCKET_EVENT_LEVEL, line);
+    g_free(line);
+}
+
+void socket_server_publish_bytes(guint64 bytes) {
+    if (!g_subscribers[SOCKET_EVENT_BYTES]) return;
+
+    gchar *line = g_strdup_printf("EVENT bytes %" G_GUINT64_FORMAT, bytes);
+    socket_server_publish(SOCKET_EVENT_BYTES, line);
+    g_free(line);
+}
@@ -0,0 +1,35 @@
+#ifndef _SOCKET_SERVER_H
+#define _SOCKET_SERVER_H
+
+#include <glib.h>
+
+// Uncomment this to show debug messages from socket-server.c.
+//#define DEBUG_SOCKET
+
+#if defined(DEBUG_SOCKET) || defined(DEBUG_ALL)
+#define LOG_SOCKET LOG_MSG
+#else
+#define LOG_SOCKET(x, ...)
+#endif
+
+// Events that clients can subscribe to
+enum SocketEvent {
+    SOCKET_EVENT_STATE, // "EVENT state on|off|paused"
+    SOCKET_EVENT_LEVEL, // "EVENT level <rms> <peak>"
+    SOCKET_EVENT_BYTES, // "EVENT bytes <file size>"
+    SOCKET_EVENT_N,
+};
+
+// Start the control socket if "control-socket" is set in the settings
+void socket_server_module_init();
+void socket_server_module_exit();
+
+// Are there any subscribers for the event? Use this to skip work that only the socket needs.
+gboolean socket_server_has_subscribers(enum SocketEvent event);
+
+// Send events to the subscribers (rate limited per client)
+void socket_server_publish_state();
+void socket_server_publish_level(gdouble norm_rms, gdouble norm_peak);
+void socket_server_publish_bytes(guint64 bytes);
+
+#endif
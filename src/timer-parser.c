@@ -23,7 +23,7 @@
 
 /* Parsing of timer commands:
  Syntax:
- action := comment | ("start" | "stop" | "pause") command
+ action := comment | ("start" | "stop" | "pause" | "mute" | "unmute") command
 
  comment := '#'...\n
 
@@ -47,7 +47,7 @@
  Comments begin with '#' and ends at newline \n.
 
  In simplified form:
- start | stop | pause (at|after|if|on) ##:##:## (am|pm|) | ### (bytes|kb|mb|gb|tb) | (silence|voice|sound|audio) ## seconds (##dB | ##% | ##)
+ start | stop | pause | mute | unmute (at|after|if|on) ##:##:## (am|pm|) | ### (bytes|kb|mb|gb|tb) | (silence|voice|sound|audio) ## seconds (##dB | ##% | ##)
 
  The words "voice", "sound" and "audio" has exactly same meaning!
 
@@ -886,6 +886,18 @@ static void parser_parse_action() {
 
             // Parse rest of the "pause ..." line
             parse_parse_line();
+        } else if (match_word(g_curtoken.tok, "mute", NULL)) {
+            // "mute ..."
+            parser_add_action('M'); // 'M' = Mute all inputs (recording continues)
+
+            // Parse rest of the "mute ..." line
+            parse_parse_line();
+        } else if (match_word(g_curtoken.tok, "unmute", NULL)) {
+            // "unmute ..."
+            parser_add_action('U'); // 'U' = Unmute all inputs
+
+            // Parse rest of the "unmute ..." line
+            parse_parse_line();
         }
 
         else {
@@ -1000,6 +1012,12 @@ const gchar *parser_get_action_name(gchar action) {
     case 'P':
         return "Pause recording";
 
+    case 'M':
+        return "Mute inputs";
+
+    case 'U':
+        return "Unmute inputs";
+
     default:
         return "Unknown timer command";
     }
@@ -1019,6 +1037,14 @@ void parser_print_rec(TimerRec *tr) {
     case 'P':
         action_str = "Pause";
         break;
+
+    case 'M':
+        action_str = "Mute";
+        break;
+
+    case 'U':
+        action_str = "Unmute";
+        break;
     }
 
     LOG_MSG("action:%c (%s)\n", tr->action, action_str);
@@ -532,6 +532,16 @@ EVAL_0:
         // Check the timer condition
         gchar c = timer_func_eval_command(tr);
 
+        if (c == 'M' || c == 'U') {
+            // Mute/unmute does not change the recording state. Execute it now.
+            G_UNLOCK(g_t_list);
+
+            execute_action(tr, c);
+
+            item = g_list_next(item);
+            continue;
+        }
+
         // Notice: The Timer list may have several commands like:
         //  start at 21:00
         //  stop at 21:30
@@ -563,7 +573,7 @@ LBL_1:
 }
 
 gchar timer_func_eval_command(TimerRec *tr) {
-    // Return action code: 'S'=Start, 'T'=sTop, 'P'=Pause, 'C'=Continue, 0=No action.
+    // Return action code: 'S'=Start, 'T'=sTop, 'P'=Pause, 'C'=Continue, 'M'=Mute, 'U'=Unmute, 0=No action.
     gchar action = 0;
 
     // Test filesize?
@@ -595,6 +605,11 @@ gchar timer_func_eval_command(TimerRec *tr) {
         } else if (tr->action == 'P') { // 'P'ause
 
             action = timer_test_clock_time_P(tr);
+
+        } else if (tr->action == 'M' || tr->action == 'U') { // 'M'ute | 'U'nmute inputs
+
+            // Fires once a day, like pause
+            action = (timer_test_clock_time_P(tr) ? tr->action : 0);
         }
 
         if (action != 0) {
@@ -883,8 +898,22 @@ static gchar timer_test_time_duration(TimerRec *tr) {
     struct tm *tmp;
     tmp = localtime(&t);
 
-    // Action is s'T'op or 'P'ause recording?
-    if (tr->action == 'T'  || tr->action == 'P') {
+    // Action is 'M'ute or 'U'nmute inputs?
+    if (tr->action == 'M' || tr->action == 'U') {
+        // Eg. mute after 10 min
+        // Fire once when the recording time passes the timer value. tr->time_above holds the previous recording time.
+        gint64 recording_time_secs = rec_manager_get_stream_time();
+
+        if (tr->time_above < tr->norm_secs && recording_time_secs >= tr->norm_secs) {
+            action = tr->action;
+        }
+        tr->time_above = recording_time_secs;
+
+        LOG_TIMER("Test time period for '%c' (%s): rec.time:%ld timer value:%ld secs, -->%s.\n", tr->action,
+                  parser_get_action_name(tr->action), (long)recording_time_secs, (long)tr->norm_secs, (action == 0 ? "FALSE" : "TRUE"));
+
+        // Action is s'T'op or 'P'ause recording?
+    } else if (tr->action == 'T'  || tr->action == 'P') {
         // Eg. stop/pause after 8 min 20 sec
 
         // Compare stream time to the given timer value.
@@ -1032,6 +1061,12 @@ static void test_silence(TimerRec *tr, GstClockTimeDiff time_diff, gdouble rms)
             action = 'C';
             goto LBL_1;
         }
+
+        if (tr->action == 'M') { // Mute
+            // Unmute when the sound returns
+            action = 'U';
+            goto LBL_1;
+        }
         return;
     }
 
@@ -1060,6 +1095,10 @@ static void test_silence(TimerRec *tr, GstClockTimeDiff time_diff, gdouble rms)
     } else if (tr->action == 'P') { // Pause
         // pause if silence 3s 0.2
         action = 'P';
+
+    } else if (tr->action == 'M') { // Mute
+        // mute if silence 3s 0.2
+        action = 'M';
     }
 
     LOG_TIMER("Condition %3.2f <= %3.2f (%3.2f%s) is TRUE in %3.1f seconds time. Execute command:%s.\n",
@@ -1209,6 +1248,14 @@ void execute_action(TimerRec *tr, gchar action) {
         rec_manager_continue_recording();
         break;
 
+    case 'M': // Mute all inputs. The recording continues.
+        rec_manager_set_source_mute(NULL, TRUE, NULL);
+        break;
+
+    case 'U': // Unmute all inputs
+        rec_manager_set_source_mute(NULL, FALSE, NULL);
+        break;
+
     case 0: // Do nothing
         break;
 
@@ -31,7 +31,7 @@ void timer_evaluate_triggers(GstClockTimeDiff time_diff, gdouble rms);
 void timer_module_reset(gint for_state);
 
 typedef struct {
-    gchar action;      // recording action:   'S' = start | 'T' = stop | 'P' = pause
+    gchar action;      // recording action:   'S' = start | 'T' = stop | 'P' = pause | 'M' = mute | 'U' = unmute
     gchar action_prep; // action preposition: 'a' = after
     gchar data_type;   // data type:          't' = clock time h:m:s | 'd' = time duration h,m,s | 'f' = file size | 'l' = label
     gdouble val[3];    // data:               hours,minutes,seconds | file size | silence/voice/audio/sound duration
@@ -17,14 +17,19 @@
 */
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <gio/gdesktopappinfo.h>
 #include <time.h>
+#include <signal.h>
 
 #include "support.h" // _(x)
 #include "utility.h"
+#include "proc-info.h"
 #include "log.h"
 #include "dconf.h"
 
@@ -504,44 +509,14 @@ gboolean run_simple_command(gchar *cmd, gchar *args) {
 }
 
 GPid get_PID(gchar *app_name) {
-    // Return process PID for the given app_name
-    gchar *serr = NULL;
-    gchar *sout = NULL;
-
-    gchar *cmd = g_strdup_printf("ps -o %%p --no-heading -C %s", app_name);
-
-    exec_shell_command(cmd, &serr, &sout);
-    g_free(cmd);
-
-    GPid p = -1L;
-
-    if (sout)
-        p = atol(sout);
-
-    g_free(sout);
-    g_free(serr);
-
-    return p;
+    // Return process PID for the given app_name.
+    // Reads /proc directly (see proc-info.c), no "ps" process is started.
+    return proc_get_pid(app_name);
 }
 
 gboolean check_PID(GPid pid) {
     // Check if process id (pid) is alive and running
-    gchar *serr = NULL;
-    gchar *sout = NULL;
-
-    gchar *cmd = g_strdup_printf("ps --pid %d -o pid h", pid);
-    exec_shell_command(cmd, &serr, &sout);
-    g_free(cmd);
-
-    gint64 p = -1L;
-
-    if (sout)
-        p = atol(sout);
-
-    g_free(sout);
-    g_free(serr);
-
-    return p == pid && p > 0;
+    return proc_is_alive(pid);
 }
 
 gchar *get_nth_arg(gchar *str, guint n, gboolean ret_rest) {
@@ -991,38 +966,22 @@ LBL_1:
 void kill_program_by_name(gchar *app_name, GPid preserve_pid) {
     // Kill all app_name processes. But do not kill preserve_pid.
     // Use this to kill programs that do not respond to client requests (dbus request).
-    gchar *serr = NULL;
-    gchar *sout = NULL;
 
     // Get list of PIDs for app_name
-    gchar *cmd = g_strdup_printf("ps -o %%p --no-heading -C %s", app_name);
-
-    exec_shell_command(cmd, &serr, &sout);
-    g_free(cmd);
-
-    if (!sout) {
-        goto LBL_1;
-    }
+    GList *pids = proc_find_by_name(app_name, FALSE);
 
     // For each PID in the list...
-    gchar **args = g_strsplit(sout, "\n", -1);
-    guint i=0;
-    while (args && args[i]) {
-        GPid pid = atol(args[i]);
+    GList *item = g_list_first(pids);
+    while (item) {
+        GPid pid = (GPid)GPOINTER_TO_INT(item->data);
         if (pid != preserve_pid && pid > 1) {
             // $ kill -9 PID
-            kill(pid, SIGKILL);
+            proc_send_signal(pid, SIGKILL);
         }
-        i++;
+        item = g_list_next(item);
     }
 
-    // Free args
-    g_strfreev(args);
-    args=NULL;
-
-LBL_1:
-    g_free(sout);
-    g_free(serr);
+    g_list_free(pids);
 }
 
 void kill_frozen_instances(gchar *program_path, GPid preserve_pid) {
@@ -1081,4 +1040,16 @@ gchar *get_command_and_name(gchar *desktop_file, gchar **command) {
 }
 */
 
+void lower_thread_priority(gint nice) {
+    // Run the calling thread at low CPU and I/O priority. Threads it creates inherit these.
+#ifdef __linux__
+    pid_t tid = syscall(SYS_gettid);
 
+    setpriority(PRIO_PROCESS, tid, nice);
+
+#ifdef SYS_ioprio_set
+    // ioprio_set(IOPRIO_WHO_PROCESS, tid, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0))
+    syscall(SYS_ioprio_set, 1, tid, 3 << 13);
+#endif
+#endif
+}
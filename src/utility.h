@@ -79,6 +79,9 @@ GdkPixbuf *load_icon_pixbuf(gchar *icon_name, guint _size);
 void kill_frozen_instances(gchar *program_path, GPid preserve_pid);
 void kill_program_by_name(gchar *app_name, GPid preserve_pid);
 
+// Background workers: low CPU and I/O priority for the calling thread
+void lower_thread_priority(gint nice);
+
 #ifndef g_strrstr0
 gchar *g_strrstr0(gchar *haystack, gchar *needle);
 #endif